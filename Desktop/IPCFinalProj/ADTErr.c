@@ -90,6 +90,12 @@ ADTErr GetError(char* _msg, ADTErr _error)
 			strcat(_msg, strerror(errno));
 			break;
 		}
+		case ERR_FILE_WRITE:
+		{
+			strcpy(_msg, "Failed to write file: ");
+			strcat(_msg, strerror(errno));
+			break;
+		}
 		/* Parser module errors */
 		case ERR_PARSING_FAILED:
 		{
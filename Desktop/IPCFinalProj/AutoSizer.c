@@ -0,0 +1,250 @@
+/**************************************************************************************************
+	Creation date: 			19.10.26
+	Last modified date: 	19.10.26
+
+	Description: Implementation module for the auto sizer.
+				 Every period it takes the difference of the queue stats and decides from
+				 the share of the period each side spent blocked:
+				 feeder waits, readers don't		- one more reader
+				 readers wait, feeder doesn't		- one reader less (the feeder is the limit)
+				 both wait							- bursty, double the queue
+				 low occupancy for a few periods	- halve the queue
+				 One step per period, so every change is measured before the next one.
+**************************************************************************************************/
+
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h> /*for logger*/
+#include <string.h> /*for memset*/
+#include <errno.h> /*for ETIMEDOUT*/
+#include <time.h>
+
+#include "ADTErr.h"
+#include "logger.h"
+#include "logger_pub.h"
+#include "safeQueue.h"
+#include "cdr.h"
+#include "ShmRing.h"
+#include "FilesReader.h"
+#include "AutoSizer.h"
+
+#define NSEC_IN_MSEC 1000000UL
+#define NSEC_IN_SEC 1000000000UL
+/*share of the period spent blocked*/
+#define BLOCKED_A_LOT 0.5
+#define BLOCKED_RARELY 0.1
+/*occupancy buckets are 10% wide - below 30% for LOW_PERIODS periods in a row*/
+#define LOW_BUCKET 3
+#define LOW_PERIODS 5
+#define MAX_CAPACITY 65536
+
+static SafeQueue* s_queue = NULL;
+static SafeQueueStats s_last;
+static size_t s_minCapacity;
+static size_t s_capacity;
+static size_t s_readers;
+static size_t s_lowPeriods;
+static unsigned long s_changes;
+static unsigned long s_periodNsec;
+static pthread_mutex_t s_periodMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t s_periodCond;
+static pthread_t s_sizerThread;
+static int s_stop = 0;
+
+/*highest occupancy bucket sampled since the last period*/
+static size_t TopBucket (const SafeQueueStats* _now)
+{
+	size_t bucket;
+	for (bucket = SAFE_QUEUE_OCCUPANCY_BUCKETS; bucket > 0; --bucket)
+	{
+		if (_now->m_occupancy[bucket - 1] != s_last.m_occupancy[bucket - 1])
+		{
+			return bucket - 1;
+		}
+	}
+	return 0;
+}
+
+static void SetReaders (size_t _readers, const char* _why)
+{
+	if (ERR_OK == ReadersSetActive (_readers))
+	{
+		LOG_DEBUG_PRINT("auto sizer: %lu readers - %s\n", (unsigned long)_readers, _why);
+		s_readers = _readers;
+		++s_changes;
+	}
+}
+
+static void SetCapacity (size_t _capacity, const char* _why)
+{
+	if (ERR_OK == SafeQueueResize (s_queue, _capacity))
+	{
+		LOG_DEBUG_PRINT("auto sizer: queue of %lu - %s\n", (unsigned long)_capacity, _why);
+		s_capacity = _capacity;
+		++s_changes;
+	}
+}
+
+static void Decide (const SafeQueueStats* _now)
+{
+	/*readers share the push side - their waits are summed*/
+	double fullShare = (double)(_now->m_fullNsec - s_last.m_fullNsec) / s_periodNsec / s_readers;
+	double emptyShare = (double)(_now->m_emptyNsec - s_last.m_emptyNsec) / s_periodNsec;
+
+	if (emptyShare > BLOCKED_A_LOT && fullShare < BLOCKED_RARELY)
+	{
+		if (s_readers < MAX_READER_THREADS)
+		{
+			SetReaders (s_readers + 1, "feeder starved");
+		}
+	}
+	else if (fullShare > BLOCKED_A_LOT && emptyShare < BLOCKED_RARELY)
+	{
+		if (s_readers > 1)
+		{
+			SetReaders (s_readers - 1, "readers blocked on a full queue");
+		}
+	}
+	else if (fullShare > BLOCKED_RARELY && emptyShare > BLOCKED_RARELY)
+	{
+		if (s_capacity < MAX_CAPACITY)
+		{
+			SetCapacity (2 * s_capacity < MAX_CAPACITY ? 2 * s_capacity : MAX_CAPACITY, "bursts");
+		}
+		s_lowPeriods = 0;
+		return;
+	}
+	if (TopBucket (_now) >= LOW_BUCKET)
+	{
+		s_lowPeriods = 0;
+	}
+	else if (++s_lowPeriods >= LOW_PERIODS && s_capacity > s_minCapacity)
+	{
+		SetCapacity (s_capacity / 2 > s_minCapacity ? s_capacity / 2 : s_minCapacity, "low occupancy");
+		s_lowPeriods = 0;
+	}
+}
+
+static void* Sizer (void* _unused)
+{
+	struct timespec wakeUp;
+	SafeQueueStats now;
+	pthread_mutex_lock (&s_periodMutex);
+	clock_gettime (CLOCK_MONOTONIC, &wakeUp);
+	while (!s_stop)
+	{
+		wakeUp.tv_nsec += s_periodNsec % NSEC_IN_SEC;
+		wakeUp.tv_sec += s_periodNsec / NSEC_IN_SEC + wakeUp.tv_nsec / NSEC_IN_SEC;
+		wakeUp.tv_nsec %= NSEC_IN_SEC;
+		while (!s_stop && ETIMEDOUT != pthread_cond_timedwait (&s_periodCond, &s_periodMutex, &wakeUp));
+		/*once the files are all taken the readers end anyway*/
+		if (s_stop || 0 == ReadersGetActive ())
+		{
+			continue;
+		}
+		SafeQueueGetStats (s_queue, &now);
+		if (now.m_pushes != s_last.m_pushes || now.m_pops != s_last.m_pops)
+		{
+			Decide (&now);
+		}
+		s_last = now;
+	}
+	pthread_mutex_unlock (&s_periodMutex);
+	return NULL;
+}
+
+ADTErr AutoSizerInit (SafeQueue* _queue, unsigned int _periodMs)
+{
+	pthread_condattr_t condAttr;
+	sigset_t allSignals;
+	sigset_t oldMask;
+	ADTErr err;
+	if (NULL == _queue || 0 == _periodMs)
+	{
+		return ERR_ILLEGAL_INPUT;
+	}
+	if (NULL != s_queue)
+	{
+		return ERR_ALREADY_EXISTS;
+	}
+	if (ERR_OK != (err = SafeQueueGetStats (_queue, &s_last)))
+	{
+		return err;
+	}
+	s_minCapacity = s_capacity = s_last.m_capacity;
+	s_readers = ReadersGetActive ();
+	if (0 == s_readers)
+	{
+		return ERR_NOT_INITIALIZED;
+	}
+	s_queue = _queue;
+	s_periodNsec = _periodMs * NSEC_IN_MSEC;
+	s_lowPeriods = 0;
+	s_changes = 0;
+	s_stop = 0;
+	pthread_condattr_init (&condAttr);
+	pthread_condattr_setclock (&condAttr, CLOCK_MONOTONIC);
+	pthread_cond_init (&s_periodCond, &condAttr);
+	pthread_condattr_destroy (&condAttr);
+	/*signals go to the threads waiting for them*/
+	sigfillset (&allSignals);
+	pthread_sigmask (SIG_BLOCK, &allSignals, &oldMask);
+	if (0 != pthread_create (&s_sizerThread, NULL, Sizer, NULL))
+	{
+		pthread_sigmask (SIG_SETMASK, &oldMask, NULL);
+		pthread_cond_destroy (&s_periodCond);
+		s_queue = NULL;
+		LOG_ERROR_PRINT("%s\n", "Creating auto sizer thread failed");
+		return ERR_THREAD_CANT_CREATE;
+	}
+	pthread_sigmask (SIG_SETMASK, &oldMask, NULL);
+	LOG_DEBUG_PRINT("Auto sizer every %u ms from %lu readers, queue of %lu\n", _periodMs, (unsigned long)s_readers, (unsigned long)s_capacity);
+	return ERR_OK;
+}
+
+/*the sizes are changed by the sizer thread under s_periodMutex*/
+void AutoSizerPrintStats (FILE* _file, void* _unused)
+{
+	size_t readers;
+	size_t capacity;
+	unsigned long changes;
+	pthread_mutex_lock (&s_periodMutex);
+	readers = s_readers;
+	capacity = s_capacity;
+	changes = s_changes;
+	pthread_mutex_unlock (&s_periodMutex);
+	fprintf (_file, "autosizer_readers %lu\n", (unsigned long)readers);
+	fprintf (_file, "autosizer_queue_capacity %lu\n", (unsigned long)capacity);
+	fprintf (_file, "autosizer_changes %lu\n", changes);
+}
+
+ADTErr AutoSizerGetSizes (size_t* _readers, size_t* _capacity)
+{
+	if (NULL == _readers || NULL == _capacity)
+	{
+		return ERR_ILLEGAL_INPUT;
+	}
+	pthread_mutex_lock (&s_periodMutex);
+	*_readers = s_readers;
+	*_capacity = s_capacity;
+	pthread_mutex_unlock (&s_periodMutex);
+	return ERR_OK;
+}
+
+ADTErr EndAutoSizer (void)
+{
+	if (NULL == s_queue)
+	{
+		return ERR_NOT_INITIALIZED;
+	}
+	pthread_mutex_lock (&s_periodMutex);
+	s_stop = 1;
+	pthread_cond_signal (&s_periodCond);
+	pthread_mutex_unlock (&s_periodMutex);
+	pthread_join (s_sizerThread, NULL);
+	pthread_cond_destroy (&s_periodCond);
+	LOG_DEBUG_PRINT("Auto sizer ended with %lu readers, queue of %lu after %lu changes\n",
+					(unsigned long)s_readers, (unsigned long)s_capacity, s_changes);
+	s_queue = NULL;
+	return ERR_OK;
+}
@@ -0,0 +1,28 @@
+/*************************************************************************
+Creation Date: 19.10.26
+Last edit: 19.10.26
+Description: Header file for the auto sizer - watches the SafeQueue between
+			 the readers and the DB feeder and sizes both sides at runtime:
+			 a starving feeder gets another reader, readers that mostly wait
+			 for room lose one, bursts (both sides waiting) double the queue
+			 and a queue that stays nearly empty is halved back.
+**************************************************************************/
+
+#ifndef __AUTO_SIZER_H__
+#define __AUTO_SIZER_H__
+
+#include <stdio.h> /*for FILE in AutoSizerPrintStats*/
+
+/*Call after InitReaders. The queue capacity never goes below its size now.*/
+ADTErr AutoSizerInit (SafeQueue* _queue, unsigned int _periodMs);
+
+/*Writes the current sizes as "autosizer_..." lines - fits MetricsAddSource*/
+void AutoSizerPrintStats (FILE* _file, void* _unused);
+
+/*The sizes it set last*/
+ADTErr AutoSizerGetSizes (size_t* _readers, size_t* _capacity);
+
+/*Stops the sizer thread, before SafeQueueDestroy*/
+ADTErr EndAutoSizer (void);
+
+#endif /*__AUTO_SIZER_H__*/
@@ -6,6 +6,11 @@
 	Description: Implementation module for Billing functions.
 					SIGUSR1 - print subscriber bills.
 					SIGUSR2 - print operator bills
+					SIGRTMIN+1 - heavy users report
+					SIGRTMIN+2 - metrics file
+				 Signals are read synchronously by a control thread (signalfd),
+				 together with requests from other threads (eventfd) and the
+				 periodic export timer (timerfd).
 **************************************************************************************************/
 
 #include <pthread.h>
@@ -13,6 +18,13 @@
 #include <string.h> /*for logger*/
 #include <errno.h> /*for logger*/
 #include <stdio.h> /*for logger*/
+#include <stdint.h> /*for uint64_t*/
+#include <stdlib.h> /*for malloc, qsort*/
+#include <unistd.h> /*for sysconf, read, close*/
+#include <poll.h>
+#include <sys/signalfd.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
 
 #include "ADTErr.h"
 #include "GData.h"
@@ -25,34 +37,106 @@
 #include "OperatorDB.h"
 #include "SubscriberDB.h"
 #include "DataManager.h"
+#include "Metrics.h"
 #include "Billing.h"
 
-#define SUB_DB_FILE "SubscribersInfos.txt"
+#define SUB_DB_FILE_PREFIX "SubscribersInfos"
+#define SUB_DELTA_FILE_PREFIX "SubscribersDelta"
 #define OPR_DB_FILE "OperatorsInfos.txt"
+#define OPR_DELTA_FILE "OperatorsDelta.txt"
+#define TOP_N_FILE "TopSubscribers.txt"
+/*real time signal for delta (changed records only) export*/
+#define SIG_DELTA_EXPORT SIGRTMIN
+#define SIG_TOP_N_EXPORT (SIGRTMIN + 1)
+#define SIG_METRICS (SIGRTMIN + 2)
+/*length of every heavy users list*/
+#define TOP_N_SIZE 1000
+#define NUM_OF_FDS 3
+#define SIGNAL_FD 0
+#define EVENT_FD 1
+#define TIMER_FD 2
 #define ERR_STR_LENGTH 100
+#define FILE_NAME_LENGTH 64
+/*writer threads for subscriber bills - one output file each*/
+#define MAX_WRITERS 16
+/*set to 0 to skip writing the manifest*/
+#define EXPORT_MANIFEST 1
 
 typedef struct
 {
-	pthread_mutex_t m_DBMutex;
+	pthread_rwlock_t* m_DBLock;
 	SubscriberDB* 	m_subDB;
 	OperatorDB*		m_oprDB;
 }Billing;
 
+typedef struct
+{
+	SubscriberDB* 	m_subDB;
+	size_t			m_shard;
+	size_t			m_nShards;
+	size_t			m_nPrinted;
+	unsigned long	m_sinceGeneration;
+	ADTErr			m_error;
+	char			m_fileName[FILE_NAME_LENGTH];
+}ExportShard;
+
+typedef struct
+{
+	SubscriberDB* 	m_subDB;
+	size_t			m_shard;
+	size_t			m_nShards;
+	size_t			m_nRanked;
+	ADTErr			m_error;
+	SubscriberRank*	m_tops[NUM_OF_TOP_KINDS];
+}RankShard;
+
 static pthread_t s_billThread;
-static pthread_cond_t s_waitForSig = PTHREAD_COND_INITIALIZER;
-static int s_flag = 0;
+static int s_signalFd = -1;
+static int s_eventFd = -1;
+static int s_timerFd = -1;
+/*requests posted by BillingRequest, collected by the control thread*/
+static volatile unsigned int s_posted = 0;
+/*what the periodic timer asks for*/
+static volatile unsigned int s_timerRequests = 0;
+/*last generation already written by any export - base for the next delta*/
+static unsigned long s_subExportedGen = 0;
+static unsigned long s_oprExportedGen = 0;
+
+static void BillingSignalSet (sigset_t* _set)
+{
+	sigemptyset (_set);
+	sigaddset (_set, SIGUSR1);
+	sigaddset (_set, SIGUSR2);
+	sigaddset (_set, SIG_DELTA_EXPORT);
+	sigaddset (_set, SIG_TOP_N_EXPORT);
+	sigaddset (_set, SIG_METRICS);
+	sigaddset (_set, SIGINT);
+	sigaddset (_set, SIGTERM);
+}
 
-static void handler (int sig)
+static unsigned int Signal2Request (unsigned int _sig)
 {
-	if (SIGUSR1 == sig)
+	if (SIGUSR1 == _sig)
 	{
-		s_flag = 1;
+		return BILL_SUBSCRIBERS;
 	}	
-	if (SIGUSR2 == sig)
+	if (SIGUSR2 == _sig)
+	{
+		return BILL_OPERATORS;
+	}
+	if (SIG_DELTA_EXPORT == _sig)
+	{
+		return BILL_DELTA;
+	}
+	if (SIG_TOP_N_EXPORT == _sig)
 	{
-		s_flag = 2;
+		return BILL_TOP_N;
 	}
-	pthread_cond_signal(&s_waitForSig);
+	if (SIG_METRICS == _sig)
+	{
+		return BILL_METRICS;
+	}
+	return BILL_STOP;
 }
 
 static ADTErr PrepParams (DBManagerParams* _mngParams, Billing* _billing)
@@ -60,8 +144,8 @@ static ADTErr PrepParams (DBManagerParams* _mngParams, Billing* _billing)
 	ADTErr errorCheck;
 	char errorStr[ERR_STR_LENGTH];
 	LOG_DEBUG_PRINT("%s\n", "Starting to prep params");
-	LOG_DEBUG_PRINT("%s\n", "Getting mutex");
-	errorCheck = GetDBMutex (_mngParams, &_billing->m_DBMutex);
+	LOG_DEBUG_PRINT("%s\n", "Getting DB lock");
+	errorCheck = GetDBLock (_mngParams, &_billing->m_DBLock);
 	if (ERR_OK != errorCheck)
 	{
 		GetError (errorStr, errorCheck);
@@ -88,9 +172,362 @@ static ADTErr PrepParams (DBManagerParams* _mngParams, Billing* _billing)
 	return ERR_OK;
 }
 
+/*one writer per online core, bounded by MAX_WRITERS*/
+static size_t NumOfWriters (void)
+{
+	long nCores = sysconf(_SC_NPROCESSORS_ONLN);
+	if (nCores < 1)
+	{
+		return 1;
+	}
+	return (nCores > MAX_WRITERS) ? MAX_WRITERS : (size_t)nCores;
+}
+
+static void* ExportShardThread (void* _shard)
+{
+	ExportShard* shard = _shard;
+	shard->m_error = SubscriberDBPrintShardToFile (shard->m_subDB, shard->m_fileName, shard->m_shard, shard->m_nShards, shard->m_sinceGeneration, &shard->m_nPrinted);
+	return NULL;
+}
+
+static ADTErr WriteManifest (const char* _prefix, const ExportShard* _shards, size_t _nShards, unsigned long _toGeneration)
+{
+	FILE* manifest;
+	size_t i;
+	size_t total = 0;
+	char fileName[FILE_NAME_LENGTH];
+	char tmpName[FILE_NAME_LENGTH];
+	LOG_DEBUG_PRINT("Writing %s manifest\n", _prefix);
+	snprintf (fileName, FILE_NAME_LENGTH, "%s.manifest", _prefix);
+	snprintf (tmpName, FILE_NAME_LENGTH, "%s.manifest.tmp", _prefix);
+	manifest = fopen (tmpName, "w");
+	if (!manifest)
+	{
+		LOG_ERROR_PRINT("manifest: %s\n", strerror(errno));
+		return ERR_FILE_OPEN;
+	}
+	for (i = 0; i < _nShards; ++i)
+	{
+		total += _shards[i].m_nPrinted;
+	}
+	fprintf (manifest, "shards %lu\nsubscribers %lu\ngenerations %lu-%lu\n", (unsigned long)_nShards, (unsigned long)total, _shards[0].m_sinceGeneration + 1, _toGeneration);
+	for (i = 0; i < _nShards; ++i)
+	{
+		fprintf (manifest, "%s %lu\n", _shards[i].m_fileName, (unsigned long)_shards[i].m_nPrinted);
+	}
+	if (0 != fclose (manifest))
+	{
+		LOG_ERROR_PRINT("manifest: %s\n", strerror(errno));
+		return ERR_FILE_CLOSE;
+	}
+	/*readers never see a half written manifest*/
+	if (0 != rename (tmpName, fileName))
+	{
+		LOG_ERROR_PRINT("manifest: %s\n", strerror(errno));
+		return ERR_FILE_WRITE;
+	}
+	return ERR_OK;
+}
+
+/*shards of an export with more writers (another machine, or more cores then) - numbered _nShards to MAX_WRITERS*/
+static void RemoveStaleShards (const char* _prefix, size_t _nShards)
+{
+	char fileName[FILE_NAME_LENGTH];
+	for (; _nShards < MAX_WRITERS; ++_nShards)
+	{
+		snprintf (fileName, FILE_NAME_LENGTH, "%s.%lu.txt", _prefix, (unsigned long)_nShards);
+		if (0 == unlink (fileName))
+		{
+			LOG_DEBUG_PRINT("Removed stale %s\n", fileName);
+		}
+		else if (ENOENT != errno)
+		{
+			LOG_WARN_PRINT("Removing stale %s: %s\n", fileName, strerror(errno));
+		}
+	}
+}
+
+/*splits the subscriber DB bucket range between writer threads, each writes <_prefix>.<n>.txt
+  with the subscribers changed after _sinceGeneration (0 - all of them)*/
+static ADTErr ExportSubscribers (SubscriberDB* _subDB, const char* _prefix, unsigned long _sinceGeneration)
+{
+	unsigned long toGeneration;
+	ExportShard shards[MAX_WRITERS];
+	pthread_t writers[MAX_WRITERS];
+	int isThread[MAX_WRITERS];
+	size_t nShards = NumOfWriters();
+	size_t i;
+	ADTErr result = ERR_OK;
+	LOG_DEBUG_PRINT("Exporting subscribers with %lu writers\n", (unsigned long)nShards);
+	/*changes from now on belong to the next export*/
+	toGeneration = SubscriberDBCloseGeneration (_subDB);
+	for (i = 0; i < nShards; ++i)
+	{
+		shards[i].m_subDB = _subDB;
+		shards[i].m_shard = i;
+		shards[i].m_nShards = nShards;
+		shards[i].m_nPrinted = 0;
+		shards[i].m_sinceGeneration = _sinceGeneration;
+		shards[i].m_error = ERR_OK;
+		snprintf (shards[i].m_fileName, FILE_NAME_LENGTH, "%s.%lu.txt", _prefix, (unsigned long)i);
+		isThread[i] = (0 == pthread_create(&writers[i], NULL, ExportShardThread, &shards[i]));
+		if (!isThread[i])
+		{
+			/*still export this shard, just not in parallel*/
+			LOG_WARN_PRINT("Creating writer %lu failed, writing inline\n", (unsigned long)i);
+			ExportShardThread (&shards[i]);
+		}
+	}
+	for (i = 0; i < nShards; ++i)
+	{
+		if (isThread[i] && 0 != pthread_join(writers[i], NULL))
+		{
+			LOG_ERROR_PRINT("Joining writer %lu failed\n", (unsigned long)i);
+			result = ERR_THREAD_CANT_JOIN;
+		}
+		if (ERR_OK != shards[i].m_error)
+		{
+			LOG_ERROR_PRINT("Writing %s failed\n", shards[i].m_fileName);
+			result = shards[i].m_error;
+		}
+	}
+	if (EXPORT_MANIFEST && ERR_OK == result)
+	{
+		result = WriteManifest (_prefix, shards, nShards, toGeneration);
+	}
+	if (ERR_OK == result)
+	{
+		/*the manifest already lists only the new shards*/
+		RemoveStaleShards (_prefix, nShards);
+		s_subExportedGen = toGeneration;
+	}
+	return result;
+}
+
+static ADTErr ExportOperators (OperatorDB* _oprDB, int _isDelta)
+{
+	unsigned long toGeneration;
+	ADTErr result;
+	toGeneration = OperatorDBCloseGeneration (_oprDB);
+	if (_isDelta)
+	{
+		result = OperatorDBPrintDeltaToFile (_oprDB, OPR_DELTA_FILE, s_oprExportedGen, NULL);
+	}
+	else
+	{
+		result = OperatorDBPrintToFile (_oprDB, OPR_DB_FILE);
+	}
+	if (ERR_OK == result)
+	{
+		s_oprExportedGen = toGeneration;
+	}
+	return result;
+}
+
+static void* RankShardThread (void* _shard)
+{
+	RankShard* shard = _shard;
+	shard->m_error = SubscriberDBTopN (shard->m_subDB, shard->m_shard, shard->m_nShards, TOP_N_SIZE, shard->m_tops, &shard->m_nRanked);
+	return NULL;
+}
+
+static const char* TopKindName (int _kind)
+{
+	if (TOP_OUTGOING_DURATION == _kind)
+	{
+		return "outgoing seconds";
+	}
+	return (TOP_DATA_VOLUME == _kind) ? "data MB" : "sent SMS";
+}
+
+/*every shard's top-N list sorted together - the global top-N is the head*/
+static ADTErr WriteTopN (const RankShard* _shards, size_t _nShards, SubscriberRank* _merged)
+{
+	FILE* file;
+	size_t nMerged;
+	size_t i;
+	int kind;
+	LOG_DEBUG_PRINT("%s\n", "Merging top-N lists");
+	file = fopen (TOP_N_FILE ".tmp", "w");
+	if (!file)
+	{
+		LOG_ERROR_PRINT("top-N: %s\n", strerror(errno));
+		return ERR_FILE_OPEN;
+	}
+	for (kind = 0; kind < NUM_OF_TOP_KINDS; ++kind)
+	{
+		nMerged = 0;
+		for (i = 0; i < _nShards; ++i)
+		{
+			memcpy (_merged + nMerged, _shards[i].m_tops[kind], _shards[i].m_nRanked * sizeof(SubscriberRank));
+			nMerged += _shards[i].m_nRanked;
+		}
+		qsort (_merged, nMerged, sizeof(SubscriberRank), SubscriberRankCompare);
+		fprintf (file, "Top %d by %s\n", TOP_N_SIZE, TopKindName (kind));
+		for (i = 0; i < nMerged && i < TOP_N_SIZE; ++i)
+		{
+			fprintf (file, "%lu %s %g\n", (unsigned long)i + 1, _merged[i].m_imsi, _merged[i].m_value);
+		}
+	}
+	if (0 != fclose (file))
+	{
+		LOG_ERROR_PRINT("top-N: %s\n", strerror(errno));
+		return ERR_FILE_CLOSE;
+	}
+	if (0 != rename (TOP_N_FILE ".tmp", TOP_N_FILE))
+	{
+		LOG_ERROR_PRINT("top-N: %s\n", strerror(errno));
+		return ERR_FILE_WRITE;
+	}
+	return ERR_OK;
+}
+
+/*one bounded heap per shard and kind, in parallel like the bill writers, then merged*/
+static ADTErr ExportTopN (SubscriberDB* _subDB)
+{
+	RankShard shards[MAX_WRITERS];
+	pthread_t rankers[MAX_WRITERS];
+	int isThread[MAX_WRITERS];
+	SubscriberRank* ranks;
+	size_t nShards = NumOfWriters();
+	size_t i;
+	int kind;
+	ADTErr result = ERR_OK;
+	LOG_DEBUG_PRINT("Ranking subscribers with %lu threads\n", (unsigned long)nShards);
+	/*per shard lists, and room to merge the lists of one kind*/
+	ranks = malloc ((nShards * NUM_OF_TOP_KINDS + nShards) * TOP_N_SIZE * sizeof(SubscriberRank));
+	if (!ranks)
+	{
+		LOG_ERROR_PRINT("%s\n", "Allocating top-N lists failed");
+		return ERR_ALLOCATION_FAILED;
+	}
+	for (i = 0; i < nShards; ++i)
+	{
+		shards[i].m_subDB = _subDB;
+		shards[i].m_shard = i;
+		shards[i].m_nShards = nShards;
+		shards[i].m_nRanked = 0;
+		shards[i].m_error = ERR_OK;
+		for (kind = 0; kind < NUM_OF_TOP_KINDS; ++kind)
+		{
+			shards[i].m_tops[kind] = ranks + (i * NUM_OF_TOP_KINDS + kind) * TOP_N_SIZE;
+		}
+		isThread[i] = (0 == pthread_create(&rankers[i], NULL, RankShardThread, &shards[i]));
+		if (!isThread[i])
+		{
+			LOG_WARN_PRINT("Creating ranker %lu failed, ranking inline\n", (unsigned long)i);
+			RankShardThread (&shards[i]);
+		}
+	}
+	for (i = 0; i < nShards; ++i)
+	{
+		if (isThread[i] && 0 != pthread_join(rankers[i], NULL))
+		{
+			LOG_ERROR_PRINT("Joining ranker %lu failed\n", (unsigned long)i);
+			result = ERR_THREAD_CANT_JOIN;
+		}
+		if (ERR_OK != shards[i].m_error)
+		{
+			result = shards[i].m_error;
+		}
+	}
+	if (ERR_OK == result)
+	{
+		result = WriteTopN (shards, nShards, ranks + nShards * NUM_OF_TOP_KINDS * TOP_N_SIZE);
+	}
+	free (ranks);
+	return result;
+}
+
+/*drains every ready descriptor - nothing is lost, the same request pending twice is done once*/
+static unsigned int CollectRequests (struct pollfd* _fds)
+{
+	struct signalfd_siginfo sigInfo;
+	uint64_t counter;
+	unsigned int requests = 0;
+	if (_fds[SIGNAL_FD].revents & POLLIN)
+	{
+		while (sizeof(sigInfo) == read (s_signalFd, &sigInfo, sizeof(sigInfo)))
+		{
+			LOG_DEBUG_PRINT("Signal %u recieved\n", sigInfo.ssi_signo);
+			requests |= Signal2Request (sigInfo.ssi_signo);
+		}
+	}
+	if (_fds[EVENT_FD].revents & POLLIN)
+	{
+		if (sizeof(counter) == read (s_eventFd, &counter, sizeof(counter)))
+		{
+			requests |= __sync_fetch_and_and (&s_posted, 0);
+		}
+	}
+	if (_fds[TIMER_FD].revents & POLLIN)
+	{
+		/*several expirations during a long export count as one*/
+		if (sizeof(counter) == read (s_timerFd, &counter, sizeof(counter)))
+		{
+			LOG_DEBUG_PRINT("Export timer expired %lu times\n", (unsigned long)counter);
+			requests |= s_timerRequests;
+		}
+	}
+	return requests;
+}
+
+/*always in the same order, whatever order the requests came in*/
+static void HandleRequests (Billing* _billing, unsigned int _requests)
+{
+	unsigned long start = MetricsStart ();
+	/*needs no DB lock - and shouldn't wait behind an export*/
+	if (_requests & BILL_METRICS)
+	{
+		MetricsWrite ();
+		_requests &= ~BILL_METRICS;
+		if (!_requests)
+		{
+			return;
+		}
+		start = MetricsStart ();
+	}
+	/*a read lock - lookups are answered during the export. closing a generation is a write,
+	  but only this thread closes them and the feeder that reads them is kept out*/
+	LOG_DEBUG_PRINT("%s\n", "Read lock DBLock");
+	if (0 != pthread_rwlock_rdlock(_billing->m_DBLock))
+	{
+		LOG_ERROR_PRINT("%s\n", "Locking DBLock failed");		
+		return;
+	}	
+	LOG_DEBUG_PRINT("Trying to write bills to file - requests 0x%x\n", _requests);
+	if (_requests & BILL_SUBSCRIBERS)
+	{
+		ExportSubscribers (_billing->m_subDB, SUB_DB_FILE_PREFIX, 0);
+	}
+	if (_requests & BILL_OPERATORS)
+	{
+		ExportOperators (_billing->m_oprDB, 0);
+	}
+	if (_requests & BILL_DELTA)
+	{
+		ExportSubscribers (_billing->m_subDB, SUB_DELTA_FILE_PREFIX, s_subExportedGen);
+		ExportOperators (_billing->m_oprDB, 1);
+	}
+	if (_requests & BILL_TOP_N)
+	{
+		ExportTopN (_billing->m_subDB);
+	}
+	LOG_DEBUG_PRINT("%s\n", "Unlocking DBLock");
+	if (0 != pthread_rwlock_unlock (_billing->m_DBLock))
+	{
+		LOG_ERROR_PRINT("%s\n", "Unlocking DBLock failed");		
+	}
+	MetricsRecord (METRIC_EXPORT, start);
+	MetricsAdd (METRIC_EXPORTS, 1);
+	LOG_DEBUG_PRINT("%s\n", "All current Bills written");
+}
+
 static void* ExportBills (void* _params)
 {
 	Billing billing;
+	struct pollfd fds[NUM_OF_FDS];
+	unsigned int requests;
 	LOG_DEBUG_PRINT("%s\n", "ExportBills Thread started");
 	LOG_DEBUG_PRINT("%s\n", "Trying to prep parameters");
 	if (ERR_OK != PrepParams ((DBManagerParams*)_params, &billing))
@@ -98,80 +535,102 @@ static void* ExportBills (void* _params)
 		LOG_ERROR_PRINT("%s\n", "PrepParams failed");
 		return NULL;
 	}
-	LOG_DEBUG_PRINT("%s\n", "All parameters are ready");			
+	LOG_DEBUG_PRINT("%s\n", "All parameters are ready");
+	fds[SIGNAL_FD].fd = s_signalFd;
+	fds[EVENT_FD].fd = s_eventFd;
+	fds[TIMER_FD].fd = s_timerFd;
 	while (1)
 	{
-		LOG_DEBUG_PRINT("%s\n", "Lock DBMutex");
-		if (0 != pthread_mutex_lock(&billing.m_DBMutex))
-		{
-			LOG_ERROR_PRINT("%s\n", "Locking DBMutex failed");		
-			pthread_exit (NULL);
-		}	
-		/*wait for signal*/
-		LOG_DEBUG_PRINT("%s\n", "Waiting for signal");		
-		if (0 != pthread_cond_wait(&s_waitForSig, &billing.m_DBMutex))
+		fds[SIGNAL_FD].events = fds[EVENT_FD].events = fds[TIMER_FD].events = POLLIN;
+		LOG_DEBUG_PRINT("%s\n", "Waiting for requests");		
+		if (poll (fds, NUM_OF_FDS, -1) < 0)
 		{
-			LOG_ERROR_PRINT("%s\n", "Signal wait failed");					
-			LOG_DEBUG_PRINT("%s\n", "Unlocking DBMutex");
-			if (0 != pthread_mutex_unlock (&billing.m_DBMutex))
+			if (EINTR == errno)
 			{
-				LOG_ERROR_PRINT("%s\n", "Unlocking DBMutex failed");		
-				pthread_exit (NULL);
+				continue;
 			}
-			pthread_exit (NULL);
-		}
-		LOG_DEBUG_PRINT("%s\n", "Signal recieved");
-		LOG_DEBUG_PRINT("Trying to write bills to file - flag is %d\n",s_flag);		
-		/*start exporting bills*/
-		if (1 == s_flag)
-		{
-			SubscriberDBPrintToFile (billing.m_subDB, SUB_DB_FILE);
+			LOG_ERROR_PRINT("poll: %s\n", strerror(errno));
+			break;
 		}
-		else if (2 == s_flag)
+		requests = CollectRequests (fds);
+		if (requests & ~BILL_STOP)
 		{
-			OperatorDBPrintToFile (billing.m_oprDB, OPR_DB_FILE);
+			HandleRequests (&billing, requests);
 		}
-		LOG_DEBUG_PRINT("%s\n", "Unlocking DBMutex");
-		if (0 != pthread_mutex_unlock (&billing.m_DBMutex))
+		if (requests & BILL_STOP)
 		{
-			LOG_ERROR_PRINT("%s\n", "Unlocking DBMutex failed");		
-			pthread_exit (NULL);
+			LOG_DEBUG_PRINT("%s\n", "Stop request recieved");
+			break;
 		}
-		LOG_DEBUG_PRINT("%s\n", "All current Bills written");
 	}
 	LOG_DEBUG_PRINT("%s\n", "ExportBills finished succesfully");
 	pthread_exit (NULL);
 }
 
+static void CloseFds (void)
+{
+	if (s_signalFd >= 0)
+	{
+		close (s_signalFd);
+		s_signalFd = -1;
+	}
+	if (s_eventFd >= 0)
+	{
+		close (s_eventFd);
+		s_eventFd = -1;
+	}
+	if (s_timerFd >= 0)
+	{
+		close (s_timerFd);
+		s_timerFd = -1;
+	}
+}
+
+ADTErr BillingPrepSignals (void)
+{
+	sigset_t set;
+	LOG_DEBUG_PRINT("%s\n", "Blocking billing signals");
+	BillingSignalSet (&set);
+	if (0 != pthread_sigmask (SIG_BLOCK, &set, NULL))
+	{
+		LOG_ERROR_PRINT("%s\n", "pthread_sigmask failed");
+		return ERR_SIGACTION;
+	}
+	return ERR_OK;
+}
+
 ADTErr BillingInit (DBManagerParams* _mngParams)
 {
-	struct sigaction sig;
+	sigset_t set;
+	ADTErr errorCheck;
 	LOG_DEBUG_PRINT("%s\n", "BillingInit function started");
 	if (!_mngParams)
 	{
 		LOG_ERROR_PRINT("%s\n", "mngParams not initialized");
 		return ERR_NOT_INITIALIZED;
 	}
-	LOG_DEBUG_PRINT("%s\n", "Trying to initialize default for SIGUSR1");	
-	/*set default for signal SIGUSR1 and SIGUSR2*/
-	sig.sa_handler = &handler;
-	if (-1 == sigaction(SIGUSR1, &sig, NULL))
+	/*in case main didn't - still only covers threads created from now on*/
+	if (ERR_OK != (errorCheck = BillingPrepSignals ()))
 	{
-		LOG_ERROR_PRINT("sigaction: %s\n", strerror(errno));
-		return ERR_SIGACTION;
+		return errorCheck;
 	}
-	LOG_DEBUG_PRINT("%s\n", "Defaults for SIGUSR1 initialized");	
-	LOG_DEBUG_PRINT("%s\n", "Trying to initialize default for SIGUSR2");
-	if (-1 == sigaction(SIGUSR2, &sig, NULL))
+	LOG_DEBUG_PRINT("%s\n", "Trying to create signalfd, eventfd and timerfd");
+	BillingSignalSet (&set);
+	s_signalFd = signalfd (-1, &set, SFD_NONBLOCK | SFD_CLOEXEC);
+	s_eventFd = eventfd (0, EFD_NONBLOCK | EFD_CLOEXEC);
+	s_timerFd = timerfd_create (CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+	if (s_signalFd < 0 || s_eventFd < 0 || s_timerFd < 0)
 	{
-		LOG_ERROR_PRINT("sigaction: %s\n", strerror(errno));
+		LOG_ERROR_PRINT("control fds: %s\n", strerror(errno));
+		CloseFds ();
 		return ERR_SIGACTION;
 	}
-	LOG_DEBUG_PRINT("%s\n", "Defaults for SIGUSR2 initialized");
+	LOG_DEBUG_PRINT("%s\n", "Control fds created");
 	/*start billing thread*/
 	LOG_DEBUG_PRINT("%s\n", "Stating billing thread");
 	if (0 != pthread_create(&s_billThread, NULL, ExportBills, _mngParams))
 	{
+		CloseFds ();
 		LOG_ERROR_PRINT("%s\n", "Creating billThread failed");	
 		return ERR_THREAD_CANT_CREATE;
 	}
@@ -179,6 +638,45 @@ ADTErr BillingInit (DBManagerParams* _mngParams)
 	return ERR_OK;
 }
 
+ADTErr BillingRequest (unsigned int _requests)
+{
+	uint64_t one = 1;
+	if (s_eventFd < 0)
+	{
+		LOG_ERROR_PRINT("%s\n", "Billing not initialized");
+		return ERR_NOT_INITIALIZED;
+	}
+	__sync_fetch_and_or (&s_posted, _requests);
+	if (sizeof(one) != write (s_eventFd, &one, sizeof(one)))
+	{
+		/*only fails when the counter is saturated - the control thread is awake anyway*/
+		LOG_WARN_PRINT("eventfd write: %s\n", strerror(errno));
+	}
+	return ERR_OK;
+}
+
+ADTErr BillingSetPeriodicExport (unsigned int _seconds, unsigned int _requests)
+{
+	struct itimerspec period;
+	if (s_timerFd < 0)
+	{
+		LOG_ERROR_PRINT("%s\n", "Billing not initialized");
+		return ERR_NOT_INITIALIZED;
+	}
+	s_timerRequests = _requests & ~BILL_STOP;
+	memset (&period, 0, sizeof(period));
+	period.it_value.tv_sec = _seconds;
+	period.it_interval.tv_sec = _seconds;
+	/*interval timer keeps its own schedule - a slow export doesn't shift the next one*/
+	if (-1 == timerfd_settime (s_timerFd, 0, &period, NULL))
+	{
+		LOG_ERROR_PRINT("timerfd_settime: %s\n", strerror(errno));
+		return ERR_GENERAL;
+	}
+	LOG_DEBUG_PRINT("Periodic export every %u seconds, requests 0x%x\n", _seconds, s_timerRequests);
+	return ERR_OK;
+}
+
 ADTErr EndBilling (void)		
 {
 	LOG_DEBUG_PRINT("%s\n", "Trying to join billThread");
@@ -187,7 +685,7 @@ ADTErr EndBilling (void)
 		LOG_ERROR_PRINT("%s\n", "Joining thread failed");
 		return ERR_THREAD_CANT_JOIN;
 	}
+	CloseFds ();
 	LOG_DEBUG_PRINT("%s\n", "BillThread is done");	
 	return ERR_OK;
 }	
-
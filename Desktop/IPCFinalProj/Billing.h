@@ -4,13 +4,44 @@ Creation Date: 9.11.15
 Last edit: 12.11.15
 Description: Header file for Billing functions declarations
 					SIGUSR1 - print subscriber bills.
+							  Written in parallel to SubscribersInfos.<n>.txt,
+							  one file per writer thread, listed in SubscribersInfos.manifest.
 					SIGUSR2 - print operator bills
+					SIGRTMIN - print only subscribers and operators changed since the
+							  previous export to SubscribersDelta.<n>.txt and OperatorsDelta.txt
+					SIGRTMIN+1 - write the top TOP_N_SIZE subscribers by outgoing minutes,
+							  data volume and sent SMS to TopSubscribers.txt
+					SIGRTMIN+2 - rewrite the metrics file now (see Metrics.h)
+					SIGINT/SIGTERM - finish pending exports and stop the billing thread.
 **************************************************************************/
 
 #ifndef __BILLING_H__
 #define __BILLING_H__
 
+typedef enum
+{
+	BILL_SUBSCRIBERS	= 0x01,	/*SIGUSR1*/
+	BILL_OPERATORS		= 0x02,	/*SIGUSR2*/
+	BILL_DELTA			= 0x04,	/*SIGRTMIN*/
+	BILL_STOP			= 0x08,	/*SIGINT, SIGTERM*/
+	BILL_TOP_N			= 0x10,	/*SIGRTMIN+1*/
+	BILL_METRICS		= 0x20	/*SIGRTMIN+2*/
+} e_billRequest;
+
+/*Blocks the billing signals in the calling thread and every thread it creates later.
+  Call from main before any other thread is started, so only the billing thread gets them.*/
+ADTErr BillingPrepSignals (void);
+
 ADTErr BillingInit (DBManagerParams* _mngParams);
+
+/*Queue e_billRequest flags (or-ed) from any thread.
+  Requests are never lost - the same request pending twice is done once.*/
+ADTErr BillingRequest (unsigned int _requests);
+
+/*Every _seconds do _requests, 0 seconds stops the timer. Call after BillingInit.*/
+ADTErr BillingSetPeriodicExport (unsigned int _seconds, unsigned int _requests);
+
+/*Waits for the billing thread - returns after a BILL_STOP request*/
 ADTErr EndBilling (void);
 
 #endif /*__BILLING_H__*/
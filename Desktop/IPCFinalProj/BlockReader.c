@@ -0,0 +1,572 @@
+/**************************************************************************************************************************************
+Creation Date : 19.10.2026
+Last modified date 19.10.2026
+Description : BlockReader - READS_IN_FLIGHT blocks are read one after the other in the file, and used in that order.
+			  A used block is asked again for the next place in the file, so the kernel always has reads to do.
+			  A short read that is not the end of the file (the file grew, or was written while read) starts the
+			  blocks again from where it stopped.
+**************************************************************************************************************************************/
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <errno.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/uio.h>
+#ifdef __linux__
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#endif
+
+#include "ADTErr.h"
+#include "logger.h"
+#include "logger_pub.h"
+#include "BlockReader.h"
+
+#if defined(__NR_io_uring_setup) && defined(__NR_io_uring_enter)
+#define HAVE_URING
+#endif
+
+#define READ_BLOCK_SIZE (256 * 1024)
+#define READS_IN_FLIGHT 4
+#define SIZE_STR_ERR 100
+
+typedef enum
+{
+	BLOCK_FREE,
+	BLOCK_PENDING,		/* asked for - queued in the ring, or to pread when it is needed */
+	BLOCK_DONE
+} BlockState;
+
+typedef struct
+{
+	char*			m_data;
+	struct iovec	m_iov;
+	unsigned long	m_offset;
+	long			m_len;		/* < 0 - the read failed */
+	BlockState		m_state;
+} Block;
+
+#ifdef HAVE_URING
+typedef struct
+{
+	int						m_fd;
+	unsigned*				m_sqTail;
+	unsigned*				m_sqMask;
+	unsigned*				m_sqArray;
+	unsigned*				m_cqHead;
+	unsigned*				m_cqTail;
+	unsigned*				m_cqMask;
+	struct io_uring_sqe*	m_sqes;
+	struct io_uring_cqe*	m_cqes;
+	void*					m_sqRing;
+	size_t					m_sqRingSize;
+	void*					m_cqRing;
+	size_t					m_cqRingSize;
+	size_t					m_sqesSize;
+	unsigned				m_toSubmit;
+} Uring;
+#endif
+
+struct BlockReader
+{
+	int				m_fd;
+	unsigned long	m_nextOffset;	/* where the next block is asked from */
+	size_t			m_current;		/* the block being used */
+	size_t			m_pos;			/* next byte of the current block */
+	int				m_isEnd;
+	int				m_isFailed;
+#ifdef HAVE_URING
+	Uring*			m_uring;		/* NULL - pread */
+#endif
+	Block			m_blocks[READS_IN_FLIGHT];
+};
+
+static pthread_once_t s_selectOnce = PTHREAD_ONCE_INIT;
+static ReadBackend s_backend = READ_BACKEND_AUTO;
+
+/******************************************** io_uring ********************************************/
+
+#ifdef HAVE_URING
+static void UringDestroy(Uring* _uring)
+{
+	if(NULL == _uring)
+	{
+		return;
+	}
+	if(NULL != _uring->m_sqes)
+	{
+		munmap(_uring->m_sqes,_uring->m_sqesSize);
+	}
+	if(NULL != _uring->m_cqRing && _uring->m_cqRing != _uring->m_sqRing)
+	{
+		munmap(_uring->m_cqRing,_uring->m_cqRingSize);
+	}
+	if(NULL != _uring->m_sqRing)
+	{
+		munmap(_uring->m_sqRing,_uring->m_sqRingSize);
+	}
+	close(_uring->m_fd);
+	free(_uring);
+}
+
+/* NULL - no ring, errno tells why */
+static Uring* UringCreate(unsigned _entries)
+{
+	struct io_uring_params params;
+	Uring* uring;
+	char* sq;
+	char* cq;
+
+	if(NULL == (uring = calloc(1,sizeof(Uring))))
+	{
+		return NULL;
+	}
+	memset(&params,0,sizeof(params));
+	if((uring->m_fd = (int)syscall(__NR_io_uring_setup,_entries,&params)) < 0)
+	{
+		free(uring);
+		return NULL;
+	}
+	uring->m_sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+	uring->m_cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+	if(params.features & IORING_FEAT_SINGLE_MMAP)
+	{
+		if(uring->m_cqRingSize > uring->m_sqRingSize)
+		{
+			uring->m_sqRingSize = uring->m_cqRingSize;
+		}
+		uring->m_cqRingSize = uring->m_sqRingSize;
+	}
+	uring->m_sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+	sq = mmap(NULL,uring->m_sqRingSize,PROT_READ | PROT_WRITE,MAP_SHARED | MAP_POPULATE,uring->m_fd,IORING_OFF_SQ_RING);
+	if(MAP_FAILED == sq)
+	{
+		close(uring->m_fd);
+		free(uring);
+		return NULL;
+	}
+	uring->m_sqRing = sq;
+	cq = (params.features & IORING_FEAT_SINGLE_MMAP) ? sq
+		: mmap(NULL,uring->m_cqRingSize,PROT_READ | PROT_WRITE,MAP_SHARED | MAP_POPULATE,uring->m_fd,IORING_OFF_CQ_RING);
+	uring->m_cqRing = (MAP_FAILED == cq) ? NULL : cq;
+	uring->m_sqes = mmap(NULL,uring->m_sqesSize,PROT_READ | PROT_WRITE,MAP_SHARED | MAP_POPULATE,uring->m_fd,IORING_OFF_SQES);
+	if(MAP_FAILED == uring->m_sqes)
+	{
+		uring->m_sqes = NULL;
+	}
+	if(NULL == uring->m_cqRing || NULL == uring->m_sqes)
+	{
+		UringDestroy(uring);
+		return NULL;
+	}
+	uring->m_sqTail = (unsigned*)(sq + params.sq_off.tail);
+	uring->m_sqMask = (unsigned*)(sq + params.sq_off.ring_mask);
+	uring->m_sqArray = (unsigned*)(sq + params.sq_off.array);
+	uring->m_cqHead = (unsigned*)(cq + params.cq_off.head);
+	uring->m_cqTail = (unsigned*)(cq + params.cq_off.tail);
+	uring->m_cqMask = (unsigned*)(cq + params.cq_off.ring_mask);
+	uring->m_cqes = (struct io_uring_cqe*)(cq + params.cq_off.cqes);
+	return uring;
+}
+
+/* queued, the kernel sees it at UringEnter. READV - the read every io_uring kernel has */
+static void UringQueueRead(Uring* _uring,int _fd,Block* _block,unsigned long _userData)
+{
+	unsigned tail = *_uring->m_sqTail;
+	unsigned index = tail & *_uring->m_sqMask;
+	struct io_uring_sqe* sqe = &_uring->m_sqes[index];
+
+	memset(sqe,0,sizeof(struct io_uring_sqe));
+	sqe->opcode = IORING_OP_READV;
+	sqe->fd = _fd;
+	sqe->addr = (unsigned long)&_block->m_iov;
+	sqe->len = 1;
+	sqe->off = _block->m_offset;
+	sqe->user_data = _userData;
+	_uring->m_sqArray[index] = index;
+	__atomic_store_n(_uring->m_sqTail,tail + 1,__ATOMIC_RELEASE);
+	++_uring->m_toSubmit;
+}
+
+/* submits what is queued, and with _isWait waits for a completion. -1 - the ring can not be used */
+static int UringEnter(Uring* _uring,int _isWait)
+{
+	long nDone;
+
+	while(0 != _uring->m_toSubmit || _isWait)
+	{
+		nDone = syscall(__NR_io_uring_enter,_uring->m_fd,_uring->m_toSubmit,_isWait ? 1 : 0,_isWait ? IORING_ENTER_GETEVENTS : 0,NULL,0);
+		if(nDone < 0)
+		{
+			if(EINTR == errno || EAGAIN == errno || EBUSY == errno)
+			{
+				continue;
+			}
+			return -1;
+		}
+		_uring->m_toSubmit -= (unsigned)nDone;
+		_isWait = 0;
+	}
+	return 0;
+}
+
+static void UringReap(Uring* _uring,Block* _blocks)
+{
+	unsigned head = *_uring->m_cqHead;
+	unsigned tail = __atomic_load_n(_uring->m_cqTail,__ATOMIC_ACQUIRE);
+	struct io_uring_cqe* cqe;
+
+	for(; head != tail; ++head)
+	{
+		cqe = &_uring->m_cqes[head & *_uring->m_cqMask];
+		_blocks[cqe->user_data].m_len = cqe->res;
+		_blocks[cqe->user_data].m_state = BLOCK_DONE;
+	}
+	__atomic_store_n(_uring->m_cqHead,head,__ATOMIC_RELEASE);
+}
+#endif
+
+/********************************************* backend *********************************************/
+
+static void SelectAuto(void)
+{
+#ifdef HAVE_URING
+	Uring* uring;
+
+	if(READ_BACKEND_AUTO == s_backend)
+	{
+		uring = UringCreate(READS_IN_FLIGHT);
+		s_backend = (NULL != uring) ? READ_BACKEND_URING : READ_BACKEND_PREAD;
+		UringDestroy(uring);
+	}
+#else
+	s_backend = READ_BACKEND_PREAD;
+#endif
+}
+
+ReadBackend BlockReaderSelect(ReadBackend _wanted)
+{
+#ifndef HAVE_URING
+	if(READ_BACKEND_URING == _wanted)
+	{
+		LOG_WARN_PRINT("%s","io_uring is not built in, reading with pread");
+	}
+	_wanted = READ_BACKEND_PREAD;
+#endif
+	if(READ_BACKEND_AUTO != _wanted)
+	{
+		s_backend = _wanted;
+	}
+	pthread_once(&s_selectOnce,SelectAuto);
+	return s_backend;
+}
+
+const char* BlockReaderBackendName(ReadBackend _backend)
+{
+	return (READ_BACKEND_URING == _backend) ? "io_uring" : (READ_BACKEND_PREAD == _backend) ? "pread" : "auto";
+}
+
+BlockReader* BlockReaderCreate(ADTErr* _err)
+{
+	BlockReader* reader;
+	char strErr[SIZE_STR_ERR];
+	size_t i;
+
+	pthread_once(&s_selectOnce,SelectAuto);
+	if(NULL == (reader = calloc(1,sizeof(BlockReader))))
+	{
+		GetError(strErr,ERR_ALLOCATION_FAILED);
+		LOG_ERROR_PRINT("%s",strErr);
+		*_err = ERR_ALLOCATION_FAILED;
+		return NULL;
+	}
+	for(i = 0; i < READS_IN_FLIGHT; ++i)
+	{
+		if(NULL == (reader->m_blocks[i].m_data = malloc(READ_BLOCK_SIZE)))
+		{
+			BlockReaderDestroy(reader);
+			GetError(strErr,ERR_ALLOCATION_FAILED);
+			LOG_ERROR_PRINT("%s",strErr);
+			*_err = ERR_ALLOCATION_FAILED;
+			return NULL;
+		}
+		reader->m_blocks[i].m_iov.iov_base = reader->m_blocks[i].m_data;
+		reader->m_blocks[i].m_iov.iov_len = READ_BLOCK_SIZE;
+	}
+	reader->m_fd = -1;
+#ifdef HAVE_URING
+	/* a ring per thread - nothing shared between the readers */
+	if(READ_BACKEND_URING == s_backend && NULL == (reader->m_uring = UringCreate(READS_IN_FLIGHT)))
+	{
+		LOG_WARN_PRINT("io_uring ring failed (%s), this reader uses pread",strerror(errno));
+	}
+#endif
+	*_err = ERR_OK;
+	return reader;
+}
+
+/* every read asked of the kernel has ended - the blocks may be used again */
+static void Drain(BlockReader* _reader)
+{
+	size_t i;
+
+	for(i = 0; i < READS_IN_FLIGHT; ++i)
+	{
+#ifdef HAVE_URING
+		while(NULL != _reader->m_uring && BLOCK_PENDING == _reader->m_blocks[i].m_state)
+		{
+			UringReap(_reader->m_uring,_reader->m_blocks);
+			if(BLOCK_PENDING == _reader->m_blocks[i].m_state && 0 != UringEnter(_reader->m_uring,1))
+			{
+				break;
+			}
+		}
+#endif
+		_reader->m_blocks[i].m_state = BLOCK_FREE;
+	}
+}
+
+void BlockReaderDestroy(BlockReader* _reader)
+{
+	size_t i;
+
+	if(NULL == _reader)
+	{
+		return;
+	}
+#ifdef HAVE_URING
+	if(NULL != _reader->m_uring)
+	{
+		Drain(_reader);
+		UringDestroy(_reader->m_uring);
+	}
+#endif
+	for(i = 0; i < READS_IN_FLIGHT; ++i)
+	{
+		free(_reader->m_blocks[i].m_data);
+	}
+	free(_reader);
+}
+
+static void Ask(BlockReader* _reader,size_t _index)
+{
+	Block* block = &_reader->m_blocks[_index];
+
+	block->m_offset = _reader->m_nextOffset;
+	block->m_len = 0;
+	block->m_state = BLOCK_PENDING;
+	_reader->m_nextOffset += READ_BLOCK_SIZE;
+#ifdef HAVE_URING
+	if(NULL != _reader->m_uring)
+	{
+		UringQueueRead(_reader->m_uring,_reader->m_fd,block,_index);
+	}
+#endif
+}
+
+#ifdef HAVE_URING
+static void Restart(BlockReader* _reader,unsigned long _offset);
+
+/* the ring failed under us - what the kernel still has may yet be written to the blocks, so they
+   are left to it (a leak, once per reader) and this reader goes on with new blocks and pread,
+   from the current block and place in it */
+static void LeaveRing(BlockReader* _reader)
+{
+	unsigned long offset = _reader->m_blocks[_reader->m_current].m_offset + _reader->m_pos;
+	size_t i;
+
+	LOG_ERROR_PRINT("io_uring_enter failed (%s), this reader uses pread",strerror(errno));
+	_reader->m_uring = NULL;
+	for(i = 0; i < READS_IN_FLIGHT; ++i)
+	{
+		if(NULL == (_reader->m_blocks[i].m_data = malloc(READ_BLOCK_SIZE)))
+		{
+			_reader->m_isFailed = 1;
+			_reader->m_isEnd = 1;
+			return;
+		}
+		_reader->m_blocks[i].m_iov.iov_base = _reader->m_blocks[i].m_data;
+		_reader->m_blocks[i].m_state = BLOCK_FREE;
+	}
+	Restart(_reader,offset);
+}
+#endif
+
+static void Restart(BlockReader* _reader,unsigned long _offset)
+{
+	size_t i;
+
+	Drain(_reader);
+	_reader->m_nextOffset = _offset;
+	_reader->m_current = 0;
+	_reader->m_pos = 0;
+	for(i = 0; i < READS_IN_FLIGHT; ++i)
+	{
+		Ask(_reader,i);
+	}
+#ifdef HAVE_URING
+	if(NULL != _reader->m_uring && 0 != UringEnter(_reader->m_uring,0))
+	{
+		LeaveRing(_reader);
+	}
+#endif
+}
+
+static void Wait(BlockReader* _reader,Block* _block)
+{
+	ssize_t nRead;
+
+#ifdef HAVE_URING
+	while(NULL != _reader->m_uring && BLOCK_PENDING == _block->m_state)
+	{
+		UringReap(_reader->m_uring,_reader->m_blocks);
+		if(BLOCK_PENDING == _block->m_state && 0 != UringEnter(_reader->m_uring,1))
+		{
+			LeaveRing(_reader);
+			return;
+		}
+	}
+#endif
+	while(BLOCK_PENDING == _block->m_state)
+	{
+		nRead = pread(_reader->m_fd,_block->m_data,READ_BLOCK_SIZE,(off_t)_block->m_offset);
+		if(nRead < 0 && EINTR == errno)
+		{
+			continue;
+		}
+		_block->m_len = (nRead < 0) ? -errno : nRead;
+		_block->m_state = BLOCK_DONE;
+	}
+}
+
+ADTErr BlockReaderStart(BlockReader* _reader,int _fd,unsigned long _offset)
+{
+	if(NULL == _reader || _fd < 0)
+	{
+		return ERR_NOT_INITIALIZED;
+	}
+	Drain(_reader);
+	_reader->m_fd = _fd;
+	_reader->m_isEnd = 0;
+	_reader->m_isFailed = 0;
+	Restart(_reader,_offset);
+	return ERR_OK;
+}
+
+/* 1 - the current block has bytes to give */
+static int Ready(BlockReader* _reader)
+{
+	Block* block;
+
+	while(!_reader->m_isEnd)
+	{
+		block = &_reader->m_blocks[_reader->m_current];
+		if(BLOCK_DONE != block->m_state)
+		{
+			Wait(_reader,block);
+			continue;
+		}
+		if(block->m_len < 0)
+		{
+			LOG_ERROR_PRINT("read at %lu failed: %s",block->m_offset,strerror((int)-block->m_len));
+			_reader->m_isFailed = 1;
+			break;
+		}
+		if(_reader->m_pos < (size_t)block->m_len)
+		{
+			return 1;
+		}
+		if(0 == block->m_len)
+		{
+			break;
+		}
+		if(block->m_len < READ_BLOCK_SIZE)
+		{
+			/* the blocks after it were asked from the wrong place - or past the end of the file */
+			Restart(_reader,block->m_offset + block->m_len);
+			continue;
+		}
+		Ask(_reader,_reader->m_current);
+		_reader->m_current = (_reader->m_current + 1) % READS_IN_FLIGHT;
+		_reader->m_pos = 0;
+#ifdef HAVE_URING
+		/* after the move - the block just asked is past the one LeaveRing goes on from */
+		if(NULL != _reader->m_uring && 0 != UringEnter(_reader->m_uring,0))
+		{
+			LeaveRing(_reader);
+		}
+#endif
+	}
+	_reader->m_isEnd = 1;
+	Drain(_reader);
+	return 0;
+}
+
+char* BlockReaderGets(BlockReader* _reader,char* _line,int _size)
+{
+	size_t nCopied = 0;
+	size_t take;
+	Block* block;
+	char* from;
+	char* newLine = NULL;
+
+	if(NULL == _reader || NULL == _line || _size < 2)
+	{
+		return NULL;
+	}
+	while(NULL == newLine && nCopied < (size_t)_size - 1 && Ready(_reader))
+	{
+		block = &_reader->m_blocks[_reader->m_current];
+		from = block->m_data + _reader->m_pos;
+		take = (size_t)block->m_len - _reader->m_pos;
+		if(take > (size_t)_size - 1 - nCopied)
+		{
+			take = (size_t)_size - 1 - nCopied;
+		}
+		if(NULL != (newLine = memchr(from,'\n',take)))
+		{
+			take = newLine - from + 1;
+		}
+		memcpy(_line + nCopied,from,take);
+		nCopied += take;
+		_reader->m_pos += take;
+	}
+	if(0 == nCopied)
+	{
+		return NULL;
+	}
+	_line[nCopied] = '\0';
+	return _line;
+}
+
+int BlockReaderRead(BlockReader* _reader,void* _buffer,size_t _size)
+{
+	size_t nCopied = 0;
+	size_t take;
+	Block* block;
+
+	if(NULL == _reader || NULL == _buffer)
+	{
+		return 0;
+	}
+	while(nCopied < _size && Ready(_reader))
+	{
+		block = &_reader->m_blocks[_reader->m_current];
+		take = (size_t)block->m_len - _reader->m_pos;
+		if(take > _size - nCopied)
+		{
+			take = _size - nCopied;
+		}
+		memcpy((char*)_buffer + nCopied,block->m_data + _reader->m_pos,take);
+		nCopied += take;
+		_reader->m_pos += take;
+	}
+	return nCopied == _size;
+}
+
+int BlockReaderIsFailed(const BlockReader* _reader)
+{
+	return NULL != _reader && _reader->m_isFailed;
+}
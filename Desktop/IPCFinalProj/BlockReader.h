@@ -0,0 +1,42 @@
+/**************************************************************************************************************************************
+Creation Date : 19.10.2026
+Last modified date 19.10.2026
+Description : BlockReader - reads a file in large blocks with several reads in flight, and gives it as lines (as fgets) or
+			  as fixed records. A reader thread keeps one BlockReader for all the files it takes.
+			  Backends: io_uring (Linux, raw syscalls - no liburing) keeps READS_IN_FLIGHT reads queued in the kernel;
+			  pread reads a block when the previous one is used up, and works anywhere
+								-- header file --
+**************************************************************************************************************************************/
+#ifndef __BLOCKREADER_H__
+#define __BLOCKREADER_H__
+
+typedef struct BlockReader BlockReader;
+
+typedef enum
+{
+	READ_BACKEND_AUTO,		/* io_uring if this kernel lets us set up a ring, else pread */
+	READ_BACKEND_PREAD,
+	READ_BACKEND_URING
+} ReadBackend;
+
+/* at startup, before the readers - the backend taken. without a call AUTO is taken by the first BlockReaderCreate */
+ReadBackend BlockReaderSelect(ReadBackend _wanted);
+
+/* "io_uring" / "pread" */
+const char* BlockReaderBackendName(ReadBackend _backend);
+
+BlockReader* BlockReaderCreate(ADTErr* _err);
+void BlockReaderDestroy(BlockReader* _reader);
+
+/* starts reading _fd from _offset - the caller keeps _fd open until the next start or the destroy */
+ADTErr BlockReaderStart(BlockReader* _reader,int _fd,unsigned long _offset);
+
+/* as fgets. NULL - end of file or a failed read, BlockReaderIsFailed tells which */
+char* BlockReaderGets(BlockReader* _reader,char* _line,int _size);
+
+/* 1 - _size bytes were read to _buffer, 0 - the file ended (a part of a record is dropped) or a read failed */
+int BlockReaderRead(BlockReader* _reader,void* _buffer,size_t _size);
+
+int BlockReaderIsFailed(const BlockReader* _reader);
+
+#endif /* __BLOCKREADER_H__ */
@@ -0,0 +1,662 @@
+/**************************************************************************************************
+	Creation date: 			19.10.26
+	Last modified date: 	19.10.26
+
+	Description: Implementation module for checkpoints.
+				 The file: the header, then a {path, offset} entry per input file, the
+				 subscribers and the operators as their raw bytes, and the magic again
+				 (a short file is detected). Native byte order - the checkpoint is read
+				 back by the same build.
+				 The feeder stores the offset of every CDR it applied under the DB write
+				 lock, and a checkpoint is written under its read lock, so the offsets
+				 always match the totals - lookups and exports go on meanwhile.
+				 One reader reads a file and the queue keeps its order, so an offset
+				 covers all the lines of its file before it. Lines that never
+				 reached the feeder after the last applied one (bad lines, other partitions)
+				 are read again after a restart and skipped again.
+				 The DB lock is released before the fsync - the data is already in the
+				 tmp file by then.
+				 Between checkpoints the delta log keeps what was added; a checkpoint holds
+				 it, cuts its pending batch under the DB lock (that batch is in the
+				 checkpoint) and empties it once the rename is done.
+**************************************************************************************************/
+
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h> /*for malloc*/
+#include <string.h>
+#include <errno.h> /*for ETIMEDOUT, ENOENT*/
+#include <fcntl.h> /*for open*/
+#include <unistd.h> /*for fsync*/
+#include <sys/stat.h> /*for fstat*/
+#include <time.h>
+
+#include "ADTErr.h"
+#include "logger.h"
+#include "logger_pub.h"
+#include "GData.h"
+#include "safeQueue.h"
+#include "cdr.h"
+#include "Subscriber.h"
+#include "Operator.h"
+#include "SubscriberDB.h"
+#include "OperatorDB.h"
+#include "DataManager.h"
+#include "ShmRing.h"
+#include "FilesReader.h"
+#include "DeltaLog.h"
+#include "Checkpoint.h"
+
+#define CHECKPOINT_MAGIC 0x434b5054U
+#define CHECKPOINT_VERSION 2
+#define FILE_NAME_SIZE 256
+/*any path a reader opens fits*/
+#define PATH_SIZE READER_PATH_SIZE
+#define KEY_SIZE 64
+#define FILES_PER_BLOCK 1024
+#define MAX_FILE_BLOCKS 1024
+#define WRITE_BUFFER_SIZE (1024 * 1024)
+#define NSEC_IN_SEC 1000000000UL
+
+typedef struct
+{
+	unsigned int	m_magic;
+	unsigned int	m_version;
+	unsigned int	m_subscriberSize;
+	unsigned int	m_operatorSize;
+	unsigned long	m_nFiles;
+	unsigned long	m_nSubscribers;
+	unsigned long	m_nOperators;
+	unsigned long	m_sequence;		/*checkpoints taken, over all runs*/
+} CheckpointHeader;
+
+typedef struct
+{
+	char			m_path[PATH_SIZE];
+	unsigned long	m_offset;		/*applied up to here*/
+} FileProgress;
+
+typedef struct
+{
+	FILE*			m_file;
+	unsigned long	m_nRecords;
+	size_t			m_recordSize;
+	int				m_failed;
+} RecordWriter;
+
+static char s_fileName[FILE_NAME_SIZE];
+static char s_tmpName[FILE_NAME_SIZE + 8];
+static char s_logName[FILE_NAME_SIZE + 8];
+/*file ids are 1 + the index, entries never move once added*/
+static FileProgress* s_blocks[MAX_FILE_BLOCKS];
+static unsigned int s_nFiles = 0;
+static pthread_mutex_t s_filesMutex = PTHREAD_MUTEX_INITIALIZER;
+/*what the last checkpoint holds - added to the databases by CheckpointStart*/
+static unsigned long s_nSubscribersToLoad = 0;
+static unsigned long s_nOperatorsToLoad = 0;
+static long s_recordsOffset = 0;
+static unsigned long s_sequence = 0;
+
+static SubscriberDB* s_subDB = NULL;
+static OperatorDB* s_oprDB = NULL;
+static pthread_rwlock_t* s_DBLock = NULL;
+static pthread_mutex_t s_takeMutex = PTHREAD_MUTEX_INITIALIZER;
+
+static pthread_mutex_t s_periodMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t s_periodCond;
+static pthread_t s_checkpointThread;
+static unsigned long s_periodNsec = 0;
+static int s_stop = 0;
+
+static unsigned long s_taken = 0;
+static unsigned long s_failed = 0;
+static unsigned long s_lastNsec = 0;
+static unsigned long s_lastBytes = 0;
+
+static unsigned long NowNsec (void)
+{
+	struct timespec now;
+	clock_gettime (CLOCK_MONOTONIC, &now);
+	return (unsigned long)now.tv_sec * NSEC_IN_SEC + now.tv_nsec;
+}
+
+static FileProgress* FileEntry (unsigned int _fileId)
+{
+	return &s_blocks[(_fileId - 1) / FILES_PER_BLOCK][(_fileId - 1) % FILES_PER_BLOCK];
+}
+
+/*under s_filesMutex, 0 when there is no room*/
+static unsigned int AddFile (const char* _path, unsigned long _offset)
+{
+	FileProgress* entry;
+	size_t block = s_nFiles / FILES_PER_BLOCK;
+	if (block >= MAX_FILE_BLOCKS)
+	{
+		return 0;
+	}
+	if (!s_blocks[block] && !(s_blocks[block] = calloc (FILES_PER_BLOCK, sizeof(FileProgress))))
+	{
+		return 0;
+	}
+	entry = &s_blocks[block][s_nFiles % FILES_PER_BLOCK];
+	strcpy (entry->m_path, _path);
+	entry->m_offset = _offset;
+	return ++s_nFiles;
+}
+
+static ADTErr ReadCheckpoint (const char* _fileName)
+{
+	CheckpointHeader header;
+	FileProgress entry;
+	struct stat fileStat;
+	unsigned int trailer;
+	unsigned long i;
+	FILE* file;
+	/*nothing of an earlier checkpoint is loaded*/
+	s_nSubscribersToLoad = s_nOperatorsToLoad = s_sequence = 0;
+	if (!(file = fopen (_fileName, "r")))
+	{
+		if (ENOENT == errno)
+		{
+			LOG_DEBUG_PRINT("No checkpoint in %s, starting from scratch\n", _fileName);
+			return ERR_OK;
+		}
+		LOG_ERROR_PRINT("Opening checkpoint %s failed\n", _fileName);
+		return ERR_FILE_OPEN;
+	}
+	if (1 != fread (&header, sizeof(header), 1, file) || CHECKPOINT_MAGIC != header.m_magic
+		|| CHECKPOINT_VERSION != header.m_version || SubscriberSize () != header.m_subscriberSize
+		|| OperatorSize () != header.m_operatorSize || 0 != fstat (fileno (file), &fileStat)
+		|| (unsigned long)fileStat.st_size != sizeof(header) + header.m_nFiles * sizeof(FileProgress)
+			+ header.m_nSubscribers * header.m_subscriberSize + header.m_nOperators * header.m_operatorSize + sizeof(trailer)
+		|| 0 != fseek (file, -(long)sizeof(trailer), SEEK_END) || 1 != fread (&trailer, sizeof(trailer), 1, file)
+		|| CHECKPOINT_MAGIC != trailer || 0 != fseek (file, sizeof(header), SEEK_SET))
+	{
+		fclose (file);
+		/*not counting again what it holds is the point - better not to start*/
+		LOG_ERROR_PRINT("Checkpoint %s is damaged or of another build\n", _fileName);
+		return ERR_ILLEGAL_INPUT;
+	}
+	pthread_mutex_lock (&s_filesMutex);
+	for (i = 0; i < header.m_nFiles; ++i)
+	{
+		if (1 != fread (&entry, sizeof(entry), 1, file) || 0 == AddFile (entry.m_path, entry.m_offset))
+		{
+			pthread_mutex_unlock (&s_filesMutex);
+			fclose (file);
+			LOG_ERROR_PRINT("Reading checkpoint %s failed\n", _fileName);
+			return ERR_FILE_OPEN;
+		}
+	}
+	pthread_mutex_unlock (&s_filesMutex);
+	s_recordsOffset = ftell (file);
+	s_nSubscribersToLoad = header.m_nSubscribers;
+	s_nOperatorsToLoad = header.m_nOperators;
+	s_sequence = header.m_sequence;
+	fclose (file);
+	LOG_DEBUG_PRINT("Checkpoint %lu in %s: %lu files, %lu subscribers, %lu operators\n", s_sequence, _fileName,
+					header.m_nFiles, s_nSubscribersToLoad, s_nOperatorsToLoad);
+	return ERR_OK;
+}
+
+/*a file of the delta log, later than the checkpoint*/
+static void RestoreFile (const char* _path, unsigned long _offset, void* _unused)
+{
+	unsigned int i;
+	if (strlen (_path) >= PATH_SIZE)
+	{
+		return;
+	}
+	pthread_mutex_lock (&s_filesMutex);
+	for (i = 1; i <= s_nFiles && 0 != strcmp (FileEntry (i)->m_path, _path); ++i);
+	if (i <= s_nFiles || 0 != (i = AddFile (_path, 0)))
+	{
+		FileEntry (i)->m_offset = _offset;
+	}
+	pthread_mutex_unlock (&s_filesMutex);
+}
+
+ADTErr CheckpointInit (const char* _fileName, unsigned int _logPeriodMs)
+{
+	ADTErr err;
+	if (!_fileName || strlen (_fileName) >= FILE_NAME_SIZE)
+	{
+		return ERR_ILLEGAL_INPUT;
+	}
+	strcpy (s_fileName, _fileName);
+	sprintf (s_tmpName, "%s.tmp", _fileName);
+	sprintf (s_logName, "%s.wal", _fileName);
+	if (ERR_OK != (err = ReadCheckpoint (_fileName)))
+	{
+		return err;
+	}
+	return DeltaLogInit (s_logName, s_sequence, _logPeriodMs, RestoreFile, NULL);
+}
+
+unsigned long CheckpointFileStart (const char* _filePath, unsigned int* _fileId, void* _unused)
+{
+	unsigned long offset = 0;
+	unsigned int i;
+	*_fileId = 0;
+	if (strlen (_filePath) >= PATH_SIZE)
+	{
+		LOG_WARN_PRINT("%s: path too long to checkpoint, it is read again after a restart\n", _filePath);
+		return 0;
+	}
+	pthread_mutex_lock (&s_filesMutex);
+	for (i = 1; i <= s_nFiles; ++i)
+	{
+		if (0 == strcmp (FileEntry (i)->m_path, _filePath))
+		{
+			*_fileId = i;
+			offset = FileEntry (i)->m_offset;
+			break;
+		}
+	}
+	if (0 == *_fileId && 0 == (*_fileId = AddFile (_filePath, 0)))
+	{
+		LOG_WARN_PRINT("%s: too many files to checkpoint, it is read again after a restart\n", _filePath);
+	}
+	pthread_mutex_unlock (&s_filesMutex);
+	return offset;
+}
+
+void CheckpointApplied (const DBApplied* _applied, void* _unused)
+{
+	FileProgress* entry = NULL;
+	if (0 != _applied->m_fileId)
+	{
+		entry = FileEntry (_applied->m_fileId);
+		entry->m_offset = _applied->m_offset;
+	}
+	DeltaLogAdd (_applied, entry ? entry->m_path : NULL);
+}
+
+/*takes _sub*/
+static ADTErr MergeSubscriber (Subscriber* _sub)
+{
+	Subscriber* exist;
+	char imsi[KEY_SIZE];
+	ADTErr err;
+	SubscriberGetIMSI (_sub, imsi);
+	/*the feeder may have added some already*/
+	if (ERR_OK == SubscriberDBGet (s_subDB, imsi, &exist))
+	{
+		err = SubscriberUpdate (exist, _sub);
+		SubscriberDBMarkDirty (s_subDB, exist);
+		SubscriberDestroy (_sub);
+		return err;
+	}
+	if (ERR_OK != (err = SubscriberDBInsert (s_subDB, _sub)))
+	{
+		SubscriberDestroy (_sub);
+	}
+	return err;
+}
+
+/*takes _opr*/
+static ADTErr MergeOperator (Operator* _opr)
+{
+	Operator* exist;
+	char name[KEY_SIZE];
+	ADTErr err;
+	OperatorGetName (_opr, name);
+	if (ERR_OK == OperatorDBGet (s_oprDB, name, &exist))
+	{
+		err = OperatorUpdate (exist, _opr);
+		OperatorDBMarkDirty (s_oprDB, exist);
+		OperatorDestroy (_opr);
+		return err;
+	}
+	if (ERR_OK != (err = OperatorDBInsert (s_oprDB, _opr)))
+	{
+		OperatorDestroy (_opr);
+	}
+	return err;
+}
+
+static ADTErr LoadSubscriber (FILE* _file)
+{
+	Subscriber* sub;
+	if (!(sub = malloc (SubscriberSize ())))
+	{
+		return ERR_ALLOCATION_FAILED;
+	}
+	if (1 != fread (sub, SubscriberSize (), 1, _file))
+	{
+		free (sub);
+		return ERR_FILE_OPEN;
+	}
+	return MergeSubscriber (sub);
+}
+
+static ADTErr LoadOperator (FILE* _file)
+{
+	Operator* opr;
+	if (!(opr = malloc (OperatorSize ())))
+	{
+		return ERR_ALLOCATION_FAILED;
+	}
+	if (1 != fread (opr, OperatorSize (), 1, _file))
+	{
+		free (opr);
+		return ERR_FILE_OPEN;
+	}
+	return MergeOperator (opr);
+}
+
+static ADTErr ReplaySubscriber (const char* _imsi, const SubscriberUsage* _usage, void* _unused)
+{
+	ADTErr err;
+	Subscriber* sub = SubscriberCreateFromUsage (_imsi, _usage, &err);
+	return sub ? MergeSubscriber (sub) : err;
+}
+
+static ADTErr ReplayOperator (const char* _name, const OperatorUsage* _usage, void* _unused)
+{
+	ADTErr err;
+	Operator* opr = OperatorCreateFromUsage (_name, _usage, &err);
+	return opr ? MergeOperator (opr) : err;
+}
+
+/*under the DB write lock*/
+static ADTErr LoadRecords (void)
+{
+	unsigned long i;
+	ADTErr err = ERR_OK;
+	FILE* file;
+	if (0 == s_nSubscribersToLoad && 0 == s_nOperatorsToLoad)
+	{
+		return ERR_OK;
+	}
+	if (!(file = fopen (s_fileName, "r")) || 0 != fseek (file, s_recordsOffset, SEEK_SET))
+	{
+		if (file)
+		{
+			fclose (file);
+		}
+		return ERR_FILE_OPEN;
+	}
+	for (i = 0; i < s_nSubscribersToLoad && ERR_OK == err; ++i)
+	{
+		err = LoadSubscriber (file);
+	}
+	for (i = 0; i < s_nOperatorsToLoad && ERR_OK == err; ++i)
+	{
+		err = LoadOperator (file);
+	}
+	fclose (file);
+	LOG_DEBUG_PRINT("Loaded %lu subscribers and %lu operators of checkpoint %lu\n", s_nSubscribersToLoad, s_nOperatorsToLoad, s_sequence);
+	return err;
+}
+
+static int WriteSubscriber (const Subscriber* _sub, void* _writer)
+{
+	RecordWriter* writer = _writer;
+	if (1 != fwrite (_sub, writer->m_recordSize, 1, writer->m_file))
+	{
+		writer->m_failed = 1;
+		return 0;
+	}
+	++writer->m_nRecords;
+	return 1;
+}
+
+static int WriteOperator (const Operator* _opr, void* _writer)
+{
+	return WriteSubscriber ((const Subscriber*)_opr, _writer);
+}
+
+/*so the rename itself survives a power loss*/
+static void SyncDirectory (const char* _fileName)
+{
+	char dirName[FILE_NAME_SIZE];
+	char* slash;
+	int fd;
+	strcpy (dirName, _fileName);
+	slash = strrchr (dirName, '/');
+	if (!slash)
+	{
+		strcpy (dirName, ".");
+	}
+	else
+	{
+		slash[slash == dirName ? 1 : 0] = '\0';
+	}
+	if (-1 != (fd = open (dirName, O_RDONLY)))
+	{
+		fsync (fd);
+		close (fd);
+	}
+}
+
+/*everything but the fsync, under the DB read lock*/
+static ADTErr WriteCheckpoint (FILE* _file)
+{
+	CheckpointHeader header;
+	RecordWriter writer;
+	unsigned int trailer = CHECKPOINT_MAGIC;
+	unsigned int i;
+	memset (&header, 0, sizeof(header));
+	header.m_magic = CHECKPOINT_MAGIC;
+	header.m_version = CHECKPOINT_VERSION;
+	header.m_subscriberSize = SubscriberSize ();
+	header.m_operatorSize = OperatorSize ();
+	header.m_sequence = s_sequence + 1;
+	pthread_mutex_lock (&s_filesMutex);
+	header.m_nFiles = s_nFiles;
+	pthread_mutex_unlock (&s_filesMutex);
+	/*the counts are known at the end*/
+	if (1 != fwrite (&header, sizeof(header), 1, _file))
+	{
+		return ERR_FILE_WRITE;
+	}
+	for (i = 1; i <= header.m_nFiles; ++i)
+	{
+		if (1 != fwrite (FileEntry (i), sizeof(FileProgress), 1, _file))
+		{
+			return ERR_FILE_WRITE;
+		}
+	}
+	writer.m_file = _file;
+	writer.m_failed = 0;
+	writer.m_nRecords = 0;
+	writer.m_recordSize = header.m_subscriberSize;
+	SubscriberDBForEach (s_subDB, WriteSubscriber, &writer);
+	header.m_nSubscribers = writer.m_nRecords;
+	writer.m_nRecords = 0;
+	writer.m_recordSize = header.m_operatorSize;
+	OperatorDBForEach (s_oprDB, WriteOperator, &writer);
+	header.m_nOperators = writer.m_nRecords;
+	if (writer.m_failed || 1 != fwrite (&trailer, sizeof(trailer), 1, _file))
+	{
+		return ERR_FILE_WRITE;
+	}
+	s_lastBytes = ftell (_file);
+	if (0 != fseek (_file, 0, SEEK_SET) || 1 != fwrite (&header, sizeof(header), 1, _file) || 0 != fflush (_file))
+	{
+		return ERR_FILE_WRITE;
+	}
+	return ERR_OK;
+}
+
+ADTErr CheckpointTake (void)
+{
+	unsigned long start;
+	ADTErr err;
+	FILE* file;
+	if (!s_subDB)
+	{
+		return ERR_NOT_INITIALIZED;
+	}
+	pthread_mutex_lock (&s_takeMutex);
+	start = NowNsec ();
+	if (!(file = fopen (s_tmpName, "w")))
+	{
+		++s_failed;
+		pthread_mutex_unlock (&s_takeMutex);
+		LOG_ERROR_PRINT("Creating %s failed\n", s_tmpName);
+		return ERR_FILE_OPEN;
+	}
+	setvbuf (file, NULL, _IOFBF, WRITE_BUFFER_SIZE);
+	DeltaLogHold ();
+	pthread_rwlock_rdlock (s_DBLock);
+	if (ERR_OK == (err = WriteCheckpoint (file)))
+	{
+		DeltaLogCut ();
+	}
+	pthread_rwlock_unlock (s_DBLock);
+	if (ERR_OK == err && 0 != fsync (fileno (file)))
+	{
+		err = ERR_FILE_WRITE;
+	}
+	if (0 != fclose (file) && ERR_OK == err)
+	{
+		err = ERR_FILE_CLOSE;
+	}
+	if (ERR_OK == err && 0 != rename (s_tmpName, s_fileName))
+	{
+		err = ERR_FILE_WRITE;
+	}
+	if (ERR_OK != err)
+	{
+		/*the last good checkpoint stays*/
+		unlink (s_tmpName);
+		DeltaLogRelease (0, s_sequence);
+		++s_failed;
+		pthread_mutex_unlock (&s_takeMutex);
+		LOG_ERROR_PRINT("Writing checkpoint %s failed\n", s_fileName);
+		return err;
+	}
+	SyncDirectory (s_fileName);
+	++s_sequence;
+	DeltaLogRelease (1, s_sequence);
+	++s_taken;
+	s_lastNsec = NowNsec () - start;
+	pthread_mutex_unlock (&s_takeMutex);
+	LOG_DEBUG_PRINT("Checkpoint %lu: %lu bytes in %.3f sec\n", s_sequence, s_lastBytes, s_lastNsec / 1e9);
+	return ERR_OK;
+}
+
+static void* Checkpointer (void* _unused)
+{
+	struct timespec wakeUp;
+	pthread_mutex_lock (&s_periodMutex);
+	clock_gettime (CLOCK_MONOTONIC, &wakeUp);
+	while (!s_stop)
+	{
+		wakeUp.tv_nsec += s_periodNsec % NSEC_IN_SEC;
+		wakeUp.tv_sec += s_periodNsec / NSEC_IN_SEC + wakeUp.tv_nsec / NSEC_IN_SEC;
+		wakeUp.tv_nsec %= NSEC_IN_SEC;
+		while (!s_stop && ETIMEDOUT != pthread_cond_timedwait (&s_periodCond, &s_periodMutex, &wakeUp));
+		if (s_stop)
+		{
+			break;
+		}
+		pthread_mutex_unlock (&s_periodMutex);
+		CheckpointTake ();
+		pthread_mutex_lock (&s_periodMutex);
+	}
+	pthread_mutex_unlock (&s_periodMutex);
+	return NULL;
+}
+
+ADTErr CheckpointStart (DBManagerParams* _params, unsigned int _periodSec)
+{
+	pthread_condattr_t condAttr;
+	sigset_t allSignals;
+	sigset_t oldMask;
+	ADTErr err;
+	if (!_params || '\0' == s_fileName[0])
+	{
+		return ERR_NOT_INITIALIZED;
+	}
+	if (ERR_OK != (err = GetSubscriberDB (_params, &s_subDB)) || ERR_OK != (err = GetOperatorDB (_params, &s_oprDB))
+		|| ERR_OK != (err = GetDBLock (_params, &s_DBLock)))
+	{
+		s_subDB = NULL;
+		return err;
+	}
+	pthread_rwlock_wrlock (s_DBLock);
+	if (ERR_OK == (err = LoadRecords ()))
+	{
+		err = DeltaLogReplay (ReplaySubscriber, ReplayOperator, NULL);
+	}
+	pthread_rwlock_unlock (s_DBLock);
+	if (ERR_OK != err)
+	{
+		s_subDB = NULL;
+		LOG_ERROR_PRINT("Loading checkpoint %s failed\n", s_fileName);
+		return err;
+	}
+	if (ERR_OK != (err = DeltaLogStart (s_DBLock)))
+	{
+		/*the checkpoints alone are still right*/
+		LOG_ERROR_PRINT("Starting delta log %s failed\n", s_logName);
+	}
+	s_periodNsec = _periodSec * NSEC_IN_SEC;
+	if (0 == s_periodNsec)
+	{
+		return ERR_OK;
+	}
+	s_stop = 0;
+	pthread_condattr_init (&condAttr);
+	pthread_condattr_setclock (&condAttr, CLOCK_MONOTONIC);
+	pthread_cond_init (&s_periodCond, &condAttr);
+	pthread_condattr_destroy (&condAttr);
+	/*signals go to the threads waiting for them*/
+	sigfillset (&allSignals);
+	pthread_sigmask (SIG_BLOCK, &allSignals, &oldMask);
+	if (0 != pthread_create (&s_checkpointThread, NULL, Checkpointer, NULL))
+	{
+		pthread_sigmask (SIG_SETMASK, &oldMask, NULL);
+		pthread_cond_destroy (&s_periodCond);
+		s_periodNsec = 0;
+		LOG_ERROR_PRINT("%s\n", "Creating checkpoint thread failed");
+		return ERR_THREAD_CANT_CREATE;
+	}
+	pthread_sigmask (SIG_SETMASK, &oldMask, NULL);
+	LOG_DEBUG_PRINT("Checkpoint to %s every %u sec\n", s_fileName, _periodSec);
+	return ERR_OK;
+}
+
+void CheckpointPrintStats (FILE* _file, void* _unused)
+{
+	fprintf (_file, "checkpoint_taken %lu\n", s_taken);
+	fprintf (_file, "checkpoint_failed %lu\n", s_failed);
+	fprintf (_file, "checkpoint_sequence %lu\n", s_sequence);
+	fprintf (_file, "checkpoint_last_bytes %lu\n", s_lastBytes);
+	fprintf (_file, "checkpoint_last_sec %.3f\n", s_lastNsec / 1e9);
+	DeltaLogPrintStats (_file, NULL);
+}
+
+ADTErr EndCheckpoint (void)
+{
+	ADTErr err;
+	unsigned int i;
+	if (!s_subDB)
+	{
+		return ERR_NOT_INITIALIZED;
+	}
+	if (0 != s_periodNsec)
+	{
+		pthread_mutex_lock (&s_periodMutex);
+		s_stop = 1;
+		pthread_cond_signal (&s_periodCond);
+		pthread_mutex_unlock (&s_periodMutex);
+		pthread_join (s_checkpointThread, NULL);
+		pthread_cond_destroy (&s_periodCond);
+	}
+	err = CheckpointTake ();
+	/*what the checkpoint missed, if it failed*/
+	EndDeltaLog ();
+	s_subDB = NULL;
+	for (i = 0; i < MAX_FILE_BLOCKS && s_blocks[i]; ++i)
+	{
+		free (s_blocks[i]);
+		s_blocks[i] = NULL;
+	}
+	s_nFiles = 0;
+	return err;
+}
@@ -0,0 +1,39 @@
+/*************************************************************************
+Creation Date: 19.10.26
+Last edit: 19.10.26
+Description: Header file for checkpoints - the databases together with how
+			 far every input file was read into them, written atomically
+			 (a tmp file, fsync, rename). A restart loads the last one and the
+			 readers go on from its offsets, so every CDR is counted once
+			 however the previous run ended.
+			 The offsets come from the CDRs the feeder applied (CDRGetSource),
+			 in-process reader threads only.
+**************************************************************************/
+
+#ifndef __CHECKPOINT_H__
+#define __CHECKPOINT_H__
+
+/*Before InitReaders: reads the file offsets of the checkpoint in _fileName, if there is one,
+  and of the delta log (<file>.wal) after it. The log gets a batch every _logPeriodMs (0 - no log)*/
+ADTErr CheckpointInit (const char* _fileName, unsigned int _logPeriodMs);
+
+/*Fits ReadersSetFileStart - the offset the last checkpoint reached in _filePath*/
+unsigned long CheckpointFileStart (const char* _filePath, unsigned int* _fileId, void* _unused);
+
+/*Fits DBManagerSetAppliedHook*/
+void CheckpointApplied (const DBApplied* _applied, void* _unused);
+
+/*After InitDBManager: adds the records of the last checkpoint and what the delta log
+  has after it to the databases, then takes one every _periodSec (0 - only in EndCheckpoint)*/
+ADTErr CheckpointStart (DBManagerParams* _params, unsigned int _periodSec);
+
+/*Takes one now, under the DB read lock*/
+ADTErr CheckpointTake (void);
+
+/*Writes "checkpoint_..." lines - fits MetricsAddSource*/
+void CheckpointPrintStats (FILE* _file, void* _unused);
+
+/*After EndDBManager: stops the periodic checkpoints and takes the last one*/
+ADTErr EndCheckpoint (void);
+
+#endif /*__CHECKPOINT_H__*/
@@ -13,6 +13,7 @@
 #include <fcntl.h> /*for open*/
 #include <unistd.h> /*for close*/
 #include <sys/stat.h> /*for flags*/
+#include <time.h> /*for clock_gettime*/
 
 #include "ADTErr.h"
 #include "logger.h"
@@ -24,6 +25,11 @@
 #include "Subscriber.h"
 #include "OperatorDB.h"
 #include "SubscriberDB.h"
+#include "Metrics.h"
+#include "GHashMap.h"
+#include "PersistTable.h"
+#include "ShmRing.h"
+#include "FilesReader.h"
 #include "DataManager.h"
 
 #define Q_IS_EMPTY_KEY "END"
@@ -33,17 +39,43 @@
 #define FAILED_DATA_LOG_NAME "FailedData.txt"
 #define ERR_STR_LENGTH 100
 #define KEY_STR_LENGTH 30
+#define NSEC_IN_SEC 1000000000UL
+#define DB_FILE_NAME_LENGTH 256
+/*to start with, the file doubles when full*/
+#define FILES_CAPACITY 1024
+#define FNV_OFFSET 14695981039346656037UL
+#define FNV_PRIME 1099511628211UL
 
 struct DBManagerParams
 {
 	SubscriberDB* m_subDB;
 	OperatorDB* m_oprDB;
-	pthread_mutex_t m_DBMutex;
-	SafeQueue* m_safeQ;
+	/*the feeder writes, exports, checkpoints and lookups read*/
+	pthread_rwlock_t m_DBLock;
+	void* m_source;
+	CDRPopFunc m_pop;
+	CDRReleaseFunc m_release;
+	DBManagerStats m_stats;
 	void* m_magic;
 }; 
 
+/*a record of <prefix>.files - the key is a hash of the path, which may be longer than a key*/
+typedef struct
+{
+	char			m_path[READER_PATH_SIZE];
+	unsigned long	m_offset;		/*applied up to here*/
+	unsigned int	m_fileId;		/*1 + its place in the table, records never move*/
+} FileOffset;
+
 static pthread_t s_feederThread;
+/*empty - the databases are in memory only*/
+static char s_subDBFile[DB_FILE_NAME_LENGTH];
+static char s_oprDBFile[DB_FILE_NAME_LENGTH];
+static DBAppliedFunc s_applied = NULL;
+static void* s_appliedContext = NULL;
+/*the readers add files while the feeder moves their offsets*/
+static PersistTable* s_filesTable = NULL;
+static pthread_mutex_t s_filesMutex = PTHREAD_MUTEX_INITIALIZER;
 
 static ADTErr PrepData (CDR* _cdr, Subscriber** _newSubscriber, Operator** _newOperator);
 static ADTErr InsertSub2DB (SubscriberDB* _subDB, Subscriber* _newSubscriber, char* _key);
@@ -52,19 +84,131 @@ static void* DBFeeder(void* _params);
 /*if only one is needed send the other with NULL*/
 static void LogFailedData (Subscriber* _sub, Operator* _opr);
 
+static ADTErr PopSafeQueue (void* _safeQ, CDR** _cdr)
+{
+	return SafeQueuePop (_safeQ, (void**)_cdr);
+}
+
+static ADTErr ReleaseCDR (void* _safeQ, CDR* _cdr)
+{
+	CDRDestroy (_cdr);
+	return ERR_OK;
+}
+
+ADTErr DBManagerUseFiles (const char* _prefix)
+{
+	char filesName[DB_FILE_NAME_LENGTH];
+	ADTErr err;
+	if (!_prefix || strlen (_prefix) + sizeof(".subscribers") > DB_FILE_NAME_LENGTH || s_filesTable)
+	{
+		return ERR_ILLEGAL_INPUT;
+	}
+	sprintf (filesName, "%s.files", _prefix);
+	s_filesTable = PTableOpen (filesName, sizeof(FileOffset), FILES_CAPACITY, &err);
+	if (!s_filesTable)
+	{
+		LOG_ERROR_PRINT("Opening %s failed\n", filesName);
+		return err;
+	}
+	sprintf (s_subDBFile, "%s.subscribers", _prefix);
+	sprintf (s_oprDBFile, "%s.operators", _prefix);
+	return ERR_OK;
+}
+
+static void PathKey (const char* _filePath, char* _key)
+{
+	unsigned long hash = FNV_OFFSET;
+	for (; '\0' != *_filePath; ++_filePath)
+	{
+		hash = (hash ^ (unsigned char)*_filePath) * FNV_PRIME;
+	}
+	sprintf (_key, "%016lx", hash);
+}
+
+unsigned long DBManagerFileStart (const char* _filePath, unsigned int* _fileId, void* _unused)
+{
+	FileOffset entry;
+	FileOffset* stored;
+	char key[PTABLE_KEY_SIZE];
+	unsigned long offset = 0;
+	*_fileId = 0;
+	if (!s_filesTable || strlen (_filePath) >= READER_PATH_SIZE)
+	{
+		return 0;
+	}
+	PathKey (_filePath, key);
+	pthread_mutex_lock (&s_filesMutex);
+	stored = PTableFind (s_filesTable, key);
+	if (stored && 0 == strcmp (stored->m_path, _filePath))
+	{
+		*_fileId = stored->m_fileId;
+		offset = stored->m_offset;
+	}
+	else if (stored)
+	{
+		LOG_ERROR_PRINT("%s has the key of %s, it is read again after a restart\n", _filePath, stored->m_path);
+	}
+	else
+	{
+		memset (&entry, 0, sizeof(entry));
+		strcpy (entry.m_path, _filePath);
+		entry.m_fileId = PTableCountItems (s_filesTable) + 1;
+		if (ERR_OK == PTableInsert (s_filesTable, key, &entry, (void**)&stored))
+		{
+			*_fileId = entry.m_fileId;
+		}
+		else
+		{
+			LOG_ERROR_PRINT("%s: adding to the files table failed, it is read again after a restart\n", _filePath);
+		}
+	}
+	pthread_mutex_unlock (&s_filesMutex);
+	return offset;
+}
+
+static int SetOffset (HashKey _key, Data _entry, void* _offset)
+{
+	((FileOffset*)_entry)->m_offset = *(const unsigned long*)_offset;
+	return 1;
+}
+
+/*under the DB write lock, once the CDR is in the databases - a process killed in between counts it again*/
+static void FileApplied (const DBApplied* _applied)
+{
+	if (!s_filesTable || 0 == _applied->m_fileId)
+	{
+		return;
+	}
+	pthread_mutex_lock (&s_filesMutex);
+	PTableForEachInRange (s_filesTable, _applied->m_fileId - 1, _applied->m_fileId, SetOffset, (void*)&_applied->m_offset);
+	pthread_mutex_unlock (&s_filesMutex);
+}
+
+ADTErr DBManagerSetAppliedHook (DBAppliedFunc _applied, void* _context)
+{
+	s_applied = _applied;
+	s_appliedContext = _context;
+	return ERR_OK;
+}
+
 DBManagerParams* InitDBManager (SafeQueue* _safeQ, ADTErr* _error)
+{
+	return InitDBManagerWithSource (_safeQ, PopSafeQueue, ReleaseCDR, _error);
+}
+
+DBManagerParams* InitDBManagerWithSource (void* _source, CDRPopFunc _pop, CDRReleaseFunc _release, ADTErr* _error)
 {	
 	DBManagerParams* params;
 	ADTErr errorCheck;
 	LOG_DEBUG_PRINT("%s\n", "InitDBManager has started");
-	LOG_DEBUG_PRINT("%s %p %s %p\n", "_safeQ:",(void*)_safeQ,"_error:",(void*)_error);
-	if (!_safeQ)
+	LOG_DEBUG_PRINT("%s %p %s %p\n", "_source:",_source,"_error:",(void*)_error);
+	if (!_source || !_pop || !_release)
 	{
 		if (_error)
 		{
 			*_error = ERR_NOT_INITIALIZED;
 		}
-		LOG_ERROR_PRINT ("%s\n", "safeQ not initialized");
+		LOG_ERROR_PRINT ("%s\n", "CDR source not initialized");
 		return NULL;
 	}
 	LOG_DEBUG_PRINT("%s\n", "Trying to allocate memory for params");
@@ -79,11 +223,14 @@ DBManagerParams* InitDBManager (SafeQueue* _safeQ, ADTErr* _error)
 		LOG_ERROR_PRINT ("%s\n", "Params allocation failed");
 		return NULL;
 	}
-	params->m_safeQ = _safeQ;
+	params->m_source = _source;
+	params->m_pop = _pop;
+	params->m_release = _release;
+	memset (&params->m_stats, 0, sizeof(params->m_stats));
 	params->m_magic = MAGIC;
 	/*create SBI data base*/
 	LOG_DEBUG_PRINT("%s\n", "Trying to create SBI database");
-	params->m_subDB = SubscriberDBCreate (&errorCheck);
+	params->m_subDB = s_subDBFile[0] ? SubscriberDBOpen (s_subDBFile, &errorCheck) : SubscriberDBCreate (&errorCheck);
 	if (ERR_OK != errorCheck || !params->m_subDB)
 	{
 		if (_error)
@@ -96,7 +243,7 @@ DBManagerParams* InitDBManager (SafeQueue* _safeQ, ADTErr* _error)
 	LOG_DEBUG_PRINT("%s\n", "SBI database creation was successful");
 	/*create OBI data base*/
 	LOG_DEBUG_PRINT("%s\n", "Trying to create OBI database");
-	params->m_oprDB = OperatorDBCreate (&errorCheck);
+	params->m_oprDB = s_oprDBFile[0] ? OperatorDBOpen (s_oprDBFile, &errorCheck) : OperatorDBCreate (&errorCheck);
 	if (ERR_OK != errorCheck || !params->m_oprDB)
 	{
 		SubscriberDBDestroy (params->m_subDB);
@@ -108,9 +255,9 @@ DBManagerParams* InitDBManager (SafeQueue* _safeQ, ADTErr* _error)
 		return NULL;
 	}
 	LOG_DEBUG_PRINT("%s\n", "OBI database creation was successful");
-	/*create DBMutex*/
-	LOG_DEBUG_PRINT("%s\n", "Trying to create database mutex");
-	if (0 != pthread_mutex_init(&params->m_DBMutex, NULL))
+	/*create DBLock*/
+	LOG_DEBUG_PRINT("%s\n", "Trying to create database lock");
+	if (0 != pthread_rwlock_init(&params->m_DBLock, NULL))
 	{
 		SubscriberDBDestroy (params->m_subDB);
 		OperatorDBDestroy (params->m_oprDB);
@@ -118,16 +265,16 @@ DBManagerParams* InitDBManager (SafeQueue* _safeQ, ADTErr* _error)
 		{		
 			*_error = ERR_INTERNAL_DB_FAIL;
 		}
-		LOG_ERROR_PRINT("%s\n", "DBMutex creation failed");
+		LOG_ERROR_PRINT("%s\n", "DBLock creation failed");
 		return NULL;
 	}
-	LOG_DEBUG_PRINT("%s\n", "Database mutex creation was successful");
+	LOG_DEBUG_PRINT("%s\n", "Database lock creation was successful");
 	LOG_DEBUG_PRINT("%s\n", "Trying to create feederThread");
 	if (0 != pthread_create(&s_feederThread, NULL, DBFeeder, params))
 	{
 		SubscriberDBDestroy (params->m_subDB);
 		OperatorDBDestroy (params->m_oprDB);
-		pthread_mutex_destroy (&params->m_DBMutex);
+		pthread_rwlock_destroy (&params->m_DBLock);
 		if (_error)
 		{		
 			*_error = ERR_INTERNAL_DB_FAIL;
@@ -144,6 +291,13 @@ DBManagerParams* InitDBManager (SafeQueue* _safeQ, ADTErr* _error)
 	return params;
 }	
 
+static unsigned long NowNsec (clockid_t _clock)
+{
+	struct timespec now;
+	clock_gettime (_clock, &now);
+	return (unsigned long)now.tv_sec * NSEC_IN_SEC + now.tv_nsec;
+}
+
 static void* DBFeeder(void* _params)
 {
 	ADTErr errorCheck;
@@ -154,12 +308,17 @@ static void* DBFeeder(void* _params)
 	char oprName[KEY_STR_LENGTH];
 	DBManagerParams* params = _params;
 	CDR* cdr;
+	DBApplied applied;
+	unsigned long popStart;
+	unsigned long insertStart;
 	LOG_DEBUG_PRINT("%s\n", "DBFeeder thread has started");
 	while (1)
 	{
 		/*get CDR*/
 		LOG_DEBUG_PRINT("%s\n", "Trying to get CDR from Q");
-		errorCheck = SafeQueuePop (params->m_safeQ, (void**)&cdr);
+		popStart = NowNsec (CLOCK_MONOTONIC);
+		errorCheck = params->m_pop (params->m_source, &cdr);
+		params->m_stats.m_queueWaitNsec += NowNsec (CLOCK_MONOTONIC) - popStart;
 		if (ERR_OK != errorCheck)
 		{
 			GetError (errorStr, errorCheck);
@@ -171,9 +330,10 @@ static void* DBFeeder(void* _params)
 		errorCheck = CDRGetIMSI(cdr, imsi);
 		if (ERR_OK != CDRGetIMSI(cdr, imsi))
 		{
-			CDRDestroy (cdr);
+			params->m_release (params->m_source, cdr);
 			GetError (errorStr, errorCheck);
 			LOG_WARN_PRINT("%s\n", errorStr);
+			MetricsAdd (METRIC_RECORDS_FAILED, 1);
 			continue;
 		}	
 		/*check if IMSI is an ending signal*/
@@ -181,17 +341,20 @@ static void* DBFeeder(void* _params)
 		if (0 == strcmp (imsi, Q_IS_EMPTY_KEY))
 		{
 			LOG_DEBUG_PRINT("%s\n", "End key recieved");
-			CDRDestroy (cdr);
+			params->m_release (params->m_source, cdr);
 			break;
 		}
 		LOG_DEBUG_PRINT("%s %s\n", "Get IMSI was successful. IMSI:", imsi);
 		LOG_DEBUG_PRINT("%s\n", "Starting to prep data");
 		/*if data is invalid then skip to next in Q*/
 		errorCheck = PrepData (cdr, &newSubscriber, &newOperator);
+		CDRGetSource (cdr, &applied.m_fileId, &applied.m_offset);
+		params->m_release (params->m_source, cdr);
 		if (ERR_OK != errorCheck)
 		{
 			GetError (errorStr, errorCheck);
 			LOG_WARN_PRINT("%s\n", errorStr);
+			MetricsAdd (METRIC_RECORDS_FAILED, 1);
 			continue;
 		}
 		LOG_DEBUG_PRINT("%s\n", "Prep data was successful");
@@ -204,18 +367,28 @@ static void* DBFeeder(void* _params)
 			OperatorDestroy (newOperator);
 			GetError (errorStr, errorCheck);
 			LOG_WARN_PRINT("%s\n", errorStr);
+			MetricsAdd (METRIC_RECORDS_FAILED, 1);
 			continue;
 		}
-		LOG_DEBUG_PRINT("%s\n", "Locking mutex");
-		if (0 != pthread_mutex_lock(&params->m_DBMutex))
+		if (s_applied)
+		{
+			/*the inserts take the new records*/
+			applied.m_imsi = imsi;
+			applied.m_operator = oprName;
+			SubscriberGetUsage (newSubscriber, &applied.m_subscriberUsage);
+			OperatorGetUsage (newOperator, &applied.m_operatorUsage);
+		}
+		LOG_DEBUG_PRINT("%s\n", "Locking DB for write");
+		insertStart = MetricsStart ();
+		if (0 != pthread_rwlock_wrlock(&params->m_DBLock))
 		{
 			LogFailedData (newSubscriber, newOperator);
 			SubscriberDestroy (newSubscriber);
 			OperatorDestroy (newOperator);			
-			LOG_ERROR_PRINT("%s\n", "Locking mutex failed");
+			LOG_ERROR_PRINT("%s\n", "Locking DB failed");
 			pthread_exit (NULL);
 		}
-		LOG_DEBUG_PRINT("%s\n", "Mutex locked");
+		LOG_DEBUG_PRINT("%s\n", "DB locked");
 		LOG_DEBUG_PRINT("%s\n", "Trying to insert to subscriber DB");
 		errorCheck = InsertSub2DB (params->m_subDB, newSubscriber, imsi);
 		if (ERR_OK != errorCheck)	
@@ -223,12 +396,13 @@ static void* DBFeeder(void* _params)
 			LogFailedData (newSubscriber, newOperator);
 			SubscriberDestroy (newSubscriber);
 			OperatorDestroy (newOperator);
-			if (0 != pthread_mutex_unlock (&params->m_DBMutex))
+			if (0 != pthread_rwlock_unlock (&params->m_DBLock))
 			{
 				pthread_exit (NULL);
 			}		
 			GetError (errorStr, errorCheck);
 			LOG_WARN_PRINT("%s\n", errorStr);
+			MetricsAdd (METRIC_RECORDS_FAILED, 1);
 			continue;
 		}
 		LOG_DEBUG_PRINT("%s\n", "Insert to subscriber DB was succesfull");
@@ -240,22 +414,39 @@ static void* DBFeeder(void* _params)
 			OperatorDestroy (newOperator);
 			GetError (errorStr, errorCheck);
 			LOG_WARN_PRINT("%s\n", errorStr);	
-			if (0 != pthread_mutex_unlock (&params->m_DBMutex))
+			/*the subscriber part is in - a restart must not apply it again*/
+			FileApplied (&applied);
+			if (s_applied)
+			{
+				applied.m_operator = NULL;
+				s_applied (&applied, s_appliedContext);
+			}
+			if (0 != pthread_rwlock_unlock (&params->m_DBLock))
 			{
-				LOG_ERROR_PRINT("%s\n", "Unlocking mutex failed");
+				LOG_ERROR_PRINT("%s\n", "Unlocking DB failed");
 				pthread_exit (NULL);
 			}	
+			MetricsAdd (METRIC_RECORDS_FAILED, 1);
 			continue;
 		}
 		LOG_DEBUG_PRINT("%s\n", "Insert to subscriber DB was succesfull");
-		LOG_DEBUG_PRINT("%s\n", "Unlocking mutex");
-		if (0 != pthread_mutex_unlock (&params->m_DBMutex))
+		FileApplied (&applied);
+		if (s_applied)
 		{
-			LOG_ERROR_PRINT("%s\n", "Unlocking mutex failed");
+			s_applied (&applied, s_appliedContext);
+		}
+		LOG_DEBUG_PRINT("%s\n", "Unlocking DB");
+		if (0 != pthread_rwlock_unlock (&params->m_DBLock))
+		{
+			LOG_ERROR_PRINT("%s\n", "Unlocking DB failed");
 			pthread_exit (NULL);
 		}
-		LOG_DEBUG_PRINT("%s\n", "Mutex unlocked");
+		LOG_DEBUG_PRINT("%s\n", "DB unlocked");
+		MetricsRecord (METRIC_DB_INSERT, insertStart);
+		MetricsAdd (METRIC_RECORDS_INSERTED, 1);
+		++params->m_stats.m_records;
 	}
+	params->m_stats.m_cpuNsec = NowNsec (CLOCK_THREAD_CPUTIME_ID);
 	LOG_DEBUG_PRINT("%s\n", "DBFeeder finished succesfully");	
 	pthread_exit (NULL);
 }
@@ -270,7 +461,6 @@ static ADTErr PrepData (CDR* _cdr, Subscriber** _newSubscriber, Operator** _newO
 	*_newSubscriber = SubscriberCreate (_cdr, &errorCheck);
 	if (ERR_OK != errorCheck || !*_newSubscriber)
 	{
-		CDRDestroy (_cdr);
 		GetError (errorStr, errorCheck);
 		LOG_ERROR_PRINT("%s\n", errorStr);	
 		return ERR_DATA_PREP_FAILED;
@@ -282,13 +472,11 @@ static ADTErr PrepData (CDR* _cdr, Subscriber** _newSubscriber, Operator** _newO
 	{
 		LogFailedData (*_newSubscriber, NULL);
 		SubscriberDestroy (*_newSubscriber);
-		CDRDestroy (_cdr);
 		GetError (errorStr, errorCheck);
 		LOG_ERROR_PRINT("%s\n", errorStr);
 		return ERR_DATA_PREP_FAILED;
 	}
 	LOG_DEBUG_PRINT("%s\n", "Operator created succesfully");	
-	CDRDestroy (_cdr);
 	LOG_DEBUG_PRINT("%s\n", "PrepData finished succesfully");	
 	return ERR_OK;
 }
@@ -312,6 +500,8 @@ static ADTErr InsertSub2DB (SubscriberDB* _subDB, Subscriber* _newSubscriber, ch
 			LOG_ERROR_PRINT("%s\n", errorStr);
 			return ERR_DB_UPDATE_FAILED;
 		}
+		/*so the next delta export includes it*/
+		SubscriberDBMarkDirty (_subDB, existSubscriber);
 		SubscriberDestroy (_newSubscriber);
 		LOG_DEBUG_PRINT("%s\n", "Subscriber Updated succesfully");		
 	}
@@ -349,6 +539,8 @@ static ADTErr InsertOpr2DB (OperatorDB* _oprDB, Operator* _newOperator, char* _k
 			LOG_ERROR_PRINT("%s\n", errorStr);
 			return ERR_DB_UPDATE_FAILED;
 		}
+		/*so the next delta export includes it*/
+		OperatorDBMarkDirty (_oprDB, existOperator);
 		OperatorDestroy (_newOperator);
 		LOG_DEBUG_PRINT("%s\n", "Operator Updated succesfully");		
 		return ERR_OK;
@@ -439,8 +631,13 @@ ADTErr DestroyDBManager (DBManagerParams* _params)
 	SubscriberDBDestroy (_params->m_subDB);
 	LOG_DEBUG_PRINT("%s\n", "Destroying oprDB");	
 	OperatorDBDestroy (_params->m_oprDB);
-	LOG_DEBUG_PRINT("%s\n", "Destroying DBMutex");
-	pthread_mutex_destroy (&_params->m_DBMutex);
+	LOG_DEBUG_PRINT("%s\n", "Destroying DBLock");
+	pthread_rwlock_destroy (&_params->m_DBLock);
+	if (s_filesTable)
+	{
+		PTableClose (s_filesTable);
+		s_filesTable = NULL;
+	}
 	_params->m_magic = NULL;
 	LOG_DEBUG_PRINT("%s\n", "Destroying params");
 	free (_params);
@@ -474,16 +671,30 @@ ADTErr GetOperatorDB (const DBManagerParams* _params, OperatorDB** _oprDB)
 	return ERR_OK;
 }
 
-ADTErr GetDBMutex (const DBManagerParams* _params, pthread_mutex_t* _DBMutex)
+ADTErr GetDBLock (const DBManagerParams* _params, pthread_rwlock_t** _DBLock)
 {
-	LOG_DEBUG_PRINT("%s\n", "GetDBMutex has started");
-	if (INVALID_MNGR_PRMS(_params) || !_DBMutex)
+	LOG_DEBUG_PRINT("%s\n", "GetDBLock has started");
+	if (INVALID_MNGR_PRMS(_params) || !_DBLock)
 	{
 		LOG_ERROR_PRINT("%s\n", "A paramater is not initialized");
 		return ERR_NOT_INITIALIZED;
 	}
-	*_DBMutex = _params->m_DBMutex;
-	LOG_DEBUG_PRINT("%s\n", "GetDBMutex finished succesfully");	
+	/*the lock itself - a copy of it doesn't lock anything*/
+	*_DBLock = (pthread_rwlock_t*)&_params->m_DBLock;
+	LOG_DEBUG_PRINT("%s\n", "GetDBLock finished succesfully");	
 	return ERR_OK;
 }
 
+
+ADTErr GetDBManagerStats (const DBManagerParams* _params, DBManagerStats* _stats)
+{
+	LOG_DEBUG_PRINT("%s\n", "GetDBManagerStats has started");
+	if (INVALID_MNGR_PRMS(_params) || !_stats)
+	{
+		LOG_ERROR_PRINT("%s\n", "A paramater is not initialized");
+		return ERR_NOT_INITIALIZED;
+	}
+	*_stats = _params->m_stats;
+	LOG_DEBUG_PRINT("%s\n", "GetDBManagerStats finished succesfully");	
+	return ERR_OK;
+}
@@ -10,13 +10,55 @@ Description: Header file for Database Manager functions declarations
 
 typedef struct DBManagerParams DBManagerParams;
 
+/*what the feeder thread did, complete once EndDBManager returned*/
+typedef struct
+{
+	unsigned long	m_records;			/*inserted or merged into the databases*/
+	unsigned long	m_cpuNsec;
+	unsigned long	m_queueWaitNsec;	/*in the pop - waiting for records*/
+} DBManagerStats;
+
+/*where the feeder gets its CDRs - the SafeQueue or the shared memory ring.
+  release is called once the CDR was used, before the next pop.*/
+typedef ADTErr (*CDRPopFunc) (void* _source, CDR** _cdr);
+typedef ADTErr (*CDRReleaseFunc) (void* _source, CDR* _cdr);
+
+/*before InitReaders: keep the databases in <prefix>.subscribers and <prefix>.operators and how
+  far every input file was read into them in <prefix>.files - a restart with the same prefix
+  goes on with what they hold, and its readers from those offsets (DBManagerFileStart).
+  In-process reader threads only, like the checkpoints*/
+ADTErr DBManagerUseFiles (const char* _prefix);
+
+/*Fits ReadersSetFileStart - the offset the <prefix>.files of DBManagerUseFiles reached in _filePath*/
+unsigned long DBManagerFileStart (const char* _filePath, unsigned int* _fileId, void* _unused);
+
+/*one CDR the feeder put in the databases*/
+typedef struct
+{
+	const char*		m_imsi;
+	const char*		m_operator;			/*NULL - only the subscriber part went in*/
+	SubscriberUsage	m_subscriberUsage;	/*what it added*/
+	OperatorUsage	m_operatorUsage;
+	unsigned int	m_fileId;			/*the source the reader stamped on it (CDRGetSource)*/
+	unsigned long	m_offset;
+} DBApplied;
+
+/*called by the feeder under the DB write lock once a CDR is in the databases*/
+typedef void (*DBAppliedFunc) (const DBApplied* _applied, void* _context);
+
+/*before InitDBManager, NULL - none*/
+ADTErr DBManagerSetAppliedHook (DBAppliedFunc _applied, void* _context);
+
 DBManagerParams* InitDBManager (SafeQueue* _safeQ, ADTErr* _error);
+DBManagerParams* InitDBManagerWithSource (void* _source, CDRPopFunc _pop, CDRReleaseFunc _release, ADTErr* _error);
 /*Wait until the DBManager finishes*/
 ADTErr EndDBManager 	(DBManagerParams* _params);
 ADTErr DestroyDBManager (DBManagerParams* _params);
 
 ADTErr GetSubscriberDB 	(const DBManagerParams* _params, SubscriberDB** _subDB);
 ADTErr GetOperatorDB 	(const DBManagerParams* _params, OperatorDB** _oprDB);
-ADTErr GetDBMutex 		(const DBManagerParams* _params, pthread_mutex_t* _DBMutex);
+/*write - the feeder only. read - whatever only reads the databases, and so runs together with the others*/
+ADTErr GetDBLock 		(const DBManagerParams* _params, pthread_rwlock_t** _DBLock);
+ADTErr GetDBManagerStats (const DBManagerParams* _params, DBManagerStats* _stats);
 
 #endif /*__DATAMNGR_H__*/
@@ -0,0 +1,338 @@
+/**************************************************************************************************************************************
+Creation Date : 19.10.2026
+Last modified date 19.10.2026
+Description : Decompress - streams a compressed file through a fixed buffer of decompressed bytes, lines are cut from it
+**************************************************************************************************************************************/
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#ifdef CDR_GZIP
+#include <zlib.h>
+#endif
+#ifdef CDR_ZSTD
+#include <zstd.h>
+#endif
+
+#include "ADTErr.h"
+#include "logger.h"
+#include "logger_pub.h"
+#include "Decompress.h"
+
+#define IN_SIZE (64 * 1024)
+#define OUT_SIZE (128 * 1024)
+#define SIZE_STR_ERR 100
+
+struct Decompressor
+{
+	FILE*			m_fp;
+	CompressedKind	m_kind;
+	int				m_isEnd;
+	int				m_isCorrupt;
+	size_t			m_pos;		/* next byte of m_out to give */
+	size_t			m_len;		/* bytes in m_out */
+#ifdef CDR_GZIP
+	z_stream		m_gzip;
+#endif
+#ifdef CDR_ZSTD
+	ZSTD_DCtx*		m_zstd;
+	ZSTD_inBuffer	m_zstdIn;
+	size_t			m_zstdLeft;	/* ZSTD_decompressStream - 0 at the end of a frame */
+#endif
+	unsigned char	m_in[IN_SIZE];
+	unsigned char	m_out[OUT_SIZE];
+};
+
+CompressedKind DecompressKind(const unsigned char* _bytes,size_t _size)
+{
+	if(NULL == _bytes)
+	{
+		return COMPRESSED_NONE;
+	}
+	if(_size >= 2 && 0x1F == _bytes[0] && 0x8B == _bytes[1])
+	{
+		return COMPRESSED_GZIP;
+	}
+	if(_size >= 4 && 0x28 == _bytes[0] && 0xB5 == _bytes[1] && 0x2F == _bytes[2] && 0xFD == _bytes[3])
+	{
+		return COMPRESSED_ZSTD;
+	}
+	return COMPRESSED_NONE;
+}
+
+int DecompressIsBuilt(CompressedKind _kind)
+{
+	switch(_kind)
+	{
+#ifdef CDR_GZIP
+		case COMPRESSED_GZIP: return 1;
+#endif
+#ifdef CDR_ZSTD
+		case COMPRESSED_ZSTD: return 1;
+#endif
+		default: return 0;
+	}
+}
+
+#if defined(CDR_GZIP) || defined(CDR_ZSTD)
+/* the input ran out - 0 at the end of the file */
+static size_t ReadIn(Decompressor* _decompressor)
+{
+	size_t nRead = fread(_decompressor->m_in,1,IN_SIZE,_decompressor->m_fp);
+
+	if(0 == nRead && ferror(_decompressor->m_fp))
+	{
+		LOG_ERROR_PRINT("%s","read of a compressed file failed");
+		_decompressor->m_isCorrupt = 1;
+	}
+	return nRead;
+}
+#endif
+
+#ifdef CDR_GZIP
+static ADTErr GzipOpen(Decompressor* _decompressor)
+{
+	memset(&_decompressor->m_gzip,0,sizeof(z_stream));
+	/* 15 + 16 - a gzip header, not zlib */
+	return (Z_OK == inflateInit2(&_decompressor->m_gzip,15 + 16)) ? ERR_OK : ERR_ALLOCATION_FAILED;
+}
+
+/* a .gz may be several members one after the other, as cat a.gz b.gz makes */
+static void GzipFill(Decompressor* _decompressor)
+{
+	z_stream* stream = &_decompressor->m_gzip;
+	int status;
+
+	stream->next_out = _decompressor->m_out;
+	stream->avail_out = OUT_SIZE;
+	while(OUT_SIZE == stream->avail_out && !_decompressor->m_isEnd)
+	{
+		if(0 == stream->avail_in)
+		{
+			if(0 == (stream->avail_in = ReadIn(_decompressor)))
+			{
+				/* inflateReset zeroes total_in - a member was not ended */
+				if(0 != stream->total_in && !_decompressor->m_isCorrupt)
+				{
+					LOG_ERROR_PRINT("%s","gzip: the file ends in the middle of a member");
+					_decompressor->m_isCorrupt = 1;
+				}
+				_decompressor->m_isEnd = 1;
+				break;
+			}
+			stream->next_in = _decompressor->m_in;
+		}
+		status = inflate(stream,Z_NO_FLUSH);
+		if(Z_STREAM_END == status)
+		{
+			inflateReset(stream);
+		}
+		else if(Z_OK != status && Z_BUF_ERROR != status)
+		{
+			LOG_ERROR_PRINT("gzip: %s",(NULL != stream->msg) ? stream->msg : "corrupt data");
+			_decompressor->m_isCorrupt = 1;
+			_decompressor->m_isEnd = 1;
+		}
+	}
+	_decompressor->m_len = OUT_SIZE - stream->avail_out;
+}
+#endif
+
+#ifdef CDR_ZSTD
+static ADTErr ZstdOpen(Decompressor* _decompressor)
+{
+	if(NULL == (_decompressor->m_zstd = ZSTD_createDCtx()))
+	{
+		return ERR_ALLOCATION_FAILED;
+	}
+	_decompressor->m_zstdIn.src = _decompressor->m_in;
+	_decompressor->m_zstdIn.size = 0;
+	_decompressor->m_zstdIn.pos = 0;
+	_decompressor->m_zstdLeft = 0;
+	return ERR_OK;
+}
+
+static void ZstdFill(Decompressor* _decompressor)
+{
+	ZSTD_inBuffer* in = &_decompressor->m_zstdIn;
+	ZSTD_outBuffer out;
+
+	out.dst = _decompressor->m_out;
+	out.size = OUT_SIZE;
+	out.pos = 0;
+	while(0 == out.pos && !_decompressor->m_isEnd)
+	{
+		if(in->pos == in->size)
+		{
+			in->pos = 0;
+			if(0 == (in->size = ReadIn(_decompressor)))
+			{
+				_decompressor->m_isEnd = 1;
+				break;
+			}
+		}
+		_decompressor->m_zstdLeft = ZSTD_decompressStream(_decompressor->m_zstd,&out,in);
+		if(ZSTD_isError(_decompressor->m_zstdLeft))
+		{
+			LOG_ERROR_PRINT("zstd: %s",ZSTD_getErrorName(_decompressor->m_zstdLeft));
+			_decompressor->m_isCorrupt = 1;
+			_decompressor->m_isEnd = 1;
+		}
+	}
+	if(_decompressor->m_isEnd && !_decompressor->m_isCorrupt && 0 != _decompressor->m_zstdLeft)
+	{
+		LOG_ERROR_PRINT("%s","zstd: the file ends in the middle of a frame");
+		_decompressor->m_isCorrupt = 1;
+	}
+	_decompressor->m_len = out.pos;
+}
+#endif
+
+/* 0 - nothing more to give */
+static size_t Fill(Decompressor* _decompressor)
+{
+	_decompressor->m_pos = 0;
+	_decompressor->m_len = 0;
+	switch(_decompressor->m_kind)
+	{
+#ifdef CDR_GZIP
+		case COMPRESSED_GZIP: GzipFill(_decompressor); break;
+#endif
+#ifdef CDR_ZSTD
+		case COMPRESSED_ZSTD: ZstdFill(_decompressor); break;
+#endif
+		default: break;
+	}
+	return _decompressor->m_len;
+}
+
+Decompressor* DecompressOpen(FILE* _fp,CompressedKind _kind,ADTErr* _err)
+{
+	Decompressor* decompressor;
+	ADTErr err = ERR_ILLEGAL_INPUT;
+	char strErr[SIZE_STR_ERR];
+
+	if(NULL == _fp || !DecompressIsBuilt(_kind))
+	{
+		*_err = (NULL == _fp) ? ERR_NOT_INITIALIZED : ERR_ILLEGAL_INPUT;
+		return NULL;
+	}
+	if(NULL == (decompressor = calloc(1,sizeof(Decompressor))))
+	{
+		GetError(strErr,ERR_ALLOCATION_FAILED);
+		LOG_ERROR_PRINT("%s",strErr);
+		*_err = ERR_ALLOCATION_FAILED;
+		return NULL;
+	}
+	decompressor->m_fp = _fp;
+	decompressor->m_kind = _kind;
+	switch(_kind)
+	{
+#ifdef CDR_GZIP
+		case COMPRESSED_GZIP: err = GzipOpen(decompressor); break;
+#endif
+#ifdef CDR_ZSTD
+		case COMPRESSED_ZSTD: err = ZstdOpen(decompressor); break;
+#endif
+		default: break;
+	}
+	if(ERR_OK != err)
+	{
+		GetError(strErr,err);
+		LOG_ERROR_PRINT("%s",strErr);
+		free(decompressor);
+		*_err = err;
+		return NULL;
+	}
+	*_err = ERR_OK;
+	return decompressor;
+}
+
+void DecompressClose(Decompressor* _decompressor)
+{
+	if(NULL == _decompressor)
+	{
+		return;
+	}
+#ifdef CDR_GZIP
+	if(COMPRESSED_GZIP == _decompressor->m_kind)
+	{
+		inflateEnd(&_decompressor->m_gzip);
+	}
+#endif
+#ifdef CDR_ZSTD
+	if(COMPRESSED_ZSTD == _decompressor->m_kind)
+	{
+		ZSTD_freeDCtx(_decompressor->m_zstd);
+	}
+#endif
+	free(_decompressor);
+}
+
+char* DecompressGets(Decompressor* _decompressor,char* _line,int _size)
+{
+	size_t nCopied = 0;
+	size_t take;
+	unsigned char* from;
+	unsigned char* newLine = NULL;
+
+	if(NULL == _decompressor || NULL == _line || _size < 2)
+	{
+		return NULL;
+	}
+	while(NULL == newLine && nCopied < (size_t)_size - 1)
+	{
+		if(_decompressor->m_pos == _decompressor->m_len && 0 == Fill(_decompressor))
+		{
+			break;
+		}
+		from = _decompressor->m_out + _decompressor->m_pos;
+		take = _decompressor->m_len - _decompressor->m_pos;
+		if(take > (size_t)_size - 1 - nCopied)
+		{
+			take = (size_t)_size - 1 - nCopied;
+		}
+		if(NULL != (newLine = memchr(from,'\n',take)))
+		{
+			take = newLine - from + 1;
+		}
+		memcpy(_line + nCopied,from,take);
+		nCopied += take;
+		_decompressor->m_pos += take;
+	}
+	if(0 == nCopied)
+	{
+		return NULL;
+	}
+	_line[nCopied] = '\0';
+	return _line;
+}
+
+ADTErr DecompressSkip(Decompressor* _decompressor,unsigned long _bytes)
+{
+	size_t take;
+
+	if(NULL == _decompressor)
+	{
+		return ERR_NOT_INITIALIZED;
+	}
+	while(_bytes > 0)
+	{
+		if(_decompressor->m_pos == _decompressor->m_len && 0 == Fill(_decompressor))
+		{
+			return ERR_UNDERFLOW;
+		}
+		take = _decompressor->m_len - _decompressor->m_pos;
+		if(take > _bytes)
+		{
+			take = _bytes;
+		}
+		_decompressor->m_pos += take;
+		_bytes -= take;
+	}
+	return ERR_OK;
+}
+
+int DecompressIsCorrupt(const Decompressor* _decompressor)
+{
+	return NULL != _decompressor && _decompressor->m_isCorrupt;
+}
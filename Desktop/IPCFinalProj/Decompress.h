@@ -0,0 +1,38 @@
+/**************************************************************************************************************************************
+Creation Date : 19.10.2026
+Last modified date 19.10.2026
+Description : Decompress - reads the lines of a compressed CDR file as fgets reads a text file, without a copy on disk.
+			  gzip is built with -D CDR_GZIP (zlib), zstd with -D CDR_ZSTD (libzstd) - see the makefile
+								-- header file --
+**************************************************************************************************************************************/
+#ifndef __DECOMPRESS_H__
+#define __DECOMPRESS_H__
+
+typedef struct Decompressor Decompressor;
+
+typedef enum
+{
+	COMPRESSED_NONE,
+	COMPRESSED_GZIP,
+	COMPRESSED_ZSTD
+} CompressedKind;
+
+/* the kind of a file from its first _size bytes (4 are enough) */
+CompressedKind DecompressKind(const unsigned char* _bytes,size_t _size);
+
+/* 1 - this build reads _kind */
+int DecompressIsBuilt(CompressedKind _kind);
+
+/* reads _fp from where it is - the caller keeps _fp and closes it after DecompressClose */
+Decompressor* DecompressOpen(FILE* _fp,CompressedKind _kind,ADTErr* _err);
+void DecompressClose(Decompressor* _decompressor);
+
+/* as fgets on the decompressed bytes. NULL - end of file or a corrupt file, DecompressIsCorrupt tells which */
+char* DecompressGets(Decompressor* _decompressor,char* _line,int _size);
+
+/* skips _bytes decompressed bytes. ERR_UNDERFLOW - the file has less */
+ADTErr DecompressSkip(Decompressor* _decompressor,unsigned long _bytes);
+
+int DecompressIsCorrupt(const Decompressor* _decompressor);
+
+#endif /* __DECOMPRESS_H__ */
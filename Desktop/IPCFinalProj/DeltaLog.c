@@ -0,0 +1,850 @@
+/**************************************************************************************************
+	Creation date: 			19.10.26
+	Last modified date: 	19.10.26
+
+	Description: Implementation module for the delta log.
+				 A batch on disk: the header, then {path length, path, offset} per file,
+				 then {key length, key, counters} per subscriber and per operator.
+				 Native byte order, the checksum covers the header and the body.
+				 The feeder adds to the pending batch under the DB write lock, the writer
+				 swaps it with an empty one under the read lock (the feeder is out, and
+				 s_logMutex keeps out a checkpoint's cut) and writes it without it.
+				 A batch that could not be written, or a delta there was no memory for,
+				 breaks the log until the next checkpoint - a replay of later batches
+				 would move the files past CDRs it does not have. The checkpoint is right
+				 either way.
+**************************************************************************************************/
+
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h> /*for calloc*/
+#include <string.h>
+#include <errno.h> /*for ETIMEDOUT*/
+#include <fcntl.h> /*for open*/
+#include <unistd.h> /*for pwrite, fdatasync*/
+#include <sys/stat.h> /*for fstat*/
+#include <time.h>
+
+#include "ADTErr.h"
+#include "logger.h"
+#include "logger_pub.h"
+#include "GData.h"
+#include "safeQueue.h"
+#include "cdr.h"
+#include "Subscriber.h"
+#include "Operator.h"
+#include "SubscriberDB.h"
+#include "OperatorDB.h"
+#include "DataManager.h"
+#include "DeltaLog.h"
+
+#define BATCH_MAGIC 0x444c5447U
+#define KEY_SIZE 32
+#define PATH_SIZE 1024
+#define INITIAL_SUBSCRIBERS 1024
+#define INITIAL_OPERATORS 16
+#define INITIAL_FILES 16
+#define COUNTERS_SIZE (4 * sizeof(unsigned int) + 2 * sizeof(double))
+#define FNV_OFFSET 2166136261U
+#define FNV_PRIME 16777619U
+#define NSEC_IN_SEC 1000000000UL
+#define NSEC_IN_MSEC 1000000UL
+
+typedef struct
+{
+	unsigned int	m_magic;
+	unsigned int	m_checksum;		/*0 while it is computed*/
+	unsigned long	m_sequence;		/*of the checkpoint it goes on from*/
+	unsigned int	m_nFiles;
+	unsigned int	m_nSubscribers;
+	unsigned int	m_nOperators;
+	unsigned int	m_bodySize;
+} BatchHeader;
+
+typedef struct
+{
+	char			m_key[KEY_SIZE];	/*"" - an empty slot*/
+	unsigned int	m_incomingDuration;
+	unsigned int	m_outgoingDuration;
+	unsigned int	m_messagesReceived;
+	unsigned int	m_messagesSent;
+	double			m_downloaded;
+	double			m_uploaded;
+} Delta;
+
+typedef struct
+{
+	Delta*			m_slots;
+	size_t			m_capacity;		/*power of 2, at most half full*/
+	size_t			m_nItems;
+} DeltaTable;
+
+typedef struct
+{
+	const char*		m_path;			/*owned by the caller of DeltaLogAdd*/
+	unsigned int	m_fileId;
+	unsigned long	m_offset;
+} FileDelta;
+
+typedef struct
+{
+	DeltaTable		m_subscribers;
+	DeltaTable		m_operators;
+	FileDelta*		m_files;
+	size_t			m_nFiles;
+	size_t			m_filesCapacity;
+	size_t			m_lastFile;		/*the CDRs of a file come in runs*/
+} Batch;
+
+typedef struct
+{
+	const unsigned char*	m_at;
+	const unsigned char*	m_end;
+} BodyReader;
+
+static Batch s_batches[2];
+static Batch* s_pending = &s_batches[0];
+static Batch* s_writing = &s_batches[1];
+static unsigned char* s_buffer = NULL;
+static size_t s_bufferSize = 0;
+
+static int s_fd = -1;
+static unsigned long s_logSize = 0;		/*end of the last whole batch*/
+static unsigned long s_replayEnd = 0;
+static unsigned long s_sequence = 0;
+static pthread_rwlock_t* s_DBLock = NULL;
+
+static pthread_mutex_t s_logMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t s_logCond;
+static pthread_t s_writerThread;
+static unsigned long s_periodNsec = 0;
+static int s_isLogging = 0;		/*DeltaLogAdd fills the pending batch*/
+static int s_isStarted = 0;		/*the writer runs*/
+static int s_stop = 0;
+static int s_isHeld = 0;
+static int s_isCut = 0;
+static int s_isBroken = 0;
+
+static unsigned long s_nBatches = 0;
+static unsigned long s_nBytes = 0;
+static unsigned long s_nDeltas = 0;
+static unsigned long s_syncNsec = 0;
+static unsigned long s_maxSyncNsec = 0;
+static unsigned long s_nFailed = 0;
+static unsigned long s_replayedBatches = 0;
+static unsigned long s_replayedDeltas = 0;
+
+static unsigned long NowNsec (void)
+{
+	struct timespec now;
+	clock_gettime (CLOCK_MONOTONIC, &now);
+	return (unsigned long)now.tv_sec * NSEC_IN_SEC + now.tv_nsec;
+}
+
+static unsigned int Checksum (unsigned int _hash, const void* _bytes, size_t _size)
+{
+	const unsigned char* bytes = _bytes;
+	while (_size--)
+	{
+		_hash = (_hash ^ *bytes++) * FNV_PRIME;
+	}
+	return _hash;
+}
+
+/*************************************** pending batch ***************************************/
+
+static Delta* TableSlot (Delta* _slots, size_t _capacity, const char* _key)
+{
+	size_t i = Checksum (FNV_OFFSET, _key, strlen (_key)) & (_capacity - 1);
+	while ('\0' != _slots[i].m_key[0] && 0 != strcmp (_slots[i].m_key, _key))
+	{
+		i = (i + 1) & (_capacity - 1);
+	}
+	return &_slots[i];
+}
+
+static ADTErr TableInit (DeltaTable* _table, size_t _capacity)
+{
+	if (!(_table->m_slots = calloc (_capacity, sizeof(Delta))))
+	{
+		return ERR_ALLOCATION_FAILED;
+	}
+	_table->m_capacity = _capacity;
+	_table->m_nItems = 0;
+	return ERR_OK;
+}
+
+static ADTErr TableGrow (DeltaTable* _table)
+{
+	Delta* slots;
+	size_t capacity = 2 * _table->m_capacity;
+	size_t i;
+	if (!(slots = calloc (capacity, sizeof(Delta))))
+	{
+		return ERR_REALLOCATION_FAILED;
+	}
+	for (i = 0; i < _table->m_capacity; ++i)
+	{
+		if ('\0' != _table->m_slots[i].m_key[0])
+		{
+			*TableSlot (slots, capacity, _table->m_slots[i].m_key) = _table->m_slots[i];
+		}
+	}
+	free (_table->m_slots);
+	_table->m_slots = slots;
+	_table->m_capacity = capacity;
+	return ERR_OK;
+}
+
+/*NULL - no memory, or a key it cannot keep*/
+static Delta* TableGet (DeltaTable* _table, const char* _key)
+{
+	Delta* delta;
+	if ('\0' == _key[0] || strlen (_key) >= KEY_SIZE)
+	{
+		return NULL;
+	}
+	if (2 * (_table->m_nItems + 1) > _table->m_capacity && ERR_OK != TableGrow (_table))
+	{
+		return NULL;
+	}
+	delta = TableSlot (_table->m_slots, _table->m_capacity, _key);
+	if ('\0' == delta->m_key[0])
+	{
+		strcpy (delta->m_key, _key);
+		++_table->m_nItems;
+	}
+	return delta;
+}
+
+static void TableDestroy (DeltaTable* _table)
+{
+	free (_table->m_slots);
+	_table->m_slots = NULL;
+	_table->m_capacity = 0;
+	_table->m_nItems = 0;
+}
+
+static ADTErr BatchFile (Batch* _batch, unsigned int _fileId, const char* _path, unsigned long _offset)
+{
+	FileDelta* files;
+	size_t i = _batch->m_lastFile;
+	if (i >= _batch->m_nFiles || _fileId != _batch->m_files[i].m_fileId)
+	{
+		for (i = 0; i < _batch->m_nFiles && _fileId != _batch->m_files[i].m_fileId; ++i);
+		if (i == _batch->m_nFiles)
+		{
+			if (i == _batch->m_filesCapacity)
+			{
+				if (!(files = realloc (_batch->m_files, 2 * _batch->m_filesCapacity * sizeof(FileDelta))))
+				{
+					return ERR_REALLOCATION_FAILED;
+				}
+				_batch->m_files = files;
+				_batch->m_filesCapacity *= 2;
+			}
+			_batch->m_files[i].m_fileId = _fileId;
+			_batch->m_files[i].m_path = _path;
+			++_batch->m_nFiles;
+		}
+		_batch->m_lastFile = i;
+	}
+	_batch->m_files[i].m_offset = _offset;
+	return ERR_OK;
+}
+
+static ADTErr BatchInit (Batch* _batch)
+{
+	_batch->m_nFiles = 0;
+	_batch->m_lastFile = 0;
+	_batch->m_filesCapacity = INITIAL_FILES;
+	if (ERR_OK != TableInit (&_batch->m_subscribers, INITIAL_SUBSCRIBERS)
+		|| ERR_OK != TableInit (&_batch->m_operators, INITIAL_OPERATORS)
+		|| !(_batch->m_files = malloc (INITIAL_FILES * sizeof(FileDelta))))
+	{
+		return ERR_ALLOCATION_FAILED;
+	}
+	return ERR_OK;
+}
+
+static int BatchIsEmpty (const Batch* _batch)
+{
+	return 0 == _batch->m_nFiles && 0 == _batch->m_subscribers.m_nItems && 0 == _batch->m_operators.m_nItems;
+}
+
+static void BatchClear (Batch* _batch)
+{
+	memset (_batch->m_subscribers.m_slots, 0, _batch->m_subscribers.m_capacity * sizeof(Delta));
+	memset (_batch->m_operators.m_slots, 0, _batch->m_operators.m_capacity * sizeof(Delta));
+	_batch->m_subscribers.m_nItems = 0;
+	_batch->m_operators.m_nItems = 0;
+	_batch->m_nFiles = 0;
+	_batch->m_lastFile = 0;
+}
+
+static void BatchDestroy (Batch* _batch)
+{
+	TableDestroy (&_batch->m_subscribers);
+	TableDestroy (&_batch->m_operators);
+	free (_batch->m_files);
+	_batch->m_files = NULL;
+}
+
+void DeltaLogAdd (const DBApplied* _applied, const char* _path)
+{
+	Delta* delta;
+	if (!s_isLogging || s_isBroken)
+	{
+		return;
+	}
+	if (!(delta = TableGet (&s_pending->m_subscribers, _applied->m_imsi)))
+	{
+		s_isBroken = 1;
+		LOG_ERROR_PRINT("Delta log: no room for %s, it stops until the next checkpoint\n", _applied->m_imsi);
+		return;
+	}
+	delta->m_incomingDuration += _applied->m_subscriberUsage.m_incomingDuration;
+	delta->m_outgoingDuration += _applied->m_subscriberUsage.m_outgoingDuration;
+	delta->m_messagesReceived += _applied->m_subscriberUsage.m_messagesReceived;
+	delta->m_messagesSent += _applied->m_subscriberUsage.m_messagesSent;
+	delta->m_downloaded += _applied->m_subscriberUsage.m_downloaded;
+	delta->m_uploaded += _applied->m_subscriberUsage.m_uploaded;
+	if (_applied->m_operator)
+	{
+		if (!(delta = TableGet (&s_pending->m_operators, _applied->m_operator)))
+		{
+			s_isBroken = 1;
+			LOG_ERROR_PRINT("Delta log: no room for %s, it stops until the next checkpoint\n", _applied->m_operator);
+			return;
+		}
+		delta->m_incomingDuration += _applied->m_operatorUsage.m_incomingDuration;
+		delta->m_outgoingDuration += _applied->m_operatorUsage.m_outgoingDuration;
+		delta->m_messagesReceived += _applied->m_operatorUsage.m_messagesReceived;
+		delta->m_messagesSent += _applied->m_operatorUsage.m_messagesSent;
+		delta->m_downloaded += _applied->m_operatorUsage.m_downloaded;
+		delta->m_uploaded += _applied->m_operatorUsage.m_uploaded;
+	}
+	if (_path && ERR_OK != BatchFile (s_pending, _applied->m_fileId, _path, _applied->m_offset))
+	{
+		s_isBroken = 1;
+		LOG_ERROR_PRINT("Delta log: no room for %s, it stops until the next checkpoint\n", _path);
+	}
+}
+
+/*************************************** batch on disk ***************************************/
+
+static ADTErr GrowBuffer (size_t _size)
+{
+	unsigned char* buffer;
+	if (_size <= s_bufferSize)
+	{
+		return ERR_OK;
+	}
+	if (!(buffer = realloc (s_buffer, _size)))
+	{
+		return ERR_REALLOCATION_FAILED;
+	}
+	s_buffer = buffer;
+	s_bufferSize = _size;
+	return ERR_OK;
+}
+
+static unsigned char* PutDeltas (unsigned char* _at, const DeltaTable* _table)
+{
+	const Delta* delta;
+	size_t i;
+	for (i = 0; i < _table->m_capacity; ++i)
+	{
+		delta = &_table->m_slots[i];
+		if ('\0' == delta->m_key[0])
+		{
+			continue;
+		}
+		*_at = strlen (delta->m_key);
+		memcpy (_at + 1, delta->m_key, *_at);
+		_at += 1 + *_at;
+		/*the counters follow each other in Delta, ParseBatch reads them one by one*/
+		memcpy (_at, &delta->m_incomingDuration, COUNTERS_SIZE);
+		_at += COUNTERS_SIZE;
+	}
+	return _at;
+}
+
+/*the header and the body in s_buffer, 0 - no memory*/
+static size_t EncodeBatch (const Batch* _batch)
+{
+	BatchHeader header;
+	unsigned char* at;
+	unsigned short pathSize;
+	size_t size = sizeof(header);
+	size_t i;
+	for (i = 0; i < _batch->m_nFiles; ++i)
+	{
+		size += sizeof(pathSize) + strlen (_batch->m_files[i].m_path) + sizeof(unsigned long);
+	}
+	size += (_batch->m_subscribers.m_nItems + _batch->m_operators.m_nItems) * (1 + KEY_SIZE + COUNTERS_SIZE);
+	if (ERR_OK != GrowBuffer (size))
+	{
+		return 0;
+	}
+	at = s_buffer + sizeof(header);
+	for (i = 0; i < _batch->m_nFiles; ++i)
+	{
+		pathSize = strlen (_batch->m_files[i].m_path);
+		memcpy (at, &pathSize, sizeof(pathSize));
+		memcpy (at + sizeof(pathSize), _batch->m_files[i].m_path, pathSize);
+		at += sizeof(pathSize) + pathSize;
+		memcpy (at, &_batch->m_files[i].m_offset, sizeof(unsigned long));
+		at += sizeof(unsigned long);
+	}
+	at = PutDeltas (at, &_batch->m_subscribers);
+	at = PutDeltas (at, &_batch->m_operators);
+	memset (&header, 0, sizeof(header));
+	header.m_magic = BATCH_MAGIC;
+	header.m_sequence = s_sequence;
+	header.m_nFiles = _batch->m_nFiles;
+	header.m_nSubscribers = _batch->m_subscribers.m_nItems;
+	header.m_nOperators = _batch->m_operators.m_nItems;
+	header.m_bodySize = at - s_buffer - sizeof(header);
+	header.m_checksum = Checksum (Checksum (FNV_OFFSET, &header, sizeof(header)), s_buffer + sizeof(header), header.m_bodySize);
+	memcpy (s_buffer, &header, sizeof(header));
+	return at - s_buffer;
+}
+
+static int WriteAll (const unsigned char* _bytes, size_t _size, unsigned long _offset)
+{
+	ssize_t nWritten;
+	while (_size > 0)
+	{
+		if (0 > (nWritten = pwrite (s_fd, _bytes, _size, _offset)))
+		{
+			if (EINTR == errno)
+			{
+				continue;
+			}
+			return -1;
+		}
+		_bytes += nWritten;
+		_offset += nWritten;
+		_size -= nWritten;
+	}
+	return 0;
+}
+
+/*under s_logMutex*/
+static void WriteBatch (Batch* _batch)
+{
+	unsigned long syncStart;
+	size_t size;
+	if (BatchIsEmpty (_batch))
+	{
+		return;
+	}
+	if (s_isBroken)
+	{
+		BatchClear (_batch);
+		return;
+	}
+	if (0 == (size = EncodeBatch (_batch)) || 0 != WriteAll (s_buffer, size, s_logSize))
+	{
+		/*a torn batch would hide the ones after it*/
+		if (0 != size && 0 != ftruncate (s_fd, s_logSize))
+		{
+			LOG_ERROR_PRINT("%s\n", "Cutting the delta log failed");
+		}
+		s_isBroken = 1;
+		++s_nFailed;
+		BatchClear (_batch);
+		LOG_ERROR_PRINT("%s\n", "Writing the delta log failed, it stops until the next checkpoint");
+		return;
+	}
+	syncStart = NowNsec ();
+	if (0 != fdatasync (s_fd))
+	{
+		s_isBroken = 1;
+		++s_nFailed;
+		LOG_ERROR_PRINT("%s\n", "Syncing the delta log failed, it stops until the next checkpoint");
+	}
+	syncStart = NowNsec () - syncStart;
+	s_syncNsec += syncStart;
+	s_maxSyncNsec = syncStart > s_maxSyncNsec ? syncStart : s_maxSyncNsec;
+	s_logSize += size;
+	s_nBytes += size;
+	s_nDeltas += _batch->m_subscribers.m_nItems + _batch->m_operators.m_nItems;
+	++s_nBatches;
+	BatchClear (_batch);
+}
+
+/*under s_logMutex*/
+static void CommitPending (void)
+{
+	Batch* batch;
+	pthread_rwlock_rdlock (s_DBLock);
+	batch = s_pending;
+	s_pending = s_writing;
+	s_writing = batch;
+	pthread_rwlock_unlock (s_DBLock);
+	WriteBatch (s_writing);
+}
+
+/*1 - a whole batch at _at, its body in s_buffer*/
+static int ReadBatch (unsigned long _at, unsigned long _end, BatchHeader* _header)
+{
+	unsigned int checksum;
+	if (_at + sizeof(*_header) > _end || sizeof(*_header) != pread (s_fd, _header, sizeof(*_header), _at)
+		|| BATCH_MAGIC != _header->m_magic || _at + sizeof(*_header) + _header->m_bodySize > _end
+		|| ERR_OK != GrowBuffer (_header->m_bodySize)
+		|| (ssize_t)_header->m_bodySize != pread (s_fd, s_buffer, _header->m_bodySize, _at + sizeof(*_header)))
+	{
+		return 0;
+	}
+	checksum = _header->m_checksum;
+	_header->m_checksum = 0;
+	_header->m_checksum = Checksum (Checksum (FNV_OFFSET, _header, sizeof(*_header)), s_buffer, _header->m_bodySize);
+	return checksum == _header->m_checksum;
+}
+
+static int Get (BodyReader* _reader, void* _value, size_t _size)
+{
+	if (_size > (size_t)(_reader->m_end - _reader->m_at))
+	{
+		return 0;
+	}
+	memcpy (_value, _reader->m_at, _size);
+	_reader->m_at += _size;
+	return 1;
+}
+
+static int GetKey (BodyReader* _reader, char* _key)
+{
+	unsigned char size;
+	if (!Get (_reader, &size, 1) || size >= KEY_SIZE || !Get (_reader, _key, size))
+	{
+		return 0;
+	}
+	_key[size] = '\0';
+	return 1;
+}
+
+/*the callbacks may be NULL*/
+static ADTErr ParseBatch (const BatchHeader* _header, DeltaLogFileFunc _onFile, DeltaLogSubscriberFunc _onSubscriber,
+						  DeltaLogOperatorFunc _onOperator, void* _context)
+{
+	BodyReader reader;
+	SubscriberUsage subUsage;
+	OperatorUsage oprUsage;
+	char path[PATH_SIZE];
+	char key[KEY_SIZE];
+	unsigned short pathSize;
+	unsigned long offset;
+	unsigned int i;
+	ADTErr err;
+	reader.m_at = s_buffer;
+	reader.m_end = s_buffer + _header->m_bodySize;
+	for (i = 0; i < _header->m_nFiles; ++i)
+	{
+		if (!Get (&reader, &pathSize, sizeof(pathSize)) || pathSize >= PATH_SIZE || !Get (&reader, path, pathSize)
+			|| !Get (&reader, &offset, sizeof(offset)))
+		{
+			return ERR_ILLEGAL_INPUT;
+		}
+		path[pathSize] = '\0';
+		if (_onFile)
+		{
+			_onFile (path, offset, _context);
+		}
+	}
+	for (i = 0; i < _header->m_nSubscribers; ++i)
+	{
+		if (!GetKey (&reader, key) || !Get (&reader, &subUsage.m_incomingDuration, sizeof(unsigned int))
+			|| !Get (&reader, &subUsage.m_outgoingDuration, sizeof(unsigned int))
+			|| !Get (&reader, &subUsage.m_messagesReceived, sizeof(unsigned int))
+			|| !Get (&reader, &subUsage.m_messagesSent, sizeof(unsigned int))
+			|| !Get (&reader, &subUsage.m_downloaded, sizeof(double)) || !Get (&reader, &subUsage.m_uploaded, sizeof(double)))
+		{
+			return ERR_ILLEGAL_INPUT;
+		}
+		if (_onSubscriber && ERR_OK != (err = _onSubscriber (key, &subUsage, _context)))
+		{
+			return err;
+		}
+	}
+	for (i = 0; i < _header->m_nOperators; ++i)
+	{
+		if (!GetKey (&reader, key) || !Get (&reader, &oprUsage.m_incomingDuration, sizeof(unsigned int))
+			|| !Get (&reader, &oprUsage.m_outgoingDuration, sizeof(unsigned int))
+			|| !Get (&reader, &oprUsage.m_messagesReceived, sizeof(unsigned int))
+			|| !Get (&reader, &oprUsage.m_messagesSent, sizeof(unsigned int))
+			|| !Get (&reader, &oprUsage.m_downloaded, sizeof(double)) || !Get (&reader, &oprUsage.m_uploaded, sizeof(double)))
+		{
+			return ERR_ILLEGAL_INPUT;
+		}
+		if (_onOperator && ERR_OK != (err = _onOperator (key, &oprUsage, _context)))
+		{
+			return err;
+		}
+	}
+	return ERR_OK;
+}
+
+/*************************************** log ***************************************/
+
+ADTErr DeltaLogInit (const char* _fileName, unsigned long _sequence, unsigned int _periodMs, DeltaLogFileFunc _onFile, void* _context)
+{
+	BatchHeader header;
+	struct stat fileStat;
+	unsigned long at = 0;
+	if (!_fileName)
+	{
+		return ERR_NOT_INITIALIZED;
+	}
+	if (-1 == (s_fd = open (_fileName, O_RDWR | O_CREAT, 0644)) || 0 != fstat (s_fd, &fileStat))
+	{
+		LOG_ERROR_PRINT("Opening delta log %s failed\n", _fileName);
+		return ERR_FILE_OPEN;
+	}
+	s_sequence = _sequence;
+	/*batches of an older checkpoint are left by a crash right after it - they are in it*/
+	while (ReadBatch (at, fileStat.st_size, &header))
+	{
+		if (_sequence == header.m_sequence)
+		{
+			if (ERR_OK != ParseBatch (&header, _onFile, NULL, NULL, _context))
+			{
+				break;
+			}
+			++s_replayedBatches;
+			s_replayedDeltas += header.m_nSubscribers + header.m_nOperators;
+		}
+		at += sizeof(header) + header.m_bodySize;
+	}
+	if (at < (unsigned long)fileStat.st_size)
+	{
+		LOG_WARN_PRINT("Delta log %s: %lu bytes after the last whole batch, cut\n", _fileName, fileStat.st_size - at);
+		if (0 != ftruncate (s_fd, at))
+		{
+			close (s_fd);
+			s_fd = -1;
+			return ERR_FILE_WRITE;
+		}
+	}
+	s_logSize = at;
+	s_replayEnd = at;
+	if (0 != _periodMs)
+	{
+		if (ERR_OK != BatchInit (&s_batches[0]) || ERR_OK != BatchInit (&s_batches[1]))
+		{
+			BatchDestroy (&s_batches[0]);
+			BatchDestroy (&s_batches[1]);
+			close (s_fd);
+			s_fd = -1;
+			return ERR_ALLOCATION_FAILED;
+		}
+		/*the feeder may apply CDRs before the writer starts - their files are in the batches*/
+		s_periodNsec = _periodMs * NSEC_IN_MSEC;
+		s_isLogging = 1;
+	}
+	LOG_DEBUG_PRINT("Delta log %s: %lu batches to replay on checkpoint %lu\n", _fileName, s_replayedBatches, _sequence);
+	return ERR_OK;
+}
+
+ADTErr DeltaLogReplay (DeltaLogSubscriberFunc _onSubscriber, DeltaLogOperatorFunc _onOperator, void* _context)
+{
+	BatchHeader header;
+	unsigned long at = 0;
+	ADTErr err;
+	if (-1 == s_fd)
+	{
+		return ERR_NOT_INITIALIZED;
+	}
+	while (at < s_replayEnd)
+	{
+		if (!ReadBatch (at, s_replayEnd, &header))
+		{
+			return ERR_FILE_OPEN;
+		}
+		if (s_sequence == header.m_sequence && ERR_OK != (err = ParseBatch (&header, NULL, _onSubscriber, _onOperator, _context)))
+		{
+			return err;
+		}
+		at += sizeof(header) + header.m_bodySize;
+	}
+	return ERR_OK;
+}
+
+static void* DeltaLogWriter (void* _unused)
+{
+	struct timespec wakeUp;
+	pthread_mutex_lock (&s_logMutex);
+	clock_gettime (CLOCK_MONOTONIC, &wakeUp);
+	while (!s_stop)
+	{
+		wakeUp.tv_nsec += s_periodNsec % NSEC_IN_SEC;
+		wakeUp.tv_sec += s_periodNsec / NSEC_IN_SEC + wakeUp.tv_nsec / NSEC_IN_SEC;
+		wakeUp.tv_nsec %= NSEC_IN_SEC;
+		while (!s_stop && ETIMEDOUT != pthread_cond_timedwait (&s_logCond, &s_logMutex, &wakeUp));
+		/*a checkpoint is being written*/
+		while (!s_stop && s_isHeld)
+		{
+			pthread_cond_wait (&s_logCond, &s_logMutex);
+		}
+		if (s_stop)
+		{
+			break;
+		}
+		CommitPending ();
+	}
+	pthread_mutex_unlock (&s_logMutex);
+	return NULL;
+}
+
+ADTErr DeltaLogStart (pthread_rwlock_t* _DBLock)
+{
+	pthread_condattr_t condAttr;
+	sigset_t allSignals;
+	sigset_t oldMask;
+	if (-1 == s_fd || !_DBLock)
+	{
+		return ERR_NOT_INITIALIZED;
+	}
+	if (!s_isLogging)
+	{
+		return ERR_OK;
+	}
+	s_DBLock = _DBLock;
+	s_stop = 0;
+	pthread_condattr_init (&condAttr);
+	pthread_condattr_setclock (&condAttr, CLOCK_MONOTONIC);
+	pthread_cond_init (&s_logCond, &condAttr);
+	pthread_condattr_destroy (&condAttr);
+	/*signals go to the threads waiting for them*/
+	sigfillset (&allSignals);
+	pthread_sigmask (SIG_BLOCK, &allSignals, &oldMask);
+	if (0 != pthread_create (&s_writerThread, NULL, DeltaLogWriter, NULL))
+	{
+		pthread_sigmask (SIG_SETMASK, &oldMask, NULL);
+		pthread_cond_destroy (&s_logCond);
+		pthread_rwlock_wrlock (s_DBLock);
+		s_isLogging = 0;
+		pthread_rwlock_unlock (s_DBLock);
+		BatchDestroy (&s_batches[0]);
+		BatchDestroy (&s_batches[1]);
+		LOG_ERROR_PRINT("%s\n", "Creating delta log thread failed");
+		return ERR_THREAD_CANT_CREATE;
+	}
+	pthread_sigmask (SIG_SETMASK, &oldMask, NULL);
+	s_isStarted = 1;
+	LOG_DEBUG_PRINT("Delta log batch every %lu msec\n", s_periodNsec / NSEC_IN_MSEC);
+	return ERR_OK;
+}
+
+void DeltaLogHold (void)
+{
+	pthread_mutex_lock (&s_logMutex);
+	s_isHeld = 1;
+	pthread_mutex_unlock (&s_logMutex);
+}
+
+void DeltaLogCut (void)
+{
+	Batch* batch;
+	if (!s_isLogging)
+	{
+		return;
+	}
+	/*held - the writer's batch is empty*/
+	batch = s_pending;
+	s_pending = s_writing;
+	s_writing = batch;
+	s_isCut = 1;
+}
+
+ADTErr DeltaLogRelease (int _isCheckpointTaken, unsigned long _sequence)
+{
+	ADTErr err = ERR_OK;
+	pthread_mutex_lock (&s_logMutex);
+	if (_isCheckpointTaken)
+	{
+		/*all of it is in the checkpoint*/
+		if (s_isCut)
+		{
+			BatchClear (s_writing);
+		}
+		s_sequence = _sequence;
+		s_isBroken = 0;
+		if (-1 != s_fd && 0 != ftruncate (s_fd, 0))
+		{
+			/*the new batches go after the old ones, a replay skips those*/
+			err = ERR_FILE_WRITE;
+			LOG_WARN_PRINT("%s\n", "Emptying the delta log failed");
+		}
+		else
+		{
+			s_logSize = 0;
+		}
+	}
+	else if (s_isCut)
+	{
+		/*before the ones added since*/
+		WriteBatch (s_writing);
+	}
+	s_isCut = 0;
+	s_isHeld = 0;
+	if (s_isStarted)
+	{
+		pthread_cond_signal (&s_logCond);
+	}
+	pthread_mutex_unlock (&s_logMutex);
+	return err;
+}
+
+void DeltaLogPrintStats (FILE* _file, void* _unused)
+{
+	fprintf (_file, "delta_log_batches %lu\n", s_nBatches);
+	fprintf (_file, "delta_log_bytes %lu\n", s_nBytes);
+	fprintf (_file, "delta_log_deltas %lu\n", s_nDeltas);
+	fprintf (_file, "delta_log_sync_sec %.3f\n", s_syncNsec / 1e9);
+	fprintf (_file, "delta_log_max_sync_sec %.6f\n", s_maxSyncNsec / 1e9);
+	fprintf (_file, "delta_log_failed %lu\n", s_nFailed);
+	fprintf (_file, "delta_log_broken %d\n", s_isBroken);
+	fprintf (_file, "delta_log_replayed_batches %lu\n", s_replayedBatches);
+	fprintf (_file, "delta_log_replayed_deltas %lu\n", s_replayedDeltas);
+}
+
+ADTErr EndDeltaLog (void)
+{
+	ADTErr err = ERR_OK;
+	if (-1 == s_fd)
+	{
+		return ERR_NOT_INITIALIZED;
+	}
+	if (s_isStarted)
+	{
+		pthread_mutex_lock (&s_logMutex);
+		s_stop = 1;
+		pthread_cond_signal (&s_logCond);
+		pthread_mutex_unlock (&s_logMutex);
+		pthread_join (s_writerThread, NULL);
+		pthread_cond_destroy (&s_logCond);
+		pthread_mutex_lock (&s_logMutex);
+		CommitPending ();
+		pthread_mutex_unlock (&s_logMutex);
+		s_isStarted = 0;
+	}
+	if (s_isLogging)
+	{
+		s_isLogging = 0;
+		BatchDestroy (&s_batches[0]);
+		BatchDestroy (&s_batches[1]);
+	}
+	if (0 != close (s_fd))
+	{
+		err = ERR_FILE_CLOSE;
+	}
+	s_fd = -1;
+	free (s_buffer);
+	s_buffer = NULL;
+	s_bufferSize = 0;
+	return err;
+}
@@ -0,0 +1,48 @@
+/*************************************************************************
+Creation Date: 19.10.26
+Last edit: 19.10.26
+Description: Header file for the delta log - a write-ahead log of what the
+			 feeder added since the last checkpoint. The CDRs of a batch are
+			 summed per IMSI and per operator, with how far each file was
+			 read, and the batch is written with one fdatasync.
+			 A batch is tagged with the sequence of the checkpoint it goes on
+			 from; a checkpoint empties the log, and a restart replays only
+			 the batches of the checkpoint it loaded. A torn last batch is cut.
+			 Used by Checkpoint - the checkpoint holds the log while it writes.
+**************************************************************************/
+
+#ifndef __DELTALOG_H__
+#define __DELTALOG_H__
+
+/*the log replays these*/
+typedef void (*DeltaLogFileFunc) (const char* _path, unsigned long _offset, void* _context);
+typedef ADTErr (*DeltaLogSubscriberFunc) (const char* _imsi, const SubscriberUsage* _usage, void* _context);
+typedef ADTErr (*DeltaLogOperatorFunc) (const char* _operator, const OperatorUsage* _usage, void* _context);
+
+/*Opens _fileName and calls _onFile for the files of every batch that goes on from checkpoint _sequence,
+  in the order they were written - before the readers start. From here DeltaLogAdd fills a batch
+  every _periodMs (0 - nothing is logged, the log is only replayed)*/
+ADTErr DeltaLogInit (const char* _fileName, unsigned long _sequence, unsigned int _periodMs, DeltaLogFileFunc _onFile, void* _context);
+
+/*The totals of the same batches, under the DB write lock*/
+ADTErr DeltaLogReplay (DeltaLogSubscriberFunc _onSubscriber, DeltaLogOperatorFunc _onOperator, void* _context);
+
+/*Starts writing the batches, taking _DBLock (read) only to swap the batch being filled*/
+ADTErr DeltaLogStart (pthread_rwlock_t* _DBLock);
+
+/*Under the DB write lock, _path - the file of the CDR, NULL - not tracked*/
+void DeltaLogAdd (const DBApplied* _applied, const char* _path);
+
+/*A checkpoint: Hold (waits for a batch being written), Cut under the DB read lock
+  once the checkpoint has the databases, and Release when it is on disk or failed*/
+void DeltaLogHold (void);
+void DeltaLogCut (void);
+ADTErr DeltaLogRelease (int _isCheckpointTaken, unsigned long _sequence);
+
+/*Writes "delta_log_..." lines*/
+void DeltaLogPrintStats (FILE* _file, void* _unused);
+
+/*After the feeder ended: writes what is left and closes the log*/
+ADTErr EndDeltaLog (void);
+
+#endif /*__DELTALOG_H__*/
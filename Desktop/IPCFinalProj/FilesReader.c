@@ -10,6 +10,10 @@ Description :  FilesReader - open all files from directory and send CDR lines to
 #include <stdio.h>
 #include <fcntl.h> 
 #include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <limits.h> /* ULONG_MAX */
 
 #include "ADTErr.h"
 #include "logger.h"
@@ -19,36 +23,243 @@ Description :  FilesReader - open all files from directory and send CDR lines to
 #include "GStack.h"
 #include "cdr.h"
 #include "parser.h"
+#include "cdrbin.h"
+#include "Decompress.h"
+#include "BlockReader.h"
+#include "ShmRing.h"
+#include "Metrics.h"
 #include "FilesReader.h"
 
 #define CDR_LINE_SIZE 128
-#define PATH_SIZE 64
-#define NUM_OF_THREADS 10
+#define PATH_SIZE READER_PATH_SIZE
+/* no chunk smaller than this - a reader's share of a small directory is not worth splitting */
+#define MIN_CHUNK_SIZE (4UL * 1024 * 1024)
 #define SIZE_STR_ERR 100 
+#define NSEC_IN_SEC 1000000000UL
+#define FNV_OFFSET 2166136261U
+#define FNV_PRIME 16777619U
 
-static pthread_t s_threads[NUM_OF_THREADS];
+static pthread_t s_threads[MAX_READER_THREADS];
+/* the pool - threads above s_target park between files, all under s_poolMutex */
+static pthread_mutex_t s_poolMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t s_poolCond = PTHREAD_COND_INITIALIZER;
+static size_t s_created;
+static size_t s_running;
+static size_t s_target;
+static int s_noMoreFiles;
+static SafeQueue* s_queue;
+static ShmRing* s_ring;
+static size_t s_partition = 0;
+static size_t s_nPartitions = 1;
+static ReadersStats s_stats;
+static ReaderFileStartFunc s_fileStart = NULL;
+static void* s_fileStartContext = NULL;
 static Stack* s_stack;
+
+/* a file, or a chunk of one: the lines (records) that start in [m_start,m_end) */
+typedef struct
+{
+	char			m_path[PATH_SIZE];
+	unsigned long	m_start;
+	unsigned long	m_end;		/* 0 - to the end of the file */
+	unsigned long	m_size;		/* bytes to read - the schedule is by it */
+} FileTask;
+
+typedef struct
+{
+	FileTask**	m_tasks;
+	size_t		m_nTasks;
+	size_t		m_capacity;
+} Tasks;
 static pthread_mutex_t errFileMutex = PTHREAD_MUTEX_INITIALIZER;
 
-static Stack* CreateStackFillFilesName(char* _directoryName,ADTErr* _err);
+ADTErr GetReadersStats(ReadersStats* _stats)
+{
+	if(NULL == _stats)
+	{
+		return ERR_NOT_INITIALIZED;
+	}
+	*_stats = s_stats;
+	return ERR_OK;
+}
+
+static unsigned long NowNsec(clockid_t _clock)
+{
+	struct timespec now;
+
+	clock_gettime(_clock,&now);
+	return (unsigned long)now.tv_sec * NSEC_IN_SEC + now.tv_nsec;
+}
+
+/* adds what one thread counted to the totals */
+static void AddReaderStats(const ReadersStats* _local)
+{
+	__sync_fetch_and_add(&s_stats.m_lines,_local->m_lines);
+	__sync_fetch_and_add(&s_stats.m_badLines,_local->m_badLines);
+	__sync_fetch_and_add(&s_stats.m_otherLines,_local->m_otherLines);
+	__sync_fetch_and_add(&s_stats.m_bytes,_local->m_bytes);
+	__sync_fetch_and_add(&s_stats.m_cpuNsec,NowNsec(CLOCK_THREAD_CPUTIME_ID));
+	__sync_fetch_and_add(&s_stats.m_queueWaitNsec,_local->m_queueWaitNsec);
+}
+
+ADTErr ReadersSetPartition(size_t _partition,size_t _nPartitions)
+{
+	if(0 == _nPartitions || _partition >= _nPartitions)
+	{
+		return ERR_ILLEGAL_INPUT;
+	}
+	s_partition = _partition;
+	s_nPartitions = _nPartitions;
+	return ERR_OK;
+}
+
+ADTErr ReadersSetFileStart(ReaderFileStartFunc _fileStart,void* _context)
+{
+	s_fileStart = _fileStart;
+	s_fileStartContext = _context;
+	return ERR_OK;
+}
+
+/* FNV-1a of the IMSI field, before parsing the line.
+   not the subscriber DB hash - the keys of one partition would crowd its buckets */
+static int IsMyLine(const char* _cdrLine)
+{
+	unsigned int hash = FNV_OFFSET;
+
+	if(1 == s_nPartitions)
+	{
+		return 1;
+	}
+	for(; '\0' != *_cdrLine && '|' != *_cdrLine; ++_cdrLine)
+	{
+		hash = (hash ^ (unsigned char)*_cdrLine) * FNV_PRIME;
+	}
+	return s_partition == hash % s_nPartitions;
+}
+
+/* the IMSI of a binary record is NUL padded */
+static int IsMyRecord(const unsigned char* _record)
+{
+	char imsi[17] = "";
+
+	if(1 == s_nPartitions)
+	{
+		return 1;
+	}
+	memcpy(imsi,_record,16);
+	return IsMyLine(imsi);
+}
+
+static Stack* CreateStackFillFilesName(char* _directoryName,size_t _nThreads,ADTErr* _err);
+static size_t PeekFile(FILE* _fp,unsigned char* _magic);
 static void* FileReader(void* _queue);
 static ADTErr DestroyFileNamesStack(void);
 
+/* a thread per online core */
+static size_t DefaultReaders(void)
+{
+	long nCores = sysconf(_SC_NPROCESSORS_ONLN);
+
+	if(nCores < 1)
+	{
+		nCores = 1;
+	}
+	else if(nCores > MAX_READER_THREADS)
+	{
+		nCores = MAX_READER_THREADS;
+	}
+	return (size_t)nCores;
+}
+
 ADTErr InitReaders(SafeQueue* _queue,char* _path)
+{
+	return InitReadersWithCount(_queue,_path,DefaultReaders());
+}
+
+/* creates threads up to s_target, under s_poolMutex */
+static ADTErr CreateReaders(void)
+{
+	while(s_created < s_target && !s_noMoreFiles)
+	{
+		if(pthread_create(&s_threads[s_created], NULL,FileReader,(void*)s_queue) != 0)
+		{
+			LOG_ERROR_PRINT("Create thread %lu failed",(unsigned long)s_created);
+			return ERR_THREAD_CANT_CREATE;
+		}
+		LOG_DEBUG_PRINT("Thread %lu created",(unsigned long)s_created);
+		++s_created;
+		++s_running;
+	}
+	return ERR_OK;
+}
+
+ADTErr ReadersSetActive(size_t _nThreads)
 {
 	ADTErr err;
-	int i;	
+
+	if(0 == _nThreads || _nThreads > MAX_READER_THREADS)
+	{
+		return ERR_ILLEGAL_INPUT;
+	}
+	pthread_mutex_lock(&s_poolMutex);
+	s_target = _nThreads;
+	err = CreateReaders();
+	pthread_cond_broadcast(&s_poolCond);
+	pthread_mutex_unlock(&s_poolMutex);
+	return err;
+}
+
+size_t ReadersGetActive(void)
+{
+	size_t nThreads;
+
+	pthread_mutex_lock(&s_poolMutex);
+	nThreads = s_noMoreFiles ? 0 : s_target;
+	pthread_mutex_unlock(&s_poolMutex);
+	return nThreads;
+}
+
+static ADTErr StartReaders(SafeQueue* _queue,ShmRing* _ring,char* _path,size_t _nThreads);
+
+ADTErr InitReadersWithCount(SafeQueue* _queue,char* _path,size_t _nThreads)
+{
 	char strErr[SIZE_STR_ERR];
 
 	if(NULL == _queue)
 	{
-		pthread_mutex_destroy(&errFileMutex);
 		GetError(strErr,ERR_NOT_INITIALIZED);
 		LOG_ERROR_PRINT("%s",strErr);
 		return ERR_NOT_INITIALIZED;
 	}
+	return StartReaders(_queue,NULL,_path,_nThreads);
+}
+
+ADTErr InitReadersToRing(ShmRing* _ring,char* _path)
+{
+	char strErr[SIZE_STR_ERR];
+
+	if(NULL == _ring)
+	{
+		GetError(strErr,ERR_NOT_INITIALIZED);
+		LOG_ERROR_PRINT("%s",strErr);
+		return ERR_NOT_INITIALIZED;
+	}
+	return StartReaders(NULL,_ring,_path,DefaultReaders());
+}
+
+static ADTErr StartReaders(SafeQueue* _queue,ShmRing* _ring,char* _path,size_t _nThreads)
+{
+	ADTErr err;
+	char strErr[SIZE_STR_ERR];
+
+	if(0 == _nThreads || _nThreads > MAX_READER_THREADS)
+	{
+		GetError(strErr,ERR_ILLEGAL_INPUT);
+		LOG_ERROR_PRINT("%s",strErr);
+		return ERR_ILLEGAL_INPUT;
+	}
 	/* The function will fill the stack with name files in directory Storage */
-	s_stack = CreateStackFillFilesName(_path,&err);
+	s_stack = CreateStackFillFilesName(_path,_nThreads,&err);
 	if(NULL == s_stack)
 	{
 		pthread_mutex_destroy(&errFileMutex);
@@ -56,37 +267,51 @@ ADTErr InitReaders(SafeQueue* _queue,char* _path)
 		LOG_ERROR_PRINT("%s",strErr);
 		return ERR_ALLOCATION_FAILED;
 	}
-	for(i = 0; i < NUM_OF_THREADS; i++)
+	memset(&s_stats,0,sizeof(s_stats));
+	pthread_mutex_lock(&s_poolMutex);
+	s_queue = _queue;
+	s_ring = _ring;
+	s_created = 0;
+	s_running = 0;
+	s_target = _nThreads;
+	s_noMoreFiles = 0;
+	if(ERR_OK != (err = CreateReaders()) && 0 == s_created)
 	{
-		if(pthread_create(&s_threads[i], NULL,FileReader,(void*)_queue) != 0)
-		{
-			DestroyFileNamesStack();
-			pthread_mutex_destroy(&errFileMutex);
-			LOG_ERROR_PRINT("Create thread %d failed",i);
-			return ERR_THREAD_CANT_CREATE;
-		}
-		LOG_DEBUG_PRINT("Thread %d created",i);
+		pthread_mutex_unlock(&s_poolMutex);
+		DestroyFileNamesStack();
+		pthread_mutex_destroy(&errFileMutex);
+		return err;
 	}
+	pthread_mutex_unlock(&s_poolMutex);
 	return ERR_OK;
 }
 
 ADTErr EndReaders(SafeQueue* _queue)
 {
-	int i;
+	size_t i;
 	ADTErr err;
 	char strErr[SIZE_STR_ERR];	
 
-	if(NULL == _queue)
+	if(NULL == _queue && NULL == s_ring)
 	{
 		GetError(strErr,ERR_NOT_INITIALIZED);
 		LOG_ERROR_PRINT("%s",strErr);
 		return ERR_NOT_INITIALIZED;
 	}
-	for(i = 0; i < NUM_OF_THREADS; i++)
+	/* ReadersSetActive may still add threads until the files run out */
+	for(i = 0; ; i++)
 	{
+		pthread_mutex_lock(&s_poolMutex);
+		if(i == s_created)
+		{
+			s_noMoreFiles = 1;
+			pthread_mutex_unlock(&s_poolMutex);
+			break;
+		}
+		pthread_mutex_unlock(&s_poolMutex);
 		if(pthread_join(s_threads[i], NULL) != 0)
 		{
-			LOG_ERROR_PRINT("Join thread %d failed",i);
+			LOG_ERROR_PRINT("Join thread %lu failed",(unsigned long)i);
 			return ERR_THREAD_CANT_JOIN;
 		}
 	}
@@ -97,7 +322,8 @@ ADTErr EndReaders(SafeQueue* _queue)
 		LOG_ERROR_PRINT("%s",strErr);
 		return err;
 	}
-	if(ERR_OK != (err = SendEndMsg2Queue(_queue)))
+	err = (NULL != s_ring) ? ShmRingEndProducer(s_ring) : SendEndMsg2Queue(_queue);
+	if(ERR_OK != err)
 	{
 		GetError(strErr,err);
 		LOG_ERROR_PRINT("%s",strErr);
@@ -106,15 +332,176 @@ ADTErr EndReaders(SafeQueue* _queue)
 	return ERR_OK;
 }
 
-static Stack* CreateStackFillFilesName(char* _directoryName,ADTErr* _err)
+/* the largest first (LPT) - the stack gives the last pushed first, so ascending here */
+static int CompareTaskSize(const void* _a,const void* _b)
+{
+	const FileTask* a = *(const FileTask* const*)_a;
+	const FileTask* b = *(const FileTask* const*)_b;
+
+	return (a->m_size > b->m_size) - (a->m_size < b->m_size);
+}
+
+static ADTErr AddTask(Tasks* _tasks,const char* _path,unsigned long _start,unsigned long _end,unsigned long _size)
+{
+	FileTask** grown;
+	FileTask* task;
+
+	if(_tasks->m_nTasks == _tasks->m_capacity)
+	{
+		if(NULL == (grown = realloc(_tasks->m_tasks,(2 * _tasks->m_capacity + 16) * sizeof(FileTask*))))
+		{
+			return ERR_REALLOCATION_FAILED;
+		}
+		_tasks->m_tasks = grown;
+		_tasks->m_capacity = 2 * _tasks->m_capacity + 16;
+	}
+	if(NULL == (task = malloc(sizeof(FileTask))))
+	{
+		return ERR_ALLOCATION_FAILED;
+	}
+	strcpy(task->m_path,_path);
+	task->m_start = _start;
+	task->m_end = _end;
+	task->m_size = _size;
+	_tasks->m_tasks[_tasks->m_nTasks++] = task;
+	return ERR_OK;
+}
+
+/* where the chunks of _task may start: text - any byte (a chunk starts at its first whole line),
+   binary - a record. compressed files are read from the start only - 0 */
+static unsigned long ChunkUnit(const FileTask* _task,unsigned long* _dataStart)
+{
+	unsigned char magic[CDRBIN_MAGIC_SIZE];
+	CdrBinOperators* operators;
+	unsigned long unit = 1;
+	size_t nMagic;
+	FILE* fp;
+	ADTErr err;
+
+	*_dataStart = 0;
+	if(NULL == (fp = fopen(_task->m_path,"r")))
+	{
+		return 0;
+	}
+	nMagic = PeekFile(fp,magic);
+	if(CdrBinIsBinary(magic,nMagic))
+	{
+		operators = CdrBinReadHeader(fp,_dataStart,&err);
+		unit = (NULL != operators) ? CDRBIN_RECORD_SIZE : 0;
+		CdrBinDestroyOperators(operators);
+	}
+	else if(COMPRESSED_NONE != DecompressKind(magic,nMagic))
+	{
+		unit = 0;
+	}
+	fclose(fp);
+	return unit;
+}
+
+/* a file larger than _share is read by up to _maxChunks threads at once - a chunk of each.
+   the last chunk goes to the end of the file, whatever it is by then */
+static ADTErr SplitFile(Tasks* _tasks,size_t _index,unsigned long _share,size_t _maxChunks)
+{
+	FileTask* task = _tasks->m_tasks[_index];
+	unsigned long dataStart;
+	unsigned long unit;
+	unsigned long nUnits;
+	unsigned long chunk;
+	unsigned long start;
+	size_t nChunks;
+	ADTErr err;
+
+	if(0 == (unit = ChunkUnit(task,&dataStart)) || task->m_size <= dataStart)
+	{
+		return ERR_OK;
+	}
+	nChunks = (task->m_size + _share - 1) / _share;
+	if(nChunks > _maxChunks)
+	{
+		nChunks = _maxChunks;
+	}
+	nUnits = (task->m_size - dataStart) / unit;
+	chunk = ((nUnits + nChunks - 1) / nChunks) * unit;
+	if(nChunks < 2 || 0 == chunk)
+	{
+		return ERR_OK;
+	}
+	/* the first chunk keeps the task - with a binary file's header */
+	task->m_end = dataStart + chunk;
+	task->m_size = task->m_end;
+	for(start = task->m_end; start < dataStart + nUnits * unit; start += chunk)
+	{
+		if(ERR_OK != (err = AddTask(_tasks,task->m_path,start,(start + chunk < dataStart + nUnits * unit) ? start + chunk : 0,chunk)))
+		{
+			return err;
+		}
+	}
+	return ERR_OK;
+}
+
+/* LPT alone leaves a file larger than a reader's share of all the bytes to one reader at the end -
+   such files are split. not with a file start function: it keeps one offset per file */
+static ADTErr PlanTasks(Tasks* _tasks,size_t _nThreads)
+{
+	unsigned long total = 0;
+	unsigned long largest = 0;
+	unsigned long share;
+	size_t nFiles = _tasks->m_nTasks;
+	size_t i;
+	ADTErr err;
+
+	for(i = 0; i < nFiles; ++i)
+	{
+		total += _tasks->m_tasks[i]->m_size;
+		if(_tasks->m_tasks[i]->m_size > largest)
+		{
+			largest = _tasks->m_tasks[i]->m_size;
+		}
+	}
+	share = total / _nThreads;
+	if(share < MIN_CHUNK_SIZE)
+	{
+		share = MIN_CHUNK_SIZE;
+	}
+	if(NULL == s_fileStart && _nThreads > 1 && largest > share)
+	{
+		for(i = 0; i < nFiles; ++i)
+		{
+			if(_tasks->m_tasks[i]->m_size > share && ERR_OK != (err = SplitFile(_tasks,i,share,_nThreads)))
+			{
+				return err;
+			}
+		}
+	}
+	qsort(_tasks->m_tasks,_tasks->m_nTasks,sizeof(FileTask*),CompareTaskSize);
+	LOG_DEBUG_PRINT("%lu files, %lu bytes, %lu tasks for %lu readers",(unsigned long)nFiles,total,
+					(unsigned long)_tasks->m_nTasks,(unsigned long)_nThreads);
+	return ERR_OK;
+}
+
+static void FreeTasks(Tasks* _tasks,size_t _from)
+{
+	for(; _from < _tasks->m_nTasks; ++_from)
+	{
+		free(_tasks->m_tasks[_from]);
+	}
+	free(_tasks->m_tasks);
+}
+
+/* the files of the directory are stat-ed here, and pushed so that the largest is read first */
+static Stack* CreateStackFillFilesName(char* _directoryName,size_t _nThreads,ADTErr* _err)
 {
 	DIR* directoryP = NULL;
 	struct dirent* dirData = NULL;
+	struct stat fileStat;
 	Stack* stackLocal = NULL;
+	Tasks tasks = {NULL,0,0};
+	FileTask* task;
 	int strSize = 0;
-	char* path = NULL;
+	char path[PATH_SIZE];
 	char strErr[SIZE_STR_ERR];
-	ADTErr error;
+	ADTErr error = ERR_OK;
+	size_t i;
 
 	if(NULL == _directoryName )
 	{
@@ -141,41 +528,48 @@ static Stack* CreateStackFillFilesName(char* _directoryName,ADTErr* _err)
 		LOG_ERROR_PRINT("%s",strErr);
 		return NULL;
 	}
-	while((dirData = readdir(directoryP)) != NULL)
+	while(ERR_OK == error && (dirData = readdir(directoryP)) != NULL)
 	{
 		strSize = strlen(dirData->d_name);
 		/* ignore tmp files */
 		if(dirData->d_name[0] != '.' && dirData->d_name[strSize -1] != '~')
 		{
-			path = malloc(PATH_SIZE);
-			strcpy(path,_directoryName);
-			if(NULL == path)
-			{
-				if(NULL != _err)
-				{	
-					*_err = ERR_ALLOCATION_FAILED;
-				}
-				closedir(directoryP);
-				StackDestroy(stackLocal);
-				LOG_ERROR_PRINT("%s","strcopy to path -faild");
-				return NULL;
-			} 
-			strcat(path,dirData->d_name);
-			if(ERR_OK != (error = StackPush(stackLocal, path)))
+			if(strlen(_directoryName) + strSize >= PATH_SIZE)
 			{
-				StackDestroy(stackLocal);
-				closedir(directoryP);
-				if(NULL != _err)
-				{	
-					*_err = error;
-				}
-				GetError(strErr,error);
-				LOG_ERROR_PRINT("%s",strErr);
-				return NULL;
+				LOG_ERROR_PRINT("%s%s - path too long, not read",_directoryName,dirData->d_name);
+				continue;
 			}
+			strcpy(path,_directoryName);
+			strcat(path,dirData->d_name);
+			error = AddTask(&tasks,path,0,0,(0 == stat(path,&fileStat) && S_ISREG(fileStat.st_mode)) ? (unsigned long)fileStat.st_size : 0);
 		}
 	}
 	closedir(directoryP);
+	if(ERR_OK == error)
+	{
+		error = PlanTasks(&tasks,_nThreads);
+	}
+	for(i = 0; ERR_OK == error && i < tasks.m_nTasks && ERR_OK == (error = StackPush(stackLocal,tasks.m_tasks[i])); ++i)
+	{
+	}
+	if(ERR_OK != error)
+	{
+		/* tasks before i are in the stack */
+		while(ERR_OK == StackPop(stackLocal,(void**)&task))
+		{
+			free(task);
+		}
+		FreeTasks(&tasks,i);
+		StackDestroy(stackLocal);
+		if(NULL != _err)
+		{	
+			*_err = error;
+		}
+		GetError(strErr,error);
+		LOG_ERROR_PRINT("%s",strErr);
+		return NULL;
+	}
+	free(tasks.m_tasks);
 	if(NULL != _err)
 	{
 		*_err = ERR_OK;
@@ -185,7 +579,7 @@ static Stack* CreateStackFillFilesName(char* _directoryName,ADTErr* _err)
 
 static ADTErr DestroyFileNamesStack(void)
 {	
-	char* filePath = NULL;
+	FileTask* task = NULL;
 	char strErr[SIZE_STR_ERR];
 	ADTErr error;
 
@@ -196,55 +590,356 @@ static ADTErr DestroyFileNamesStack(void)
 		return ERR_NOT_INITIALIZED;
 	}
 	/* if stack is not empty, gets and free all the items */
-	while(ERR_OK == (error = StackPop(s_stack,(void**)&filePath)))
+	while(ERR_OK == (error = StackPop(s_stack,(void**)&task)))
 	{
-		free(filePath);
+		free(task);
 	}
 	StackDestroy(s_stack);
 	return ERR_OK;
 }
 
-static void* FileReader(void* _queue)
+/* parks while the pool is above its target, then takes the next file.
+   the first thread to find no files wakes the parked ones so they end too */
+static ADTErr NextFile(FileTask** _task)
+{
+	ADTErr err;
+
+	pthread_mutex_lock(&s_poolMutex);
+	while(s_running > s_target && !s_noMoreFiles)
+	{
+		--s_running;
+		pthread_cond_wait(&s_poolCond,&s_poolMutex);
+		++s_running;
+	}
+	pthread_mutex_unlock(&s_poolMutex);
+	if(ERR_OK != (err = StackPop(s_stack,(void**)_task)))
+	{
+		pthread_mutex_lock(&s_poolMutex);
+		s_noMoreFiles = 1;
+		pthread_cond_broadcast(&s_poolCond);
+		pthread_mutex_unlock(&s_poolMutex);
+	}
+	return err;
+}
+
+/* ring mode - parses into a ring slot, a line that does not parse still takes its slot */
+static ADTErr ParseToRing(char* _cdrLine,ReadersStats* _local)
+{
+	CDR* cdr;
+	ADTErr err;
+	unsigned long pushStart = NowNsec(CLOCK_MONOTONIC);
+
+	if(ERR_OK != (err = ShmRingReserve(s_ring,&cdr)))
+	{
+		return err;
+	}
+	_local->m_queueWaitNsec += NowNsec(CLOCK_MONOTONIC) - pushStart;
+	err = ParseInto(_cdrLine,cdr);
+	ShmRingCommit(s_ring,cdr,ERR_OK == err);
+	return err;
+}
+
+/* where the caller wants _fp read from - a file now shorter than that was replaced, read it all */
+static unsigned long StartFile(FILE* _fp,const char* _filePath,unsigned int* _fileId)
+{
+	struct stat fileStat;
+	unsigned long offset;
+
+	*_fileId = 0;
+	if(NULL == s_fileStart || 0 == (offset = s_fileStart(_filePath,_fileId,s_fileStartContext)))
+	{
+		return 0;
+	}
+	if(0 != fstat(fileno(_fp),&fileStat) || (unsigned long)fileStat.st_size < offset)
+	{
+		LOG_WARN_PRINT("%s is shorter than its last offset %lu, reading it from the start",_filePath,offset);
+		return 0;
+	}
+	if(0 != fseek(_fp,(long)offset,SEEK_SET))
+	{
+		LOG_WARN_PRINT("%s: seek to %lu failed, reading it from the start",_filePath,offset);
+		return 0;
+	}
+	LOG_DEBUG_PRINT("%s goes on from %lu",_filePath,offset);
+	return offset;
+}
+
+/* the first bytes of _fp, which tell its kind - _fp is left at the start */
+static size_t PeekFile(FILE* _fp,unsigned char* _magic)
+{
+	size_t nRead = fread(_magic,1,CDRBIN_MAGIC_SIZE,_fp);
+
+	rewind(_fp);
+	return nRead;
+}
+
+/* a line of a text file, _offset - right after it */
+static void SendLine(char* _cdrLine,unsigned int _fileId,unsigned long _offset,SafeQueue* _queue,ReadersStats* _local)
+{
+	CDR* cdr;
+	FILE* fpFileErr = NULL;
+	unsigned long pushStart;
+	unsigned long metricStart;
+	ADTErr err;
+
+	LOG_DEBUG_PRINT("read line : %s",_cdrLine);
+	++_local->m_lines;
+	_local->m_bytes += strlen(_cdrLine);
+	MetricsAdd(METRIC_LINES_READ,1);
+	MetricsAdd(METRIC_BYTES_READ,strlen(_cdrLine));
+	metricStart = MetricsStart();
+	if(!IsMyLine(_cdrLine))
+	{
+		++_local->m_otherLines;
+		return;
+	}
+	err = (NULL != s_ring) ? ParseToRing(_cdrLine,_local) : Parse(_cdrLine,&cdr);
+	if(ERR_OK != err)
+	{
+		++_local->m_badLines;
+		MetricsAdd(METRIC_LINES_BAD,1);
+		pthread_mutex_lock(&errFileMutex);   /** LOCK **/
+		fpFileErr = fopen("ErrorLines","a");
+		fprintf(fpFileErr,"ERR LINE- IMSI - %s\n",_cdrLine);
+		fclose(fpFileErr);
+		pthread_mutex_unlock(&errFileMutex);  /** UNLOCK **/
+		return;
+	}
+	MetricsRecord(METRIC_PARSE,metricStart);
+	if(NULL != s_ring)
+	{
+		return;
+	}
+	CDRSetSource(cdr,_fileId,_offset);
+	pushStart = NowNsec(CLOCK_MONOTONIC);
+	SendCDR2Queue(cdr,_queue);
+	_local->m_queueWaitNsec += NowNsec(CLOCK_MONOTONIC) - pushStart;
+}
+
+/* a compressed text file, decompressed on this reader thread - offsets are of the decompressed lines,
+   so going on from one decompresses the file up to it */
+static void ReadCompressedFile(FILE* _fp,const char* _filePath,CompressedKind _kind,SafeQueue* _queue,ReadersStats* _local)
 {
-	char* filePath = NULL;
-	SafeQueue* queue = NULL;
 	char cdrLine[CDR_LINE_SIZE];
+	Decompressor* decompressor;
+	unsigned int fileId = 0;
+	unsigned long offset = 0;
+	unsigned long metricStart;
+	ADTErr err;
+
+	if(!DecompressIsBuilt(_kind))
+	{
+		LOG_ERROR_PRINT("%s is %s compressed, this build does not read it",_filePath,(COMPRESSED_GZIP == _kind) ? "gzip" : "zstd");
+		return;
+	}
+	if(NULL == (decompressor = DecompressOpen(_fp,_kind,&err)))
+	{
+		return;
+	}
+	if(NULL != s_fileStart && 0 != (offset = s_fileStart(_filePath,&fileId,s_fileStartContext))
+		&& ERR_OK != DecompressSkip(decompressor,offset))
+	{
+		LOG_WARN_PRINT("%s is shorter than its last offset %lu, reading it from the start",_filePath,offset);
+		DecompressClose(decompressor);
+		rewind(_fp);
+		offset = 0;
+		if(NULL == (decompressor = DecompressOpen(_fp,_kind,&err)))
+		{
+			return;
+		}
+	}
+	if(0 != offset)
+	{
+		LOG_DEBUG_PRINT("%s goes on from %lu",_filePath,offset);
+	}
+	metricStart = MetricsStart();
+	while(DecompressGets(decompressor,cdrLine,CDR_LINE_SIZE))
+	{
+		MetricsRecord(METRIC_READ_LINE,metricStart);
+		offset += strlen(cdrLine);
+		SendLine(cdrLine,fileId,offset,_queue,_local);
+		metricStart = MetricsStart();
+	}
+	if(DecompressIsCorrupt(decompressor))
+	{
+		LOG_ERROR_PRINT("%s is corrupt after %lu bytes, the rest is not read",_filePath,offset);
+	}
+	DecompressClose(decompressor);
+}
+
+/* a binary file - fixed size records, no parsing. an offset is always of a whole record */
+static void ReadBinaryFile(FILE* _fp,const FileTask* _task,BlockReader* _reader,SafeQueue* _queue,ReadersStats* _local)
+{
+	unsigned char record[CDRBIN_RECORD_SIZE];
+	CdrBinOperators* operators;
 	CDR* cdr;
+	const char* _filePath = _task->m_path;
+	unsigned int fileId = 0;
+	unsigned long dataStart;
+	unsigned long offset;
+	unsigned long end = (0 == _task->m_end) ? ULONG_MAX : _task->m_end;
+	unsigned long pushStart;
+	unsigned long metricStart;
+	ADTErr err;
+
+	if(NULL == (operators = CdrBinReadHeader(_fp,&dataStart,&err)))
+	{
+		LOG_ERROR_PRINT("%s: bad binary CDR header",_filePath);
+		return;
+	}
+	/* a chunk starts at a record */
+	offset = (0 == _task->m_start) ? StartFile(_fp,_filePath,&fileId) : _task->m_start;
+	if(offset < dataStart || 0 != (offset - dataStart) % CDRBIN_RECORD_SIZE)
+	{
+		if(0 != offset)
+		{
+			LOG_WARN_PRINT("%s: offset %lu is not of a record, reading it from the start",_filePath,offset);
+		}
+		offset = dataStart;
+	}
+	BlockReaderStart(_reader,fileno(_fp),offset);
+	metricStart = MetricsStart();
+	while(offset < end && BlockReaderRead(_reader,record,CDRBIN_RECORD_SIZE))
+	{
+		MetricsRecord(METRIC_READ_LINE,metricStart);
+		++_local->m_lines;
+		_local->m_bytes += CDRBIN_RECORD_SIZE;
+		offset += CDRBIN_RECORD_SIZE;
+		MetricsAdd(METRIC_LINES_READ,1);
+		MetricsAdd(METRIC_BYTES_READ,CDRBIN_RECORD_SIZE);
+		metricStart = MetricsStart();
+		if(!IsMyRecord(record))
+		{
+			++_local->m_otherLines;
+			continue;
+		}
+		if(NULL != s_ring)
+		{
+			pushStart = NowNsec(CLOCK_MONOTONIC);
+			if(ERR_OK != ShmRingReserve(s_ring,&cdr))
+			{
+				break;
+			}
+			_local->m_queueWaitNsec += NowNsec(CLOCK_MONOTONIC) - pushStart;
+			err = CdrBinDecode(record,operators,cdr);
+			ShmRingCommit(s_ring,cdr,ERR_OK == err);
+		}
+		else if(NULL != (cdr = CDRCreate(&err)) && ERR_OK != (err = CdrBinDecode(record,operators,cdr)))
+		{
+			CDRDestroy(cdr);
+		}
+		if(ERR_OK != err)
+		{
+			++_local->m_badLines;
+			MetricsAdd(METRIC_LINES_BAD,1);
+			LOG_WARN_PRINT("%s: bad record at %lu",_filePath,offset - CDRBIN_RECORD_SIZE);
+			metricStart = MetricsStart();
+			continue;
+		}
+		MetricsRecord(METRIC_PARSE,metricStart);
+		if(NULL != s_ring)
+		{
+			metricStart = MetricsStart();
+			continue;
+		}
+		CDRSetSource(cdr,fileId,offset);
+		pushStart = NowNsec(CLOCK_MONOTONIC);
+		SendCDR2Queue(cdr,_queue);
+		_local->m_queueWaitNsec += NowNsec(CLOCK_MONOTONIC) - pushStart;
+		metricStart = MetricsStart();
+	}
+	if(BlockReaderIsFailed(_reader))
+	{
+		LOG_ERROR_PRINT("%s: read failed after %lu bytes, the rest is not read",_filePath,offset);
+	}
+	CdrBinDestroyOperators(operators);
+}
+
+/* a text file, or a chunk of one - the line that goes over the chunk's start is of the chunk before */
+static void ReadTextFile(FILE* _fp,const FileTask* _task,BlockReader* _reader,SafeQueue* _queue,ReadersStats* _local)
+{
+	char cdrLine[CDR_LINE_SIZE];
+	unsigned int fileId = 0;
+	unsigned long offset;
+	unsigned long end = (0 == _task->m_end) ? ULONG_MAX : _task->m_end;
+	unsigned long metricStart;
+	size_t length;
+	int isLineStart = 1;
+
+	offset = (0 == _task->m_start) ? StartFile(_fp,_task->m_path,&fileId) : _task->m_start - 1;
+	BlockReaderStart(_reader,fileno(_fp),offset);
+	while(0 != _task->m_start && BlockReaderGets(_reader,cdrLine,CDR_LINE_SIZE))
+	{
+		length = strlen(cdrLine);
+		offset += length;
+		if('\n' == cdrLine[length - 1])
+		{
+			break;
+		}
+	}
+	metricStart = MetricsStart();
+	/* a line longer than CDR_LINE_SIZE comes in parts - the chunk that has its start reads all of them */
+	while((offset < end || !isLineStart) && BlockReaderGets(_reader,cdrLine,CDR_LINE_SIZE))
+	{	
+		MetricsRecord(METRIC_READ_LINE,metricStart);
+		length = strlen(cdrLine);
+		offset += length;
+		isLineStart = ('\n' == cdrLine[length - 1]);
+		SendLine(cdrLine,fileId,offset,_queue,_local);
+		metricStart = MetricsStart();
+	}
+	if(BlockReaderIsFailed(_reader))
+	{
+		LOG_ERROR_PRINT("%s: read failed after %lu bytes, the rest is not read",_task->m_path,offset);
+	}
+}
+
+static void* FileReader(void* _queue)
+{
+	FileTask* task = NULL;
+	SafeQueue* queue = ((SafeQueue*)_queue);
+	unsigned char magic[CDRBIN_MAGIC_SIZE];
+	size_t nMagic;
+	CompressedKind kind;
 	FILE* fp = NULL;
-	FILE* fpFileErr = NULL;
-	char strErr[SIZE_STR_ERR];
+	ReadersStats local = {0};
+	BlockReader* reader;
+	ADTErr err;
 
-	if(NULL == _queue)
+	if(NULL == (reader = BlockReaderCreate(&err)))
 	{
-		GetError(strErr,ERR_NOT_INITIALIZED);
-		LOG_ERROR_PRINT("%s",strErr);
-		return NULL;
+		pthread_exit(NULL);
 	}
-	queue = ((SafeQueue*)_queue);
     /* loop - until the stack is empty */
-	while(ERR_OK == StackPop(s_stack,(void**)&filePath))
+	while(ERR_OK == NextFile(&task))
 	{
-		if((fp = fopen(filePath,"r")) == NULL)
+		if((fp = fopen(task->m_path,"r")) == NULL)
 		{
 			LOG_ERROR_PRINT("%s","open file failed");
-			return NULL;
+			free(task);
+			continue;
 		}
-		free(filePath);
-		while(fgets(cdrLine,CDR_LINE_SIZE,fp))
-		{	
-			LOG_DEBUG_PRINT("read line : %s",cdrLine);
-			if(ERR_OK != Parse(cdrLine,&cdr))
-			{
-				pthread_mutex_lock(&errFileMutex);   /** LOCK **/
-				fpFileErr = fopen("ErrorLines","a");
-				fprintf(fpFileErr,"ERR LINE- IMSI - %s\n",cdrLine);
-				fclose(fpFileErr);
-				pthread_mutex_unlock(&errFileMutex);  /** UNLOCK **/
-				continue;
-			}
-			SendCDR2Queue(cdr,queue);
+		if(0 == task->m_start)
+		{
+			MetricsAdd(METRIC_FILES_READ,1);
+		}
+		nMagic = PeekFile(fp,magic);
+		if(CdrBinIsBinary(magic,nMagic))
+		{
+			ReadBinaryFile(fp,task,reader,queue,&local);
+		}
+		else if(COMPRESSED_NONE != (kind = DecompressKind(magic,nMagic)))
+		{
+			ReadCompressedFile(fp,task->m_path,kind,queue,&local);
+		}
+		else
+		{
+			ReadTextFile(fp,task,reader,queue,&local);
 		}
+		free(task);
 		fclose(fp);
 	}
+	BlockReaderDestroy(reader);
+	AddReaderStats(&local);
 	pthread_exit(NULL);
 }
@@ -8,11 +8,60 @@ Description : Files - open all files from directory and send CDR lines to Q
 #ifndef __FILESREADER_H__
 #define __FILESREADER_H__
 
-/* the function create n threads. every thread reads lines from file in directory "Stroage" and send line by line to Q.
+#define MAX_READER_THREADS 64
+/* the longest path of a file the readers read (with the directory), with its '\0' */
+#define READER_PATH_SIZE 256
+
+/* totals of all reader threads since the last InitReaders */
+typedef struct
+{
+	unsigned long	m_lines;			/* including the bad ones */
+	unsigned long	m_badLines;			/* written to ErrorLines */
+	unsigned long	m_otherLines;		/* left to the other partitions */
+	unsigned long	m_bytes;
+	unsigned long	m_cpuNsec;
+	unsigned long	m_queueWaitNsec;	/* in SafeQueuePush - waiting for room */
+} ReadersStats;
+
+/* the function create a thread per online core (up to MAX_READER_THREADS). every thread reads lines from file in directory "Stroage" and send line by line to Q.
    the thread will send lines to Q until we dont have files any more
+   a file that starts with the binary CDR magic (cdrbin.h) is read as records, not parsed,
+   a gzip / zstd file is decompressed by the thread that reads it (Decompress.h)
+   the largest files are taken first, and a text or binary file larger than a thread's share of the directory is read
+   in chunks by several threads (not with ReadersSetFileStart - it keeps one offset per file)
  */
 ADTErr InitReaders(SafeQueue* _queue,char* _path);
 
+/* same as InitReaders with _nThreads (1 - MAX_READER_THREADS) reader threads */
+ADTErr InitReadersWithCount(SafeQueue* _queue,char* _path,size_t _nThreads);
+
+/* reader process - lines are parsed straight into the aggregator's shared memory ring.
+   end with EndReaders(NULL), it ends this producer on the ring */
+ADTErr InitReadersToRing(ShmRing* _ring,char* _path);
+
+/* before InitReaders - read only the lines of IMSIs with hash(IMSI) % _nPartitions == _partition,
+   the rest belong to the other instances. (0, 1) - all lines */
+ADTErr ReadersSetPartition(size_t _partition,size_t _nPartitions);
+
+/* asked for every file a reader opens: returns the offset to start reading it from and
+   the id stamped on its CDRs (CDRSetSource) - with the offset after each one's line.
+   may be called by several readers at once */
+typedef unsigned long (*ReaderFileStartFunc)(const char* _filePath,unsigned int* _fileId,void* _context);
+
+/* before InitReaders - NULL: every file from its start, CDRs of file id 0 */
+ADTErr ReadersSetFileStart(ReaderFileStartFunc _fileStart,void* _context);
+
+/* changes the number of reading threads while they run - new threads are created
+   as needed, extra threads stop after their current file until the number grows again */
+ADTErr ReadersSetActive(size_t _nThreads);
+
+/* the current target, 0 once all files were taken */
+size_t ReadersGetActive(void);
+
+/* _queue is NULL after InitReadersToRing */
 ADTErr EndReaders(SafeQueue* _queue);
 
+/* complete once EndReaders returned */
+ADTErr GetReadersStats(ReadersStats* _stats);
+
 #endif /* __FILESREADER_H__ */
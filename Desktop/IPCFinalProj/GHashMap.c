@@ -293,11 +293,31 @@ size_t HashCountOccupiedBuckets(const HashMap* _map)
 	return _map->m_noBuckets;
 }
 
+size_t HashCountBuckets(const HashMap* _map)
+{
+	if (IS_ILLEGAL_HASH)
+	{
+		return 0;
+	}
+	
+	return _map->m_hashSize;
+}
+
 int HashForEach(HashMap* _map, const HashDoFunc _doFunc, void* _params)
+{
+	if (IS_ILLEGAL_HASH)
+	{
+		return false;
+	}
+	
+	return HashForEachInRange(_map, 0, _map->m_hashSize, _doFunc, _params);
+}
+
+int HashForEachInRange(HashMap* _map, size_t _fromBucket, size_t _toBucket, const HashDoFunc _doFunc, void* _params)
 {
 	ListItr end;
 	ListItr stop;
-	int i = 0;
+	size_t i = 0;
 	ParamAndFunc toSend;
 	
 	if (IS_ILLEGAL_HASH || NULL == _doFunc)
@@ -305,9 +325,14 @@ int HashForEach(HashMap* _map, const HashDoFunc _doFunc, void* _params)
 		return false;
 	}
 	
+	if (_toBucket > _map->m_hashSize)
+	{
+		_toBucket = _map->m_hashSize;
+	}
+	
 	toSend.m_param = _params;
 	toSend.m_func = _doFunc;
-	for (i = 0; i < _map->m_hashSize; ++i)
+	for (i = _fromBucket; i < _toBucket; ++i)
 	{
 		end = ListEnd(_map->m_buckets[i]);
 		stop = ListForEach(ListBegin(_map->m_buckets[i]), end, HashToList, (void*) &toSend);
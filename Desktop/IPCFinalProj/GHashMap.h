@@ -28,9 +28,17 @@ ADTErr   HashRemove(HashMap* _map, const HashKey _key, Data* _data);
 
 size_t   HashCountItems(const HashMap* _map);
 size_t   HashCountOccupiedBuckets(const HashMap* _map);
+size_t   HashCountBuckets(const HashMap* _map);
 
 int      HashForEach(HashMap* _map, const HashDoFunc _doFunc, void* _params);
 
+/*
+ * Same as HashForEach, but only visits buckets [_fromBucket, _toBucket).
+ * _toBucket is clipped to the number of buckets.
+ * Lets several threads walk disjoint parts of the same map.
+ */
+int      HashForEachInRange(HashMap* _map, size_t _fromBucket, size_t _toBucket, const HashDoFunc _doFunc, void* _params);
+
 Data     HashFind(const HashMap* _map, const HashKey _key);
 
 #ifdef _DEBUG
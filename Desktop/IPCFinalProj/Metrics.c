@@ -0,0 +1,400 @@
+/**************************************************************************************************
+	Creation date: 			19.10.26
+	Last modified date: 	19.10.26
+
+	Description: Implementation module for the runtime metrics.
+				 Every thread gets a shard on its first update. A shard has one writer,
+				 so updates are plain (relaxed) stores - the metrics writer may read a
+				 value one update old, never a torn one.
+				 Histograms are log-linear (HDR style): exact below 32 ns, then 32
+				 buckets per power of two - about 3% error, fixed size, no allocation.
+**************************************************************************************************/
+
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h> /*for logger*/
+#include <stdlib.h> /*for calloc*/
+#include <string.h> /*for memset*/
+#include <errno.h> /*for ETIMEDOUT*/
+#include <time.h>
+
+#include "ADTErr.h"
+#include "logger.h"
+#include "logger_pub.h"
+#include "Metrics.h"
+
+#define SUB_BITS 5
+#define SUB_BUCKETS (1 << SUB_BITS)
+/*longer samples are counted as 2^MAX_BITS ns - about 18 minutes*/
+#define MAX_BITS 40
+#define NUM_OF_BUCKETS ((MAX_BITS - SUB_BITS + 1) * SUB_BUCKETS)
+#define MAX_VALUE ((1UL << MAX_BITS) - 1)
+#define NSEC_IN_SEC 1000000000UL
+#define FILE_NAME_LENGTH 128
+#define CACHE_LINE 64
+#define MAX_SOURCES 8
+/*single writer - a relaxed store is enough, and keeps the compiler from tearing it*/
+#define BUMP(_field, _value) __atomic_store_n (&(_field), (_field) + (_value), __ATOMIC_RELAXED)
+#define PEEK(_field) __atomic_load_n (&(_field), __ATOMIC_RELAXED)
+
+typedef struct
+{
+	unsigned long	m_counts[NUM_OF_BUCKETS];
+	unsigned long	m_total;
+	unsigned long	m_sum;
+	unsigned long	m_max;
+}Histogram;
+
+typedef struct MetricsShard MetricsShard;
+struct MetricsShard
+{
+	unsigned long	m_counters[NUM_OF_COUNTERS];
+	Histogram		m_histograms[NUM_OF_HISTOGRAMS];
+	MetricsShard*	m_next;
+} __attribute__((aligned(CACHE_LINE)));
+
+static const char* s_counterNames[NUM_OF_COUNTERS] =
+{
+	"files_read", "lines_read", "bytes_read", "lines_bad", "records_inserted", "records_failed", "exports"
+};
+static const char* s_histogramNames[NUM_OF_HISTOGRAMS] =
+{
+	"read_line_nsec", "parse_nsec", "queue_push_nsec", "queue_pop_nsec", "db_insert_nsec", "export_nsec"
+};
+
+static volatile int s_isOn = 0;
+/*a thread's shard belongs to one MetricsInit - a later one gives it a new shard*/
+static unsigned long s_generation = 0;
+static __thread MetricsShard* s_myShard = NULL;
+static __thread unsigned long s_myGeneration = 0;
+static MetricsShard* s_shards = NULL;
+static size_t s_nShards = 0;
+static pthread_mutex_t s_shardsMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t s_writeMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t s_periodMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t s_periodCond;
+static pthread_t s_writerThread;
+static int s_isWriterRunning = 0;
+static int s_stop = 0;
+static unsigned int s_periodSec = 0;
+static unsigned long s_startNsec = 0;
+static char s_fileName[FILE_NAME_LENGTH];
+static MetricsSourceFunc s_sources[MAX_SOURCES];
+static void* s_sourceContexts[MAX_SOURCES];
+static size_t s_nSources = 0;
+
+static unsigned long NowNsec (void)
+{
+	struct timespec now;
+	clock_gettime (CLOCK_MONOTONIC, &now);
+	return (unsigned long)now.tv_sec * NSEC_IN_SEC + now.tv_nsec;
+}
+
+static size_t BucketOf (unsigned long _value)
+{
+	int msb;
+	if (_value < SUB_BUCKETS)
+	{
+		return _value;
+	}
+	msb = 63 - __builtin_clzl (_value);
+	return (size_t)(msb - SUB_BITS + 1) * SUB_BUCKETS + ((_value >> (msb - SUB_BITS)) & (SUB_BUCKETS - 1));
+}
+
+/*the lowest value of the bucket*/
+static unsigned long BucketValue (size_t _bucket)
+{
+	if (_bucket < SUB_BUCKETS)
+	{
+		return _bucket;
+	}
+	return (unsigned long)(SUB_BUCKETS + _bucket % SUB_BUCKETS) << (_bucket / SUB_BUCKETS - 1);
+}
+
+static MetricsShard* MyShard (void)
+{
+	MetricsShard* shard;
+	if (NULL != s_myShard && s_myGeneration == s_generation)
+	{
+		return s_myShard;
+	}
+	shard = NULL;
+	if (0 != posix_memalign ((void**)&shard, CACHE_LINE, sizeof(MetricsShard)))
+	{
+		return NULL;
+	}
+	memset (shard, 0, sizeof(MetricsShard));
+	pthread_mutex_lock (&s_shardsMutex);
+	shard->m_next = s_shards;
+	s_shards = shard;
+	++s_nShards;
+	s_myGeneration = s_generation;
+	pthread_mutex_unlock (&s_shardsMutex);
+	s_myShard = shard;
+	return shard;
+}
+
+unsigned long MetricsStart (void)
+{
+	return s_isOn ? NowNsec () : 0;
+}
+
+void MetricsAdd (e_metricCounter _counter, unsigned long _value)
+{
+	MetricsShard* shard;
+	if (!s_isOn || _counter >= NUM_OF_COUNTERS || NULL == (shard = MyShard ()))
+	{
+		return;
+	}
+	BUMP (shard->m_counters[_counter], _value);
+}
+
+void MetricsRecord (e_metricHistogram _histogram, unsigned long _start)
+{
+	MetricsShard* shard;
+	Histogram* histogram;
+	unsigned long elapsed;
+	/*a start taken before MetricsInit is 0*/
+	if (!s_isOn || 0 == _start || _histogram >= NUM_OF_HISTOGRAMS || NULL == (shard = MyShard ()))
+	{
+		return;
+	}
+	elapsed = NowNsec () - _start;
+	if (elapsed > MAX_VALUE)
+	{
+		elapsed = MAX_VALUE;
+	}
+	histogram = &shard->m_histograms[_histogram];
+	BUMP (histogram->m_counts[BucketOf (elapsed)], 1);
+	BUMP (histogram->m_total, 1);
+	BUMP (histogram->m_sum, elapsed);
+	if (elapsed > histogram->m_max)
+	{
+		__atomic_store_n (&histogram->m_max, elapsed, __ATOMIC_RELAXED);
+	}
+}
+
+static unsigned long Percentile (const Histogram* _histogram, double _percent)
+{
+	unsigned long rank = (unsigned long)(_histogram->m_total * _percent / 100.0);
+	unsigned long seen = 0;
+	size_t i;
+	for (i = 0; i < NUM_OF_BUCKETS; ++i)
+	{
+		seen += _histogram->m_counts[i];
+		if (seen > rank)
+		{
+			return BucketValue (i);
+		}
+	}
+	return _histogram->m_max;
+}
+
+static void SumHistogram (int _histogram, Histogram* _sum)
+{
+	const MetricsShard* shard;
+	const Histogram* from;
+	unsigned long max;
+	size_t i;
+	memset (_sum, 0, sizeof(Histogram));
+	for (shard = s_shards; NULL != shard; shard = shard->m_next)
+	{
+		from = &shard->m_histograms[_histogram];
+		for (i = 0; i < NUM_OF_BUCKETS; ++i)
+		{
+			_sum->m_counts[i] += PEEK (from->m_counts[i]);
+		}
+		/*from the buckets, so the percentiles always add up*/
+		max = PEEK (from->m_max);
+		_sum->m_sum += PEEK (from->m_sum);
+		if (max > _sum->m_max)
+		{
+			_sum->m_max = max;
+		}
+	}
+	for (i = 0; i < NUM_OF_BUCKETS; ++i)
+	{
+		_sum->m_total += _sum->m_counts[i];
+	}
+}
+
+static void WriteMetrics (FILE* _file)
+{
+	static Histogram sum;
+	const MetricsShard* shard;
+	unsigned long total;
+	int i;
+	fprintf (_file, "# billing metrics - totals since start, rewritten every %u seconds\n", s_periodSec);
+	fprintf (_file, "uptime_sec %.3f\n", (NowNsec () - s_startNsec) / (double)NSEC_IN_SEC);
+	fprintf (_file, "threads %lu\n", (unsigned long)s_nShards);
+	for (i = 0; i < NUM_OF_COUNTERS; ++i)
+	{
+		total = 0;
+		for (shard = s_shards; NULL != shard; shard = shard->m_next)
+		{
+			total += PEEK (shard->m_counters[i]);
+		}
+		fprintf (_file, "counter %s %lu\n", s_counterNames[i], total);
+	}
+	for (i = 0; i < NUM_OF_HISTOGRAMS; ++i)
+	{
+		SumHistogram (i, &sum);
+		fprintf (_file, "histogram %s count=%lu mean=%.1f p50=%lu p90=%lu p99=%lu p99.9=%lu max=%lu\n", s_histogramNames[i],
+				 sum.m_total, sum.m_total ? (double)sum.m_sum / sum.m_total : 0.0, Percentile (&sum, 50.0),
+				 Percentile (&sum, 90.0), Percentile (&sum, 99.0), Percentile (&sum, 99.9), sum.m_max);
+	}
+	for (i = 0; i < (int)s_nSources; ++i)
+	{
+		s_sources[i] (_file, s_sourceContexts[i]);
+	}
+}
+
+ADTErr MetricsAddSource (MetricsSourceFunc _source, void* _context)
+{
+	if (!_source)
+	{
+		return ERR_NOT_INITIALIZED;
+	}
+	pthread_mutex_lock (&s_writeMutex);
+	if (MAX_SOURCES == s_nSources)
+	{
+		pthread_mutex_unlock (&s_writeMutex);
+		LOG_ERROR_PRINT("%s\n", "Too many metrics sources");
+		return ERR_OVERFLOW;
+	}
+	s_sources[s_nSources] = _source;
+	s_sourceContexts[s_nSources] = _context;
+	++s_nSources;
+	pthread_mutex_unlock (&s_writeMutex);
+	return ERR_OK;
+}
+
+ADTErr MetricsWrite (void)
+{
+	char tmpName[FILE_NAME_LENGTH + 4];
+	FILE* file;
+	ADTErr result = ERR_OK;
+	if (!s_isOn)
+	{
+		return ERR_NOT_INITIALIZED;
+	}
+	pthread_mutex_lock (&s_writeMutex);
+	/*readers of the file never see it half written*/
+	snprintf (tmpName, sizeof(tmpName), "%s.tmp", s_fileName);
+	file = fopen (tmpName, "w");
+	if (NULL == file)
+	{
+		LOG_ERROR_PRINT("%s: %s\n", tmpName, strerror(errno));
+		pthread_mutex_unlock (&s_writeMutex);
+		return ERR_FILE_OPEN;
+	}
+	pthread_mutex_lock (&s_shardsMutex);
+	WriteMetrics (file);
+	pthread_mutex_unlock (&s_shardsMutex);
+	if (0 != fclose (file) || 0 != rename (tmpName, s_fileName))
+	{
+		LOG_ERROR_PRINT("%s: %s\n", s_fileName, strerror(errno));
+		result = ERR_FILE_WRITE;
+	}
+	pthread_mutex_unlock (&s_writeMutex);
+	return result;
+}
+
+static void* PeriodicWriter (void* _unused)
+{
+	struct timespec wakeUp;
+	pthread_mutex_lock (&s_periodMutex);
+	clock_gettime (CLOCK_MONOTONIC, &wakeUp);
+	while (!s_stop)
+	{
+		wakeUp.tv_sec += s_periodSec;
+		while (!s_stop && ETIMEDOUT != pthread_cond_timedwait (&s_periodCond, &s_periodMutex, &wakeUp));
+		if (!s_stop)
+		{
+			pthread_mutex_unlock (&s_periodMutex);
+			MetricsWrite ();
+			pthread_mutex_lock (&s_periodMutex);
+		}
+	}
+	pthread_mutex_unlock (&s_periodMutex);
+	return NULL;
+}
+
+ADTErr MetricsInit (const char* _fileName, unsigned int _periodSec)
+{
+	pthread_condattr_t condAttr;
+	sigset_t allSignals;
+	sigset_t oldMask;
+	if (!_fileName || strlen (_fileName) >= FILE_NAME_LENGTH)
+	{
+		LOG_ERROR_PRINT("%s\n", "metrics file name missing or too long");
+		return ERR_ILLEGAL_INPUT;
+	}
+	if (s_isOn)
+	{
+		return ERR_ALREADY_EXISTS;
+	}
+	strcpy (s_fileName, _fileName);
+	s_periodSec = _periodSec;
+	s_startNsec = NowNsec ();
+	++s_generation;
+	s_isOn = 1;
+	if (0 == _periodSec)
+	{
+		return ERR_OK;
+	}
+	pthread_condattr_init (&condAttr);
+	pthread_condattr_setclock (&condAttr, CLOCK_MONOTONIC);
+	pthread_cond_init (&s_periodCond, &condAttr);
+	pthread_condattr_destroy (&condAttr);
+	s_stop = 0;
+	/*signals go to the threads waiting for them*/
+	sigfillset (&allSignals);
+	pthread_sigmask (SIG_BLOCK, &allSignals, &oldMask);
+	s_isWriterRunning = (0 == pthread_create (&s_writerThread, NULL, PeriodicWriter, NULL));
+	pthread_sigmask (SIG_SETMASK, &oldMask, NULL);
+	if (!s_isWriterRunning)
+	{
+		pthread_cond_destroy (&s_periodCond);
+		LOG_ERROR_PRINT("%s\n", "Creating metrics writer thread failed");
+		return ERR_THREAD_CANT_CREATE;
+	}
+	LOG_DEBUG_PRINT("Metrics written to %s every %u seconds\n", s_fileName, _periodSec);
+	return ERR_OK;
+}
+
+ADTErr MetricsDestroy (void)
+{
+	MetricsShard* shard;
+	if (!s_isOn)
+	{
+		return ERR_NOT_INITIALIZED;
+	}
+	if (s_isWriterRunning)
+	{
+		pthread_mutex_lock (&s_periodMutex);
+		s_stop = 1;
+		pthread_cond_signal (&s_periodCond);
+		pthread_mutex_unlock (&s_periodMutex);
+		pthread_join (s_writerThread, NULL);
+		pthread_cond_destroy (&s_periodCond);
+		s_isWriterRunning = 0;
+	}
+	MetricsWrite ();
+	/*threads still updating see it off before the shards go*/
+	s_isOn = 0;
+	__sync_synchronize ();
+	pthread_mutex_lock (&s_shardsMutex);
+	while (NULL != s_shards)
+	{
+		shard = s_shards;
+		s_shards = shard->m_next;
+		free (shard);
+	}
+	s_nShards = 0;
+	pthread_mutex_unlock (&s_shardsMutex);
+	pthread_mutex_lock (&s_writeMutex);
+	s_nSources = 0;
+	pthread_mutex_unlock (&s_writeMutex);
+	return ERR_OK;
+}
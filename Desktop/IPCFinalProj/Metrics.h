@@ -0,0 +1,64 @@
+/*************************************************************************
+Creation Date: 19.10.26
+Last edit: 19.10.26
+Description: Header file for the runtime metrics - counters and latency
+			 histograms of every pipeline stage.
+			 Every thread updates its own copy (no locks, no shared cache lines),
+			 the writer sums them. The metrics file is rewritten every period and
+			 on MetricsWrite - Billing calls it on SIGRTMIN+2.
+			 Before MetricsInit (and in the unit tests) every call does nothing.
+**************************************************************************/
+
+#ifndef __METRICS_H__
+#define __METRICS_H__
+
+typedef enum
+{
+	METRIC_FILES_READ,
+	METRIC_LINES_READ,
+	METRIC_BYTES_READ,
+	METRIC_LINES_BAD,			/*Parse failed - written to ErrorLines*/
+	METRIC_RECORDS_INSERTED,
+	METRIC_RECORDS_FAILED,		/*dropped by the DB feeder*/
+	METRIC_EXPORTS,
+	NUM_OF_COUNTERS
+} e_metricCounter;
+
+/*all in nano seconds*/
+typedef enum
+{
+	METRIC_READ_LINE,			/*fgets*/
+	METRIC_PARSE,
+	METRIC_QUEUE_PUSH,			/*including the wait for room*/
+	METRIC_QUEUE_POP,			/*including the wait for records*/
+	METRIC_DB_INSERT,			/*lock, insert or update both DBs, unlock*/
+	METRIC_EXPORT,				/*one round of billing requests*/
+	NUM_OF_HISTOGRAMS
+} e_metricHistogram;
+
+/*Rewrites _fileName every _periodSec seconds (0 - only on MetricsWrite).
+  Call from main before the pipeline threads start.*/
+ADTErr MetricsInit (const char* _fileName, unsigned int _periodSec);
+
+/*Writes more lines into the metrics file, called on every write*/
+typedef void (*MetricsSourceFunc) (FILE* _file, void* _context);
+
+/*_context must stay valid until MetricsDestroy. Up to 8 sources.*/
+ADTErr MetricsAddSource (MetricsSourceFunc _source, void* _context);
+
+/*Time stamp to pass to MetricsRecord, 0 when metrics are off*/
+unsigned long MetricsStart (void);
+
+void MetricsAdd (e_metricCounter _counter, unsigned long _value);
+
+/*Adds the time since _start (from MetricsStart) to the histogram*/
+void MetricsRecord (e_metricHistogram _histogram, unsigned long _start);
+
+/*Rewrites the metrics file now - totals since MetricsInit*/
+ADTErr MetricsWrite (void);
+
+/*Stops the periodic writer, writes the file a last time and frees everything.
+  Call after the instrumented threads ended.*/
+ADTErr MetricsDestroy (void);
+
+#endif /*__METRICS_H__*/
@@ -29,6 +29,7 @@ struct Operator
 	unsigned int 	m_messagesSent;
 	double			m_downloaded;
 	double 			m_uploaded;
+	unsigned long	m_generation;
 };
 
 Operator* OperatorCreate(CDR* _cdr, ADTErr* _err)
@@ -116,6 +117,45 @@ Operator* OperatorCreate(CDR* _cdr, ADTErr* _err)
 	return operator;
 }
 
+Operator* OperatorCreateFromUsage(const char* _operatorName, const OperatorUsage* _usage, ADTErr* _err)
+{
+	Operator* operator = NULL;
+	char errMsg[ERR_MSG_SIZE];
+	ADTErr err = ERR_OK;
+	
+	if (NULL == _operatorName || NULL == _usage)
+	{
+		err = ERR_NOT_INITIALIZED;
+	}
+	else if (strlen(_operatorName) >= STRING_SIZE)
+	{
+		err = ERR_ILLEGAL_INPUT;
+	}
+	else if (NULL == (operator = (Operator*) calloc(1, sizeof(Operator))))
+	{
+		err = ERR_ALLOCATION_FAILED;
+	}
+	if (NULL != _err)
+	{
+		*_err = err;
+	}
+	if (ERR_OK != err)
+	{
+		GetError(errMsg, err);
+		LOG_ERROR_PRINT("%s", errMsg);
+		return NULL;
+	}
+	
+	strcpy(operator->m_operatorName, _operatorName);
+	operator->m_incomingDuration = _usage->m_incomingDuration;
+	operator->m_outgoingDuration = _usage->m_outgoingDuration;
+	operator->m_messagesReceived = _usage->m_messagesReceived;
+	operator->m_messagesSent = _usage->m_messagesSent;
+	operator->m_downloaded = _usage->m_downloaded;
+	operator->m_uploaded = _usage->m_uploaded;
+	return operator;
+}
+
 void OperatorDestroy(Operator* _operator)
 {
 	if (NULL == _operator)
@@ -190,6 +230,53 @@ ADTErr OperatorGetName(const Operator* _operator, char* _operatorName)
 	return ERR_OK;
 }
 
+ADTErr OperatorGetUsage(const Operator* _operator, OperatorUsage* _usage)
+{
+	char errMsg[ERR_MSG_SIZE];
+	
+	if (NULL == _operator)
+	{
+		GetError(errMsg, ERR_NOT_INITIALIZED);
+		LOG_ERROR_PRINT("%s", errMsg);
+		return ERR_NOT_INITIALIZED;
+	}
+	if (NULL == _usage)
+	{
+		GetError(errMsg, ERR_ILLEGAL_INPUT);
+		LOG_ERROR_PRINT("%s", errMsg);
+		return ERR_ILLEGAL_INPUT;
+	}
+	
+	_usage->m_incomingDuration = _operator->m_incomingDuration;
+	_usage->m_outgoingDuration = _operator->m_outgoingDuration;
+	_usage->m_messagesReceived = _operator->m_messagesReceived;
+	_usage->m_messagesSent = _operator->m_messagesSent;
+	_usage->m_downloaded = _operator->m_downloaded;
+	_usage->m_uploaded = _operator->m_uploaded;
+	return ERR_OK;
+}
+
+void OperatorSetGeneration(Operator* _operator, unsigned long _generation)
+{
+	if (NULL == _operator)
+	{
+		LOG_WARN_PRINT("%s", "Attempted to mark uninitialized operator.");
+		return;
+	}
+	
+	_operator->m_generation = _generation;
+}
+
+unsigned long OperatorGetGeneration(const Operator* _operator)
+{
+	return (NULL == _operator) ? 0 : _operator->m_generation;
+}
+
+size_t OperatorSize(void)
+{
+	return sizeof(Operator);
+}
+
 ADTErr OperatorPrintToFile(const Operator* _operator, const int _fileDescriptor)
 {
 	int nBytes;
@@ -11,8 +11,22 @@
 
 typedef struct Operator Operator;
 
+/* Totals of one operator, as printed in the bills */
+typedef struct
+{
+	unsigned int 	m_incomingDuration;
+	unsigned int 	m_outgoingDuration;
+	unsigned int 	m_messagesReceived;
+	unsigned int 	m_messagesSent;
+	double			m_downloaded;
+	double 			m_uploaded;
+} OperatorUsage;
+
 Operator* 	OperatorCreate(CDR* _cdr, ADTErr* _err);
 
+/* The totals of a saved operator, or of a logged change */
+Operator* 	OperatorCreateFromUsage(const char* _operatorName, const OperatorUsage* _usage, ADTErr* _err);
+
 void 		OperatorDestroy(Operator* _operator);
 
 int			OperatorIsSame(const Operator* _op1, const Operator* _op2);
@@ -21,6 +35,15 @@ ADTErr		OperatorUpdate(Operator* _destination, const Operator* _source);
 
 ADTErr		OperatorGetName(const Operator* _operator, char* _operatorName);
 
+ADTErr		OperatorGetUsage(const Operator* _operator, OperatorUsage* _usage);
+
+/* Generation of the last change, used by the database for delta exports */
+void		OperatorSetGeneration(Operator* _operator, unsigned long _generation);
+unsigned long OperatorGetGeneration(const Operator* _operator);
+
+/* An operator holds no pointers - the database may keep a copy of these many bytes */
+size_t		OperatorSize(void);
+
 ADTErr 		OperatorPrintToFile(const Operator* _operator, const int _fileDescriptor);
 
 #ifdef _DEBUG
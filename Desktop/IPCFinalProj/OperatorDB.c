@@ -21,16 +21,33 @@
 #include "cdr.h"
 #include "Operator.h"
 #include "OperatorDB.h"
+#include "PersistTable.h"
 
 #define NUM_OF_BUCKETS 1000
+#define FILE_CAPACITY 4096 /* to start with, the file doubles when full */
 #define OPERATOR_NAME_SIZE 32
 #define ERR_MSG_SIZE 128
 
 struct OperatorDB
 {
-	HashMap* m_map;
+	HashMap* 		m_map;
+	PersistTable*	m_table;		/* instead of m_map when opened on a file */
+	unsigned long	m_generation;
 };
 
+typedef struct DoParams
+{
+	OperatorDoFunc	m_doFunc;
+	void*			m_params;
+} DoParams;
+
+typedef struct DeltaParams
+{
+	int				m_fileDesc;
+	unsigned long	m_sinceGeneration;
+	size_t			m_nPrinted;
+} DeltaParams;
+
 /* Hash function */
 /*static unsigned int qhashmurmur3_32(HashKey _data, size_t _nbytes)
 {
@@ -134,8 +151,23 @@ static int PrintOperators(HashKey _ignore, Data _data)
 	OperatorPrint((Operator*)_data);
 	return true;
 }
+
+static int PrintStoredOperators(HashKey _ignore, Data _data, void* _ignoreParams)
+{
+	OperatorPrint((Operator*)_data);
+	return true;
+}
 #endif /* _DEBUG */
 
+static int ForEachOperator(const OperatorDB* _odb, const HashDoFunc _doFunc, void* _params)
+{
+	if (NULL != _odb->m_table)
+	{
+		return PTableForEachInRange(_odb->m_table, 0, PTableCountItems(_odb->m_table), _doFunc, _params);
+	}
+	return HashForEach(_odb->m_map, _doFunc, _params);
+}
+
 static int CompareOperators(HashKey _opName1, HashKey _opName2)
 {
 	return ( ! strcmp((char*)_opName1, (char*)_opName2) );
@@ -169,6 +201,8 @@ OperatorDB* OperatorDBCreate(ADTErr* _err)
 		free(odb);
 		return NULL;
 	}
+	odb->m_table = NULL;
+	odb->m_generation = 1;
 	
 	if (NULL != _err)
 	{
@@ -178,6 +212,48 @@ OperatorDB* OperatorDBCreate(ADTErr* _err)
 	return odb;
 }
 
+OperatorDB* OperatorDBOpen(const char* _fileName, ADTErr* _err)
+{
+	ADTErr err;
+	char errMsg[ERR_MSG_SIZE];
+	
+	OperatorDB* odb = malloc(sizeof(OperatorDB));
+	if (NULL == odb)
+	{
+		if (NULL != _err)
+		{
+			*_err = ERR_ALLOCATION_FAILED;
+		}
+		GetError(errMsg, ERR_ALLOCATION_FAILED);
+		LOG_ERROR_PRINT("%s", errMsg);
+		return NULL;
+	}
+	
+	odb->m_table = PTableOpen(_fileName, OperatorSize(), FILE_CAPACITY, &err);
+	if (NULL == odb->m_table)
+	{
+		if (NULL != _err)
+		{
+			*_err = err;
+		}
+		free(odb);
+		return NULL;
+	}
+	odb->m_map = NULL;
+	odb->m_generation = PTableGetUserValue(odb->m_table);
+	if (0 == odb->m_generation)
+	{
+		odb->m_generation = 1;
+	}
+	
+	if (NULL != _err)
+	{
+		*_err = ERR_OK;
+	}
+	LOG_DEBUG_PRINT("Opened operator database %s with %lu operators.", _fileName, (unsigned long)PTableCountItems(odb->m_table));
+	return odb;
+}
+
 void OperatorDBDestroy(OperatorDB* _odb)
 {
 	if (NULL == _odb)
@@ -186,12 +262,43 @@ void OperatorDBDestroy(OperatorDB* _odb)
 		return;
 	}
 	
-	HashForEach(_odb->m_map, FreeOperators, NULL);
-	HashDestroy(_odb->m_map);
+	if (NULL != _odb->m_table)
+	{
+		PTableSetUserValue(_odb->m_table, _odb->m_generation);
+		PTableClose(_odb->m_table);
+	}
+	else
+	{
+		HashForEach(_odb->m_map, FreeOperators, NULL);
+		HashDestroy(_odb->m_map);
+	}
 	free(_odb);
 	LOG_DEBUG_PRINT("%s", "Successfully destroyed operator database");
 }
 
+/* The file keeps a copy, so the operator is freed like the map would own it */
+static ADTErr InsertToTable(OperatorDB* _odb, Operator* _op)
+{
+	ADTErr err;
+	char errMsg[ERR_MSG_SIZE];
+	char operatorName[OPERATOR_NAME_SIZE];
+	void* stored = NULL;
+	
+	OperatorGetName(_op, operatorName);
+	err = PTableInsert(_odb->m_table, operatorName, _op, &stored);
+	if (ERR_OK != err)
+	{
+		GetError(errMsg, err);
+		LOG_WARN_PRINT("%s", errMsg);
+		return err;
+	}
+	
+	OperatorSetGeneration((Operator*)stored, _odb->m_generation);
+	OperatorDestroy(_op);
+	LOG_DEBUG_PRINT("%s", "Successfully inserted to database file.");
+	return ERR_OK;
+}
+
 ADTErr OperatorDBInsert(OperatorDB* _odb, const Operator* _op)
 {
 	ADTErr err;
@@ -211,6 +318,11 @@ ADTErr OperatorDBInsert(OperatorDB* _odb, const Operator* _op)
 		return ERR_ILLEGAL_INPUT;
 	}
 	
+	if (NULL != _odb->m_table)
+	{
+		return InsertToTable(_odb, (Operator*)_op);
+	}
+	
 	operatorName = (char*) malloc(OPERATOR_NAME_SIZE * sizeof(char));
 	if (NULL == operatorName)
 	{
@@ -228,6 +340,8 @@ ADTErr OperatorDBInsert(OperatorDB* _odb, const Operator* _op)
 	}
 	else
 	{
+		/* database owns the operator from now on */
+		OperatorSetGeneration((Operator*)_op, _odb->m_generation);
 		LOG_DEBUG_PRINT("%s", "Successfully inserted to database.");
 	}
 	
@@ -252,7 +366,7 @@ ADTErr OperatorDBGet(const OperatorDB* _odb, const char* _operatorName , Operato
 		return ERR_ILLEGAL_INPUT;
 	}
 	
-	*_op = HashFind(_odb->m_map, (const HashKey)_operatorName);
+	*_op = (NULL != _odb->m_table) ? PTableFind(_odb->m_table, _operatorName) : HashFind(_odb->m_map, (const HashKey)_operatorName);
 	err = (NULL == *_op) ? ERR_NOT_FOUND : ERR_OK;
 	if (ERR_OK != err)
 	{
@@ -284,7 +398,20 @@ ADTErr OperatorDBRemove(OperatorDB* _odb, const char* _operatorName, Operator**
 		return ERR_ILLEGAL_INPUT;
 	}
 	
-	HashRemove(_odb->m_map, (const HashKey)_operatorName, (Data*)_op);
+	if (NULL != _odb->m_table)
+	{
+		/* the caller frees it, as an operator removed from the map */
+		*_op = malloc(OperatorSize());
+		if (NULL != *_op && ERR_OK != PTableRemove(_odb->m_table, _operatorName, *_op))
+		{
+			free(*_op);
+			*_op = NULL;
+		}
+	}
+	else
+	{
+		HashRemove(_odb->m_map, (const HashKey)_operatorName, (Data*)_op);
+	}
 	err = (NULL == *_op) ? ERR_NOT_FOUND : ERR_OK;
 	if (ERR_OK != err)
 	{
@@ -330,7 +457,7 @@ ADTErr OperatorDBPrintToFile(const OperatorDB* _odb, const char* _fileName)
 		return ERR_FILE_OPEN;
 	}
 	
-	if ( ! HashForEach(_odb->m_map, PrintAllToFile, (void*)&fileDesc) )
+	if ( ! ForEachOperator(_odb, PrintAllToFile, (void*)&fileDesc) )
 	{
 		GetError(errMsg, ERR_GENERAL);
 		LOG_ERROR_PRINT("%s", errMsg);
@@ -348,6 +475,138 @@ ADTErr OperatorDBPrintToFile(const OperatorDB* _odb, const char* _fileName)
 	return ERR_OK;
 }
 
+static int DoOnOperator(HashKey _key, Data _operator, void* _doParams)
+{
+	DoParams* doParams = (DoParams*)_doParams;
+	
+	return doParams->m_doFunc((const Operator*)_operator, doParams->m_params);
+}
+
+ADTErr OperatorDBForEach(const OperatorDB* _odb, OperatorDoFunc _doFunc, void* _params)
+{
+	DoParams doParams;
+	char errMsg[ERR_MSG_SIZE];
+	
+	if (NULL == _odb)
+	{
+		GetError(errMsg, ERR_NOT_INITIALIZED);
+		LOG_ERROR_PRINT("%s", errMsg);
+		return ERR_NOT_INITIALIZED;
+	}
+	if (NULL == _doFunc)
+	{
+		GetError(errMsg, ERR_ILLEGAL_INPUT);
+		LOG_ERROR_PRINT("%s", errMsg);
+		return ERR_ILLEGAL_INPUT;
+	}
+	
+	doParams.m_doFunc = _doFunc;
+	doParams.m_params = _params;
+	ForEachOperator(_odb, DoOnOperator, (void*)&doParams);
+	return ERR_OK;
+}
+
+static int PrintDeltaToFile(HashKey _key, Data _operator, void* _params)
+{
+	DeltaParams* params = (DeltaParams*)_params;
+	
+	if (OperatorGetGeneration((Operator*)_operator) > params->m_sinceGeneration)
+	{
+		OperatorPrintToFile((Operator*)_operator, params->m_fileDesc);
+		++params->m_nPrinted;
+	}
+	return true;
+}
+
+ADTErr OperatorDBPrintDeltaToFile(const OperatorDB* _odb, const char* _fileName, unsigned long _sinceGeneration, size_t* _nPrinted)
+{
+	DeltaParams params;
+	char errMsg[ERR_MSG_SIZE];
+	
+	if (NULL == _odb)
+	{
+		GetError(errMsg, ERR_NOT_INITIALIZED);
+		LOG_ERROR_PRINT("%s", errMsg);
+		return ERR_NOT_INITIALIZED;
+	}
+	if (NULL == _fileName)
+	{
+		GetError(errMsg, ERR_ILLEGAL_INPUT);
+		LOG_ERROR_PRINT("%s", errMsg);
+		return ERR_ILLEGAL_INPUT;
+	}
+	
+	params.m_sinceGeneration = _sinceGeneration;
+	params.m_nPrinted = 0;
+	params.m_fileDesc = open(_fileName, O_WRONLY | O_TRUNC | O_CREAT, S_IRUSR | S_IWUSR);
+	if (params.m_fileDesc < 0)
+	{
+		GetError(errMsg, ERR_FILE_OPEN);
+		LOG_ERROR_PRINT("%s", errMsg);
+		return ERR_FILE_OPEN;
+	}
+	
+	if ( ! ForEachOperator(_odb, PrintDeltaToFile, (void*)&params) )
+	{
+		close(params.m_fileDesc);
+		GetError(errMsg, ERR_GENERAL);
+		LOG_ERROR_PRINT("%s", errMsg);
+		return ERR_GENERAL;
+	}
+	
+	if (-1 == close(params.m_fileDesc))
+	{
+		GetError(errMsg, ERR_FILE_CLOSE);
+		LOG_ERROR_PRINT("%s", errMsg);
+		return ERR_FILE_CLOSE;
+	}
+	
+	if (NULL != _nPrinted)
+	{
+		*_nPrinted = params.m_nPrinted;
+	}
+	LOG_DEBUG_PRINT("Successfully wrote delta to file %s.", _fileName);
+	return ERR_OK;
+}
+
+ADTErr OperatorDBMarkDirty(OperatorDB* _odb, Operator* _op)
+{
+	char errMsg[ERR_MSG_SIZE];
+	
+	if (NULL == _odb)
+	{
+		GetError(errMsg, ERR_NOT_INITIALIZED);
+		LOG_ERROR_PRINT("%s", errMsg);
+		return ERR_NOT_INITIALIZED;
+	}
+	if (NULL == _op)
+	{
+		GetError(errMsg, ERR_ILLEGAL_INPUT);
+		LOG_ERROR_PRINT("%s", errMsg);
+		return ERR_ILLEGAL_INPUT;
+	}
+	
+	OperatorSetGeneration(_op, _odb->m_generation);
+	return ERR_OK;
+}
+
+unsigned long OperatorDBCloseGeneration(OperatorDB* _odb)
+{
+	if (NULL == _odb)
+	{
+		LOG_WARN_PRINT("%s", "Attempted to close generation of uninitialized operator database");
+		return 0;
+	}
+	
+	LOG_DEBUG_PRINT("Closed operator generation %lu.", _odb->m_generation);
+	if (NULL != _odb->m_table)
+	{
+		PTableSetUserValue(_odb->m_table, _odb->m_generation + 1);
+		PTableFlush(_odb->m_table);
+	}
+	return _odb->m_generation++;
+}
+
 #ifdef _DEBUG
 void OperatorDBPrint(const OperatorDB* _odb)
 {
@@ -357,6 +616,11 @@ void OperatorDBPrint(const OperatorDB* _odb)
 		return;
 	}
 	
+	if (NULL != _odb->m_table)
+	{
+		PTableForEachInRange(_odb->m_table, 0, PTableCountItems(_odb->m_table), PrintStoredOperators, NULL);
+		return;
+	}
 	HashPrint(_odb->m_map, PrintOperators);
 }
 #endif /* _DEBUG */
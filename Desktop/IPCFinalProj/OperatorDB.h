@@ -13,6 +13,9 @@ typedef struct OperatorDB OperatorDB;
 
 OperatorDB* OperatorDBCreate(ADTErr* _err);
 
+/* Kept in the memory mapped file _fileName - same policy as SubscriberDBOpen */
+OperatorDB* OperatorDBOpen(const char* _fileName, ADTErr* _err);
+
 /* Note: frees all operators still stored */
 void 		OperatorDBDestroy(OperatorDB* _odb);
 
@@ -24,6 +27,24 @@ ADTErr 		OperatorDBRemove(OperatorDB* _odb, const char* _operatorName, Operator*
 
 ADTErr 		OperatorDBPrintToFile(const OperatorDB* _odb, const char* _fileName);
 
+/* Visits every operator (unordered), stops when _doFunc returns 0 */
+typedef int (*OperatorDoFunc)(const Operator* _op, void* _params);
+ADTErr		OperatorDBForEach(const OperatorDB* _odb, OperatorDoFunc _doFunc, void* _params);
+
+/*
+ * Prints (truncating _fileName) only operators changed after generation _sinceGeneration.
+ * Number of printed operators is returned in _nPrinted (may be NULL).
+ */
+ADTErr 		OperatorDBPrintDeltaToFile(const OperatorDB* _odb, const char* _fileName, unsigned long _sinceGeneration, size_t* _nPrinted);
+
+/*
+ * Dirty tracking - same policy as SubscriberDB:
+ * inserts and OperatorDBMarkDirty stamp the current generation,
+ * OperatorDBCloseGeneration returns it and opens a new one.
+ */
+ADTErr		OperatorDBMarkDirty(OperatorDB* _odb, Operator* _op);
+unsigned long OperatorDBCloseGeneration(OperatorDB* _odb);
+
 #ifdef _DEBUG
 void		OperatorDBPrint(const OperatorDB* _odb);
 #endif /* _DEBUG */
@@ -0,0 +1,503 @@
+/**************************************************************************************************
+	Creation date: 			19.10.26
+	Last modified date: 	19.10.26
+
+	Description: Implementation of functions for PERSISTENT TABLE.
+				 File layout: a page of header, m_maxRecords slots of {key, record}, the
+				 first m_nRecords in use, then the index - a power of two of
+				 {record + 1, hash} entries (0 empty, TOMBSTONE removed) probed linearly.
+				 The file is created sparse, so unused slots take no disk space.
+				 An insert writes the slot, then its index entry, then counts it (release
+				 stores, so the compiler keeps that order) - the slots before m_nRecords are
+				 always whole. The index is only derived from them: an open of a file that
+				 was not closed rebuilds it from the slots (the only case an open reads all
+				 of them), whatever a killed process left half done. Removes are not safe
+				 against that - the billing never removes.
+				 A full table doubles: the file grows, is mapped again and the index moves
+				 to its new end and is rebuilt - the records stay where they are.
+				 The index is kept at most half full, removes are rebuilt away when
+				 tombstones take its free entries.
+**************************************************************************************************/
+
+#include <stdio.h> /* snprintf */
+#include <stdlib.h> /* malloc */
+#include <stdint.h> /* uint32_t */
+#include <stdbool.h> /* true/false */
+#include <string.h> /* memcpy, strncmp */
+#include <unistd.h> /* close, ftruncate */
+#include <fcntl.h> /* open */
+#include <sys/mman.h> /* mmap */
+#include <sys/stat.h> /* fstat */
+
+#include "ADTErr.h"
+#include "logger.h"
+#include "logger_pub.h"
+#include "GData.h"
+#include "GHashMap.h"
+#include "PersistTable.h"
+
+#define TABLE_MAGIC 0x50544231U
+#define TABLE_VERSION 2
+#define HEADER_SIZE 4096
+#define MIN_INDEX_SLOTS 16
+#define EMPTY 0
+#define TOMBSTONE 0xFFFFFFFFU
+#define ROUND_UP_8(_size) (((_size) + 7) & ~(size_t)7)
+#define SLOT(_table, _record) ((_table)->m_slots + (size_t)(_record) * (_table)->m_header->m_slotSize)
+#define SLOT_RECORD(_slot) ((_slot) + PTABLE_KEY_SIZE)
+#define ERR_MSG_SIZE 128
+
+typedef struct
+{
+	uint32_t	m_magic;
+	uint32_t	m_version;
+	uint32_t	m_isClean;		/* closed by PTableClose */
+	uint32_t	m_pad;
+	uint64_t	m_recordSize;
+	uint64_t	m_slotSize;
+	uint64_t	m_indexSlots;
+	uint64_t	m_maxRecords;
+	uint64_t	m_nRecords;
+	uint64_t	m_nTombstones;
+	uint64_t	m_userValue;
+} TableHeader;
+
+typedef struct
+{
+	uint32_t	m_record;
+	uint32_t	m_hash;
+} IndexEntry;
+
+struct PersistTable
+{
+	TableHeader*	m_header;
+	IndexEntry*		m_index;
+	char*			m_slots;
+	size_t			m_mapSize;
+	int				m_fileDesc;		/* to grow the file */
+};
+
+/* DJB2 mixed by the murmur3 finalizer - the index masks the low bits */
+static uint32_t HashOf(const char* _key)
+{
+	uint32_t hash = 5381;
+	int c;
+
+	while ((c = (unsigned char)*_key++))
+	{
+		hash = ((hash << 5) + hash) + c;
+	}
+	hash ^= hash >> 16;
+	hash *= 0x85ebca6b;
+	hash ^= hash >> 13;
+	hash *= 0xc2b2ae35;
+	hash ^= hash >> 16;
+	return hash;
+}
+
+static size_t MapSize(size_t _indexSlots, size_t _maxRecords, size_t _slotSize)
+{
+	return HEADER_SIZE + _maxRecords * _slotSize + _indexSlots * sizeof(IndexEntry);
+}
+
+/* at most half full */
+static size_t IndexSlotsFor(size_t _maxRecords)
+{
+	size_t indexSlots = MIN_INDEX_SLOTS;
+
+	while (indexSlots < 2 * _maxRecords)
+	{
+		indexSlots *= 2;
+	}
+	return indexSlots;
+}
+
+static void SetRegions(PersistTable* _table)
+{
+	_table->m_slots = (char*)_table->m_header + HEADER_SIZE;
+	_table->m_index = (IndexEntry*)(_table->m_slots + _table->m_header->m_maxRecords * _table->m_header->m_slotSize);
+}
+
+/* Entry of _key, or the entry an insert of it would take */
+static IndexEntry* Probe(const PersistTable* _table, const char* _key, uint32_t _hash, int* _isFound)
+{
+	size_t mask = _table->m_header->m_indexSlots - 1;
+	size_t i = _hash & mask;
+	IndexEntry* freeEntry = NULL;
+	IndexEntry* entry;
+
+	while (1)
+	{
+		entry = &_table->m_index[i];
+		if (EMPTY == entry->m_record)
+		{
+			*_isFound = false;
+			return (NULL != freeEntry) ? freeEntry : entry;
+		}
+		if (TOMBSTONE == entry->m_record)
+		{
+			freeEntry = (NULL != freeEntry) ? freeEntry : entry;
+		}
+		else if (entry->m_hash == _hash && 0 == strncmp(SLOT(_table, entry->m_record - 1), _key, PTABLE_KEY_SIZE))
+		{
+			*_isFound = true;
+			return entry;
+		}
+		i = (i + 1) & mask;
+	}
+}
+
+static void RebuildIndex(PersistTable* _table)
+{
+	TableHeader* header = _table->m_header;
+	IndexEntry* entry;
+	uint32_t hash;
+	size_t i;
+	int isFound;
+
+	memset(_table->m_index, 0, header->m_indexSlots * sizeof(IndexEntry));
+	header->m_nTombstones = 0;
+	for (i = 0; i < header->m_nRecords; ++i)
+	{
+		hash = HashOf(SLOT(_table, i));
+		entry = Probe(_table, SLOT(_table, i), hash, &isFound);
+		entry->m_hash = hash;
+		entry->m_record = i + 1;
+	}
+	LOG_DEBUG_PRINT("Rebuilt persistent table index of %lu records.", (unsigned long)header->m_nRecords);
+}
+
+/* Twice the slots. A process killed in here leaves a file that was not closed - its open rebuilds the index */
+static ADTErr Grow(PersistTable* _table)
+{
+	size_t maxRecords = 2 * _table->m_header->m_maxRecords;
+	size_t indexSlots = IndexSlotsFor(maxRecords);
+	size_t mapSize;
+	void* map;
+
+	if (maxRecords >= TOMBSTONE / 2)
+	{
+		return ERR_OVERFLOW;
+	}
+	mapSize = MapSize(indexSlots, maxRecords, _table->m_header->m_slotSize);
+	if (-1 == ftruncate(_table->m_fileDesc, mapSize))
+	{
+		return ERR_FILE_WRITE;
+	}
+	/* a new mapping first - the old one stays usable if it fails, the larger file opens with the old layout */
+	map = mmap(NULL, mapSize, PROT_READ | PROT_WRITE, MAP_SHARED, _table->m_fileDesc, 0);
+	if (MAP_FAILED == map)
+	{
+		return ERR_ALLOCATION_FAILED;
+	}
+	munmap(_table->m_header, _table->m_mapSize);
+	_table->m_header = map;
+	_table->m_mapSize = mapSize;
+	_table->m_header->m_indexSlots = indexSlots;
+	_table->m_header->m_maxRecords = maxRecords;
+	SetRegions(_table);
+	RebuildIndex(_table);
+	LOG_DEBUG_PRINT("Persistent table grew to %lu records.", (unsigned long)maxRecords);
+	return ERR_OK;
+}
+
+static ADTErr InitHeader(int _fileDesc, size_t _recordSize, size_t _capacity, TableHeader* _header)
+{
+	size_t indexSlots = IndexSlotsFor(_capacity);
+
+	memset(_header, 0, sizeof(TableHeader));
+	_header->m_magic = TABLE_MAGIC;
+	_header->m_version = TABLE_VERSION;
+	_header->m_recordSize = _recordSize;
+	_header->m_slotSize = ROUND_UP_8(PTABLE_KEY_SIZE + _recordSize);
+	_header->m_indexSlots = indexSlots;
+	_header->m_maxRecords = _capacity;
+
+	if (-1 == ftruncate(_fileDesc, MapSize(indexSlots, _capacity, _header->m_slotSize)))
+	{
+		return ERR_FILE_WRITE;
+	}
+	return ERR_OK;
+}
+
+static ADTErr ReadHeader(int _fileDesc, size_t _recordSize, off_t _fileSize, TableHeader* _header)
+{
+	if ((ssize_t)sizeof(TableHeader) != pread(_fileDesc, _header, sizeof(TableHeader), 0))
+	{
+		return ERR_FILE_OPEN;
+	}
+	/* larger - a process was killed in Grow after the file grew */
+	if (TABLE_MAGIC != _header->m_magic || TABLE_VERSION != _header->m_version || _recordSize != _header->m_recordSize
+		|| _fileSize < (off_t)MapSize(_header->m_indexSlots, _header->m_maxRecords, _header->m_slotSize))
+	{
+		return ERR_ILLEGAL_INPUT;
+	}
+	return ERR_OK;
+}
+
+static PersistTable* OpenFailed(const char* _fileName, int _fileDesc, ADTErr _err, ADTErr* _errOut)
+{
+	char errMsg[ERR_MSG_SIZE];
+
+	if (_fileDesc >= 0)
+	{
+		close(_fileDesc);
+	}
+	if (NULL != _errOut)
+	{
+		*_errOut = _err;
+	}
+	GetError(errMsg, _err);
+	LOG_ERROR_PRINT("%s %s", errMsg, (NULL != _fileName) ? _fileName : "");
+	return NULL;
+}
+
+PersistTable* PTableOpen(const char* _fileName, size_t _recordSize, size_t _capacity, ADTErr* _err)
+{
+	PersistTable* table = NULL;
+	TableHeader header;
+	struct stat fileStat;
+	int fileDesc;
+	ADTErr err;
+
+	if (NULL == _fileName || 0 == _recordSize || 0 == _capacity || _capacity >= TOMBSTONE / 2)
+	{
+		return OpenFailed(_fileName, -1, ERR_ILLEGAL_INPUT, _err);
+	}
+
+	fileDesc = open(_fileName, O_RDWR | O_CREAT, S_IRUSR | S_IWUSR);
+	if (fileDesc < 0 || -1 == fstat(fileDesc, &fileStat))
+	{
+		return OpenFailed(_fileName, fileDesc, ERR_FILE_OPEN, _err);
+	}
+	err = (0 == fileStat.st_size) ? InitHeader(fileDesc, _recordSize, _capacity, &header)
+								   : ReadHeader(fileDesc, _recordSize, fileStat.st_size, &header);
+	if (ERR_OK != err)
+	{
+		return OpenFailed(_fileName, fileDesc, err, _err);
+	}
+
+	table = malloc(sizeof(PersistTable));
+	if (NULL == table)
+	{
+		return OpenFailed(_fileName, fileDesc, ERR_ALLOCATION_FAILED, _err);
+	}
+	table->m_mapSize = MapSize(header.m_indexSlots, header.m_maxRecords, header.m_slotSize);
+	table->m_header = mmap(NULL, table->m_mapSize, PROT_READ | PROT_WRITE, MAP_SHARED, fileDesc, 0);
+	if (MAP_FAILED == table->m_header)
+	{
+		free(table);
+		return OpenFailed(_fileName, fileDesc, ERR_ALLOCATION_FAILED, _err);
+	}
+	table->m_fileDesc = fileDesc;
+
+	if (0 == fileStat.st_size)
+	{
+		*table->m_header = header;
+	}
+	SetRegions(table);
+	if (0 != fileStat.st_size && ! table->m_header->m_isClean)
+	{
+		LOG_WARN_PRINT("Persistent table %s was not closed, rebuilding its index.", _fileName);
+		RebuildIndex(table);
+	}
+	table->m_header->m_isClean = false;
+
+	if (NULL != _err)
+	{
+		*_err = ERR_OK;
+	}
+	LOG_DEBUG_PRINT("Opened persistent table %s of %lu records.", _fileName, (unsigned long)table->m_header->m_nRecords);
+	return table;
+}
+
+void PTableClose(PersistTable* _table)
+{
+	if (NULL == _table)
+	{
+		LOG_WARN_PRINT("%s", "Attempted to close uninitialized persistent table");
+		return;
+	}
+
+	/* clean only once everything before it is on the disk */
+	msync(_table->m_header, _table->m_mapSize, MS_SYNC);
+	_table->m_header->m_isClean = true;
+	msync(_table->m_header, HEADER_SIZE, MS_SYNC);
+	munmap(_table->m_header, _table->m_mapSize);
+	close(_table->m_fileDesc);
+	free(_table);
+	LOG_DEBUG_PRINT("%s", "Successfully closed persistent table");
+}
+
+ADTErr PTableInsert(PersistTable* _table, const char* _key, const void* _record, void** _stored)
+{
+	TableHeader* header;
+	IndexEntry* entry;
+	char* slot;
+	char errMsg[ERR_MSG_SIZE];
+	uint32_t hash;
+	int isFound;
+	ADTErr err;
+
+	if (NULL == _table)
+	{
+		return ERR_NOT_INITIALIZED;
+	}
+	if (NULL == _key || NULL == _record || strlen(_key) >= PTABLE_KEY_SIZE)
+	{
+		return ERR_ILLEGAL_INPUT;
+	}
+
+	hash = HashOf(_key);
+	entry = Probe(_table, _key, hash, &isFound);
+	if (isFound)
+	{
+		return ERR_ALREADY_EXISTS;
+	}
+	header = _table->m_header;
+	if (header->m_nRecords == header->m_maxRecords || 2 * (header->m_nRecords + header->m_nTombstones) >= header->m_indexSlots)
+	{
+		if (header->m_nRecords == header->m_maxRecords && ERR_OK != (err = Grow(_table)))
+		{
+			GetError(errMsg, err);
+			LOG_ERROR_PRINT("%s - persistent table of %lu records is full", errMsg, (unsigned long)header->m_nRecords);
+			return err;
+		}
+		header = _table->m_header;
+		if (2 * (header->m_nRecords + header->m_nTombstones) >= header->m_indexSlots)
+		{
+			RebuildIndex(_table);
+		}
+		entry = Probe(_table, _key, hash, &isFound);
+	}
+
+	slot = SLOT(_table, header->m_nRecords);
+	memset(slot, 0, PTABLE_KEY_SIZE);
+	strcpy(slot, _key);
+	memcpy(SLOT_RECORD(slot), _record, header->m_recordSize);
+	if (TOMBSTONE == entry->m_record)
+	{
+		--header->m_nTombstones;
+	}
+	entry->m_hash = hash;
+	__atomic_store_n(&entry->m_record, (uint32_t)(header->m_nRecords + 1), __ATOMIC_RELEASE);
+	__atomic_store_n(&header->m_nRecords, header->m_nRecords + 1, __ATOMIC_RELEASE);
+
+	if (NULL != _stored)
+	{
+		*_stored = SLOT_RECORD(slot);
+	}
+	return ERR_OK;
+}
+
+void* PTableFind(const PersistTable* _table, const char* _key)
+{
+	IndexEntry* entry;
+	int isFound;
+
+	if (NULL == _table || NULL == _key)
+	{
+		return NULL;
+	}
+
+	entry = Probe(_table, _key, HashOf(_key), &isFound);
+	return isFound ? SLOT_RECORD(SLOT(_table, entry->m_record - 1)) : NULL;
+}
+
+/* The last slot moves into the hole, so the records stay dense */
+ADTErr PTableRemove(PersistTable* _table, const char* _key, void* _record)
+{
+	TableHeader* header;
+	IndexEntry* entry;
+	IndexEntry* lastEntry;
+	char* slot;
+	char* lastSlot;
+	int isFound;
+
+	if (NULL == _table)
+	{
+		return ERR_NOT_INITIALIZED;
+	}
+	if (NULL == _key)
+	{
+		return ERR_ILLEGAL_INPUT;
+	}
+
+	header = _table->m_header;
+	entry = Probe(_table, _key, HashOf(_key), &isFound);
+	if ( ! isFound )
+	{
+		return ERR_NOT_FOUND;
+	}
+
+	slot = SLOT(_table, entry->m_record - 1);
+	if (NULL != _record)
+	{
+		memcpy(_record, SLOT_RECORD(slot), header->m_recordSize);
+	}
+	lastSlot = SLOT(_table, header->m_nRecords - 1);
+	if (slot != lastSlot)
+	{
+		lastEntry = Probe(_table, lastSlot, HashOf(lastSlot), &isFound);
+		memcpy(slot, lastSlot, header->m_slotSize);
+		lastEntry->m_record = entry->m_record;
+	}
+	entry->m_record = TOMBSTONE;
+	++header->m_nTombstones;
+	--header->m_nRecords;
+	return ERR_OK;
+}
+
+size_t PTableCountItems(const PersistTable* _table)
+{
+	return (NULL == _table) ? 0 : _table->m_header->m_nRecords;
+}
+
+int PTableForEachInRange(PersistTable* _table, size_t _from, size_t _to, const HashDoFunc _doFunc, void* _params)
+{
+	char* slot;
+	size_t i;
+
+	if (NULL == _table || NULL == _doFunc)
+	{
+		return false;
+	}
+
+	if (_to > _table->m_header->m_nRecords)
+	{
+		_to = _table->m_header->m_nRecords;
+	}
+
+	for (i = _from; i < _to; ++i)
+	{
+		slot = SLOT(_table, i);
+		if ( ! _doFunc((HashKey)slot, (Data)SLOT_RECORD(slot), _params) )
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+unsigned long PTableGetUserValue(const PersistTable* _table)
+{
+	return (NULL == _table) ? 0 : _table->m_header->m_userValue;
+}
+
+void PTableSetUserValue(PersistTable* _table, unsigned long _value)
+{
+	if (NULL != _table)
+	{
+		_table->m_header->m_userValue = _value;
+	}
+}
+
+ADTErr PTableFlush(PersistTable* _table)
+{
+	if (NULL == _table)
+	{
+		return ERR_NOT_INITIALIZED;
+	}
+
+	return (0 == msync(_table->m_header, _table->m_mapSize, MS_ASYNC)) ? ERR_OK : ERR_FILE_WRITE;
+}
@@ -0,0 +1,58 @@
+/**************************************************************************************************
+	Creation date: 			19.10.26
+	Last modified date: 	19.10.26
+
+	Description: Header file for PERSISTENT TABLE - a hash table of fixed size records that
+				 lives in a memory mapped file. The ADT policy:
+				 1) Container of plain records (no pointers inside), keys up to 31 chars.
+				 2) Insert/Find/Remove by key, records are changed in place.
+				 3) Opening an existing file maps it and goes on - no load, no rehash,
+				    the same time for any number of records.
+				 Records are stored densely in insert order before an on-disk open addressing
+				 index, so pages are touched only as records are added. A full table doubles.
+				 Pointers returned by PTableFind/PTableInsert stay valid until the next
+				 PTableInsert (it may grow the table and map it elsewhere), PTableRemove or PTableClose.
+**************************************************************************************************/
+
+#ifndef __PERSIST_TABLE_H__
+#define __PERSIST_TABLE_H__
+
+#define PTABLE_KEY_SIZE 32
+
+typedef struct PersistTable PersistTable;
+
+/*
+ * Maps _fileName, creating it for _capacity records of _recordSize bytes if it does not exist.
+ * An existing file keeps its own capacity, its record size must be _recordSize.
+ * A file that was not closed has its index rebuilt from the records.
+ */
+PersistTable* 	PTableOpen(const char* _fileName, size_t _recordSize, size_t _capacity, ADTErr* _err);
+
+/* Writes the mapping back to the file and unmaps it */
+void			PTableClose(PersistTable* _table);
+
+/* Copies _record into the table, the stored copy is returned in _stored (may be NULL) */
+ADTErr			PTableInsert(PersistTable* _table, const char* _key, const void* _record, void** _stored);
+
+/* The stored record or NULL */
+void*			PTableFind(const PersistTable* _table, const char* _key);
+
+/* Copies the record out to _record (may be NULL) and removes it */
+ADTErr			PTableRemove(PersistTable* _table, const char* _key, void* _record);
+
+size_t			PTableCountItems(const PersistTable* _table);
+
+/*
+ * Visits records [_from, _to) in insert order (_to is clipped to the number of records),
+ * _doFunc gets the key and the stored record. Stops when _doFunc returns 0.
+ */
+int				PTableForEachInRange(PersistTable* _table, size_t _from, size_t _to, const HashDoFunc _doFunc, void* _params);
+
+/* A value kept in the file header for the table's owner (e.g. a generation counter) */
+unsigned long	PTableGetUserValue(const PersistTable* _table);
+void			PTableSetUserValue(PersistTable* _table, unsigned long _value);
+
+/* Starts writing changed pages back to the file without waiting for it */
+ADTErr			PTableFlush(PersistTable* _table);
+
+#endif /* __PERSIST_TABLE_H__ */
@@ -0,0 +1,260 @@
+/**************************************************************************************************
+	Creation date: 			19.10.26
+	Last modified date: 	19.10.26
+
+	Description: Load generator for the billing query server.
+				 Every client thread keeps one request in flight (closed loop) and
+				 times each round trip. Prints the latency percentiles and throughput.
+
+	Usage: QueryLoad [-s socket] [-c clients] [-n requests per client] [-o] [-f keys file] [key ...]
+				 -f	one key per line, anything after the first '|' is ignored -
+					so a CDR file from Storage can be used as is
+				 -o	keys are operator names (GET-OP)
+**************************************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#define DEFAULT_SOCKET_PATH "./billing.sock"
+#define DEFAULT_CLIENTS 4
+#define DEFAULT_REQUESTS 10000
+#define MAX_CLIENTS 32
+#define MAX_KEYS 100000
+#define KEY_LENGTH 64
+#define LINE_LENGTH 256
+#define NSEC_IN_SEC 1000000000L
+
+typedef struct
+{
+	int				m_id;
+	const char*		m_socketPath;
+	const char*		m_request;
+	char**			m_keys;
+	size_t			m_nKeys;
+	size_t			m_nRequests;
+	long*			m_latencies;	/*nano seconds, one per request*/
+	size_t			m_nFound;
+	size_t			m_nErrors;
+}LoadClient;
+
+static long NowNsec (void)
+{
+	struct timespec now;
+	clock_gettime (CLOCK_MONOTONIC, &now);
+	return now.tv_sec * NSEC_IN_SEC + now.tv_nsec;
+}
+
+static int Connect (const char* _socketPath)
+{
+	struct sockaddr_un addr;
+	int fd = socket (AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0)
+	{
+		return -1;
+	}
+	memset (&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strncpy (addr.sun_path, _socketPath, sizeof(addr.sun_path) - 1);
+	if (0 != connect (fd, (struct sockaddr*)&addr, sizeof(addr)))
+	{
+		close (fd);
+		return -1;
+	}
+	return fd;
+}
+
+/*reads until a whole reply line arrived*/
+static int ReadReply (int _fd, char* _reply, size_t _size)
+{
+	size_t length = 0;
+	ssize_t nRead;
+	while (length + 1 < _size)
+	{
+		nRead = read (_fd, _reply + length, _size - 1 - length);
+		if (nRead <= 0)
+		{
+			return -1;
+		}
+		length += (size_t)nRead;
+		if ('\n' == _reply[length - 1])
+		{
+			_reply[length] = '\0';
+			return 0;
+		}
+	}
+	return -1;
+}
+
+static void* RunClient (void* _client)
+{
+	LoadClient* client = _client;
+	char request[LINE_LENGTH];
+	char reply[LINE_LENGTH];
+	size_t i;
+	int length;
+	long start;
+	int fd = Connect (client->m_socketPath);
+	if (fd < 0)
+	{
+		fprintf (stderr, "client %d: connect %s: %s\n", client->m_id, client->m_socketPath, strerror(errno));
+		client->m_nErrors = client->m_nRequests;
+		return NULL;
+	}
+	for (i = 0; i < client->m_nRequests; ++i)
+	{
+		length = snprintf (request, LINE_LENGTH, "%s %s\n", client->m_request, client->m_keys[(i * MAX_CLIENTS + client->m_id) % client->m_nKeys]);
+		start = NowNsec ();
+		if (length != write (fd, request, length) || 0 != ReadReply (fd, reply, LINE_LENGTH))
+		{
+			fprintf (stderr, "client %d: connection lost after %lu requests\n", client->m_id, (unsigned long)i);
+			client->m_nErrors += client->m_nRequests - i;
+			client->m_nRequests = i;
+			break;
+		}
+		client->m_latencies[i] = NowNsec () - start;
+		if (0 == strncmp (reply, "OK ", 3))
+		{
+			++client->m_nFound;
+		}
+		else if (0 != strncmp (reply, "NOTFOUND ", 9))
+		{
+			++client->m_nErrors;
+		}
+	}
+	close (fd);
+	return NULL;
+}
+
+static int CompareLong (const void* _a, const void* _b)
+{
+	long a = *(const long*)_a;
+	long b = *(const long*)_b;
+	return (a > b) - (a < b);
+}
+
+static size_t ReadKeys (const char* _fileName, char** _keys, size_t _nKeys)
+{
+	char line[LINE_LENGTH];
+	FILE* file = fopen (_fileName, "r");
+	if (!file)
+	{
+		fprintf (stderr, "%s: %s\n", _fileName, strerror(errno));
+		return _nKeys;
+	}
+	while (_nKeys < MAX_KEYS && fgets (line, LINE_LENGTH, file))
+	{
+		line[strcspn (line, "|\r\n")] = '\0';
+		if ('\0' != line[0])
+		{
+			_keys[_nKeys++] = strdup (line);
+		}
+	}
+	fclose (file);
+	return _nKeys;
+}
+
+static double Percentile (const long* _sorted, size_t _n, double _p)
+{
+	size_t index = (size_t)(_p / 100.0 * (double)(_n - 1) + 0.5);
+	return _sorted[index] / 1000.0;
+}
+
+int main (int argc, char* argv[])
+{
+	LoadClient clients[MAX_CLIENTS];
+	pthread_t threads[MAX_CLIENTS];
+	static char* keys[MAX_KEYS];
+	const char* socketPath = DEFAULT_SOCKET_PATH;
+	const char* request = "GET";
+	size_t nClients = DEFAULT_CLIENTS;
+	size_t nRequests = DEFAULT_REQUESTS;
+	size_t nKeys = 0;
+	size_t total = 0;
+	size_t found = 0;
+	size_t errors = 0;
+	size_t i;
+	long* all;
+	long start;
+	double seconds;
+	int opt;
+	while (-1 != (opt = getopt (argc, argv, "s:c:n:f:o")))
+	{
+		switch (opt)
+		{
+			case 's': socketPath = optarg; break;
+			case 'c': nClients = strtoul (optarg, NULL, 10); break;
+			case 'n': nRequests = strtoul (optarg, NULL, 10); break;
+			case 'f': nKeys = ReadKeys (optarg, keys, nKeys); break;
+			case 'o': request = "GET-OP"; break;
+			default:
+				fprintf (stderr, "Usage: %s [-s socket] [-c clients] [-n requests] [-o] [-f keys file] [key ...]\n", argv[0]);
+				return 1;
+		}
+	}
+	for (; optind < argc && nKeys < MAX_KEYS; ++optind)
+	{
+		keys[nKeys++] = argv[optind];
+	}
+	if (0 == nKeys || 0 == nClients || nClients > MAX_CLIENTS || 0 == nRequests)
+	{
+		fprintf (stderr, "need at least one key, 1-%d clients and some requests\n", MAX_CLIENTS);
+		return 1;
+	}
+	all = malloc (nClients * nRequests * sizeof(long));
+	if (!all)
+	{
+		fprintf (stderr, "%s\n", "allocation failed");
+		return 1;
+	}
+	start = NowNsec ();
+	for (i = 0; i < nClients; ++i)
+	{
+		memset (&clients[i], 0, sizeof(LoadClient));
+		clients[i].m_id = (int)i;
+		clients[i].m_socketPath = socketPath;
+		clients[i].m_request = request;
+		clients[i].m_keys = keys;
+		clients[i].m_nKeys = nKeys;
+		clients[i].m_nRequests = nRequests;
+		clients[i].m_latencies = all + i * nRequests;
+		if (0 != pthread_create (&threads[i], NULL, RunClient, &clients[i]))
+		{
+			fprintf (stderr, "%s\n", "pthread_create failed");
+			return 1;
+		}
+	}
+	for (i = 0; i < nClients; ++i)
+	{
+		pthread_join (threads[i], NULL);
+	}
+	seconds = (NowNsec () - start) / (double)NSEC_IN_SEC;
+	/*compact the answered requests of every client to the front*/
+	for (i = 0; i < nClients; ++i)
+	{
+		memmove (all + total, clients[i].m_latencies, clients[i].m_nRequests * sizeof(long));
+		total += clients[i].m_nRequests;
+		found += clients[i].m_nFound;
+		errors += clients[i].m_nErrors;
+	}
+	if (0 == total)
+	{
+		fprintf (stderr, "%s\n", "no request answered");
+		free (all);
+		return 1;
+	}
+	qsort (all, total, sizeof(long), CompareLong);
+	printf ("requests %lu found %lu errors %lu clients %lu\n", (unsigned long)total, (unsigned long)found, (unsigned long)errors, (unsigned long)nClients);
+	printf ("throughput %.0f req/s\n", total / seconds);
+	printf ("latency us p50 %.1f p90 %.1f p99 %.1f p99.9 %.1f max %.1f\n", Percentile (all, total, 50), Percentile (all, total, 90),
+			Percentile (all, total, 99), Percentile (all, total, 99.9), all[total - 1] / 1000.0);
+	free (all);
+	return (errors ? 2 : 0);
+}
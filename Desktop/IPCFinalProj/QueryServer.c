@@ -0,0 +1,407 @@
+/**************************************************************************************************
+	Creation date: 			19.10.26
+	Last modified date: 	19.10.26
+
+	Description: Implementation module for Query Server functions.
+				 A single thread polls the listening unix socket, a stop eventfd and
+				 up to MAX_CLIENTS connections. Every request is one hash lookup under
+				 a DB read lock - held only to copy the totals out, and shared with
+				 exports and checkpoints, so a lookup waits only for the feeder's insert.
+**************************************************************************************************/
+
+#include <pthread.h>
+#include <string.h> /*for logger*/
+#include <errno.h> /*for logger*/
+#include <stdio.h> /*for logger*/
+#include <stdint.h> /*for uint64_t*/
+#include <unistd.h> /*for read, write, close, unlink*/
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/eventfd.h>
+
+#include "ADTErr.h"
+#include "GData.h"
+#include "logger.h"
+#include "logger_pub.h"
+#include "safeQueue.h"
+#include "cdr.h"
+#include "Operator.h"
+#include "Subscriber.h"
+#include "OperatorDB.h"
+#include "SubscriberDB.h"
+#include "DataManager.h"
+#include "QueryServer.h"
+
+#define MAX_CLIENTS 32
+#define LISTEN_BACKLOG 16
+/*slots in the poll array before the clients*/
+#define STOP_FD 0
+#define LISTEN_FD 1
+#define NUM_OF_CTRL_FDS 2
+#define IN_BUF_SIZE 4096
+#define OUT_BUF_SIZE 8192
+#define SOCKET_PATH_LENGTH 108
+#define ERR_STR_LENGTH 100
+#define REQ_GET_SUB "GET "
+#define REQ_GET_OPR "GET-OP "
+
+typedef struct
+{
+	int		m_fd;
+	size_t	m_inLength;
+	char	m_in[IN_BUF_SIZE];
+}Client;
+
+typedef struct
+{
+	pthread_rwlock_t* m_DBLock;
+	SubscriberDB* 	m_subDB;
+	OperatorDB*		m_oprDB;
+	Client			m_clients[MAX_CLIENTS];
+}QueryServer;
+
+static pthread_t s_queryThread;
+static int s_listenFd = -1;
+static int s_stopFd = -1;
+static char s_socketPath[SOCKET_PATH_LENGTH];
+static QueryServer s_server;
+
+static ADTErr PrepParams (DBManagerParams* _mngParams, QueryServer* _server)
+{
+	ADTErr errorCheck;
+	char errorStr[ERR_STR_LENGTH];
+	if (ERR_OK != (errorCheck = GetDBLock (_mngParams, &_server->m_DBLock))
+		|| ERR_OK != (errorCheck = GetSubscriberDB (_mngParams, &_server->m_subDB))
+		|| ERR_OK != (errorCheck = GetOperatorDB (_mngParams, &_server->m_oprDB)))
+	{
+		GetError (errorStr, errorCheck);
+		LOG_ERROR_PRINT("%s\n", errorStr);
+		return ERR_DATA_PREP_FAILED;
+	}
+	return ERR_OK;
+}
+
+static int SetNonBlocking (int _fd)
+{
+	int flags = fcntl (_fd, F_GETFL, 0);
+	return (flags < 0) ? -1 : fcntl (_fd, F_SETFL, flags | O_NONBLOCK);
+}
+
+/*copies the totals under the DB read lock, formats after unlocking*/
+static int AnswerSubscriber (QueryServer* _server, const char* _imsi, char* _reply, size_t _size)
+{
+	Subscriber* sub;
+	SubscriberUsage usage;
+	ADTErr err;
+	pthread_rwlock_rdlock (_server->m_DBLock);
+	err = SubscriberDBGet (_server->m_subDB, _imsi, &sub);
+	if (ERR_OK == err)
+	{
+		err = SubscriberGetUsage (sub, &usage);
+	}
+	pthread_rwlock_unlock (_server->m_DBLock);
+	if (ERR_NOT_FOUND == err)
+	{
+		return snprintf (_reply, _size, "NOTFOUND %s\n", _imsi);
+	}
+	if (ERR_OK != err)
+	{
+		return snprintf (_reply, _size, "ERR lookup failed %s\n", _imsi);
+	}
+	return snprintf (_reply, _size, "OK %s %u %u %u %u %g %g\n", _imsi, usage.m_incomingDuration, usage.m_outgoingDuration,
+					usage.m_messagesReceived, usage.m_messagesSent, usage.m_downloaded, usage.m_uploaded);
+}
+
+static int AnswerOperator (QueryServer* _server, const char* _name, char* _reply, size_t _size)
+{
+	Operator* opr;
+	OperatorUsage usage;
+	ADTErr err;
+	pthread_rwlock_rdlock (_server->m_DBLock);
+	err = OperatorDBGet (_server->m_oprDB, _name, &opr);
+	if (ERR_OK == err)
+	{
+		err = OperatorGetUsage (opr, &usage);
+	}
+	pthread_rwlock_unlock (_server->m_DBLock);
+	if (ERR_NOT_FOUND == err)
+	{
+		return snprintf (_reply, _size, "NOTFOUND %s\n", _name);
+	}
+	if (ERR_OK != err)
+	{
+		return snprintf (_reply, _size, "ERR lookup failed %s\n", _name);
+	}
+	return snprintf (_reply, _size, "OK %s %u %u %u %u %g %g\n", _name, usage.m_incomingDuration, usage.m_outgoingDuration,
+					usage.m_messagesReceived, usage.m_messagesSent, usage.m_downloaded, usage.m_uploaded);
+}
+
+static int Answer (QueryServer* _server, char* _line, char* _reply, size_t _size)
+{
+	size_t length = strlen (_line);
+	if (length && '\r' == _line[length - 1])
+	{
+		_line[--length] = '\0';
+	}
+	if (length >= QUERY_MAX_LINE)
+	{
+		return snprintf (_reply, _size, "ERR line too long\n");
+	}
+	if (0 == strncmp (_line, REQ_GET_OPR, sizeof(REQ_GET_OPR) - 1))
+	{
+		return AnswerOperator (_server, _line + sizeof(REQ_GET_OPR) - 1, _reply, _size);
+	}
+	if (0 == strncmp (_line, REQ_GET_SUB, sizeof(REQ_GET_SUB) - 1))
+	{
+		return AnswerSubscriber (_server, _line + sizeof(REQ_GET_SUB) - 1, _reply, _size);
+	}
+	return snprintf (_reply, _size, "ERR unknown request\n");
+}
+
+static int WriteAll (int _fd, const char* _buffer, size_t _length)
+{
+	ssize_t written;
+	while (_length)
+	{
+		written = send (_fd, _buffer, _length, MSG_NOSIGNAL);
+		if (written < 0)
+		{
+			if (EINTR == errno)
+			{
+				continue;
+			}
+			return -1;
+		}
+		_buffer += written;
+		_length -= (size_t)written;
+	}
+	return 0;
+}
+
+static void CloseClient (Client* _client)
+{
+	close (_client->m_fd);
+	_client->m_fd = -1;
+	_client->m_inLength = 0;
+}
+
+/*answers every complete line in one write - a pipelining client gets its replies batched.
+  a client that stops reading its replies fills the socket and is dropped.
+  returns 0 when the client should be dropped*/
+static int ServeClient (QueryServer* _server, Client* _client)
+{
+	char out[OUT_BUF_SIZE];
+	size_t outLength = 0;
+	ssize_t nRead;
+	char* line;
+	char* newLine;
+	int replyLength;
+	nRead = read (_client->m_fd, _client->m_in + _client->m_inLength, IN_BUF_SIZE - 1 - _client->m_inLength);
+	if (nRead <= 0)
+	{
+		return (nRead < 0 && (EAGAIN == errno || EINTR == errno));
+	}
+	_client->m_inLength += (size_t)nRead;
+	_client->m_in[_client->m_inLength] = '\0';
+	line = _client->m_in;
+	while (NULL != (newLine = strchr (line, '\n')))
+	{
+		*newLine = '\0';
+		if (outLength + QUERY_MAX_LINE * 2 > OUT_BUF_SIZE)
+		{
+			if (0 != WriteAll (_client->m_fd, out, outLength))
+			{
+				return 0;
+			}
+			outLength = 0;
+		}
+		replyLength = Answer (_server, line, out + outLength, OUT_BUF_SIZE - outLength);
+		if (replyLength > 0)
+		{
+			outLength += ((size_t)replyLength < OUT_BUF_SIZE - outLength) ? (size_t)replyLength : OUT_BUF_SIZE - outLength - 1;
+		}
+		line = newLine + 1;
+	}
+	if (outLength && 0 != WriteAll (_client->m_fd, out, outLength))
+	{
+		return 0;
+	}
+	/*keep the partial line for the next read*/
+	_client->m_inLength -= (size_t)(line - _client->m_in);
+	memmove (_client->m_in, line, _client->m_inLength);
+	if (IN_BUF_SIZE - 1 == _client->m_inLength)
+	{
+		LOG_WARN_PRINT("%s\n", "Query client sent a line with no end, dropping it");
+		return 0;
+	}
+	return 1;
+}
+
+static void AcceptClients (QueryServer* _server)
+{
+	int fd;
+	size_t i;
+	while ((fd = accept (s_listenFd, NULL, NULL)) >= 0)
+	{
+		for (i = 0; i < MAX_CLIENTS && _server->m_clients[i].m_fd >= 0; ++i);
+		if (MAX_CLIENTS == i || 0 != SetNonBlocking (fd))
+		{
+			LOG_WARN_PRINT("%s\n", "Query client refused");
+			close (fd);
+			continue;
+		}
+		_server->m_clients[i].m_fd = fd;
+		_server->m_clients[i].m_inLength = 0;
+		LOG_DEBUG_PRINT("Query client %lu connected\n", (unsigned long)i);
+	}
+}
+
+static void* ServeQueries (void* _server)
+{
+	QueryServer* server = _server;
+	struct pollfd fds[NUM_OF_CTRL_FDS + MAX_CLIENTS];
+	Client* owners[MAX_CLIENTS];
+	size_t nFds;
+	size_t i;
+	LOG_DEBUG_PRINT("%s\n", "Query thread started");
+	fds[STOP_FD].fd = s_stopFd;
+	fds[LISTEN_FD].fd = s_listenFd;
+	while (1)
+	{
+		fds[STOP_FD].events = fds[LISTEN_FD].events = POLLIN;
+		nFds = NUM_OF_CTRL_FDS;
+		for (i = 0; i < MAX_CLIENTS; ++i)
+		{
+			if (server->m_clients[i].m_fd >= 0)
+			{
+				owners[nFds - NUM_OF_CTRL_FDS] = &server->m_clients[i];
+				fds[nFds].fd = server->m_clients[i].m_fd;
+				fds[nFds].events = POLLIN;
+				++nFds;
+			}
+		}
+		if (poll (fds, nFds, -1) < 0)
+		{
+			if (EINTR == errno)
+			{
+				continue;
+			}
+			LOG_ERROR_PRINT("poll: %s\n", strerror(errno));
+			break;
+		}
+		if (fds[STOP_FD].revents & POLLIN)
+		{
+			LOG_DEBUG_PRINT("%s\n", "Query thread stop request");
+			break;
+		}
+		for (i = NUM_OF_CTRL_FDS; i < nFds; ++i)
+		{
+			if (fds[i].revents && !ServeClient (server, owners[i - NUM_OF_CTRL_FDS]))
+			{
+				CloseClient (owners[i - NUM_OF_CTRL_FDS]);
+			}
+		}
+		if (fds[LISTEN_FD].revents & POLLIN)
+		{
+			AcceptClients (server);
+		}
+	}
+	for (i = 0; i < MAX_CLIENTS; ++i)
+	{
+		if (server->m_clients[i].m_fd >= 0)
+		{
+			CloseClient (&server->m_clients[i]);
+		}
+	}
+	LOG_DEBUG_PRINT("%s\n", "Query thread finished");
+	return NULL;
+}
+
+static void CloseFds (void)
+{
+	if (s_listenFd >= 0)
+	{
+		close (s_listenFd);
+		s_listenFd = -1;
+		unlink (s_socketPath);
+	}
+	if (s_stopFd >= 0)
+	{
+		close (s_stopFd);
+		s_stopFd = -1;
+	}
+}
+
+ADTErr QueryServerInit (DBManagerParams* _mngParams, const char* _socketPath)
+{
+	struct sockaddr_un addr;
+	size_t i;
+	LOG_DEBUG_PRINT("%s\n", "QueryServerInit function started");
+	if (!_mngParams)
+	{
+		LOG_ERROR_PRINT("%s\n", "mngParams not initialized");
+		return ERR_NOT_INITIALIZED;
+	}
+	if (!_socketPath || strlen (_socketPath) >= sizeof(addr.sun_path))
+	{
+		LOG_ERROR_PRINT("%s\n", "Bad query socket path");
+		return ERR_ILLEGAL_INPUT;
+	}
+	if (ERR_OK != PrepParams (_mngParams, &s_server))
+	{
+		return ERR_DATA_PREP_FAILED;
+	}
+	for (i = 0; i < MAX_CLIENTS; ++i)
+	{
+		s_server.m_clients[i].m_fd = -1;
+		s_server.m_clients[i].m_inLength = 0;
+	}
+	memset (&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy (addr.sun_path, _socketPath);
+	strcpy (s_socketPath, _socketPath);
+	/*a socket left by a previous run would fail the bind*/
+	unlink (_socketPath);
+	s_stopFd = eventfd (0, EFD_NONBLOCK | EFD_CLOEXEC);
+	s_listenFd = socket (AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (s_stopFd < 0 || s_listenFd < 0
+		|| 0 != bind (s_listenFd, (struct sockaddr*)&addr, sizeof(addr))
+		|| 0 != listen (s_listenFd, LISTEN_BACKLOG))
+	{
+		LOG_ERROR_PRINT("query socket: %s\n", strerror(errno));
+		CloseFds ();
+		return ERR_GENERAL;
+	}
+	if (0 != pthread_create (&s_queryThread, NULL, ServeQueries, &s_server))
+	{
+		CloseFds ();
+		LOG_ERROR_PRINT("%s\n", "Creating queryThread failed");
+		return ERR_THREAD_CANT_CREATE;
+	}
+	LOG_DEBUG_PRINT("Query server listening on %s\n", _socketPath);
+	return ERR_OK;
+}
+
+ADTErr EndQueryServer (void)
+{
+	uint64_t one = 1;
+	if (s_stopFd < 0)
+	{
+		LOG_ERROR_PRINT("%s\n", "Query server not initialized");
+		return ERR_NOT_INITIALIZED;
+	}
+	if (sizeof(one) != write (s_stopFd, &one, sizeof(one)))
+	{
+		LOG_ERROR_PRINT("eventfd write: %s\n", strerror(errno));
+	}
+	if (0 != pthread_join (s_queryThread, NULL))
+	{
+		LOG_ERROR_PRINT("%s\n", "Joining queryThread failed");
+		return ERR_THREAD_CANT_JOIN;
+	}
+	CloseFds ();
+	LOG_DEBUG_PRINT("%s\n", "Query server is done");
+	return ERR_OK;
+}
@@ -0,0 +1,26 @@
+/*************************************************************************
+Creation Date: 19.10.26
+Last edit: 19.10.26
+Description: Header file for Query Server functions declarations.
+			 Answers single subscriber/operator lookups over a unix
+			 domain socket while the databases are being fed.
+			 Line protocol, one request per line:
+					GET <imsi>			- subscriber totals
+					GET-OP <operator>	- operator totals
+			 Replies, one line each:
+					OK <key> <in dur> <out dur> <msg rcv> <msg sent> <down MB> <up MB>
+					NOTFOUND <key>
+					ERR <reason>
+**************************************************************************/
+
+#ifndef __QUERYSERVER_H__
+#define __QUERYSERVER_H__
+
+#define QUERY_SOCKET_PATH "./billing.sock"
+#define QUERY_MAX_LINE 128
+
+ADTErr QueryServerInit (DBManagerParams* _mngParams, const char* _socketPath);
+/*Stops the query thread and removes the socket*/
+ADTErr EndQueryServer (void);
+
+#endif /*__QUERYSERVER_H__*/
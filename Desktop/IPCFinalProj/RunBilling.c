@@ -7,6 +7,7 @@ Description : Test - CDR - Insight project
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <unistd.h> /*for getopt*/
 
 #include "ADTErr.h"
 #include "logger.h"
@@ -19,35 +20,214 @@ Description : Test - CDR - Insight project
 #include "OperatorDB.h"
 #include "DataManager.h"
 #include "Billing.h"
+#include "QueryServer.h"
+#include "Metrics.h"
+#include "AutoSizer.h"
+#include "Checkpoint.h"
 #include "parser.h"
+#include "ShmRing.h"
 #include "FilesReader.h"
+#include "BlockReader.h"
 
 #define Q_SIZE 10
+/*messages per second of each log statement, and its burst - 0 for no limit*/
+#define LOG_RATE_PER_SEC 1000
+#define LOG_RATE_BURST 1000
+/*LOG_FORMAT_BINARY - read the log with logdecode*/
+#define LOG_FORMAT LOG_FORMAT_TEXT
+/*LOG_TIME_MSEC | LOG_TIME_MONOTONIC_USEC for latency analysis*/
+#define LOG_TIME_FORMAT LOG_TIME_SECONDS
+/*seconds between automatic delta exports, 0 - only on request*/
+#define DELTA_EXPORT_PERIOD 0
+/*rewritten every METRICS_PERIOD seconds and on SIGRTMIN+2, 0 - only on the signal*/
+#define METRICS_FILE "BillingMetrics.txt"
+#define METRICS_PERIOD 10
+/*readers and queue capacity re-sized every AUTO_SIZE_PERIOD_MS, 0 - fixed sizes*/
+#define AUTO_SIZE_PERIOD_MS 200
+/*-c: seconds between checkpoints, 0 - only when the files were read*/
+#define CHECKPOINT_PERIOD 600
+/*-c: msec between delta log batches (one fdatasync each), 0 - checkpoints only*/
+#define DELTA_LOG_PERIOD_MS 1000
+/*READ_BACKEND_AUTO - io_uring when the kernel allows it, else pread*/
+#define READ_BACKEND READ_BACKEND_AUTO
+/*-a / -r: reader processes parse into this shared memory ring*/
+#define RING_NAME "/billing_cdr_ring"
+#define RING_SIZE 1024
 #define STR_ERR_SIZE 60
 #define SIZE_PATH 100
 
-int main ()
+static ADTErr PopRing(void* _ring, CDR** _cdr)
 {
-	SafeQueue* safeQ;
+	return ShmRingPop(_ring, _cdr);
+}
+
+static ADTErr ReleaseRing(void* _ring, CDR* _cdr)
+{
+	return ShmRingRelease(_ring, _cdr);
+}
+
+static void Usage(const char* _name)
+{
+	fprintf(stderr, "Usage: %s [-d dir/] [-a reader processes | -r] [-n ring name] [-P i/K] [-m db prefix | -c checkpoint]\n"
+			"\t-d dir/\tthe CDR files - text (or gzip / zstd compressed text), or binary made by cdr2bin\n"
+			"\t-a n\taggregate n reader processes, no reader threads here\n"
+			"\t-r\tbe a reader process of a running aggregator\n"
+			"\t-P i/K\tread only partition i of K (hash of the IMSI), merge the K bills with billmerge\n"
+			"\t-m db\tkeep the databases in db.subscribers and db.operators and the file offsets in db.files, the next run goes on from them\n"
+			"\t-c file\tcheckpoint to file and log the changes in file.wal, the next run goes on from them\n", _name);
+}
+
+/*reads _path into the aggregator's ring - no databases, no billing*/
+static int RunReaderProcess(char* _path, const char* _ringName)
+{
+	ShmRing* ring;
+	ADTErr err;
+	char strErr[STR_ERR_SIZE];
+	ring = ShmRingAttach(_ringName, &err);
+	if(NULL == ring)
+	{
+		GetError(strErr,err);
+		LOG_ERROR_PRINT("%s",strErr);
+		return -1;
+	}
+	if(ERR_OK != (err = InitReadersToRing(ring, _path)) || ERR_OK != (err = EndReaders(NULL)))
+	{
+		/*the aggregator still waits for this reader*/
+		ShmRingEndProducer(ring);
+		ShmRingDestroy(ring);
+		GetError(strErr,err);
+		LOG_ERROR_PRINT("%s",strErr);
+		return -1;
+	}
+	ShmRingDestroy(ring);
+	return 0;
+}
+
+int main (int argc, char* argv[])
+{
+	SafeQueue* safeQ = NULL;
+	ShmRing* ring = NULL;
 	DBManagerParams* params;
+	SafeQueueStats qStats;
 	ADTErr err;
 	char strErr[STR_ERR_SIZE];
 	char path[SIZE_PATH] = "./Storage/";
-	LogCreate(LOG_ERROR | LOG_WARN | LOG_DEBUG,"FILE_LOGGER");
-	safeQ = SafeQueueInit(Q_SIZE);
-	if(NULL == safeQ)
+	const char* ringName = RING_NAME;
+	const char* checkpointFile = NULL;
+	const char* dbPrefix = NULL;
+	size_t nReaderProcesses = 0;
+	unsigned long partition = 0;
+	unsigned long nPartitions = 1;
+	int isReaderProcess = 0;
+	int opt;
+	while(-1 != (opt = getopt(argc, argv, "d:a:rn:P:m:c:")))
 	{
-		LOG_ERROR_PRINT("%s","safeQ create - failed");
+		switch(opt)
+		{
+			case 'd': strncpy(path, optarg, SIZE_PATH - 1); break;
+			case 'a': nReaderProcesses = strtoul(optarg, NULL, 10); break;
+			case 'r': isReaderProcess = 1; break;
+			case 'n': ringName = optarg; break;
+			case 'P':
+				if(2 != sscanf(optarg, "%lu/%lu", &partition, &nPartitions) || ERR_OK != ReadersSetPartition(partition, nPartitions))
+				{
+					Usage(argv[0]);
+					return -1;
+				}
+				break;
+			case 'm': dbPrefix = optarg; break;
+			case 'c': checkpointFile = optarg; break;
+			default: Usage(argv[0]); return -1;
+		}
+	}
+	/*the -m files may be ahead of any checkpoint, reader processes keep no offsets*/
+	if((isReaderProcess && nReaderProcesses) || ((checkpointFile || dbPrefix) && (isReaderProcess || nReaderProcesses))
+		|| (checkpointFile && dbPrefix))
+	{
+		Usage(argv[0]);
 		return -1;
 	}
-	if(ERR_OK != (err = InitReaders (safeQ,path)))
+	LogSetFormat(LOG_FORMAT);
+	LogSetRateLimit(LOG_RATE_PER_SEC, LOG_RATE_BURST);
+	LogCreate(LOG_ERROR | LOG_WARN | LOG_DEBUG,"FILE_LOGGER");
+	LogSetTimeFormat(LOG_TIME_FORMAT);
+	LOG_DEBUG_PRINT("reading files with %s", BlockReaderBackendName(BlockReaderSelect(READ_BACKEND)));
+	if(isReaderProcess)
+	{
+		opt = RunReaderProcess(path, ringName);
+		LogDestroy();
+		return opt;
+	}
+	/*before any thread starts, so billing signals reach only the billing thread*/
+	if(ERR_OK != (err = BillingPrepSignals()))
 	{
-		SafeQueueDestroy(safeQ);
 		GetError(strErr,err);
 		LOG_ERROR_PRINT("%s",strErr);
 		return -1;
 	}
-	params = InitDBManager (safeQ, &err); 
+	if(ERR_OK != (err = MetricsInit(METRICS_FILE, METRICS_PERIOD)))
+	{
+		GetError(strErr,err);
+		LOG_ERROR_PRINT("%s",strErr);
+	}
+	if(nReaderProcesses)
+	{
+		/*the reader processes attach to it - started with -r after this one*/
+		ring = ShmRingCreate(ringName, RING_SIZE, nReaderProcesses, &err);
+		if(NULL == ring)
+		{
+			GetError(strErr,err);
+			LOG_ERROR_PRINT("%s",strErr);
+			return -1;
+		}
+		params = InitDBManagerWithSource (ring, PopRing, ReleaseRing, &err);
+	}
+	else
+	{
+		safeQ = SafeQueueInit(Q_SIZE);
+		if(NULL == safeQ)
+		{
+			LOG_ERROR_PRINT("%s","safeQ create - failed");
+			return -1;
+		}
+		/*queue occupancy and blocked time go to the metrics file*/
+		MetricsAddSource(SafeQueuePrintStats, safeQ);
+		if(NULL != checkpointFile)
+		{
+			if(ERR_OK != (err = CheckpointInit(checkpointFile, DELTA_LOG_PERIOD_MS)))
+			{
+				SafeQueueDestroy(safeQ);
+				GetError(strErr,err);
+				LOG_ERROR_PRINT("%s",strErr);
+				return -1;
+			}
+			ReadersSetFileStart(CheckpointFileStart, NULL);
+			DBManagerSetAppliedHook(CheckpointApplied, NULL);
+		}
+		else if(NULL != dbPrefix)
+		{
+			if(ERR_OK != (err = DBManagerUseFiles(dbPrefix)))
+			{
+				SafeQueueDestroy(safeQ);
+				GetError(strErr,err);
+				LOG_ERROR_PRINT("%s",strErr);
+				return -1;
+			}
+			ReadersSetFileStart(DBManagerFileStart, NULL);
+		}
+		if(ERR_OK != (err = InitReaders (safeQ,path)))
+		{
+			SafeQueueDestroy(safeQ);
+			GetError(strErr,err);
+			LOG_ERROR_PRINT("%s",strErr);
+			return -1;
+		}
+		if(AUTO_SIZE_PERIOD_MS && ERR_OK == (err = AutoSizerInit(safeQ, AUTO_SIZE_PERIOD_MS)))
+		{
+			MetricsAddSource(AutoSizerPrintStats, NULL);
+		}
+		params = InitDBManager (safeQ, &err);
+	}
 	if(NULL == params)
 	{
 		SafeQueueDestroy(safeQ);
@@ -55,6 +235,16 @@ int main ()
 		LOG_ERROR_PRINT("%s",strErr);
 		return -1;
 	}
+	if(NULL != checkpointFile)
+	{
+		if(ERR_OK != (err = CheckpointStart(params, CHECKPOINT_PERIOD)))
+		{
+			GetError(strErr,err);
+			LOG_ERROR_PRINT("%s",strErr);
+			return -1;
+		}
+		MetricsAddSource(CheckpointPrintStats, NULL);
+	}
 	if(ERR_OK != (err = BillingInit (params)))
 	{
 		SafeQueueDestroy(safeQ);
@@ -62,25 +252,69 @@ int main ()
 		LOG_ERROR_PRINT("%s",strErr);
 		return -1;
 	}
-	if(ERR_OK != (err = EndReaders(safeQ)))
+	if(DELTA_EXPORT_PERIOD && ERR_OK != (err = BillingSetPeriodicExport (DELTA_EXPORT_PERIOD, BILL_DELTA)))
+	{
+		GetError(strErr,err);
+		LOG_ERROR_PRINT("%s",strErr);
+	}
+	/*lookups are served while the files are still being read*/
+	if(ERR_OK != (err = QueryServerInit (params, QUERY_SOCKET_PATH)))
+	{
+		GetError(strErr,err);
+		LOG_ERROR_PRINT("%s",strErr);
+	}
+	if(NULL != safeQ && ERR_OK != (err = EndReaders(safeQ)))
 	{
 		SafeQueueDestroy(safeQ);
 		GetError(strErr,err);
 		LOG_ERROR_PRINT("%s",strErr);
 		return -1;
 	}
+	if(NULL != safeQ && AUTO_SIZE_PERIOD_MS)
+	{
+		EndAutoSizer();
+	}
+	/*with reader processes - until the last of them ended*/
 	if(ERR_OK != (err = EndDBManager(params)))
 	{
 		GetError(strErr,err);
 		LOG_ERROR_PRINT("%s",strErr);
 		return -1;
 	}
+	/*everything read is in this one*/
+	if(NULL != checkpointFile && ERR_OK != (err = EndCheckpoint()))
+	{
+		GetError(strErr,err);
+		LOG_ERROR_PRINT("%s",strErr);
+	}
+	if(NULL != ring)
+	{
+		ShmRingDestroy(ring);
+	}
+	if(NULL != safeQ && ERR_OK == SafeQueueGetStats(safeQ, &qStats))
+	{
+		LOG_DEBUG_PRINT("queue of %lu: high water %lu, producers waited %lu times %.3f sec, consumer waited %lu times %.3f sec",
+			(unsigned long)qStats.m_capacity, (unsigned long)qStats.m_highWater, qStats.m_fullWaits, qStats.m_fullNsec / 1e9,
+			qStats.m_emptyWaits, qStats.m_emptyNsec / 1e9);
+	}
 	if(ERR_OK != (err = EndBilling()))
 	{
 		GetError(strErr,err);
 		LOG_ERROR_PRINT("%s",strErr);
 		return -1;
 	}
+	if(ERR_OK != (err = EndQueryServer()))
+	{
+		GetError(strErr,err);
+		LOG_ERROR_PRINT("%s",strErr);
+	}
+	/*closes the -m files clean, so the next run does not check their index*/
+	if(ERR_OK != (err = DestroyDBManager(params)))
+	{
+		GetError(strErr,err);
+		LOG_ERROR_PRINT("%s",strErr);
+	}
+	MetricsDestroy();
 	LogDestroy();
 	return 0;
 }
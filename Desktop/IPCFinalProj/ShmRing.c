@@ -0,0 +1,531 @@
+/**************************************************************************************************
+	Creation date: 			19.10.26
+	Last modified date: 	19.10.26
+
+	Description: Implementation module for the shared memory CDR ring.
+				 Layout of the shared object: the header, then m_capacity slots of
+				 m_slotSize bytes - a cache line of slot header (ready semaphore and
+				 kind) followed by the CDR itself.
+				 Producers take slots in order under m_headLock, parse without any
+				 lock and post the slot's m_ready. The consumer waits on the m_ready
+				 of the slot at its tail, so a slow producer holds back only the
+				 slots after its own. m_free counts slots the consumer released.
+				 Process shared POSIX semaphores are futex based - no system call
+				 while they do not block.
+				 A reader process may be killed anywhere: m_headLock is a robust
+				 mutex, every slot keeps the pid that took it, and the consumer waits
+				 POP_WAIT_MSEC at a time - a slot whose producer is gone is skipped,
+				 and a producer gone before its END slot counts as ended. A producer
+				 killed between taking m_free and the head loses the ring one slot.
+**************************************************************************************************/
+
+#include <stdio.h> /*for logger*/
+#include <stdlib.h> /*for malloc*/
+#include <string.h>
+#include <fcntl.h> /*for O_* constants*/
+#include <unistd.h> /*for ftruncate, getpid*/
+#include <errno.h>
+#include <signal.h> /*for kill*/
+#include <time.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <semaphore.h>
+
+#include "ADTErr.h"
+#include "logger.h"
+#include "logger_pub.h"
+#include "semaphore.h"
+#include "cdr.h"
+#include "ShmRing.h"
+
+#define RING_MAGIC 0x52494e47UL
+#define CACHE_LINE 64
+#define ROUND_UP(_size) (((_size) + CACHE_LINE - 1) / CACHE_LINE * CACHE_LINE)
+#define HEADER_SIZE ROUND_UP(sizeof(RingHeader))
+#define SLOT_HEADER_SIZE ROUND_UP(sizeof(SlotHeader))
+#define SLOT(_ring, _index) ((SlotHeader*)((char*)(_ring)->m_header + HEADER_SIZE + (_index) * (_ring)->m_header->m_slotSize))
+#define SLOT_CDR(_slot) ((CDR*)((char*)(_slot) + SLOT_HEADER_SIZE))
+#define CDR_SLOT(_cdr) ((SlotHeader*)((char*)(_cdr) - SLOT_HEADER_SIZE))
+#define NAME_LENGTH 64
+#define END_KEY "END"
+#define MAX_RING_PRODUCERS 64
+/*how long the consumer waits for a slot before it checks its producer is alive*/
+#define POP_WAIT_MSEC 200
+#define NSEC_IN_MSEC 1000000L
+#define NSEC_IN_SEC 1000000000L
+
+typedef enum
+{
+	SLOT_DATA,
+	SLOT_SKIP,		/*the producer could not parse its line*/
+	SLOT_END,		/*one producer ended*/
+	/*consumer only - never in a slot*/
+	SLOT_DEAD,		/*its producer died before committing it*/
+	SLOT_NONE		/*not taken, and no producer is left to take it*/
+} e_slotKind;
+
+typedef enum
+{
+	PRODUCER_RUNNING,
+	PRODUCER_ENDED,	/*its END slot was popped*/
+	PRODUCER_DEAD	/*found gone before its END slot*/
+} e_producerState;
+
+typedef struct
+{
+	pid_t			m_pid;
+	e_producerState	m_state;	/*consumer only*/
+} Producer;
+
+typedef struct
+{
+	sem_t		m_ready;
+	e_slotKind	m_kind;
+	pid_t		m_owner;		/*under m_headLock, before the head passes the slot*/
+} SlotHeader;
+
+typedef struct
+{
+	unsigned long	m_magic;
+	size_t			m_capacity;
+	size_t			m_slotSize;
+	size_t			m_producers;
+	sem_t			m_free;
+	pthread_mutex_t	m_headLock;		/*robust - a killed holder does not block the others*/
+	size_t			m_head;			/*under m_headLock*/
+	size_t			m_attached;		/*under m_headLock*/
+	Producer		m_producerList[MAX_RING_PRODUCERS];
+} RingHeader;
+
+/*per process*/
+struct ShmRing
+{
+	RingHeader*	m_header;
+	size_t		m_mapSize;
+	size_t		m_tail;			/*consumer only*/
+	size_t		m_ended;		/*consumer only*/
+	pid_t		m_pid;
+	int			m_isOwner;
+	char		m_name[NAME_LENGTH];
+};
+
+static ShmRing* RingAlloc (const char* _name, ADTErr* _error)
+{
+	ShmRing* ring;
+	if (!_name || '/' != _name[0] || strlen (_name) >= NAME_LENGTH)
+	{
+		*_error = ERR_ILLEGAL_INPUT;
+		LOG_ERROR_PRINT("%s\n", "shared memory name must start with '/'");
+		return NULL;
+	}
+	ring = calloc (1, sizeof(ShmRing));
+	if (!ring)
+	{
+		*_error = ERR_ALLOCATION_FAILED;
+		return NULL;
+	}
+	strcpy (ring->m_name, _name);
+	return ring;
+}
+
+static ADTErr CreateHeadLock (pthread_mutex_t* _lock)
+{
+	pthread_mutexattr_t attr;
+	int status;
+	pthread_mutexattr_init (&attr);
+	pthread_mutexattr_setpshared (&attr, PTHREAD_PROCESS_SHARED);
+	pthread_mutexattr_setrobust (&attr, PTHREAD_MUTEX_ROBUST);
+	status = pthread_mutex_init (_lock, &attr);
+	pthread_mutexattr_destroy (&attr);
+	return (0 == status) ? ERR_OK : ERR_SEM_INIT_FAILED;
+}
+
+/*a holder killed under it left nothing half done - its stores are single words*/
+static ADTErr LockHead (RingHeader* _header)
+{
+	int status = pthread_mutex_lock (&_header->m_headLock);
+	if (EOWNERDEAD == status)
+	{
+		LOG_WARN_PRINT("%s\n", "A reader process died holding the ring head");
+		status = pthread_mutex_consistent (&_header->m_headLock);
+	}
+	return (0 == status) ? ERR_OK : ERR_SEM_DOWN_FAILED;
+}
+
+/*a zombie (a reader started by the aggregator's parent shell is not, but a forked one may be) is dead too*/
+static int IsAlive (pid_t _pid)
+{
+	char path[NAME_LENGTH];
+	char state = '?';
+	FILE* stat;
+	if (0 != kill (_pid, 0) && EPERM != errno)
+	{
+		return 0;
+	}
+	snprintf (path, NAME_LENGTH, "/proc/%d/stat", (int)_pid);
+	if ((stat = fopen (path, "r")))
+	{
+		/*pid (comm) state - comm may hold spaces, not ')'*/
+		if (1 != fscanf (stat, "%*d (%*[^)]) %c", &state))
+		{
+			state = '?';
+		}
+		fclose (stat);
+	}
+	return 'Z' != state && 'X' != state;
+}
+
+ShmRing* ShmRingCreate (const char* _name, size_t _capacity, size_t _producers, ADTErr* _error)
+{
+	ShmRing* ring;
+	SlotHeader* slot;
+	ADTErr dummy;
+	size_t i;
+	int fd;
+	_error = _error ? _error : &dummy;
+	if (0 == _capacity || 0 == _producers || _producers > MAX_RING_PRODUCERS)
+	{
+		*_error = ERR_ILLEGAL_INPUT;
+		return NULL;
+	}
+	if (!(ring = RingAlloc (_name, _error)))
+	{
+		return NULL;
+	}
+	/*a ring left by a killed aggregator*/
+	shm_unlink (_name);
+	fd = shm_open (_name, O_RDWR | O_CREAT | O_EXCL, S_IRUSR | S_IWUSR);
+	ring->m_mapSize = HEADER_SIZE + _capacity * (SLOT_HEADER_SIZE + ROUND_UP(CDRSize ()));
+	if (-1 == fd || -1 == ftruncate (fd, ring->m_mapSize))
+	{
+		if (-1 != fd)
+		{
+			close (fd);
+			shm_unlink (_name);
+		}
+		free (ring);
+		*_error = ERR_FILE_OPEN;
+		LOG_ERROR_PRINT("Creating shared memory %s failed\n", _name);
+		return NULL;
+	}
+	ring->m_header = mmap (NULL, ring->m_mapSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close (fd);
+	if (MAP_FAILED == ring->m_header)
+	{
+		shm_unlink (_name);
+		free (ring);
+		*_error = ERR_ALLOCATION_FAILED;
+		LOG_ERROR_PRINT("Mapping shared memory %s failed\n", _name);
+		return NULL;
+	}
+	ring->m_isOwner = 1;
+	ring->m_header->m_capacity = _capacity;
+	ring->m_header->m_slotSize = SLOT_HEADER_SIZE + ROUND_UP(CDRSize ());
+	ring->m_header->m_producers = _producers;
+	ring->m_header->m_head = 0;
+	ring->m_header->m_attached = 0;
+	*_error = SemCreateShared (&ring->m_header->m_free, _capacity);
+	if (ERR_OK == *_error)
+	{
+		*_error = CreateHeadLock (&ring->m_header->m_headLock);
+	}
+	for (i = 0; i < _capacity && ERR_OK == *_error; ++i)
+	{
+		slot = SLOT(ring, i);
+		*_error = SemCreateShared (&slot->m_ready, 0);
+	}
+	if (ERR_OK != *_error)
+	{
+		munmap (ring->m_header, ring->m_mapSize);
+		shm_unlink (_name);
+		free (ring);
+		return NULL;
+	}
+	/*readers check it - the ring is ready*/
+	__sync_synchronize ();
+	ring->m_header->m_magic = RING_MAGIC;
+	LOG_DEBUG_PRINT("Shared memory ring %s of %lu slots for %lu readers\n", _name, (unsigned long)_capacity, (unsigned long)_producers);
+	return ring;
+}
+
+ShmRing* ShmRingAttach (const char* _name, ADTErr* _error)
+{
+	ShmRing* ring;
+	struct stat fileStat;
+	ADTErr dummy;
+	int fd;
+	_error = _error ? _error : &dummy;
+	if (!(ring = RingAlloc (_name, _error)))
+	{
+		return NULL;
+	}
+	fd = shm_open (_name, O_RDWR, 0);
+	if (-1 == fd || -1 == fstat (fd, &fileStat) || (size_t)fileStat.st_size < HEADER_SIZE)
+	{
+		if (-1 != fd)
+		{
+			close (fd);
+		}
+		free (ring);
+		*_error = ERR_FILE_OPEN;
+		LOG_ERROR_PRINT("Opening shared memory %s failed - is the aggregator running?\n", _name);
+		return NULL;
+	}
+	ring->m_mapSize = fileStat.st_size;
+	ring->m_header = mmap (NULL, ring->m_mapSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close (fd);
+	if (MAP_FAILED == ring->m_header)
+	{
+		free (ring);
+		*_error = ERR_ALLOCATION_FAILED;
+		return NULL;
+	}
+	if (RING_MAGIC != ring->m_header->m_magic)
+	{
+		munmap (ring->m_header, ring->m_mapSize);
+		free (ring);
+		*_error = ERR_NOT_INITIALIZED;
+		LOG_ERROR_PRINT("Shared memory %s is not a CDR ring\n", _name);
+		return NULL;
+	}
+	ring->m_pid = getpid ();
+	/*the consumer watches the pids it was given*/
+	if (ERR_OK != (*_error = LockHead (ring->m_header)) || ring->m_header->m_attached == ring->m_header->m_producers)
+	{
+		if (ERR_OK == *_error)
+		{
+			pthread_mutex_unlock (&ring->m_header->m_headLock);
+			*_error = ERR_OVERFLOW;
+			LOG_ERROR_PRINT("Shared memory %s has all its %lu readers\n", _name, (unsigned long)ring->m_header->m_producers);
+		}
+		munmap (ring->m_header, ring->m_mapSize);
+		free (ring);
+		return NULL;
+	}
+	ring->m_header->m_producerList[ring->m_header->m_attached].m_pid = ring->m_pid;
+	ring->m_header->m_producerList[ring->m_header->m_attached].m_state = PRODUCER_RUNNING;
+	__atomic_store_n (&ring->m_header->m_attached, ring->m_header->m_attached + 1, __ATOMIC_RELEASE);
+	pthread_mutex_unlock (&ring->m_header->m_headLock);
+	*_error = ERR_OK;
+	return ring;
+}
+
+ADTErr ShmRingReserve (ShmRing* _ring, CDR** _cdr)
+{
+	SlotHeader* slot;
+	ADTErr error;
+	if (!_ring || !_cdr)
+	{
+		return ERR_NOT_INITIALIZED;
+	}
+	if (ERR_OK != (error = SemDown (&_ring->m_header->m_free)))
+	{
+		return error;
+	}
+	if (ERR_OK != (error = LockHead (_ring->m_header)))
+	{
+		SemUp (&_ring->m_header->m_free);
+		return error;
+	}
+	slot = SLOT(_ring, _ring->m_header->m_head % _ring->m_header->m_capacity);
+	slot->m_owner = _ring->m_pid;
+	/*the consumer reads the head without the lock - the owner is in before*/
+	__atomic_store_n (&_ring->m_header->m_head, _ring->m_header->m_head + 1, __ATOMIC_RELEASE);
+	pthread_mutex_unlock (&_ring->m_header->m_headLock);
+	*_cdr = SLOT_CDR(slot);
+	CDRReset (*_cdr);
+	return ERR_OK;
+}
+
+ADTErr ShmRingCommit (ShmRing* _ring, CDR* _cdr, int _isValid)
+{
+	SlotHeader* slot;
+	if (!_ring || !_cdr)
+	{
+		return ERR_NOT_INITIALIZED;
+	}
+	slot = CDR_SLOT(_cdr);
+	slot->m_kind = _isValid ? SLOT_DATA : SLOT_SKIP;
+	return SemUp (&slot->m_ready);
+}
+
+ADTErr ShmRingEndProducer (ShmRing* _ring)
+{
+	CDR* cdr;
+	ADTErr error;
+	if (ERR_OK != (error = ShmRingReserve (_ring, &cdr)))
+	{
+		return error;
+	}
+	CDR_SLOT(cdr)->m_kind = SLOT_END;
+	return SemUp (&CDR_SLOT(cdr)->m_ready);
+}
+
+static Producer* FindProducer (ShmRing* _ring, pid_t _pid)
+{
+	size_t nAttached = __atomic_load_n (&_ring->m_header->m_attached, __ATOMIC_ACQUIRE);
+	size_t i;
+	for (i = 0; i < nAttached; ++i)
+	{
+		if (_ring->m_header->m_producerList[i].m_pid == _pid)
+		{
+			return &_ring->m_header->m_producerList[i];
+		}
+	}
+	return NULL;
+}
+
+/*counts _producer as ended once - by its END slot, or when it is found dead before it*/
+static void ProducerEnded (ShmRing* _ring, Producer* _producer, e_producerState _state)
+{
+	if (_producer && PRODUCER_RUNNING == _producer->m_state)
+	{
+		_producer->m_state = _state;
+		++_ring->m_ended;
+		if (PRODUCER_DEAD == _state)
+		{
+			LOG_ERROR_PRINT("Reader process %d died before it ended - its uncommitted CDRs are lost\n", (int)_producer->m_pid);
+		}
+	}
+}
+
+/*the slot's producer is gone, or - for a slot no one took - all the producers are*/
+static e_slotKind CheckProducers (ShmRing* _ring, SlotHeader* _slot)
+{
+	Producer* producer;
+	size_t nAttached;
+	size_t i;
+	if (_ring->m_tail < __atomic_load_n (&_ring->m_header->m_head, __ATOMIC_ACQUIRE))
+	{
+		producer = FindProducer (_ring, _slot->m_owner);
+		if ((producer && PRODUCER_DEAD == producer->m_state) || !IsAlive (_slot->m_owner))
+		{
+			/*it may have committed just before it died - no one posts the slot any more*/
+			if (ERR_OK == SemTryDown (&_slot->m_ready))
+			{
+				return _slot->m_kind;
+			}
+			ProducerEnded (_ring, producer, PRODUCER_DEAD);
+			return SLOT_DEAD;
+		}
+		return SLOT_NONE;
+	}
+	nAttached = __atomic_load_n (&_ring->m_header->m_attached, __ATOMIC_ACQUIRE);
+	for (i = 0; i < nAttached; ++i)
+	{
+		producer = &_ring->m_header->m_producerList[i];
+		if (PRODUCER_RUNNING == producer->m_state && !IsAlive (producer->m_pid))
+		{
+			ProducerEnded (_ring, producer, PRODUCER_DEAD);
+		}
+	}
+	return SLOT_NONE;
+}
+
+/*the kind of the slot at the tail once it is committed - or SLOT_DEAD / SLOT_NONE as CheckProducers finds*/
+static ADTErr WaitSlot (ShmRing* _ring, SlotHeader* _slot, e_slotKind* _kind)
+{
+	struct timespec deadline;
+	while (1)
+	{
+		clock_gettime (CLOCK_REALTIME, &deadline);
+		deadline.tv_nsec += POP_WAIT_MSEC * NSEC_IN_MSEC;
+		if (deadline.tv_nsec >= NSEC_IN_SEC)
+		{
+			++deadline.tv_sec;
+			deadline.tv_nsec -= NSEC_IN_SEC;
+		}
+		if (0 == sem_timedwait (&_slot->m_ready, &deadline))
+		{
+			*_kind = _slot->m_kind;
+			return ERR_OK;
+		}
+		if (ETIMEDOUT != errno && EINTR != errno)
+		{
+			LOG_ERROR_PRINT("sem_timedwait: %s\n", strerror (errno));
+			return ERR_SEM_DOWN_FAILED;
+		}
+		*_kind = CheckProducers (_ring, _slot);
+		if (SLOT_NONE != *_kind || _ring->m_ended == _ring->m_header->m_producers)
+		{
+			return ERR_OK;
+		}
+	}
+}
+
+ADTErr ShmRingPop (ShmRing* _ring, CDR** _cdr)
+{
+	SlotHeader* slot;
+	e_slotKind kind;
+	ADTErr error;
+	if (!_ring || !_cdr)
+	{
+		return ERR_NOT_INITIALIZED;
+	}
+	while (1)
+	{
+		slot = SLOT(_ring, _ring->m_tail % _ring->m_header->m_capacity);
+		if (ERR_OK != (error = WaitSlot (_ring, slot, &kind)))
+		{
+			return error;
+		}
+		if (SLOT_NONE == kind)
+		{
+			/*all the producers died - the slot no one took carries the END*/
+			CDRReset (SLOT_CDR(slot));
+			CDRInsertIMSI (SLOT_CDR(slot), END_KEY);
+			break;
+		}
+		++_ring->m_tail;
+		if (SLOT_DATA == kind)
+		{
+			break;
+		}
+		if (SLOT_END == kind)
+		{
+			ProducerEnded (_ring, FindProducer (_ring, slot->m_owner), PRODUCER_ENDED);
+		}
+		if ((SLOT_END == kind || SLOT_DEAD == kind) && _ring->m_ended == _ring->m_header->m_producers)
+		{
+			/*a dead producer's slot may be half parsed*/
+			CDRReset (SLOT_CDR(slot));
+			CDRInsertIMSI (SLOT_CDR(slot), END_KEY);
+			break;
+		}
+		SemUp (&_ring->m_header->m_free);
+	}
+	*_cdr = SLOT_CDR(slot);
+	return ERR_OK;
+}
+
+ADTErr ShmRingRelease (ShmRing* _ring, CDR* _cdr)
+{
+	if (!_ring || !_cdr)
+	{
+		return ERR_NOT_INITIALIZED;
+	}
+	return SemUp (&_ring->m_header->m_free);
+}
+
+ADTErr ShmRingDestroy (ShmRing* _ring)
+{
+	size_t i;
+	if (!_ring)
+	{
+		return ERR_NOT_INITIALIZED;
+	}
+	if (_ring->m_isOwner)
+	{
+		for (i = 0; i < _ring->m_header->m_capacity; ++i)
+		{
+			SemDestroy (&SLOT(_ring, i)->m_ready);
+		}
+		SemDestroy (&_ring->m_header->m_free);
+		pthread_mutex_destroy (&_ring->m_header->m_headLock);
+		shm_unlink (_ring->m_name);
+	}
+	munmap (_ring->m_header, _ring->m_mapSize);
+	free (_ring);
+	return ERR_OK;
+}
@@ -0,0 +1,40 @@
+/*************************************************************************
+Creation Date: 19.10.26
+Last edit: 19.10.26
+Description: Header file for the shared memory CDR ring - reader processes
+			 parse straight into its slots and the aggregator process feeds
+			 the databases from them, no copy and no malloc per record.
+			 Many producers, one consumer. Every slot has its own process
+			 shared semaphore, so slots are consumed in the order they were
+			 taken even when producers fill them at different speeds.
+			 Start the aggregator (ShmRingCreate) before the readers attach.
+			 A reader process killed after it attached ends for the consumer
+			 (what it had not committed is lost) - the others go on.
+**************************************************************************/
+
+#ifndef __SHM_RING_H__
+#define __SHM_RING_H__
+
+typedef struct ShmRing ShmRing;
+
+/*Aggregator: creates _name ("/name") for _producers reader processes*/
+ShmRing* ShmRingCreate (const char* _name, size_t _capacity, size_t _producers, ADTErr* _error);
+/*Reader process: maps a ring created by the aggregator, ERR_OVERFLOW - all its readers attached*/
+ShmRing* ShmRingAttach (const char* _name, ADTErr* _error);
+
+/*Producer: waits for a free slot and returns its (reset) CDR to parse into*/
+ADTErr ShmRingReserve (ShmRing* _ring, CDR** _cdr);
+/*Producer: hands the slot to the consumer, _isValid 0 - the line did not parse*/
+ADTErr ShmRingCommit (ShmRing* _ring, CDR* _cdr, int _isValid);
+/*Producer: this process sends no more CDRs*/
+ADTErr ShmRingEndProducer (ShmRing* _ring);
+
+/*Consumer: the next valid CDR, in place. After the last producer ended it is
+  the "END" CDR, as SendEndMsg2Queue sends. Release it before the next pop.*/
+ADTErr ShmRingPop (ShmRing* _ring, CDR** _cdr);
+ADTErr ShmRingRelease (ShmRing* _ring, CDR* _cdr);
+
+/*Reader process: unmaps. Aggregator: also destroys the semaphores and removes _name.*/
+ADTErr ShmRingDestroy (ShmRing* _ring);
+
+#endif /*__SHM_RING_H__*/
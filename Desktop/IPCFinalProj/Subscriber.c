@@ -29,6 +29,7 @@ struct Subscriber
 	unsigned int 	m_messagesSent;
 	double			m_downloaded;
 	double 			m_uploaded;
+	unsigned long	m_generation;
 };
 
 Subscriber* SubscriberCreate(CDR* _cdr, ADTErr* _err)
@@ -116,6 +117,45 @@ Subscriber* SubscriberCreate(CDR* _cdr, ADTErr* _err)
 	return sub;
 }
 
+Subscriber* SubscriberCreateFromUsage(const char* _imsi, const SubscriberUsage* _usage, ADTErr* _err)
+{
+	Subscriber* sub = NULL;
+	char errMsg[ERR_MSG_SIZE];
+	ADTErr err = ERR_OK;
+	
+	if (NULL == _imsi || NULL == _usage)
+	{
+		err = ERR_NOT_INITIALIZED;
+	}
+	else if (strlen(_imsi) >= STRING_SIZE)
+	{
+		err = ERR_ILLEGAL_INPUT;
+	}
+	else if (NULL == (sub = (Subscriber*) calloc(1, sizeof(Subscriber))))
+	{
+		err = ERR_ALLOCATION_FAILED;
+	}
+	if (NULL != _err)
+	{
+		*_err = err;
+	}
+	if (ERR_OK != err)
+	{
+		GetError(errMsg, err);
+		LOG_ERROR_PRINT("%s", errMsg);
+		return NULL;
+	}
+	
+	strcpy(sub->m_imsi, _imsi);
+	sub->m_incomingDuration = _usage->m_incomingDuration;
+	sub->m_outgoingDuration = _usage->m_outgoingDuration;
+	sub->m_messagesReceived = _usage->m_messagesReceived;
+	sub->m_messagesSent = _usage->m_messagesSent;
+	sub->m_downloaded = _usage->m_downloaded;
+	sub->m_uploaded = _usage->m_uploaded;
+	return sub;
+}
+
 void SubscriberDestroy(Subscriber* _sub)
 {
 	if (NULL == _sub)
@@ -190,6 +230,53 @@ ADTErr SubscriberGetIMSI(const Subscriber* _sub, char* _imsi)
 	return ERR_OK;
 }
 
+ADTErr SubscriberGetUsage(const Subscriber* _sub, SubscriberUsage* _usage)
+{
+	char errMsg[ERR_MSG_SIZE];
+	
+	if (NULL == _sub)
+	{
+		GetError(errMsg, ERR_NOT_INITIALIZED);
+		LOG_ERROR_PRINT("%s", errMsg);
+		return ERR_NOT_INITIALIZED;
+	}
+	if (NULL == _usage)
+	{
+		GetError(errMsg, ERR_ILLEGAL_INPUT);
+		LOG_ERROR_PRINT("%s", errMsg);
+		return ERR_ILLEGAL_INPUT;
+	}
+	
+	_usage->m_incomingDuration = _sub->m_incomingDuration;
+	_usage->m_outgoingDuration = _sub->m_outgoingDuration;
+	_usage->m_messagesReceived = _sub->m_messagesReceived;
+	_usage->m_messagesSent = _sub->m_messagesSent;
+	_usage->m_downloaded = _sub->m_downloaded;
+	_usage->m_uploaded = _sub->m_uploaded;
+	return ERR_OK;
+}
+
+void SubscriberSetGeneration(Subscriber* _sub, unsigned long _generation)
+{
+	if (NULL == _sub)
+	{
+		LOG_WARN_PRINT("%s", "Attempted to mark uninitialized subscriber.");
+		return;
+	}
+	
+	_sub->m_generation = _generation;
+}
+
+unsigned long SubscriberGetGeneration(const Subscriber* _sub)
+{
+	return (NULL == _sub) ? 0 : _sub->m_generation;
+}
+
+size_t SubscriberSize(void)
+{
+	return sizeof(Subscriber);
+}
+
 ADTErr SubscriberPrintToFile(const Subscriber* _sub, const int _fileDescriptor)
 {
 	int nBytes;
@@ -271,6 +358,32 @@ ADTErr SubscriberPrintToFile(const Subscriber* _sub, const int _fileDescriptor)
 	return ERR_OK;
 }
 
+int SubscriberFormat(const Subscriber* _sub, char* _buffer, size_t _size)
+{
+	if (NULL == _sub || NULL == _buffer)
+	{
+		LOG_ERROR_PRINT("%s", "Subscriber data unavailable!");
+		return -1;
+	}
+	
+	return snprintf(_buffer, _size,
+					"IMSI: %s\n"
+					"----------------------\n"
+					"Total incoming calls duration: %u\n"
+					"Total outgoing calls duration: %u\n"
+					"Total messages received: %u\n"
+					"Total messages sent: %u\n"
+					"Total downloaded data: %g [MB]\n"
+					"Total uploaded data: %g [MB]\n\n",
+					_sub->m_imsi,
+					_sub->m_incomingDuration,
+					_sub->m_outgoingDuration,
+					_sub->m_messagesReceived,
+					_sub->m_messagesSent,
+					_sub->m_downloaded,
+					_sub->m_uploaded);
+}
+
 #ifdef _DEBUG
 void SubscriberPrint(const Subscriber* _sub)
 {
@@ -11,8 +11,22 @@
 
 typedef struct Subscriber Subscriber;
 
+/* Totals of one sub, as printed in the bills */
+typedef struct
+{
+	unsigned int 	m_incomingDuration;
+	unsigned int 	m_outgoingDuration;
+	unsigned int 	m_messagesReceived;
+	unsigned int 	m_messagesSent;
+	double			m_downloaded;
+	double 			m_uploaded;
+} SubscriberUsage;
+
 Subscriber* SubscriberCreate(CDR* _cdr, ADTErr* _err);
 
+/* The totals of a saved subscriber, or of a logged change */
+Subscriber* SubscriberCreateFromUsage(const char* _imsi, const SubscriberUsage* _usage, ADTErr* _err);
+
 void		SubscriberDestroy(Subscriber* _sub);
 
 ADTErr		SubscriberUpdate(Subscriber* _destination, const Subscriber* _source);
@@ -21,9 +35,24 @@ int			SubscriberIsSame(const Subscriber* _sub1, const Subscriber* _sub2);
 
 ADTErr		SubscriberGetIMSI(const Subscriber* _sub, char* _imsi);
 
+ADTErr		SubscriberGetUsage(const Subscriber* _sub, SubscriberUsage* _usage);
+
+/* Generation of the last change, used by the database for delta exports */
+void		SubscriberSetGeneration(Subscriber* _sub, unsigned long _generation);
+unsigned long SubscriberGetGeneration(const Subscriber* _sub);
+
+/* A subscriber holds no pointers - the database may keep a copy of these many bytes */
+size_t		SubscriberSize(void);
+
 /* Receives file descriptor to already opened file: Does not close the file! */
 ADTErr		SubscriberPrintToFile(const Subscriber* _sub, const int _fileDescriptor);
 
+/* 
+ * Writes the same text as SubscriberPrintToFile into _buffer.
+ * Returns the number of characters needed (like snprintf), or -1 on error.
+ */
+int			SubscriberFormat(const Subscriber* _sub, char* _buffer, size_t _size);
+
 #ifdef _DEBUG
 void 		SubscriberPrint(const Subscriber* _sub);
 #endif /* _DEBUG */
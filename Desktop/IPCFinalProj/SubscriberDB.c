@@ -21,15 +21,45 @@
 #include "cdr.h"
 #include "Subscriber.h"
 #include "SubscriberDB.h"
+#include "PersistTable.h"
 
 struct SubscriberDB
 {
-	HashMap* m_map;
+	HashMap* 		m_map;
+	PersistTable*	m_table;		/* instead of m_map when opened on a file */
+	unsigned long	m_generation;
 };
 
 #define NUM_OF_BUCKETS 1000000
+#define FILE_CAPACITY (4 * 1024 * 1024) /* to start with, the file doubles when full */
 #define IMSI_SIZE 32
 #define ERR_MSG_SIZE 128
+#define WRITE_BUFFER_SIZE (64 * 1024)
+#define MAX_RECORD_SIZE 512
+
+typedef struct DoParams
+{
+	SubscriberDoFunc	m_doFunc;
+	void*				m_params;
+} DoParams;
+
+typedef struct ShardWriter
+{
+	int		m_fileDesc;
+	unsigned long m_sinceGeneration;
+	size_t	m_used;
+	size_t	m_nPrinted;
+	ADTErr	m_err;
+	char	m_buffer[WRITE_BUFFER_SIZE];
+} ShardWriter;
+
+/* Bounded min-heaps, the smallest of the current top _n at the root */
+typedef struct TopNHeaps
+{
+	size_t			m_capacity;
+	size_t			m_size;
+	SubscriberRank*	m_heaps[NUM_OF_TOP_KINDS];
+} TopNHeaps;
 
 /* Hash function */
 /*static unsigned int qhashmurmur3_32(HashKey _data, size_t _ignore)
@@ -137,8 +167,29 @@ static int PrintSubscribers(HashKey _ignore, Data _data)
 	SubscriberPrint((Subscriber*)_data);
 	return true;
 }
+
+static int PrintStoredSubscribers(HashKey _ignore, Data _data, void* _ignoreParams)
+{
+	SubscriberPrint((Subscriber*)_data);
+	return true;
+}
 #endif /* _DEBUG */
 
+/* Shards split the buckets of the map, or the records of the file in their insert order */
+static size_t CountShardUnits(const SubscriberDB* _sdb)
+{
+	return (NULL != _sdb->m_table) ? PTableCountItems(_sdb->m_table) : HashCountBuckets(_sdb->m_map);
+}
+
+static int ForEachInRange(const SubscriberDB* _sdb, size_t _from, size_t _to, const HashDoFunc _doFunc, void* _params)
+{
+	if (NULL != _sdb->m_table)
+	{
+		return PTableForEachInRange(_sdb->m_table, _from, _to, _doFunc, _params);
+	}
+	return HashForEachInRange(_sdb->m_map, _from, _to, _doFunc, _params);
+}
+
 static int CompareSubscribers(HashKey _imsi1, HashKey _imsi2)
 {
 	return ( ! strcmp((char*)_imsi1, (char*)_imsi2) );
@@ -173,6 +224,8 @@ SubscriberDB* SubscriberDBCreate(ADTErr* _err)
 		free(sdb);
 		return NULL;
 	}
+	sdb->m_table = NULL;
+	sdb->m_generation = 1;
 	
 	if (NULL != _err)
 	{
@@ -182,6 +235,49 @@ SubscriberDB* SubscriberDBCreate(ADTErr* _err)
 	return sdb;
 }
 
+SubscriberDB* SubscriberDBOpen(const char* _fileName, ADTErr* _err)
+{
+	ADTErr err;
+	char errMsg[ERR_MSG_SIZE];
+	
+	SubscriberDB* sdb = malloc(sizeof(SubscriberDB));
+	if (NULL == sdb)
+	{
+		if (NULL != _err)
+		{
+			*_err = ERR_ALLOCATION_FAILED;
+		}
+		GetError(errMsg, ERR_ALLOCATION_FAILED);
+		LOG_ERROR_PRINT("%s", errMsg);
+		return NULL;
+	}
+	
+	sdb->m_table = PTableOpen(_fileName, SubscriberSize(), FILE_CAPACITY, &err);
+	if (NULL == sdb->m_table)
+	{
+		if (NULL != _err)
+		{
+			*_err = err;
+		}
+		free(sdb);
+		return NULL;
+	}
+	sdb->m_map = NULL;
+	/* delta exports go on from the generation the last run was at */
+	sdb->m_generation = PTableGetUserValue(sdb->m_table);
+	if (0 == sdb->m_generation)
+	{
+		sdb->m_generation = 1;
+	}
+	
+	if (NULL != _err)
+	{
+		*_err = ERR_OK;
+	}
+	LOG_DEBUG_PRINT("Opened subscriber database %s with %lu subscribers.", _fileName, (unsigned long)PTableCountItems(sdb->m_table));
+	return sdb;
+}
+
 void SubscriberDBDestroy(SubscriberDB* _sdb)
 {
 	if (NULL == _sdb)
@@ -190,12 +286,43 @@ void SubscriberDBDestroy(SubscriberDB* _sdb)
 		return;
 	}
 	
-	HashForEach(_sdb->m_map, FreeSubscribers, NULL);
-	HashDestroy(_sdb->m_map);
+	if (NULL != _sdb->m_table)
+	{
+		PTableSetUserValue(_sdb->m_table, _sdb->m_generation);
+		PTableClose(_sdb->m_table);
+	}
+	else
+	{
+		HashForEach(_sdb->m_map, FreeSubscribers, NULL);
+		HashDestroy(_sdb->m_map);
+	}
 	free(_sdb);
 	LOG_DEBUG_PRINT("%s", "Successfully destroyed subscriber database");
 }
 
+/* The file keeps a copy, so the subscriber is freed like the map would own it */
+static ADTErr InsertToTable(SubscriberDB* _sdb, Subscriber* _sub)
+{
+	ADTErr err;
+	char errMsg[ERR_MSG_SIZE];
+	char imsi[IMSI_SIZE];
+	void* stored = NULL;
+	
+	SubscriberGetIMSI(_sub, imsi);
+	err = PTableInsert(_sdb->m_table, imsi, _sub, &stored);
+	if (ERR_OK != err)
+	{
+		GetError(errMsg, err);
+		LOG_WARN_PRINT("%s", errMsg);
+		return err;
+	}
+	
+	SubscriberSetGeneration((Subscriber*)stored, _sdb->m_generation);
+	SubscriberDestroy(_sub);
+	LOG_DEBUG_PRINT("%s", "Successfully inserted to database file.");
+	return ERR_OK;
+}
+
 ADTErr SubscriberDBInsert(SubscriberDB* _sdb, const Subscriber* _sub)
 {
 	ADTErr err;
@@ -215,6 +342,11 @@ ADTErr SubscriberDBInsert(SubscriberDB* _sdb, const Subscriber* _sub)
 		return ERR_ILLEGAL_INPUT;
 	}
 	
+	if (NULL != _sdb->m_table)
+	{
+		return InsertToTable(_sdb, (Subscriber*)_sub);
+	}
+	
 	imsi = (char*) malloc(IMSI_SIZE * sizeof(char));
 	if (NULL == imsi)
 	{
@@ -232,6 +364,8 @@ ADTErr SubscriberDBInsert(SubscriberDB* _sdb, const Subscriber* _sub)
 	}
 	else
 	{
+		/* database owns the subscriber from now on */
+		SubscriberSetGeneration((Subscriber*)_sub, _sdb->m_generation);
 		LOG_DEBUG_PRINT("%s", "Successfully inserted to database.");
 	}
 	
@@ -256,7 +390,7 @@ ADTErr SubscriberDBGet(const SubscriberDB* _sdb, const char* _imsi , Subscriber*
 		return ERR_ILLEGAL_INPUT;
 	}
 	
-	*_sub = HashFind(_sdb->m_map, (const HashKey)_imsi);
+	*_sub = (NULL != _sdb->m_table) ? PTableFind(_sdb->m_table, _imsi) : HashFind(_sdb->m_map, (const HashKey)_imsi);
 	err = (NULL == *_sub) ? ERR_NOT_FOUND : ERR_OK;
 	if (ERR_OK != err)
 	{
@@ -288,7 +422,20 @@ ADTErr SubscriberDBRemove(SubscriberDB* _sdb, const char* _imsi, Subscriber** _s
 		return ERR_ILLEGAL_INPUT;
 	}
 	
-	HashRemove(_sdb->m_map, (const HashKey)_imsi, (Data*)_sub);
+	if (NULL != _sdb->m_table)
+	{
+		/* the caller frees it, as a subscriber removed from the map */
+		*_sub = malloc(SubscriberSize());
+		if (NULL != *_sub && ERR_OK != PTableRemove(_sdb->m_table, _imsi, *_sub))
+		{
+			free(*_sub);
+			*_sub = NULL;
+		}
+	}
+	else
+	{
+		HashRemove(_sdb->m_map, (const HashKey)_imsi, (Data*)_sub);
+	}
 	err = (NULL == *_sub) ? ERR_NOT_FOUND : ERR_OK;
 	if (ERR_OK != err)
 	{
@@ -334,7 +481,7 @@ ADTErr SubscriberDBPrintToFile(const SubscriberDB* _sdb, const char* _fileName)
 		return ERR_FILE_OPEN;
 	}
 	
-	if ( ! HashForEach(_sdb->m_map, PrintAllToFile, (void*)&fileDesc) )
+	if ( ! ForEachInRange(_sdb, 0, CountShardUnits(_sdb), PrintAllToFile, (void*)&fileDesc) )
 	{
 		GetError(errMsg, ERR_GENERAL);
 		LOG_ERROR_PRINT("%s", errMsg);
@@ -352,6 +499,378 @@ ADTErr SubscriberDBPrintToFile(const SubscriberDB* _sdb, const char* _fileName)
 	return ERR_OK;
 }
 
+static int DoOnSubscriber(HashKey _key, Data _subscriber, void* _doParams)
+{
+	DoParams* doParams = (DoParams*)_doParams;
+	
+	return doParams->m_doFunc((const Subscriber*)_subscriber, doParams->m_params);
+}
+
+ADTErr SubscriberDBForEach(const SubscriberDB* _sdb, SubscriberDoFunc _doFunc, void* _params)
+{
+	DoParams doParams;
+	char errMsg[ERR_MSG_SIZE];
+	
+	if (NULL == _sdb)
+	{
+		GetError(errMsg, ERR_NOT_INITIALIZED);
+		LOG_ERROR_PRINT("%s", errMsg);
+		return ERR_NOT_INITIALIZED;
+	}
+	if (NULL == _doFunc)
+	{
+		GetError(errMsg, ERR_ILLEGAL_INPUT);
+		LOG_ERROR_PRINT("%s", errMsg);
+		return ERR_ILLEGAL_INPUT;
+	}
+	
+	doParams.m_doFunc = _doFunc;
+	doParams.m_params = _params;
+	ForEachInRange(_sdb, 0, CountShardUnits(_sdb), DoOnSubscriber, (void*)&doParams);
+	return ERR_OK;
+}
+
+static ADTErr FlushShardWriter(ShardWriter* _writer)
+{
+	size_t offset = 0;
+	ssize_t nBytes;
+	
+	while (offset < _writer->m_used)
+	{
+		nBytes = write(_writer->m_fileDesc, _writer->m_buffer + offset, _writer->m_used - offset);
+		if (nBytes < 0)
+		{
+			return ERR_FILE_WRITE;
+		}
+		offset += nBytes;
+	}
+	_writer->m_used = 0;
+	return ERR_OK;
+}
+
+static int PrintToShardWriter(HashKey _key, Data _subscriber, void* _writer)
+{
+	ShardWriter* writer = (ShardWriter*)_writer;
+	int nBytes;
+	
+	if (SubscriberGetGeneration((Subscriber*)_subscriber) <= writer->m_sinceGeneration)
+	{
+		return true;
+	}
+	
+	if (WRITE_BUFFER_SIZE - writer->m_used < MAX_RECORD_SIZE)
+	{
+		writer->m_err = FlushShardWriter(writer);
+		if (ERR_OK != writer->m_err)
+		{
+			return false;
+		}
+	}
+	
+	nBytes = SubscriberFormat((Subscriber*)_subscriber, writer->m_buffer + writer->m_used, MAX_RECORD_SIZE);
+	if (nBytes < 0 || nBytes >= MAX_RECORD_SIZE)
+	{
+		LOG_WARN_PRINT("%s", "Skipped subscriber that could not be formatted.");
+		return true;
+	}
+	writer->m_used += nBytes;
+	++writer->m_nPrinted;
+	return true;
+}
+
+ADTErr SubscriberDBPrintShardToFile(const SubscriberDB* _sdb, const char* _fileName, size_t _shard, size_t _nShards, unsigned long _sinceGeneration, size_t* _nPrinted)
+{
+	ShardWriter* writer = NULL;
+	size_t nBuckets;
+	size_t fromBucket;
+	size_t toBucket;
+	ADTErr err;
+	char errMsg[ERR_MSG_SIZE];
+	
+	if (NULL == _sdb)
+	{
+		GetError(errMsg, ERR_NOT_INITIALIZED);
+		LOG_ERROR_PRINT("%s", errMsg);
+		return ERR_NOT_INITIALIZED;
+	}
+	if (NULL == _fileName || 0 == _nShards || _shard >= _nShards)
+	{
+		GetError(errMsg, ERR_ILLEGAL_INPUT);
+		LOG_ERROR_PRINT("%s", errMsg);
+		return ERR_ILLEGAL_INPUT;
+	}
+	
+	/* too big for a thread stack */
+	writer = malloc(sizeof(ShardWriter));
+	if (NULL == writer)
+	{
+		GetError(errMsg, ERR_ALLOCATION_FAILED);
+		LOG_ERROR_PRINT("%s", errMsg);
+		return ERR_ALLOCATION_FAILED;
+	}
+	writer->m_sinceGeneration = _sinceGeneration;
+	writer->m_used = 0;
+	writer->m_nPrinted = 0;
+	writer->m_err = ERR_OK;
+	
+	writer->m_fileDesc = open(_fileName, O_WRONLY | O_TRUNC | O_CREAT, S_IRUSR | S_IWUSR);
+	if (writer->m_fileDesc < 0)
+	{
+		free(writer);
+		GetError(errMsg, ERR_FILE_OPEN);
+		LOG_ERROR_PRINT("%s", errMsg);
+		return ERR_FILE_OPEN;
+	}
+	
+	nBuckets = CountShardUnits(_sdb);
+	fromBucket = (nBuckets / _nShards) * _shard;
+	toBucket = (_shard == _nShards - 1) ? nBuckets : fromBucket + nBuckets / _nShards;
+	
+	ForEachInRange(_sdb, fromBucket, toBucket, PrintToShardWriter, (void*)writer);
+	err = (ERR_OK != writer->m_err) ? writer->m_err : FlushShardWriter(writer);
+	if (ERR_OK != err)
+	{
+		close(writer->m_fileDesc);
+		free(writer);
+		GetError(errMsg, err);
+		LOG_ERROR_PRINT("%s", errMsg);
+		return err;
+	}
+	
+	if (-1 == close(writer->m_fileDesc))
+	{
+		free(writer);
+		GetError(errMsg, ERR_FILE_CLOSE);
+		LOG_ERROR_PRINT("%s", errMsg);
+		return ERR_FILE_CLOSE;
+	}
+	
+	if (NULL != _nPrinted)
+	{
+		*_nPrinted = writer->m_nPrinted;
+	}
+	free(writer);
+	LOG_DEBUG_PRINT("Successfully wrote shard %lu/%lu to file %s.", (unsigned long)_shard, (unsigned long)_nShards, _fileName);
+	return ERR_OK;
+}
+
+/* Larger value ranks higher, equal values by IMSI, so merged shards always agree */
+static int RankIsLower(const SubscriberRank* _rank1, const SubscriberRank* _rank2)
+{
+	if (_rank1->m_value != _rank2->m_value)
+	{
+		return _rank1->m_value < _rank2->m_value;
+	}
+	return strcmp(_rank1->m_imsi, _rank2->m_imsi) > 0;
+}
+
+int SubscriberRankCompare(const void* _rank1, const void* _rank2)
+{
+	if (RankIsLower((const SubscriberRank*)_rank1, (const SubscriberRank*)_rank2))
+	{
+		return 1;
+	}
+	return RankIsLower((const SubscriberRank*)_rank2, (const SubscriberRank*)_rank1) ? -1 : 0;
+}
+
+static void HeapSiftDown(SubscriberRank* _heap, size_t _size, size_t _index)
+{
+	SubscriberRank tmp;
+	size_t smallest;
+	size_t child;
+	
+	while (1)
+	{
+		smallest = _index;
+		child = 2 * _index + 1;
+		if (child < _size && RankIsLower(&_heap[child], &_heap[smallest]))
+		{
+			smallest = child;
+		}
+		if (child + 1 < _size && RankIsLower(&_heap[child + 1], &_heap[smallest]))
+		{
+			smallest = child + 1;
+		}
+		if (smallest == _index)
+		{
+			return;
+		}
+		tmp = _heap[_index];
+		_heap[_index] = _heap[smallest];
+		_heap[smallest] = tmp;
+		_index = smallest;
+	}
+}
+
+static void HeapSiftUp(SubscriberRank* _heap, size_t _index)
+{
+	SubscriberRank tmp;
+	size_t parent;
+	
+	while (_index > 0)
+	{
+		parent = (_index - 1) / 2;
+		if (!RankIsLower(&_heap[_index], &_heap[parent]))
+		{
+			return;
+		}
+		tmp = _heap[_index];
+		_heap[_index] = _heap[parent];
+		_heap[parent] = tmp;
+		_index = parent;
+	}
+}
+
+/* Most subscribers lose to the root, so they cost one compare and no copy */
+static void HeapOffer(SubscriberRank* _heap, size_t _size, size_t _capacity, double _value, const char* _imsi)
+{
+	SubscriberRank candidate;
+	
+	candidate.m_value = _value;
+	if (_size == _capacity && _value < _heap[0].m_value)
+	{
+		return;
+	}
+	strncpy(candidate.m_imsi, _imsi, RANK_KEY_SIZE - 1);
+	candidate.m_imsi[RANK_KEY_SIZE - 1] = '\0';
+	if (_size < _capacity)
+	{
+		_heap[_size] = candidate;
+		HeapSiftUp(_heap, _size);
+	}
+	else if (RankIsLower(&_heap[0], &candidate))
+	{
+		_heap[0] = candidate;
+		HeapSiftDown(_heap, _size, 0);
+	}
+}
+
+/* Pops the minimum to the back until empty - leaves the heap sorted largest first */
+static void HeapSortDescending(SubscriberRank* _heap, size_t _size)
+{
+	SubscriberRank tmp;
+	
+	while (_size > 1)
+	{
+		--_size;
+		tmp = _heap[0];
+		_heap[0] = _heap[_size];
+		_heap[_size] = tmp;
+		HeapSiftDown(_heap, _size, 0);
+	}
+}
+
+static int OfferToHeaps(HashKey _key, Data _subscriber, void* _heaps)
+{
+	TopNHeaps* heaps = (TopNHeaps*)_heaps;
+	SubscriberUsage usage;
+	
+	if (ERR_OK != SubscriberGetUsage((Subscriber*)_subscriber, &usage))
+	{
+		return true;
+	}
+	HeapOffer(heaps->m_heaps[TOP_OUTGOING_DURATION], heaps->m_size, heaps->m_capacity, usage.m_outgoingDuration, (const char*)_key);
+	HeapOffer(heaps->m_heaps[TOP_DATA_VOLUME], heaps->m_size, heaps->m_capacity, usage.m_downloaded + usage.m_uploaded, (const char*)_key);
+	HeapOffer(heaps->m_heaps[TOP_MESSAGES_SENT], heaps->m_size, heaps->m_capacity, usage.m_messagesSent, (const char*)_key);
+	/* every subscriber is offered to all heaps, so they always have the same size */
+	if (heaps->m_size < heaps->m_capacity)
+	{
+		++heaps->m_size;
+	}
+	return true;
+}
+
+ADTErr SubscriberDBTopN(const SubscriberDB* _sdb, size_t _shard, size_t _nShards, size_t _n, SubscriberRank* _tops[NUM_OF_TOP_KINDS], size_t* _nRanked)
+{
+	TopNHeaps heaps;
+	size_t nBuckets;
+	size_t fromBucket;
+	size_t toBucket;
+	int kind;
+	char errMsg[ERR_MSG_SIZE];
+	
+	if (NULL == _sdb)
+	{
+		GetError(errMsg, ERR_NOT_INITIALIZED);
+		LOG_ERROR_PRINT("%s", errMsg);
+		return ERR_NOT_INITIALIZED;
+	}
+	if (NULL == _tops || 0 == _n || 0 == _nShards || _shard >= _nShards)
+	{
+		GetError(errMsg, ERR_ILLEGAL_INPUT);
+		LOG_ERROR_PRINT("%s", errMsg);
+		return ERR_ILLEGAL_INPUT;
+	}
+	for (kind = 0; kind < NUM_OF_TOP_KINDS; ++kind)
+	{
+		if (NULL == _tops[kind])
+		{
+			GetError(errMsg, ERR_ILLEGAL_INPUT);
+			LOG_ERROR_PRINT("%s", errMsg);
+			return ERR_ILLEGAL_INPUT;
+		}
+		heaps.m_heaps[kind] = _tops[kind];
+	}
+	heaps.m_capacity = _n;
+	heaps.m_size = 0;
+	
+	nBuckets = CountShardUnits(_sdb);
+	fromBucket = (nBuckets / _nShards) * _shard;
+	toBucket = (_shard == _nShards - 1) ? nBuckets : fromBucket + nBuckets / _nShards;
+	
+	ForEachInRange(_sdb, fromBucket, toBucket, OfferToHeaps, (void*)&heaps);
+	for (kind = 0; kind < NUM_OF_TOP_KINDS; ++kind)
+	{
+		HeapSortDescending(_tops[kind], heaps.m_size);
+	}
+	
+	if (NULL != _nRanked)
+	{
+		*_nRanked = heaps.m_size;
+	}
+	LOG_DEBUG_PRINT("Ranked %lu subscribers of shard %lu/%lu.", (unsigned long)heaps.m_size, (unsigned long)_shard, (unsigned long)_nShards);
+	return ERR_OK;
+}
+
+ADTErr SubscriberDBMarkDirty(SubscriberDB* _sdb, Subscriber* _sub)
+{
+	char errMsg[ERR_MSG_SIZE];
+	
+	if (NULL == _sdb)
+	{
+		GetError(errMsg, ERR_NOT_INITIALIZED);
+		LOG_ERROR_PRINT("%s", errMsg);
+		return ERR_NOT_INITIALIZED;
+	}
+	if (NULL == _sub)
+	{
+		GetError(errMsg, ERR_ILLEGAL_INPUT);
+		LOG_ERROR_PRINT("%s", errMsg);
+		return ERR_ILLEGAL_INPUT;
+	}
+	
+	SubscriberSetGeneration(_sub, _sdb->m_generation);
+	return ERR_OK;
+}
+
+unsigned long SubscriberDBCloseGeneration(SubscriberDB* _sdb)
+{
+	if (NULL == _sdb)
+	{
+		LOG_WARN_PRINT("%s", "Attempted to close generation of uninitialized subscriber database");
+		return 0;
+	}
+	
+	LOG_DEBUG_PRINT("Closed subscriber generation %lu.", _sdb->m_generation);
+	if (NULL != _sdb->m_table)
+	{
+		/* the file starts writing back what the closed generation changed */
+		PTableSetUserValue(_sdb->m_table, _sdb->m_generation + 1);
+		PTableFlush(_sdb->m_table);
+	}
+	return _sdb->m_generation++;
+}
+
 #ifdef _DEBUG
 void SubscriberDBPrint(const SubscriberDB* _sdb)
 {
@@ -361,6 +880,11 @@ void SubscriberDBPrint(const SubscriberDB* _sdb)
 		return;
 	}
 	
+	if (NULL != _sdb->m_table)
+	{
+		PTableForEachInRange(_sdb->m_table, 0, PTableCountItems(_sdb->m_table), PrintStoredSubscribers, NULL);
+		return;
+	}
 	HashPrint(_sdb->m_map, PrintSubscribers);
 }
 #endif /* _DEBUG */
@@ -11,8 +11,33 @@
 
 typedef struct SubscriberDB SubscriberDB;
 
+#define RANK_KEY_SIZE 32
+
+/* What subscribers are ranked by in SubscriberDBTopN */
+typedef enum
+{
+	TOP_OUTGOING_DURATION,	/* outgoing call seconds */
+	TOP_DATA_VOLUME,		/* downloaded + uploaded MB */
+	TOP_MESSAGES_SENT,		/* sent SMS */
+	NUM_OF_TOP_KINDS
+} e_topKind;
+
+typedef struct
+{
+	double	m_value;
+	char	m_imsi[RANK_KEY_SIZE];
+} SubscriberRank;
+
 SubscriberDB* 	SubscriberDBCreate(ADTErr* _err); 
 
+/*
+ * A database kept in the memory mapped file _fileName (created if missing), so the next
+ * run opens it with all its subscribers at once, no matter how many there are.
+ * Inserted subscribers are copied into the file and freed, Get returns them in place.
+ * The current generation is kept with them - delta exports go on across runs.
+ */
+SubscriberDB* 	SubscriberDBOpen(const char* _fileName, ADTErr* _err);
+
 /* Note: frees all subscribers still stored */
 void 			SubscriberDBDestroy(SubscriberDB* _sdb);
 
@@ -24,6 +49,41 @@ ADTErr 			SubscriberDBRemove(SubscriberDB* _sdb, const char* _imsi, Subscriber**
 
 ADTErr 			SubscriberDBPrintToFile(const SubscriberDB* _sdb, const char* _fileName);
 
+/* Visits every subscriber (unordered), stops when _doFunc returns 0 */
+typedef int (*SubscriberDoFunc)(const Subscriber* _sub, void* _params);
+ADTErr			SubscriberDBForEach(const SubscriberDB* _sdb, SubscriberDoFunc _doFunc, void* _params);
+
+/*
+ * Prints shard number _shard out of _nShards into _fileName (truncated).
+ * Shards split the bucket range evenly, so _nShards threads may print
+ * different shards of the same database at the same time.
+ * Only subscribers changed after generation _sinceGeneration are printed
+ * (0 prints all of them).
+ * Number of printed subscribers is returned in _nPrinted (may be NULL).
+ */
+ADTErr 			SubscriberDBPrintShardToFile(const SubscriberDB* _sdb, const char* _fileName, size_t _shard, size_t _nShards, unsigned long _sinceGeneration, size_t* _nPrinted);
+
+/*
+ * Top-N of shard number _shard out of _nShards (same split as SubscriberDBPrintShardToFile),
+ * for every e_topKind in a single pass over the shard.
+ * _tops[kind] must hold _n ranks; it is filled largest first, equal values by IMSI.
+ * Number of ranks filled in each list is returned in _nRanked (may be NULL).
+ */
+ADTErr			SubscriberDBTopN(const SubscriberDB* _sdb, size_t _shard, size_t _nShards, size_t _n, SubscriberRank* _tops[NUM_OF_TOP_KINDS], size_t* _nRanked);
+
+/* qsort order of SubscriberDBTopN lists - for merging the lists of several shards */
+int				SubscriberRankCompare(const void* _rank1, const void* _rank2);
+
+/*
+ * Dirty tracking:
+ * Every insert, and every SubscriberDBMarkDirty after an in-place update,
+ * stamps the subscriber with the current generation.
+ * SubscriberDBCloseGeneration returns the current generation and opens a new one,
+ * so a delta export prints everything after the previously closed generation.
+ */
+ADTErr			SubscriberDBMarkDirty(SubscriberDB* _sdb, Subscriber* _sub);
+unsigned long	SubscriberDBCloseGeneration(SubscriberDB* _sdb);
+
 #ifdef _DEBUG
 void			SubscriberDBPrint(const SubscriberDB* _sdb);
 #endif /* _DEBUG */
@@ -0,0 +1,388 @@
+/**************************************************************************************************
+	Creation date: 			19.10.26
+	Last modified date: 	19.10.26
+
+	Description: End to end benchmark of the billing pipeline.
+				 Generates CDR files with cdrgen (fixed seed - same data on every run),
+				 then runs InitReaders -> SafeQueue -> DBFeeder -> full bill export once
+				 and prints one JSON object with the throughput, per stage CPU and wall
+				 time, queue wait and peak RSS.
+				 Reading/parsing and feeding overlap, so their wall time is the same
+				 ingest time; the export runs alone after it.
+
+	Usage: bench [options]
+				 -D dir			use existing CDR files instead of generating (path ends with '/')
+				 -n lines		total lines (1000000)
+				 -f files		(10)
+				 -s subscribers	(100000)
+				 -z exponent	Zipf skew of the subscriber activity (1.0)
+				 -e ratio		malformed lines (0)
+				 -r seed		(1)
+				 -q size		SafeQueue size (10, as RunBilling)
+				 -t threads		reader threads (online cores, as RunBilling)
+				 -a msec		auto size the readers and the queue every msec (0 - off)
+				 -b backend		file reads: auto, io_uring or pread (auto)
+				 -L label		copied to the JSON, e.g. the commit being measured
+				 -o file		JSON output (stdout)
+**************************************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+#include "ADTErr.h"
+#include "logger.h"
+#include "logger_pub.h"
+#include "safeQueue.h"
+#include "cdr.h"
+#include "parser.h"
+#include "Subscriber.h"
+#include "SubscriberDB.h"
+#include "Operator.h"
+#include "OperatorDB.h"
+#include "DataManager.h"
+#include "Billing.h"
+#include "ShmRing.h"
+#include "FilesReader.h"
+#include "BlockReader.h"
+#include "AutoSizer.h"
+
+#define CDRGEN_PATH "./cdrgen"
+#define GEN_DIR "./bench-data/"
+#define BENCH_LOG "BENCH_LOGGER"
+#define DEFAULT_LINES "1000000"
+#define DEFAULT_FILES "10"
+#define DEFAULT_SUBSCRIBERS "100000"
+#define DEFAULT_ZIPF "1.0"
+#define DEFAULT_MALFORMED "0"
+#define DEFAULT_SEED "1"
+#define DEFAULT_Q_SIZE 10
+/*FilesReader builds dir + file name in 64 bytes*/
+#define DIR_SIZE 48
+#define STR_ERR_SIZE 60
+#define NSEC_IN_SEC 1e9
+#define USEC_IN_SEC 1e6
+#define BYTES_IN_MB (1024.0 * 1024.0)
+
+typedef struct
+{
+	const char*	m_dataDir;
+	int			m_generate;
+	const char*	m_lines;
+	const char*	m_files;
+	const char*	m_subscribers;
+	const char*	m_zipf;
+	const char*	m_malformed;
+	const char*	m_seed;
+	size_t		m_queueSize;
+	size_t		m_nReaders;
+	unsigned int	m_autoSizeMs;
+	const char*	m_label;
+	const char*	m_output;
+	ReadBackend	m_readBackend;
+} BenchConfig;
+
+typedef struct
+{
+	double			m_ingestSec;
+	double			m_exportSec;
+	double			m_exportCpuSec;
+	double			m_processCpuSec;
+	long			m_peakRssKb;
+	size_t			m_finalReaders;
+	size_t			m_finalQueueSize;
+	ReadersStats	m_readers;
+	DBManagerStats	m_feeder;
+} BenchResult;
+
+static double NowSec (void)
+{
+	struct timespec now;
+	clock_gettime (CLOCK_MONOTONIC, &now);
+	return now.tv_sec + now.tv_nsec / NSEC_IN_SEC;
+}
+
+static double CpuSec (void)
+{
+	struct rusage usage;
+	getrusage (RUSAGE_SELF, &usage);
+	return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / USEC_IN_SEC;
+}
+
+/*runs cdrgen and waits for it*/
+static int Generate (const BenchConfig* _config)
+{
+	int status;
+	pid_t pid = fork ();
+	if (pid < 0)
+	{
+		perror ("fork");
+		return -1;
+	}
+	if (0 == pid)
+	{
+		/*its progress line would mix with the JSON*/
+		if (NULL == freopen ("/dev/null", "w", stdout))
+		{
+			_exit (1);
+		}
+		execl (CDRGEN_PATH, CDRGEN_PATH, "-d", _config->m_dataDir, "-n", _config->m_lines, "-f", _config->m_files,
+			   "-s", _config->m_subscribers, "-z", _config->m_zipf, "-e", _config->m_malformed, "-r", _config->m_seed, (char*)NULL);
+		perror (CDRGEN_PATH);
+		_exit (1);
+	}
+	if (pid != waitpid (pid, &status, 0) || !WIFEXITED(status) || 0 != WEXITSTATUS(status))
+	{
+		fprintf (stderr, "%s\n", "cdrgen failed - build it with 'make cdrgen'");
+		return -1;
+	}
+	return 0;
+}
+
+/*reads the files into the running feeder, which gets the end message whatever fails here*/
+static ADTErr Ingest (const BenchConfig* _config, SafeQueue* _safeQ, char* _path)
+{
+	ADTErr err;
+	ADTErr sizerErr = ERR_OK;
+	if (ERR_OK != (err = InitReadersWithCount (_safeQ, _path, _config->m_nReaders)))
+	{
+		SendEndMsg2Queue (_safeQ);
+		return err;
+	}
+	if (_config->m_autoSizeMs)
+	{
+		sizerErr = AutoSizerInit (_safeQ, _config->m_autoSizeMs);
+	}
+	/*the readers run either way, and are joined*/
+	if (ERR_OK != (err = EndReaders (_safeQ)))
+	{
+		SendEndMsg2Queue (_safeQ);
+	}
+	if (_config->m_autoSizeMs && ERR_OK == sizerErr)
+	{
+		sizerErr = EndAutoSizer ();
+	}
+	return (ERR_OK != err) ? err : sizerErr;
+}
+
+static ADTErr RunPipeline (const BenchConfig* _config, BenchResult* _result)
+{
+	SafeQueue* safeQ;
+	DBManagerParams* params;
+	ADTErr err;
+	ADTErr endErr;
+	double start;
+	double exportStart;
+	double exportCpuStart;
+	char path[DIR_SIZE];
+
+	strncpy (path, _config->m_dataDir, DIR_SIZE - 1);
+	path[DIR_SIZE - 1] = '\0';
+	if (ERR_OK != (err = BillingPrepSignals ()))
+	{
+		return err;
+	}
+	safeQ = SafeQueueInit (_config->m_queueSize);
+	if (NULL == safeQ)
+	{
+		return ERR_ALLOCATION_FAILED;
+	}
+	start = NowSec ();
+	params = InitDBManager (safeQ, &err);
+	if (NULL == params)
+	{
+		SafeQueueDestroy (safeQ);
+		return err;
+	}
+	if (ERR_OK != (err = BillingInit (params)))
+	{
+		SendEndMsg2Queue (safeQ);
+	}
+	else
+	{
+		err = Ingest (_config, safeQ, path);
+	}
+	/*one way out from here - the feeder has its end message by now*/
+	if (ERR_OK != (endErr = EndDBManager (params)) && ERR_OK == err)
+	{
+		err = endErr;
+	}
+	if (ERR_OK == err)
+	{
+		_result->m_finalReaders = _config->m_nReaders;
+		_result->m_finalQueueSize = _config->m_queueSize;
+		if (_config->m_autoSizeMs)
+		{
+			AutoSizerGetSizes (&_result->m_finalReaders, &_result->m_finalQueueSize);
+		}
+		exportStart = NowSec ();
+		exportCpuStart = CpuSec ();
+		/*the billing thread does the exports before it stops*/
+		if (ERR_OK == (err = BillingRequest (BILL_SUBSCRIBERS | BILL_OPERATORS | BILL_STOP)))
+		{
+			err = EndBilling ();
+		}
+		_result->m_exportSec = NowSec () - exportStart;
+		_result->m_exportCpuSec = CpuSec () - exportCpuStart;
+		_result->m_ingestSec = exportStart - start;
+		GetReadersStats (&_result->m_readers);
+		GetDBManagerStats (params, &_result->m_feeder);
+	}
+	else if (ERR_OK == BillingRequest (BILL_STOP))
+	{
+		/*only when BillingInit started it*/
+		EndBilling ();
+	}
+	DestroyDBManager (params);
+	SafeQueueDestroy (safeQ);
+	return err;
+}
+
+/*_string quoted, with '"', '\\' and control characters escaped*/
+static void PrintJsonString (FILE* _out, const char* _string)
+{
+	const unsigned char* next;
+	fputc ('"', _out);
+	for (next = (const unsigned char*)_string; '\0' != *next; ++next)
+	{
+		if ('"' == *next || '\\' == *next)
+		{
+			fprintf (_out, "\\%c", *next);
+		}
+		else if (*next < ' ')
+		{
+			fprintf (_out, "\\u%04x", *next);
+		}
+		else
+		{
+			fputc (*next, _out);
+		}
+	}
+	fputc ('"', _out);
+}
+
+static void PrintJson (FILE* _out, const BenchConfig* _config, const BenchResult* _result)
+{
+	double totalSec = _result->m_ingestSec + _result->m_exportSec;
+	fprintf (_out, "{\"label\": ");
+	PrintJsonString (_out, _config->m_label);
+	fprintf (_out, ", \"config\": {\"data_dir\": ");
+	PrintJsonString (_out, _config->m_dataDir);
+	fprintf (_out, ", \"generated\": %s, \"seed\": %s, \"lines\": %s, \"files\": %s, "
+			 "\"subscribers\": %s, \"zipf\": %s, \"malformed_ratio\": %s, \"queue_size\": %lu, \"reader_threads\": %lu, \"auto_size_ms\": %u, \"read_backend\": \"%s\"}, ",
+			 _config->m_generate ? "true" : "false", _config->m_seed, _config->m_lines, _config->m_files,
+			 _config->m_subscribers, _config->m_zipf, _config->m_malformed,
+			 (unsigned long)_config->m_queueSize, (unsigned long)_config->m_nReaders, _config->m_autoSizeMs,
+			 BlockReaderBackendName (_config->m_readBackend));
+	fprintf (_out, "\"final_queue_size\": %lu, \"final_reader_threads\": %lu, ",
+			 (unsigned long)_result->m_finalQueueSize, (unsigned long)_result->m_finalReaders);
+	fprintf (_out, "\"lines\": %lu, \"bad_lines\": %lu, \"records\": %lu, \"bytes\": %lu, ",
+			 _result->m_readers.m_lines, _result->m_readers.m_badLines, _result->m_feeder.m_records, _result->m_readers.m_bytes);
+	fprintf (_out, "\"wall_sec\": %.6f, \"records_per_sec\": %.1f, \"mb_per_sec\": %.3f, ",
+			 totalSec, _result->m_readers.m_lines / _result->m_ingestSec, _result->m_readers.m_bytes / BYTES_IN_MB / _result->m_ingestSec);
+	fprintf (_out, "\"stages\": {\"read_parse\": {\"wall_sec\": %.6f, \"cpu_sec\": %.6f, \"queue_wait_sec\": %.6f}, ",
+			 _result->m_ingestSec, _result->m_readers.m_cpuNsec / NSEC_IN_SEC, _result->m_readers.m_queueWaitNsec / NSEC_IN_SEC);
+	fprintf (_out, "\"db_feed\": {\"wall_sec\": %.6f, \"cpu_sec\": %.6f, \"queue_wait_sec\": %.6f}, ",
+			 _result->m_ingestSec, _result->m_feeder.m_cpuNsec / NSEC_IN_SEC, _result->m_feeder.m_queueWaitNsec / NSEC_IN_SEC);
+	fprintf (_out, "\"export\": {\"wall_sec\": %.6f, \"cpu_sec\": %.6f}}, ", _result->m_exportSec, _result->m_exportCpuSec);
+	fprintf (_out, "\"process_cpu_sec\": %.6f, \"peak_rss_kb\": %ld}\n", _result->m_processCpuSec, _result->m_peakRssKb);
+}
+
+static void Usage (const char* _name)
+{
+	fprintf (stderr, "Usage: %s [-D dir/] [-n lines] [-f files] [-s subscribers] [-z zipf] [-e malformed ratio] [-r seed] "
+			 "[-q queue size] [-t reader threads] [-a auto size msec] [-b read backend] [-L label] [-o json file]\n", _name);
+}
+
+int main (int argc, char* argv[])
+{
+	BenchConfig config = {GEN_DIR, 1, DEFAULT_LINES, DEFAULT_FILES, DEFAULT_SUBSCRIBERS, DEFAULT_ZIPF, DEFAULT_MALFORMED,
+						  DEFAULT_SEED, DEFAULT_Q_SIZE, 0, 0, "", NULL, READ_BACKEND_AUTO};
+	long nCores = sysconf (_SC_NPROCESSORS_ONLN);
+	BenchResult result;
+	struct rusage usage;
+	char strErr[STR_ERR_SIZE];
+	FILE* out = stdout;
+	ADTErr err;
+	int opt;
+
+	config.m_nReaders = nCores < 1 ? 1 : nCores > MAX_READER_THREADS ? MAX_READER_THREADS : (size_t)nCores;
+
+	while (-1 != (opt = getopt (argc, argv, "D:n:f:s:z:e:r:q:t:a:b:L:o:")))
+	{
+		switch (opt)
+		{
+			case 'D': config.m_dataDir = optarg; config.m_generate = 0; break;
+			case 'n': config.m_lines = optarg; break;
+			case 'f': config.m_files = optarg; break;
+			case 's': config.m_subscribers = optarg; break;
+			case 'z': config.m_zipf = optarg; break;
+			case 'e': config.m_malformed = optarg; break;
+			case 'r': config.m_seed = optarg; break;
+			case 'q': config.m_queueSize = strtoul (optarg, NULL, 10); break;
+			case 't': config.m_nReaders = strtoul (optarg, NULL, 10); break;
+			case 'a': config.m_autoSizeMs = strtoul (optarg, NULL, 10); break;
+			case 'b':
+				if (0 == strcmp (optarg, "io_uring"))
+				{
+					config.m_readBackend = READ_BACKEND_URING;
+				}
+				else if (0 == strcmp (optarg, "pread"))
+				{
+					config.m_readBackend = READ_BACKEND_PREAD;
+				}
+				else if (0 != strcmp (optarg, "auto"))
+				{
+					Usage (argv[0]);
+					return 1;
+				}
+				break;
+			case 'L': config.m_label = optarg; break;
+			case 'o': config.m_output = optarg; break;
+			default: Usage (argv[0]); return 1;
+		}
+	}
+	if (0 == config.m_queueSize || 0 == config.m_nReaders || config.m_nReaders > MAX_READER_THREADS
+		|| strlen (config.m_dataDir) >= DIR_SIZE || '/' != config.m_dataDir[strlen (config.m_dataDir) - 1])
+	{
+		Usage (argv[0]);
+		return 1;
+	}
+	if (config.m_generate && 0 != Generate (&config))
+	{
+		return 1;
+	}
+	/*warnings only - debug prints of every record would be the benchmark*/
+	LogCreate (LOG_ERROR | LOG_WARN, BENCH_LOG);
+	memset (&result, 0, sizeof(result));
+	config.m_readBackend = BlockReaderSelect (config.m_readBackend);
+	err = RunPipeline (&config, &result);
+	LogDestroy ();
+	if (ERR_OK != err)
+	{
+		GetError (strErr, err);
+		fprintf (stderr, "pipeline failed: %s\n", strErr);
+		return 1;
+	}
+	getrusage (RUSAGE_SELF, &usage);
+	result.m_peakRssKb = usage.ru_maxrss;
+	result.m_processCpuSec = CpuSec ();
+	if (NULL != config.m_output && NULL == (out = fopen (config.m_output, "w")))
+	{
+		perror (config.m_output);
+		return 1;
+	}
+	PrintJson (out, &config, &result);
+	if (stdout != out)
+	{
+		fclose (out);
+	}
+	return 0;
+}
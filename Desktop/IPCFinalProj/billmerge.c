@@ -0,0 +1,408 @@
+/**************************************************************************************************
+	Creation date: 			19.10.26
+	Last modified date: 	19.10.26
+
+	Description: Merges the bills of K RunBilling instances into one bill set.
+				 Every instance runs in its own directory with -P i/K and bills only its
+				 partition of the IMSIs, so subscribers appear in one input each; every
+				 operator appears in all of them and its totals are summed.
+				 An instance appends its operators to OperatorsInfos.txt on every export,
+				 so within one input the last block of a key wins - only the inputs are
+				 summed.
+				 Reads <dir>/OperatorsInfos.txt and the shards listed in
+				 <dir>/SubscribersInfos.manifest, writes the same files (one shard) to
+				 the output directory. Records keep the order they were first seen in.
+				 Data volumes are summed from the %g the instances printed - about 6
+				 significant digits, as in the inputs.
+
+	Usage: billmerge [-o dir/] dir/ ...
+				 -o dir			output directory, must exist (./)
+**************************************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <getopt.h>
+
+#define OPERATORS_FILE "OperatorsInfos.txt"
+#define SUBSCRIBERS_PREFIX "SubscribersInfos"
+#define PATH_SIZE 512
+/*room for the ".tmp"*/
+#define TMP_PATH_SIZE (PATH_SIZE + 8)
+#define LINE_SIZE 256
+#define KEY_SIZE 64
+#define INITIAL_CAPACITY 1024
+#define NUM_OF_TOTALS 4
+#define NUM_OF_VOLUMES 2
+
+typedef struct
+{
+	char			m_key[KEY_SIZE];
+	unsigned long	m_totals[NUM_OF_TOTALS];
+	double			m_volumes[NUM_OF_VOLUMES];
+} Record;
+
+/*records in the order they were first seen, and an open addressing index to them*/
+typedef struct
+{
+	const char*	m_keyTitle;		/*"Operator" or "IMSI"*/
+	Record*		m_records;
+	size_t		m_nRecords;
+	size_t		m_capacity;
+	size_t*		m_index;		/*record + 1, 0 - empty, twice the capacity*/
+} Bill;
+
+static const char* s_totalTitles[NUM_OF_TOTALS] =
+{
+	"Total incoming calls duration", "Total outgoing calls duration", "Total messages received", "Total messages sent"
+};
+static const char* s_volumeTitles[NUM_OF_VOLUMES] = {"Total downloaded data", "Total uploaded data"};
+
+static unsigned long s_fromGeneration = 0;
+static unsigned long s_toGeneration = 0;
+
+static size_t HashOf (const char* _key)
+{
+	size_t hash = 5381;
+	for (; '\0' != *_key; ++_key)
+	{
+		hash = hash * 33 + (unsigned char)*_key;
+	}
+	return hash;
+}
+
+static int BillInit (Bill* _bill, const char* _keyTitle)
+{
+	_bill->m_keyTitle = _keyTitle;
+	_bill->m_nRecords = 0;
+	_bill->m_capacity = INITIAL_CAPACITY;
+	_bill->m_records = malloc (_bill->m_capacity * sizeof(Record));
+	_bill->m_index = calloc (2 * _bill->m_capacity, sizeof(size_t));
+	return (NULL != _bill->m_records && NULL != _bill->m_index) ? 0 : -1;
+}
+
+static void BillDestroy (Bill* _bill)
+{
+	free (_bill->m_records);
+	free (_bill->m_index);
+}
+
+/*empty again, the memory is kept for the next input*/
+static void BillClear (Bill* _bill)
+{
+	_bill->m_nRecords = 0;
+	memset (_bill->m_index, 0, 2 * _bill->m_capacity * sizeof(size_t));
+}
+
+static size_t* Slot (const Bill* _bill, const char* _key)
+{
+	size_t mask = 2 * _bill->m_capacity - 1;
+	size_t i = HashOf (_key) & mask;
+	while (0 != _bill->m_index[i] && 0 != strcmp (_bill->m_records[_bill->m_index[i] - 1].m_key, _key))
+	{
+		i = (i + 1) & mask;
+	}
+	return &_bill->m_index[i];
+}
+
+static int Grow (Bill* _bill)
+{
+	Record* records = realloc (_bill->m_records, 2 * _bill->m_capacity * sizeof(Record));
+	size_t i;
+	if (NULL == records)
+	{
+		return -1;
+	}
+	_bill->m_records = records;
+	free (_bill->m_index);
+	_bill->m_capacity *= 2;
+	_bill->m_index = calloc (2 * _bill->m_capacity, sizeof(size_t));
+	if (NULL == _bill->m_index)
+	{
+		return -1;
+	}
+	for (i = 0; i < _bill->m_nRecords; ++i)
+	{
+		*Slot (_bill, _bill->m_records[i].m_key) = i + 1;
+	}
+	return 0;
+}
+
+/*the record of _key, a zeroed new one the first time*/
+static Record* Find (Bill* _bill, const char* _key)
+{
+	size_t* slot = Slot (_bill, _key);
+	Record* record;
+	if (0 != *slot)
+	{
+		return &_bill->m_records[*slot - 1];
+	}
+	if (_bill->m_nRecords == _bill->m_capacity)
+	{
+		if (0 != Grow (_bill))
+		{
+			return NULL;
+		}
+		slot = Slot (_bill, _key);
+	}
+	record = &_bill->m_records[_bill->m_nRecords];
+	memset (record, 0, sizeof(Record));
+	strncpy (record->m_key, _key, KEY_SIZE - 1);
+	*slot = ++_bill->m_nRecords;
+	return record;
+}
+
+/*"Title: value" - the value if the line has _title*/
+static const char* ValueOf (const char* _line, const char* _title)
+{
+	size_t length = strlen (_title);
+	return (0 == strncmp (_line, _title, length) && ':' == _line[length]) ? _line + length + 1 : NULL;
+}
+
+/*a key seen again starts over - its last block in the file wins*/
+static int AddFile (Bill* _bill, const char* _fileName)
+{
+	char line[LINE_SIZE];
+	Record* record = NULL;
+	const char* value;
+	unsigned long total;
+	double volume;
+	size_t i;
+	FILE* file = fopen (_fileName, "r");
+	if (NULL == file)
+	{
+		perror (_fileName);
+		return -1;
+	}
+	while (fgets (line, LINE_SIZE, file))
+	{
+		line[strcspn (line, "\n")] = '\0';
+		if (NULL != (value = ValueOf (line, _bill->m_keyTitle)))
+		{
+			if (NULL == (record = Find (_bill, value + 1)))
+			{
+				fclose (file);
+				fprintf (stderr, "%s\n", "out of memory");
+				return -1;
+			}
+			memset (record->m_totals, 0, sizeof(record->m_totals));
+			memset (record->m_volumes, 0, sizeof(record->m_volumes));
+			continue;
+		}
+		for (i = 0; i < NUM_OF_TOTALS; ++i)
+		{
+			if (NULL != record && NULL != (value = ValueOf (line, s_totalTitles[i])) && 1 == sscanf (value, "%lu", &total))
+			{
+				record->m_totals[i] += total;
+			}
+		}
+		for (i = 0; i < NUM_OF_VOLUMES; ++i)
+		{
+			if (NULL != record && NULL != (value = ValueOf (line, s_volumeTitles[i])) && 1 == sscanf (value, "%lf", &volume))
+			{
+				record->m_volumes[i] += volume;
+			}
+		}
+	}
+	fclose (file);
+	return 0;
+}
+
+/*the records of one input summed into _bill*/
+static int AddBill (Bill* _bill, const Bill* _input)
+{
+	Record* record;
+	size_t i;
+	size_t j;
+	for (i = 0; i < _input->m_nRecords; ++i)
+	{
+		if (NULL == (record = Find (_bill, _input->m_records[i].m_key)))
+		{
+			fprintf (stderr, "%s\n", "out of memory");
+			return -1;
+		}
+		for (j = 0; j < NUM_OF_TOTALS; ++j)
+		{
+			record->m_totals[j] += _input->m_records[i].m_totals[j];
+		}
+		for (j = 0; j < NUM_OF_VOLUMES; ++j)
+		{
+			record->m_volumes[j] += _input->m_records[i].m_volumes[j];
+		}
+	}
+	return 0;
+}
+
+/*the shard files of one instance, as its manifest lists them*/
+static int AddSubscribers (Bill* _bill, const char* _dir)
+{
+	char path[PATH_SIZE];
+	char line[LINE_SIZE];
+	char shardName[LINE_SIZE];
+	unsigned long from;
+	unsigned long to;
+	int result = 0;
+	FILE* manifest;
+	snprintf (path, PATH_SIZE, "%s%s.manifest", _dir, SUBSCRIBERS_PREFIX);
+	if (NULL == (manifest = fopen (path, "r")))
+	{
+		perror (path);
+		return -1;
+	}
+	while (0 == result && fgets (line, LINE_SIZE, manifest))
+	{
+		if (2 == sscanf (line, "generations %lu-%lu", &from, &to))
+		{
+			s_fromGeneration = (0 == s_fromGeneration || from < s_fromGeneration) ? from : s_fromGeneration;
+			s_toGeneration = to > s_toGeneration ? to : s_toGeneration;
+		}
+		else if (1 == sscanf (line, SUBSCRIBERS_PREFIX ".%255s", shardName))
+		{
+			snprintf (path, PATH_SIZE, "%s%s.%s", _dir, SUBSCRIBERS_PREFIX, shardName);
+			result = AddFile (_bill, path);
+		}
+	}
+	fclose (manifest);
+	return result;
+}
+
+/*written to a tmp file and renamed, as Billing does*/
+static int WriteBill (const Bill* _bill, const char* _fileName)
+{
+	char tmpName[TMP_PATH_SIZE];
+	const Record* record;
+	size_t i;
+	size_t j;
+	FILE* file;
+	snprintf (tmpName, TMP_PATH_SIZE, "%s.tmp", _fileName);
+	if (NULL == (file = fopen (tmpName, "w")))
+	{
+		perror (tmpName);
+		return -1;
+	}
+	for (i = 0; i < _bill->m_nRecords; ++i)
+	{
+		record = &_bill->m_records[i];
+		fprintf (file, "%s: %s\n----------------------\n", _bill->m_keyTitle, record->m_key);
+		for (j = 0; j < NUM_OF_TOTALS; ++j)
+		{
+			fprintf (file, "%s: %lu\n", s_totalTitles[j], record->m_totals[j]);
+		}
+		for (j = 0; j < NUM_OF_VOLUMES; ++j)
+		{
+			fprintf (file, "%s: %g [MB]\n", s_volumeTitles[j], record->m_volumes[j]);
+		}
+		fprintf (file, "\n");
+	}
+	if (0 != fclose (file) || 0 != rename (tmpName, _fileName))
+	{
+		perror (_fileName);
+		return -1;
+	}
+	return 0;
+}
+
+static int WriteManifest (const char* _outDir, size_t _nSubscribers)
+{
+	char fileName[PATH_SIZE];
+	char tmpName[TMP_PATH_SIZE];
+	FILE* manifest;
+	snprintf (fileName, PATH_SIZE, "%s%s.manifest", _outDir, SUBSCRIBERS_PREFIX);
+	snprintf (tmpName, TMP_PATH_SIZE, "%s.tmp", fileName);
+	if (NULL == (manifest = fopen (tmpName, "w")))
+	{
+		perror (tmpName);
+		return -1;
+	}
+	fprintf (manifest, "shards 1\nsubscribers %lu\ngenerations %lu-%lu\n%s.0.txt %lu\n", (unsigned long)_nSubscribers,
+			 s_fromGeneration, s_toGeneration, SUBSCRIBERS_PREFIX, (unsigned long)_nSubscribers);
+	if (0 != fclose (manifest) || 0 != rename (tmpName, fileName))
+	{
+		perror (fileName);
+		return -1;
+	}
+	return 0;
+}
+
+int main (int argc, char* argv[])
+{
+	const char* outDir = "./";
+	char path[PATH_SIZE];
+	Bill operators;
+	Bill subscribers;
+	Bill input;
+	int result = 0;
+	int opt;
+	int i;
+
+	while (-1 != (opt = getopt (argc, argv, "o:")))
+	{
+		switch (opt)
+		{
+			case 'o': outDir = optarg; break;
+			default: optind = argc + 1;
+		}
+	}
+	if (optind >= argc || '/' != outDir[strlen (outDir) - 1])
+	{
+		fprintf (stderr, "Usage: %s [-o dir/] dir/ ...\n", argv[0]);
+		return 1;
+	}
+	if (0 != BillInit (&operators, "Operator") || 0 != BillInit (&subscribers, "IMSI") || 0 != BillInit (&input, "Operator"))
+	{
+		fprintf (stderr, "%s\n", "out of memory");
+		return 1;
+	}
+	for (i = optind; i < argc && 0 == result; ++i)
+	{
+		if ('/' != argv[i][strlen (argv[i]) - 1])
+		{
+			fprintf (stderr, "%s: directories end with '/'\n", argv[i]);
+			result = -1;
+			break;
+		}
+		snprintf (path, PATH_SIZE, "%s%s", argv[i], OPERATORS_FILE);
+		input.m_keyTitle = "Operator";
+		BillClear (&input);
+		result = AddFile (&input, path);
+		if (0 == result)
+		{
+			result = AddBill (&operators, &input);
+		}
+		if (0 == result)
+		{
+			input.m_keyTitle = "IMSI";
+			BillClear (&input);
+			result = AddSubscribers (&input, argv[i]);
+		}
+		if (0 == result)
+		{
+			result = AddBill (&subscribers, &input);
+		}
+	}
+	if (0 == result)
+	{
+		snprintf (path, PATH_SIZE, "%s%s", outDir, OPERATORS_FILE);
+		result = WriteBill (&operators, path);
+	}
+	if (0 == result)
+	{
+		snprintf (path, PATH_SIZE, "%s%s.0.txt", outDir, SUBSCRIBERS_PREFIX);
+		result = WriteBill (&subscribers, path);
+	}
+	if (0 == result)
+	{
+		result = WriteManifest (outDir, subscribers.m_nRecords);
+	}
+	if (0 == result)
+	{
+		printf ("%lu operators, %lu subscribers from %d bills\n", (unsigned long)operators.m_nRecords,
+				(unsigned long)subscribers.m_nRecords, argc - optind);
+	}
+	BillDestroy (&operators);
+	BillDestroy (&subscribers);
+	BillDestroy (&input);
+	return 0 == result ? 0 : 1;
+}
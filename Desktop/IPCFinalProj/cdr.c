@@ -26,6 +26,8 @@ struct CDR
 	double 			m_uploaded;
 	char			m_partyMSISDN[SIZE_OF_TEXT];
 	char 			m_partyOperator[SIZE_OF_TEXT];
+	unsigned int	m_fileId;
+	unsigned long	m_offset;
 };
 
 CDR* CDRCreate(ADTErr* _error)
@@ -67,6 +69,47 @@ void CDRDestroy(CDR* _cdr)
 	LOG_DEBUG_PRINT("%s", "CDR was destroyed successfully");
 }
 
+size_t CDRSize(void)
+{
+	return sizeof(CDR);
+}
+
+void CDRReset(CDR* _cdr)
+{
+	if (NULL == _cdr)
+	{
+		LOG_WARN_PRINT("%s", "Attempted to reset uninitialized CDR");
+		return; 
+	}
+
+	memset(_cdr, 0, sizeof(CDR));
+	_cdr->m_callType = LAST;
+}
+
+void CDRSetSource(CDR* _cdr, unsigned int _fileId, unsigned long _offset)
+{
+	if (NULL == _cdr)
+	{
+		LOG_WARN_PRINT("%s", "Attempted to set source of uninitialized CDR");
+		return; 
+	}
+
+	_cdr->m_fileId = _fileId;
+	_cdr->m_offset = _offset;
+}
+
+void CDRGetSource(const CDR* _cdr, unsigned int* _fileId, unsigned long* _offset)
+{
+	if (NULL == _cdr || NULL == _fileId || NULL == _offset)
+	{
+		LOG_WARN_PRINT("%s", "Attempted to get source of uninitialized CDR");
+		return; 
+	}
+
+	*_fileId = _cdr->m_fileId;
+	*_offset = _cdr->m_offset;
+}
+
 ADTErr CDRInsertIMSI(CDR* _cdr, const char* _imsi)
 {
 	char strErr[STR_ERROR_SIZE] = "";
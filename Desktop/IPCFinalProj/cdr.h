@@ -21,6 +21,16 @@ typedef struct CDR CDR;
 CDR* CDRCreate(ADTErr* _error);
 void CDRDestroy(CDR* _cdr);
 
+/* For CDRs that live in memory the caller owns (the shared memory ring):
+   bytes a CDR takes, and reset of such a CDR to the state CDRCreate returns */
+size_t CDRSize(void);
+void CDRReset(CDR* _cdr);
+
+/* Where the CDR was read: _fileId as the reader's caller numbered the file (0 - unknown)
+   and the offset right after the CDR's line, so a restart can go on from there */
+void CDRSetSource(CDR* _cdr, unsigned int _fileId, unsigned long _offset);
+void CDRGetSource(const CDR* _cdr, unsigned int* _fileId, unsigned long* _offset);
+
 /* Insert Functions */
 ADTErr CDRInsertIMSI(CDR* _cdr, const char* _imsi);
 ADTErr CDRInsertMSISDN(CDR* _cdr, const char* _msisdn);
@@ -0,0 +1,189 @@
+/*******************************************************************************************************
+Description:		* Converts a text CDR file to a binary CDR file (see cdrbin.h) that
+					  RunBilling reads without parsing - files of both kinds may share a directory
+					* Two passes over the input: the first interns the operators for the header,
+					  the second writes the records
+					* Lines that do not parse, or with a field too long for a record, are
+					  counted and left out - as RunBilling would not bill them either
+					* The output is written to <out>.tmp and renamed, so it is never half written
+					---  Text to Binary CDR Converter ---
+
+	Usage: cdr2bin in.cdr out.cdrb
+*******************************************************************************************************/
+#include <stdio.h>
+#include <string.h>
+
+#include "ADTErr.h"
+#include "logger_pub.h"
+#include "logger.h"
+#include "GData.h"
+#include "safeQueue.h"
+#include "cdr.h"
+#include "parser.h"
+#include "cdrbin.h"
+
+#define LINE_SIZE 256
+#define PATH_SIZE 512
+#define STR_ERROR_SIZE 100
+
+typedef struct
+{
+	unsigned long m_lines;
+	unsigned long m_records;
+	unsigned long m_badLines;
+	unsigned long m_longLines;
+} Counts;
+
+/* Parse cuts the line it gets, and so works on a copy. 1 - _cdr holds the line */
+static int ParseLine(const char* _line, CDR* _cdr)
+{
+	char copy[LINE_SIZE];
+
+	strcpy(copy, _line);
+	CDRReset(_cdr);
+	return ERR_OK == ParseInto(copy, _cdr);
+}
+
+/* 1 - a whole line, the rest of a longer one is skipped */
+static int ReadLine(FILE* _fp, char* _line)
+{
+	size_t length = strlen(_line);
+	int ch;
+
+	if ('\n' == _line[length - 1] || feof(_fp))
+	{
+		return 1;
+	}
+	while (EOF != (ch = fgetc(_fp)) && '\n' != ch)
+	{
+	}
+	return 0;
+}
+
+static ADTErr InternOperators(FILE* _in, CdrBinOperators* _operators, CDR* _cdr)
+{
+	char line[LINE_SIZE];
+	char name[LINE_SIZE];
+	ADTErr err;
+
+	while (fgets(line, LINE_SIZE, _in))
+	{
+		if (!ReadLine(_in, line) || !ParseLine(line, _cdr))
+		{
+			continue;
+		}
+		CDRGetOpCode(_cdr, name);
+		if (ERR_OK != (err = CdrBinIntern(_operators, name)) && ERR_ILLEGAL_INPUT != err)
+		{
+			return err;
+		}
+		CDRGetPartyOperator(_cdr, name);
+		if (ERR_OK != (err = CdrBinIntern(_operators, name)) && ERR_ILLEGAL_INPUT != err)
+		{
+			return err;
+		}
+	}
+	return ferror(_in) ? ERR_GENERAL : ERR_OK;
+}
+
+static ADTErr WriteRecords(FILE* _in, FILE* _out, const CdrBinOperators* _operators, CDR* _cdr, Counts* _counts)
+{
+	char line[LINE_SIZE];
+	unsigned char record[CDRBIN_RECORD_SIZE];
+
+	while (fgets(line, LINE_SIZE, _in))
+	{
+		++_counts->m_lines;
+		if (!ReadLine(_in, line))
+		{
+			++_counts->m_longLines;
+			continue;
+		}
+		if (!ParseLine(line, _cdr))
+		{
+			++_counts->m_badLines;
+			continue;
+		}
+		/* an operator or number too long for its field */
+		if (ERR_OK != CdrBinEncode(_cdr, _operators, record))
+		{
+			++_counts->m_longLines;
+			continue;
+		}
+		if (1 != fwrite(record, CDRBIN_RECORD_SIZE, 1, _out))
+		{
+			return ERR_FILE_WRITE;
+		}
+		++_counts->m_records;
+	}
+	return ferror(_in) ? ERR_GENERAL : ERR_OK;
+}
+
+static ADTErr Convert(FILE* _in, FILE* _out, Counts* _counts)
+{
+	CdrBinOperators* operators;
+	CDR* cdr;
+	ADTErr err;
+
+	if (NULL == (operators = CdrBinCreateOperators(&err)))
+	{
+		return err;
+	}
+	if (NULL == (cdr = CDRCreate(&err)))
+	{
+		CdrBinDestroyOperators(operators);
+		return err;
+	}
+	if (ERR_OK == (err = InternOperators(_in, operators, cdr)) && ERR_OK == (err = CdrBinWriteHeader(_out, operators)))
+	{
+		rewind(_in);
+		err = WriteRecords(_in, _out, operators, cdr, _counts);
+	}
+	CDRDestroy(cdr);
+	CdrBinDestroyOperators(operators);
+	return err;
+}
+
+int main(int argc, char* argv[])
+{
+	char tmpPath[PATH_SIZE];
+	char strErr[STR_ERROR_SIZE] = "";
+	Counts counts = {0};
+	FILE* in;
+	FILE* out;
+	ADTErr err;
+
+	if (3 != argc || strlen(argv[2]) + sizeof(".tmp") > PATH_SIZE)
+	{
+		fprintf(stderr, "Usage: %s in.cdr out.cdrb\n", argv[0]);
+		return 1;
+	}
+	if (NULL == (in = fopen(argv[1], "r")))
+	{
+		perror(argv[1]);
+		return 1;
+	}
+	sprintf(tmpPath, "%s.tmp", argv[2]);
+	if (NULL == (out = fopen(tmpPath, "w")))
+	{
+		perror(tmpPath);
+		fclose(in);
+		return 1;
+	}
+	err = Convert(in, out, &counts);
+	fclose(in);
+	if (0 != fclose(out) && ERR_OK == err)
+	{
+		err = ERR_FILE_CLOSE;
+	}
+	if (ERR_OK != err || 0 != rename(tmpPath, argv[2]))
+	{
+		GetError(strErr, (ERR_OK != err) ? err : ERR_FILE_WRITE);
+		fprintf(stderr, "%s: %s\n", argv[2], strErr);
+		remove(tmpPath);
+		return 1;
+	}
+	fprintf(stderr, "%s: %lu lines, %lu records, %lu bad lines, %lu too long\n",
+			argv[2], counts.m_lines, counts.m_records, counts.m_badLines, counts.m_longLines);
+	return 0;
+}
@@ -0,0 +1,373 @@
+/*******************************************************************************************************
+Description:		* Binary CDR files - see cdrbin.h for the layout
+					* Numbers are written byte by byte, so the files are the same on any host
+					---  Binary CDR Implementation File ---
+*******************************************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "ADTErr.h"
+#include "logger_pub.h"
+#include "logger.h"
+#include "cdr.h"
+#include "cdrbin.h"
+
+#define STR_ERROR_SIZE 100
+#define SIZE_OF_TEXT 32 /* as in the CDR */
+#define FIELD_SIZE 16
+#define NAME_SIZE 32
+#define HEADER_SIZE 16
+#define INITIAL_OPERATORS 16
+
+/* where the fields are in a record */
+#define IMSI_AT 0
+#define MSISDN_AT 16
+#define IMEI_AT 32
+#define PARTY_MSISDN_AT 48
+#define OPERATOR_AT 64
+#define PARTY_OPERATOR_AT 66
+#define CALL_TYPE_AT 68
+#define DURATION_AT 72
+#define DOWNLOADED_AT 80
+#define UPLOADED_AT 88
+
+struct CdrBinOperators
+{
+	char 	(*m_names)[NAME_SIZE];
+	size_t 	m_nNames;
+	size_t 	m_capacity;
+};
+
+static void PutU16(unsigned char* _at, unsigned int _value)
+{
+	_at[0] = _value & 0xFF;
+	_at[1] = (_value >> 8) & 0xFF;
+}
+
+static void PutU32(unsigned char* _at, unsigned int _value)
+{
+	PutU16(_at, _value & 0xFFFF);
+	PutU16(_at + 2, _value >> 16);
+}
+
+static void PutF64(unsigned char* _at, double _value)
+{
+	uint64_t bits;
+	int i;
+
+	memcpy(&bits, &_value, sizeof(bits));
+	for (i = 0; i < 8; ++i)
+	{
+		_at[i] = (bits >> (8 * i)) & 0xFF;
+	}
+}
+
+static unsigned int GetU16(const unsigned char* _at)
+{
+	return _at[0] | ((unsigned int)_at[1] << 8);
+}
+
+static unsigned int GetU32(const unsigned char* _at)
+{
+	return GetU16(_at) | (GetU16(_at + 2) << 16);
+}
+
+static double GetF64(const unsigned char* _at)
+{
+	uint64_t bits = 0;
+	double value;
+	int i;
+
+	for (i = 7; i >= 0; --i)
+	{
+		bits = (bits << 8) | _at[i];
+	}
+	memcpy(&value, &bits, sizeof(value));
+	return value;
+}
+
+/* NUL padded, a full field has no NUL */
+static ADTErr PutText(unsigned char* _at, const char* _text)
+{
+	size_t length = strlen(_text);
+
+	if (length > FIELD_SIZE)
+	{
+		return ERR_ILLEGAL_INPUT;
+	}
+	memset(_at, 0, FIELD_SIZE);
+	memcpy(_at, _text, length);
+	return ERR_OK;
+}
+
+static void GetText(char* _text, const unsigned char* _at)
+{
+	memcpy(_text, _at, FIELD_SIZE);
+	_text[FIELD_SIZE] = '\0';
+}
+
+static int FindOperator(const CdrBinOperators* _operators, const char* _name)
+{
+	size_t i;
+
+	for (i = 0; i < _operators->m_nNames; ++i)
+	{
+		if (0 == strcmp(_operators->m_names[i], _name))
+		{
+			return (int)i;
+		}
+	}
+	return -1;
+}
+
+int CdrBinIsBinary(const unsigned char* _bytes, size_t _size)
+{
+	return NULL != _bytes && _size >= CDRBIN_MAGIC_SIZE && 0 == memcmp(_bytes, CDRBIN_MAGIC, CDRBIN_MAGIC_SIZE);
+}
+
+static CdrBinOperators* CreateOperators(size_t _capacity, ADTErr* _error)
+{
+	char strErr[STR_ERROR_SIZE] = "";
+	CdrBinOperators* operators = malloc(sizeof(CdrBinOperators));
+
+	if (NULL == operators || NULL == (operators->m_names = calloc(_capacity, NAME_SIZE)))
+	{
+		free(operators);
+		if (NULL != _error)
+		{
+			*_error = ERR_ALLOCATION_FAILED;
+		}
+		GetError(strErr, ERR_ALLOCATION_FAILED);
+		LOG_ERROR_PRINT("%s", strErr);
+		return NULL;
+	}
+	operators->m_nNames = 0;
+	operators->m_capacity = _capacity;
+	if (NULL != _error)
+	{
+		*_error = ERR_OK;
+	}
+	return operators;
+}
+
+CdrBinOperators* CdrBinCreateOperators(ADTErr* _error)
+{
+	return CreateOperators(INITIAL_OPERATORS, _error);
+}
+
+void CdrBinDestroyOperators(CdrBinOperators* _operators)
+{
+	if (NULL == _operators)
+	{
+		return;
+	}
+	free(_operators->m_names);
+	free(_operators);
+}
+
+ADTErr CdrBinIntern(CdrBinOperators* _operators, const char* _name)
+{
+	char (*names)[NAME_SIZE];
+
+	if (NULL == _operators || NULL == _name)
+	{
+		return ERR_NOT_INITIALIZED;
+	}
+	if (-1 != FindOperator(_operators, _name))
+	{
+		return ERR_OK;
+	}
+	if (strlen(_name) >= NAME_SIZE)
+	{
+		return ERR_ILLEGAL_INPUT;
+	}
+	if (CDRBIN_MAX_OPERATORS == _operators->m_nNames)
+	{
+		return ERR_OVERFLOW;
+	}
+	if (_operators->m_nNames == _operators->m_capacity)
+	{
+		if (NULL == (names = realloc(_operators->m_names, 2 * _operators->m_capacity * NAME_SIZE)))
+		{
+			return ERR_REALLOCATION_FAILED;
+		}
+		_operators->m_names = names;
+		_operators->m_capacity *= 2;
+	}
+	memset(_operators->m_names[_operators->m_nNames], 0, NAME_SIZE);
+	strcpy(_operators->m_names[_operators->m_nNames], _name);
+	++_operators->m_nNames;
+	return ERR_OK;
+}
+
+size_t CdrBinCountOperators(const CdrBinOperators* _operators)
+{
+	return (NULL == _operators) ? 0 : _operators->m_nNames;
+}
+
+ADTErr CdrBinWriteHeader(FILE* _fp, const CdrBinOperators* _operators)
+{
+	unsigned char header[HEADER_SIZE] = {0};
+
+	if (NULL == _fp || NULL == _operators)
+	{
+		return ERR_NOT_INITIALIZED;
+	}
+	memcpy(header, CDRBIN_MAGIC, CDRBIN_MAGIC_SIZE);
+	PutU16(header + 4, CDRBIN_VERSION);
+	PutU16(header + 6, CDRBIN_RECORD_SIZE);
+	PutU32(header + 8, _operators->m_nNames);
+	if (1 != fwrite(header, HEADER_SIZE, 1, _fp)
+		|| _operators->m_nNames != fwrite(_operators->m_names, NAME_SIZE, _operators->m_nNames, _fp))
+	{
+		return ERR_FILE_WRITE;
+	}
+	return ERR_OK;
+}
+
+ADTErr CdrBinEncode(const CDR* _cdr, const CdrBinOperators* _operators, unsigned char* _record)
+{
+	char text[SIZE_OF_TEXT];
+	e_callType callType;
+	unsigned int duration;
+	double megabytes;
+	int id;
+
+	if (NULL == _cdr || NULL == _operators || NULL == _record)
+	{
+		return ERR_NOT_INITIALIZED;
+	}
+	memset(_record, 0, CDRBIN_RECORD_SIZE);
+	CDRGetIMSI(_cdr, text);
+	if (ERR_OK != PutText(_record + IMSI_AT, text))
+	{
+		return ERR_ILLEGAL_INPUT;
+	}
+	CDRGetMSISDN(_cdr, text);
+	if (ERR_OK != PutText(_record + MSISDN_AT, text))
+	{
+		return ERR_ILLEGAL_INPUT;
+	}
+	CDRGetIMEI(_cdr, text);
+	if (ERR_OK != PutText(_record + IMEI_AT, text))
+	{
+		return ERR_ILLEGAL_INPUT;
+	}
+	CDRGetPartyMSISDN(_cdr, text);
+	if (ERR_OK != PutText(_record + PARTY_MSISDN_AT, text))
+	{
+		return ERR_ILLEGAL_INPUT;
+	}
+	CDRGetOpCode(_cdr, text);
+	if (-1 == (id = FindOperator(_operators, text)))
+	{
+		return ERR_ILLEGAL_INPUT;
+	}
+	PutU16(_record + OPERATOR_AT, id);
+	CDRGetPartyOperator(_cdr, text);
+	if (-1 == (id = FindOperator(_operators, text)))
+	{
+		return ERR_ILLEGAL_INPUT;
+	}
+	PutU16(_record + PARTY_OPERATOR_AT, id);
+	CDRGetCallType(_cdr, &callType);
+	_record[CALL_TYPE_AT] = callType;
+	CDRGetCallDuration(_cdr, &duration);
+	PutU32(_record + DURATION_AT, duration);
+	CDRGetDownloadedMB(_cdr, &megabytes);
+	PutF64(_record + DOWNLOADED_AT, megabytes);
+	CDRGetUploadedMB(_cdr, &megabytes);
+	PutF64(_record + UPLOADED_AT, megabytes);
+	return ERR_OK;
+}
+
+CdrBinOperators* CdrBinReadHeader(FILE* _fp, unsigned long* _dataStart, ADTErr* _error)
+{
+	unsigned char header[HEADER_SIZE];
+	char strErr[STR_ERROR_SIZE] = "";
+	CdrBinOperators* operators;
+	size_t nNames;
+	size_t i;
+
+	if (NULL == _fp || NULL == _dataStart)
+	{
+		if (NULL != _error)
+		{
+			*_error = ERR_NOT_INITIALIZED;
+		}
+		return NULL;
+	}
+	if (1 != fread(header, HEADER_SIZE, 1, _fp) || !CdrBinIsBinary(header, HEADER_SIZE)
+		|| CDRBIN_VERSION != GetU16(header + 4) || CDRBIN_RECORD_SIZE != GetU16(header + 6)
+		|| CDRBIN_MAX_OPERATORS < (nNames = GetU32(header + 8)))
+	{
+		if (NULL != _error)
+		{
+			*_error = ERR_PARSING_FAILED;
+		}
+		GetError(strErr, ERR_PARSING_FAILED);
+		LOG_ERROR_PRINT("%s", strErr);
+		return NULL;
+	}
+	if (NULL == (operators = CreateOperators(nNames ? nNames : 1, _error)))
+	{
+		return NULL;
+	}
+	if (nNames != fread(operators->m_names, NAME_SIZE, nNames, _fp))
+	{
+		CdrBinDestroyOperators(operators);
+		if (NULL != _error)
+		{
+			*_error = ERR_PARSING_FAILED;
+		}
+		GetError(strErr, ERR_PARSING_FAILED);
+		LOG_ERROR_PRINT("%s", strErr);
+		return NULL;
+	}
+	for (i = 0; i < nNames; ++i)
+	{
+		operators->m_names[i][NAME_SIZE - 1] = '\0';
+	}
+	operators->m_nNames = nNames;
+	*_dataStart = HEADER_SIZE + nNames * NAME_SIZE;
+	if (NULL != _error)
+	{
+		*_error = ERR_OK;
+	}
+	return operators;
+}
+
+ADTErr CdrBinDecode(const unsigned char* _record, const CdrBinOperators* _operators, CDR* _cdr)
+{
+	char text[FIELD_SIZE + 1];
+	unsigned int operatorId;
+	unsigned int partyOperatorId;
+
+	if (NULL == _record || NULL == _operators || NULL == _cdr)
+	{
+		return ERR_NOT_INITIALIZED;
+	}
+	operatorId = GetU16(_record + OPERATOR_AT);
+	partyOperatorId = GetU16(_record + PARTY_OPERATOR_AT);
+	if (_record[CALL_TYPE_AT] >= LAST || operatorId >= _operators->m_nNames || partyOperatorId >= _operators->m_nNames)
+	{
+		return ERR_PARSING_FAILED;
+	}
+	GetText(text, _record + IMSI_AT);
+	CDRInsertIMSI(_cdr, text);
+	GetText(text, _record + MSISDN_AT);
+	CDRInsertMSISDN(_cdr, text);
+	GetText(text, _record + IMEI_AT);
+	CDRInsertIMEI(_cdr, text);
+	GetText(text, _record + PARTY_MSISDN_AT);
+	CDRInsertPartyMSISDN(_cdr, text);
+	CDRInsertOpCode(_cdr, _operators->m_names[operatorId]);
+	CDRInsertPartyOperator(_cdr, _operators->m_names[partyOperatorId]);
+	CDRInsertCallType(_cdr, (e_callType)_record[CALL_TYPE_AT]);
+	CDRInsertCallDuration(_cdr, GetU32(_record + DURATION_AT));
+	CDRInsertDownloadedMB(_cdr, GetF64(_record + DOWNLOADED_AT));
+	CDRInsertUploadedMB(_cdr, GetF64(_record + UPLOADED_AT));
+	return ERR_OK;
+}
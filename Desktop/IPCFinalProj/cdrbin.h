@@ -0,0 +1,40 @@
+/*******************************************************************************************************
+Description:		* Binary CDR files - fixed width, little endian, no parsing to read
+					* File: "CDRB", u16 version, u16 record size, u32 operators, u32 reserved,
+					  then the operator names (32 bytes each, NUL padded) - a record keeps
+					  the index of its operators in this table
+					* Record (96 bytes): IMSI, MSISDN, IMEI, party MSISDN (16 bytes each,
+					  NUL padded - a 16 digit value has no NUL), u16 operator, u16 party
+					  operator, u8 call type, 3 reserved, u32 call duration, 4 reserved,
+					  f64 downloaded MB, f64 uploaded MB
+					---  Binary CDR Header File ---
+*******************************************************************************************************/
+#ifndef __CDRBIN_H__
+#define __CDRBIN_H__
+
+#define CDRBIN_MAGIC "CDRB"
+#define CDRBIN_MAGIC_SIZE 4
+#define CDRBIN_VERSION 1
+#define CDRBIN_RECORD_SIZE 96
+#define CDRBIN_MAX_OPERATORS 65535
+
+typedef struct CdrBinOperators CdrBinOperators;
+
+/* 1 - the first _size bytes of a file are of a binary CDR file */
+int CdrBinIsBinary(const unsigned char* _bytes, size_t _size);
+
+/* Writer side: operator names are interned in the order they are first seen */
+CdrBinOperators* CdrBinCreateOperators(ADTErr* _error);
+void CdrBinDestroyOperators(CdrBinOperators* _operators);
+ADTErr CdrBinIntern(CdrBinOperators* _operators, const char* _name);
+size_t CdrBinCountOperators(const CdrBinOperators* _operators);
+ADTErr CdrBinWriteHeader(FILE* _fp, const CdrBinOperators* _operators);
+/* the operators of _cdr must be interned, ERR_ILLEGAL_INPUT - a field does not fit */
+ADTErr CdrBinEncode(const CDR* _cdr, const CdrBinOperators* _operators, unsigned char* _record);
+
+/* Reader side: _fp at the start of the file, left at the first record, which is at _dataStart */
+CdrBinOperators* CdrBinReadHeader(FILE* _fp, unsigned long* _dataStart, ADTErr* _error);
+/* fills a CDR the caller owns, ERR_PARSING_FAILED - a call type or operator out of range */
+ADTErr CdrBinDecode(const unsigned char* _record, const CdrBinOperators* _operators, CDR* _cdr);
+
+#endif /* __CDRBIN_H__ */
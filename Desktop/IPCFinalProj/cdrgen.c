@@ -0,0 +1,535 @@
+/**************************************************************************************************
+	Creation date: 			19.10.26
+	Last modified date: 	19.10.26
+
+	Description: Synthetic CDR workload generator.
+				 Writes files in the '|' separated format Parse() reads:
+				 IMSI|MSISDN|IMEI|operator|call type|date|time|duration|down MB|up MB|party MSISDN|party operator
+				 Subscriber activity follows a Zipf distribution (rejection-inversion
+				 sampling, O(1) per line for any number of subscribers). Every file is
+				 generated from its own seed, so the output doesn't depend on -j.
+
+	Usage: cdrgen [options]
+				 -d dir			output directory (./gen - apart from the sample data in ./Storage,
+				 				read it with RunBilling -d gen/)
+				 -f files		number of files (10)
+				 -n lines		total lines (1000000)
+				 -s subscribers	(100000)
+				 -z exponent	Zipf skew of subscriber activity, 0 - uniform (1.0)
+				 -m mix			call type weights (MOC:30,MTC:30,SMS_MO:15,SMS_MT:15,GPRS:10)
+				 -o operators	comma separated (Cellcom,Orange,Partner,Golan,HotMob,Rami)
+				 -e ratio		malformed lines, 0-1 (0)
+				 -F exponent	Zipf skew of the file sizes, 0 - equal sizes (0)
+				 -j threads		writer threads (online cores)
+				 -r seed		(1)
+**************************************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <sys/stat.h>
+
+#define DEFAULT_DIR "./gen"
+#define DEFAULT_FILES 10
+#define DEFAULT_LINES 1000000ULL
+#define DEFAULT_SUBSCRIBERS 100000ULL
+#define DEFAULT_ZIPF 1.0
+#define DEFAULT_MIX "MOC:30,MTC:30,SMS_MO:15,SMS_MT:15,GPRS:10"
+#define DEFAULT_OPERATORS "Cellcom,Orange,Partner,Golan,HotMob,Rami"
+#define MAX_OPERATORS 64
+#define MAX_OPERATOR_NAME 10
+#define MAX_THREADS 64
+#define NUM_OF_CALL_TYPES 5
+/* FilesReader reads lines with fgets into 128 bytes */
+#define CDR_LINE_SIZE 128
+#define PATH_SIZE 256
+#define FILE_BUFFER_SIZE (1 << 20)
+#define MAX_CALL_SECONDS 3600
+#define MAX_SESSION_MB 500.0
+#define MCC_MNC 425000000000000ULL
+
+typedef enum
+{
+	MALFORMED_CALL_TYPE,
+	MALFORMED_DURATION,
+	MALFORMED_VOLUME,
+	NUM_OF_MALFORMED_KINDS
+} e_malformed;
+
+typedef struct
+{
+	const char*			m_dir;
+	size_t				m_nFiles;
+	unsigned long long	m_nLines;
+	unsigned long long	m_nSubscribers;
+	double				m_zipf;
+	double				m_mix[NUM_OF_CALL_TYPES];	/* cumulative, last is 1 */
+	char				m_operators[MAX_OPERATORS][MAX_OPERATOR_NAME];
+	size_t				m_nOperators;
+	double				m_malformedRatio;
+	double				m_fileSkew;
+	size_t				m_nThreads;
+	unsigned long long	m_seed;
+	unsigned long long	m_stride;				/* rank -> subscriber permutation */
+	/* rejection-inversion constants */
+	double				m_hIntegralX1;
+	double				m_hIntegralN;
+	double				m_s;
+} Config;
+
+typedef struct
+{
+	const Config*		m_config;
+	size_t				m_file;
+	unsigned long long	m_nLines;
+	unsigned long long	m_rng;
+} FileJob;
+
+typedef struct
+{
+	const Config*		m_config;
+	FileJob*			m_jobs;
+	size_t*				m_nextJob;
+	pthread_mutex_t*	m_lock;
+	int					m_failed;
+} Worker;
+
+static const char* s_callTypes[NUM_OF_CALL_TYPES] = {"MOC", "MTC", "SMS_MO", "SMS_MT", "GPRS"};
+
+/* xorshift64* */
+static unsigned long long NextRandom(unsigned long long* _state)
+{
+	*_state ^= *_state >> 12;
+	*_state ^= *_state << 25;
+	*_state ^= *_state >> 27;
+	return *_state * 2685821657736338717ULL;
+}
+
+static double NextUniform(unsigned long long* _state)
+{
+	return (NextRandom(_state) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+/* splitmix64 - spreads (seed, file) into a good xorshift state */
+static unsigned long long SeedFor(unsigned long long _seed, unsigned long long _stream)
+{
+	unsigned long long z = _seed + (_stream + 1) * 0x9E3779B97F4A7C15ULL;
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+	z ^= z >> 31;
+	return z ? z : 1;
+}
+
+/*
+ * Zipf over 1..N by rejection-inversion (Hormann & Derflinger 1996):
+ * invert the integral of x^-s, accept or retry - about 1.1 draws per sample.
+ */
+static double Helper1(double _x)
+{
+	return (fabs(_x) > 1e-8) ? log1p(_x) / _x : 1.0 - _x * (0.5 - _x * (1.0 / 3.0 - 0.25 * _x));
+}
+
+static double Helper2(double _x)
+{
+	return (fabs(_x) > 1e-8) ? expm1(_x) / _x : 1.0 + _x * 0.5 * (1.0 + _x * (1.0 / 3.0) * (1.0 + 0.25 * _x));
+}
+
+static double H(double _x, double _exponent)
+{
+	return exp(-_exponent * log(_x));
+}
+
+static double HIntegral(double _x, double _exponent)
+{
+	double logX = log(_x);
+	return Helper2((1.0 - _exponent) * logX) * logX;
+}
+
+static double HIntegralInverse(double _x, double _exponent)
+{
+	double t = _x * (1.0 - _exponent);
+	if (t < -1.0)
+	{
+		t = -1.0;
+	}
+	return exp(Helper1(t) * _x);
+}
+
+static void ZipfSetup(Config* _config)
+{
+	double exponent = _config->m_zipf;
+	_config->m_hIntegralX1 = HIntegral(1.5, exponent) - 1.0;
+	_config->m_hIntegralN = HIntegral(_config->m_nSubscribers + 0.5, exponent);
+	_config->m_s = 2.0 - HIntegralInverse(HIntegral(2.5, exponent) - H(2.0, exponent), exponent);
+}
+
+/* 1 is the most active rank */
+static unsigned long long ZipfRank(const Config* _config, unsigned long long* _rng)
+{
+	double exponent = _config->m_zipf;
+	double u;
+	double x;
+	unsigned long long k;
+
+	if (0.0 == exponent)
+	{
+		return 1 + NextRandom(_rng) % _config->m_nSubscribers;
+	}
+	while (1)
+	{
+		u = _config->m_hIntegralN + NextUniform(_rng) * (_config->m_hIntegralX1 - _config->m_hIntegralN);
+		x = HIntegralInverse(u, exponent);
+		k = (unsigned long long)(x + 0.5);
+		if (k < 1)
+		{
+			k = 1;
+		}
+		else if (k > _config->m_nSubscribers)
+		{
+			k = _config->m_nSubscribers;
+		}
+		if (k - x <= _config->m_s || u >= HIntegral(k + 0.5, exponent) - H(k, exponent))
+		{
+			return k;
+		}
+	}
+}
+
+/* heavy users spread over the whole IMSI range instead of the first few */
+static unsigned long long RankToSubscriber(const Config* _config, unsigned long long _rank)
+{
+	return ((_rank - 1) * _config->m_stride) % _config->m_nSubscribers;
+}
+
+static const char* HomeOperator(const Config* _config, unsigned long long _subscriber)
+{
+	return _config->m_operators[SeedFor(0, _subscriber) % _config->m_nOperators];
+}
+
+static int PickCallType(const Config* _config, unsigned long long* _rng)
+{
+	double u = NextUniform(_rng);
+	int type;
+
+	for (type = 0; type < NUM_OF_CALL_TYPES - 1 && u >= _config->m_mix[type]; ++type);
+	return type;
+}
+
+static int FormatLine(const Config* _config, unsigned long long* _rng, char* _line)
+{
+	unsigned long long subscriber = RankToSubscriber(_config, ZipfRank(_config, _rng));
+	unsigned long long party = RankToSubscriber(_config, ZipfRank(_config, _rng));
+	int type = PickCallType(_config, _rng);
+	unsigned int duration = 0;
+	double downloaded = 0.0;
+	double uploaded = 0.0;
+	char durationText[16];
+	char downText[16];
+	char upText[16];
+	const char* typeText = s_callTypes[type];
+	unsigned long long random = NextRandom(_rng);
+
+	if (type <= 1)
+	{
+		/* mostly short calls */
+		duration = 1 + (unsigned int)(-log(1.0 - NextUniform(_rng)) * 120.0) % MAX_CALL_SECONDS;
+	}
+	else if (4 == type)
+	{
+		duration = 1 + (unsigned int)(random % MAX_CALL_SECONDS);
+		downloaded = NextUniform(_rng) * MAX_SESSION_MB;
+		uploaded = downloaded * NextUniform(_rng) * 0.2;
+	}
+	snprintf(durationText, sizeof(durationText), "%u", duration);
+	snprintf(downText, sizeof(downText), "%.2f", downloaded);
+	snprintf(upText, sizeof(upText), "%.2f", uploaded);
+
+	if (_config->m_malformedRatio > 0.0 && NextUniform(_rng) < _config->m_malformedRatio)
+	{
+		/* kinds Parse() rejects without crashing - every field is still there */
+		switch (random % NUM_OF_MALFORMED_KINDS)
+		{
+			case MALFORMED_CALL_TYPE: typeText = "VOIP"; break;
+			case MALFORMED_DURATION: strcpy(durationText, "n/a"); break;
+			default: strcpy(downText, "x.y"); break;
+		}
+	}
+
+	return snprintf(_line, CDR_LINE_SIZE, "%015llu|9725%08llu|35%013llu|%s|%s|%02u/%02u/2015|%02u:%02u:%02u|%s|%s|%s|9725%08llu|%s\n",
+					MCC_MNC + subscriber, subscriber % 100000000ULL, subscriber, HomeOperator(_config, subscriber), typeText,
+					(unsigned int)(1 + random % 28), (unsigned int)(1 + (random >> 8) % 12),
+					(unsigned int)((random >> 16) % 24), (unsigned int)((random >> 24) % 60), (unsigned int)((random >> 32) % 60),
+					durationText, downText, upText, party % 100000000ULL, HomeOperator(_config, party));
+}
+
+static int WriteFile(const FileJob* _job)
+{
+	char path[PATH_SIZE];
+	char line[CDR_LINE_SIZE];
+	unsigned long long rng = _job->m_rng;
+	unsigned long long i;
+	FILE* file;
+	char* buffer;
+	int length;
+	int result = 0;
+
+	snprintf(path, PATH_SIZE, "%s/cdr_%04lu.txt", _job->m_config->m_dir, (unsigned long)_job->m_file);
+	file = fopen(path, "w");
+	buffer = malloc(FILE_BUFFER_SIZE);
+	if (NULL == file || NULL == buffer)
+	{
+		fprintf(stderr, "%s: %s\n", path, strerror(errno));
+		free(buffer);
+		if (file)
+		{
+			fclose(file);
+		}
+		return -1;
+	}
+	setvbuf(file, buffer, _IOFBF, FILE_BUFFER_SIZE);
+	for (i = 0; i < _job->m_nLines; ++i)
+	{
+		length = FormatLine(_job->m_config, &rng, line);
+		if (length >= CDR_LINE_SIZE)
+		{
+			fprintf(stderr, "%s\n", "line longer than FilesReader reads - use shorter operator names");
+			result = -1;
+			break;
+		}
+		fwrite(line, 1, length, file);
+	}
+	if (0 != fclose(file))
+	{
+		fprintf(stderr, "%s: %s\n", path, strerror(errno));
+		result = -1;
+	}
+	free(buffer);
+	return result;
+}
+
+static void* RunWorker(void* _worker)
+{
+	Worker* worker = _worker;
+	size_t job;
+
+	while (1)
+	{
+		pthread_mutex_lock(worker->m_lock);
+		job = (*worker->m_nextJob)++;
+		pthread_mutex_unlock(worker->m_lock);
+		if (job >= worker->m_config->m_nFiles)
+		{
+			return NULL;
+		}
+		if (0 != WriteFile(&worker->m_jobs[job]))
+		{
+			worker->m_failed = 1;
+		}
+	}
+}
+
+static int ParseMix(const char* _mix, Config* _config)
+{
+	char copy[256];
+	char* savePtr = NULL;
+	char* token;
+	char* colon;
+	double weights[NUM_OF_CALL_TYPES] = {0};
+	double total = 0.0;
+	double sum = 0.0;
+	int type;
+
+	strncpy(copy, _mix, sizeof(copy) - 1);
+	copy[sizeof(copy) - 1] = '\0';
+	for (token = strtok_r(copy, ",", &savePtr); NULL != token; token = strtok_r(NULL, ",", &savePtr))
+	{
+		colon = strchr(token, ':');
+		if (NULL == colon)
+		{
+			return -1;
+		}
+		*colon = '\0';
+		for (type = 0; type < NUM_OF_CALL_TYPES && 0 != strcmp(token, s_callTypes[type]); ++type);
+		if (NUM_OF_CALL_TYPES == type)
+		{
+			return -1;
+		}
+		weights[type] = atof(colon + 1);
+		total += weights[type];
+	}
+	if (total <= 0.0)
+	{
+		return -1;
+	}
+	for (type = 0; type < NUM_OF_CALL_TYPES; ++type)
+	{
+		sum += weights[type];
+		_config->m_mix[type] = sum / total;
+	}
+	return 0;
+}
+
+static int ParseOperators(const char* _operators, Config* _config)
+{
+	char copy[MAX_OPERATORS * MAX_OPERATOR_NAME];
+	char* savePtr = NULL;
+	char* token;
+
+	strncpy(copy, _operators, sizeof(copy) - 1);
+	copy[sizeof(copy) - 1] = '\0';
+	_config->m_nOperators = 0;
+	for (token = strtok_r(copy, ",", &savePtr); NULL != token && _config->m_nOperators < MAX_OPERATORS; token = strtok_r(NULL, ",", &savePtr))
+	{
+		if (strlen(token) >= MAX_OPERATOR_NAME || strchr(token, '|'))
+		{
+			return -1;
+		}
+		strcpy(_config->m_operators[_config->m_nOperators++], token);
+	}
+	return (0 == _config->m_nOperators) ? -1 : 0;
+}
+
+static unsigned long long GreatestCommonDivisor(unsigned long long _a, unsigned long long _b)
+{
+	unsigned long long tmp;
+	while (_b)
+	{
+		tmp = _a % _b;
+		_a = _b;
+		_b = tmp;
+	}
+	return _a;
+}
+
+/* lines per file, Zipf skewed by -F, summing to exactly -n */
+static void SplitLines(const Config* _config, FileJob* _jobs)
+{
+	double totalWeight = 0.0;
+	unsigned long long assigned = 0;
+	size_t i;
+
+	for (i = 0; i < _config->m_nFiles; ++i)
+	{
+		totalWeight += pow(i + 1.0, -_config->m_fileSkew);
+	}
+	for (i = 0; i < _config->m_nFiles; ++i)
+	{
+		_jobs[i].m_config = _config;
+		_jobs[i].m_file = i;
+		_jobs[i].m_rng = SeedFor(_config->m_seed, i);
+		_jobs[i].m_nLines = (unsigned long long)(_config->m_nLines * pow(i + 1.0, -_config->m_fileSkew) / totalWeight);
+		assigned += _jobs[i].m_nLines;
+	}
+	_jobs[0].m_nLines += _config->m_nLines - assigned;
+}
+
+static void Usage(const char* _name)
+{
+	fprintf(stderr, "Usage: %s [-d dir] [-f files] [-n lines] [-s subscribers] [-z zipf] [-m mix] [-o operators] [-e malformed ratio] [-F file skew] [-j threads] [-r seed]\n", _name);
+}
+
+int main(int argc, char* argv[])
+{
+	static Config config;
+	pthread_t threads[MAX_THREADS];
+	Worker workers[MAX_THREADS];
+	pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+	FileJob* jobs;
+	size_t nextJob = 0;
+	size_t i;
+	long nCores = sysconf(_SC_NPROCESSORS_ONLN);
+	const char* mix = DEFAULT_MIX;
+	const char* operators = DEFAULT_OPERATORS;
+	int failed = 0;
+	int opt;
+
+	config.m_dir = DEFAULT_DIR;
+	config.m_nFiles = DEFAULT_FILES;
+	config.m_nLines = DEFAULT_LINES;
+	config.m_nSubscribers = DEFAULT_SUBSCRIBERS;
+	config.m_zipf = DEFAULT_ZIPF;
+	config.m_malformedRatio = 0.0;
+	config.m_fileSkew = 0.0;
+	config.m_nThreads = (nCores < 1) ? 1 : (nCores > MAX_THREADS) ? MAX_THREADS : (size_t)nCores;
+	config.m_seed = 1;
+	while (-1 != (opt = getopt(argc, argv, "d:f:n:s:z:m:o:e:F:j:r:")))
+	{
+		switch (opt)
+		{
+			case 'd': config.m_dir = optarg; break;
+			case 'f': config.m_nFiles = strtoul(optarg, NULL, 10); break;
+			case 'n': config.m_nLines = strtoull(optarg, NULL, 10); break;
+			case 's': config.m_nSubscribers = strtoull(optarg, NULL, 10); break;
+			case 'z': config.m_zipf = atof(optarg); break;
+			case 'm': mix = optarg; break;
+			case 'o': operators = optarg; break;
+			case 'e': config.m_malformedRatio = atof(optarg); break;
+			case 'F': config.m_fileSkew = atof(optarg); break;
+			case 'j': config.m_nThreads = strtoul(optarg, NULL, 10); break;
+			case 'r': config.m_seed = strtoull(optarg, NULL, 10); break;
+			default: Usage(argv[0]); return 1;
+		}
+	}
+	if (0 == config.m_nFiles || 0 == config.m_nSubscribers || config.m_nSubscribers > 100000000ULL
+		|| config.m_zipf < 0.0 || config.m_malformedRatio < 0.0 || config.m_malformedRatio > 1.0
+		|| 0 == config.m_nThreads || config.m_nThreads > MAX_THREADS)
+	{
+		fprintf(stderr, "%s\n", "bad option value (subscribers up to 100000000, threads up to 64)");
+		Usage(argv[0]);
+		return 1;
+	}
+	if (0 != ParseMix(mix, &config) || 0 != ParseOperators(operators, &config))
+	{
+		fprintf(stderr, "%s\n", "bad call type mix or operator list");
+		Usage(argv[0]);
+		return 1;
+	}
+	if (0 != mkdir(config.m_dir, 0755) && EEXIST != errno)
+	{
+		fprintf(stderr, "%s: %s\n", config.m_dir, strerror(errno));
+		return 1;
+	}
+	ZipfSetup(&config);
+	for (config.m_stride = 2654435761ULL % config.m_nSubscribers; 1 != GreatestCommonDivisor(config.m_stride, config.m_nSubscribers) || 0 == config.m_stride; ++config.m_stride);
+
+	jobs = malloc(config.m_nFiles * sizeof(FileJob));
+	if (NULL == jobs)
+	{
+		fprintf(stderr, "%s\n", "allocation failed");
+		return 1;
+	}
+	SplitLines(&config, jobs);
+	if (config.m_nThreads > config.m_nFiles)
+	{
+		config.m_nThreads = config.m_nFiles;
+	}
+	for (i = 0; i < config.m_nThreads; ++i)
+	{
+		workers[i].m_config = &config;
+		workers[i].m_jobs = jobs;
+		workers[i].m_nextJob = &nextJob;
+		workers[i].m_lock = &lock;
+		workers[i].m_failed = 0;
+		if (0 != pthread_create(&threads[i], NULL, RunWorker, &workers[i]))
+		{
+			fprintf(stderr, "%s\n", "pthread_create failed");
+			return 1;
+		}
+	}
+	for (i = 0; i < config.m_nThreads; ++i)
+	{
+		pthread_join(threads[i], NULL);
+		failed |= workers[i].m_failed;
+	}
+	free(jobs);
+	if (!failed)
+	{
+		printf("%llu lines in %lu files written to %s\n", config.m_nLines, (unsigned long)config.m_nFiles, config.m_dir);
+	}
+	return failed;
+}
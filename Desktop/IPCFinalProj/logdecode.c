@@ -0,0 +1,392 @@
+/**************************************************************************************************
+	Creation date: 			19.10.26
+	Last modified date: 	19.10.26
+
+	Description: Renders a binary log (LOG_FORMAT_BINARY) as the text logger would have
+				 written it. Layout is described in logformat.h.
+
+	Usage: logdecode [-m] [-u] [log file]	(stdin without a file)
+				 -m	milliseconds in the timestamps
+				 -u	monotonic microseconds since LogCreate
+**************************************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <getopt.h>
+
+#include "logformat.h"
+
+#define LINE_SIZE 4096
+#define FRAME_SIZE 65536
+#define TIME_SIZE 64
+#define STRING_ARG_SIZE 1024
+#define NSEC_IN_MSEC 1000000
+
+typedef struct
+{
+	int				m_isDefined;
+	int				m_line;
+	int				m_nArgs;
+	unsigned char	m_argTypes[LOG_MAX_ARGS];
+	char*			m_type;
+	char*			m_file;
+	char*			m_function;
+	char*			m_format;
+} Site;
+
+typedef struct
+{
+	const unsigned char*	m_next;
+	const unsigned char*	m_end;
+} Cursor;
+
+static Site* s_sites = NULL;
+static size_t s_nSites = 0;
+static int s_showMsec = 0;
+static int s_showMonotonic = 0;
+
+static int Take(Cursor* _cursor, void* _value, size_t _size)
+{
+	if ((size_t)(_cursor->m_end - _cursor->m_next) < _size)
+	{
+		return 0;
+	}
+	memcpy(_value, _cursor->m_next, _size);
+	_cursor->m_next += _size;
+	return 1;
+}
+
+static char* TakeString(Cursor* _cursor)
+{
+	const unsigned char* end = memchr(_cursor->m_next, '\0', _cursor->m_end - _cursor->m_next);
+	char* string;
+
+	if (NULL == end)
+	{
+		return NULL;
+	}
+	string = strdup((const char*)_cursor->m_next);
+	_cursor->m_next = end + 1;
+	return string;
+}
+
+static void ResetSites(void)
+{
+	size_t i;
+
+	for (i = 0; i < s_nSites; ++i)
+	{
+		if (s_sites[i].m_isDefined)
+		{
+			free(s_sites[i].m_type);
+			free(s_sites[i].m_file);
+			free(s_sites[i].m_function);
+			free(s_sites[i].m_format);
+		}
+	}
+	free(s_sites);
+	s_sites = NULL;
+	s_nSites = 0;
+}
+
+static int DefineSite(Cursor* _cursor)
+{
+	unsigned int id;
+	unsigned char mode;
+	int line;
+	Site* sites;
+	Site* site;
+
+	if (!Take(_cursor, &id, sizeof(id)) || !Take(_cursor, &mode, sizeof(mode)) || !Take(_cursor, &line, sizeof(line)))
+	{
+		return 0;
+	}
+	if (id >= s_nSites)
+	{
+		sites = realloc(s_sites, (id + 1) * sizeof(Site));
+		if (NULL == sites)
+		{
+			return 0;
+		}
+		memset(sites + s_nSites, 0, (id + 1 - s_nSites) * sizeof(Site));
+		s_sites = sites;
+		s_nSites = id + 1;
+	}
+	site = &s_sites[id];
+	if (site->m_isDefined)
+	{
+		return 1;
+	}
+	site->m_line = line;
+	site->m_type = TakeString(_cursor);
+	site->m_file = TakeString(_cursor);
+	site->m_function = TakeString(_cursor);
+	site->m_format = TakeString(_cursor);
+	site->m_isDefined = (NULL != site->m_format);
+	site->m_nArgs = LogFormatArgTypes(site->m_format, site->m_argTypes, LOG_MAX_ARGS);
+	return site->m_isDefined;
+}
+
+static void PrintTime(Cursor* _cursor)
+{
+	long long sec;
+	int nsec;
+	unsigned long long monoUsec;
+	time_t seconds;
+	struct tm timeInfo;
+	char text[TIME_SIZE];
+
+	if (!Take(_cursor, &sec, sizeof(sec)) || !Take(_cursor, &nsec, sizeof(nsec)) || !Take(_cursor, &monoUsec, sizeof(monoUsec)))
+	{
+		return;
+	}
+	seconds = (time_t)sec;
+	localtime_r(&seconds, &timeInfo);
+	strftime(text, TIME_SIZE, "[%Y-%m-%d %H:%M:%S", &timeInfo);
+	fputs(text, stdout);
+	if (s_showMsec)
+	{
+		printf(".%03d", nsec / NSEC_IN_MSEC);
+	}
+	putchar(']');
+	if (s_showMonotonic)
+	{
+		printf(" +%lluus", monoUsec);
+	}
+	putchar(' ');
+}
+
+#define RENDER(_value)\
+	((0 == _nStars) ? snprintf(_out, _size, _spec, (_value)) :\
+	 (1 == _nStars) ? snprintf(_out, _size, _spec, _stars[0], (_value)) :\
+	 snprintf(_out, _size, _spec, _stars[0], _stars[1], (_value)))
+
+/* One conversion with its '*' arguments, returns the rendered length */
+static int RenderSpec(char* _out, size_t _size, const char* _spec, const int* _stars, int _nStars, unsigned char _type, Cursor* _cursor)
+{
+	int intArg;
+	long longArg;
+	long long llongArg;
+	double doubleArg;
+	void* pointerArg;
+	unsigned short length;
+	char stringArg[STRING_ARG_SIZE];
+
+	switch (_type)
+	{
+		case LOG_ARG_INT:
+			return Take(_cursor, &intArg, sizeof(intArg)) ? RENDER(intArg) : -1;
+		case LOG_ARG_LONG:
+			return Take(_cursor, &longArg, sizeof(longArg)) ? RENDER(longArg) : -1;
+		case LOG_ARG_LLONG:
+			return Take(_cursor, &llongArg, sizeof(llongArg)) ? RENDER(llongArg) : -1;
+		case LOG_ARG_DOUBLE:
+			return Take(_cursor, &doubleArg, sizeof(doubleArg)) ? RENDER(doubleArg) : -1;
+		case LOG_ARG_LDOUBLE:
+			return Take(_cursor, &doubleArg, sizeof(doubleArg)) ? RENDER((long double)doubleArg) : -1;
+		case LOG_ARG_POINTER:
+			return Take(_cursor, &pointerArg, sizeof(pointerArg)) ? RENDER(pointerArg) : -1;
+		default:
+			if (!Take(_cursor, &length, sizeof(length)) || length >= STRING_ARG_SIZE || !Take(_cursor, stringArg, length))
+			{
+				return -1;
+			}
+			stringArg[length] = '\0';
+			return RENDER(stringArg);
+	}
+}
+
+static void PrintMessage(Cursor* _cursor)
+{
+	char line[LINE_SIZE];
+	char spec[LOG_MAX_SPEC];
+	unsigned char types[3];
+	int stars[2];
+	const char* format;
+	const char* next;
+	const char* percent;
+	unsigned int id;
+	size_t used = 0;
+	int nTypes;
+	int length;
+	int i;
+	Site* site;
+
+	if (!Take(_cursor, &id, sizeof(id)) || id >= s_nSites || !s_sites[id].m_isDefined)
+	{
+		fprintf(stderr, "logdecode: message of unknown site %u\n", id);
+		return;
+	}
+	site = &s_sites[id];
+	PrintTime(_cursor);
+	printf("%s::%s[%d]:%s ", site->m_file, site->m_function, site->m_line, site->m_type);
+
+	format = site->m_format;
+	while (NULL != (next = LogFormatNextSpec(format, spec, types, &nTypes)) && used < LINE_SIZE)
+	{
+		percent = strchr(format, '%');
+		length = (int)(percent - format);
+		used += snprintf(line + used, LINE_SIZE - used, "%.*s", length, format);
+		if (nTypes < 0)
+		{
+			break;
+		}
+		if (0 == nTypes)
+		{
+			used += snprintf(line + used, LINE_SIZE - used, "%%");
+		}
+		else
+		{
+			for (i = 0; i < nTypes - 1; ++i)
+			{
+				Take(_cursor, &stars[i], sizeof(stars[i]));
+			}
+			length = RenderSpec(line + used, LINE_SIZE - used, spec, stars, nTypes - 1, types[nTypes - 1], _cursor);
+			if (length < 0)
+			{
+				fprintf(stderr, "logdecode: arguments of site %u cut short\n", id);
+				break;
+			}
+			used += length;
+		}
+		format = next;
+		if (used >= LINE_SIZE)
+		{
+			used = LINE_SIZE - 1;
+		}
+	}
+	if (NULL == next && used < LINE_SIZE)
+	{
+		used += snprintf(line + used, LINE_SIZE - used, "%s", format);
+	}
+	if (used >= LINE_SIZE)
+	{
+		used = LINE_SIZE - 1;
+	}
+	fwrite(line, 1, used, stdout);
+	putchar('\n');
+}
+
+static void PrintText(Cursor* _cursor)
+{
+	PrintTime(_cursor);
+	fwrite(_cursor->m_next, 1, _cursor->m_end - _cursor->m_next, stdout);
+	putchar('\n');
+}
+
+static int CheckHeader(const unsigned char* _header)
+{
+	unsigned int endian;
+
+	memcpy(&endian, _header + LOG_BINARY_MAGIC_SIZE, sizeof(endian));
+	if (LOG_BINARY_ENDIAN != endian
+		|| sizeof(long) != _header[LOG_BINARY_MAGIC_SIZE + sizeof(endian)]
+		|| sizeof(void*) != _header[LOG_BINARY_MAGIC_SIZE + sizeof(endian) + 1])
+	{
+		fprintf(stderr, "%s\n", "logdecode: log was written on a different architecture");
+		return 0;
+	}
+	ResetSites();
+	return 1;
+}
+
+static int Decode(FILE* _log)
+{
+	static unsigned char frame[FRAME_SIZE];
+	unsigned char header[LOG_BINARY_HEADER_SIZE];
+	unsigned short length;
+	Cursor cursor;
+
+	if (LOG_BINARY_HEADER_SIZE != fread(header, 1, LOG_BINARY_HEADER_SIZE, _log)
+		|| 0 != memcmp(header, LOG_BINARY_MAGIC, LOG_BINARY_MAGIC_SIZE))
+	{
+		fprintf(stderr, "%s\n", "logdecode: not a binary log");
+		return 1;
+	}
+	if (!CheckHeader(header))
+	{
+		return 1;
+	}
+	while (sizeof(length) == fread(&length, 1, sizeof(length), _log))
+	{
+		/* an appended session starts with a new header - its length bytes are "CD" */
+		if (0 == memcmp(&length, LOG_BINARY_MAGIC, sizeof(length)))
+		{
+			memcpy(header, &length, sizeof(length));
+			if (LOG_BINARY_HEADER_SIZE - sizeof(length) == fread(header + sizeof(length), 1, LOG_BINARY_HEADER_SIZE - sizeof(length), _log)
+				&& 0 == memcmp(header, LOG_BINARY_MAGIC, LOG_BINARY_MAGIC_SIZE))
+			{
+				if (!CheckHeader(header))
+				{
+					return 1;
+				}
+				continue;
+			}
+			fprintf(stderr, "%s\n", "logdecode: corrupt session header");
+			return 1;
+		}
+		if (0 == length || length != fread(frame, 1, length, _log))
+		{
+			fprintf(stderr, "%s\n", "logdecode: log ends in the middle of a frame");
+			return 1;
+		}
+		cursor.m_next = frame + 1;
+		cursor.m_end = frame + length;
+		switch (frame[0])
+		{
+			case LOG_FRAME_SITE:
+				if (!DefineSite(&cursor))
+				{
+					fprintf(stderr, "%s\n", "logdecode: bad site frame");
+				}
+				break;
+			case LOG_FRAME_MESSAGE:
+				PrintMessage(&cursor);
+				break;
+			case LOG_FRAME_TEXT:
+				PrintText(&cursor);
+				break;
+			default:
+				fprintf(stderr, "logdecode: unknown frame kind %u\n", frame[0]);
+				break;
+		}
+	}
+	return 0;
+}
+
+int main(int argc, char* argv[])
+{
+	FILE* log = stdin;
+	int result;
+	int opt;
+
+	while (-1 != (opt = getopt(argc, argv, "mu")))
+	{
+		switch (opt)
+		{
+			case 'm': s_showMsec = 1; break;
+			case 'u': s_showMonotonic = 1; break;
+			default:
+				fprintf(stderr, "Usage: %s [-m] [-u] [log file]\n", argv[0]);
+				return 1;
+		}
+	}
+	if (optind < argc)
+	{
+		log = fopen(argv[optind], "rb");
+		if (NULL == log)
+		{
+			perror(argv[optind]);
+			return 1;
+		}
+	}
+	result = Decode(log);
+	if (stdin != log)
+	{
+		fclose(log);
+	}
+	ResetSites();
+	return result;
+}
@@ -0,0 +1,150 @@
+/**************************************************************************************************
+	Creation date: 			19.10.26
+	Last modified date: 	19.10.26
+
+	Description: Implementation of printf format scanning.
+**************************************************************************************************/
+
+#include <stddef.h>
+#include <string.h>
+
+#include "logformat.h"
+
+#define FLAG_CHARS "-+ #0'"
+#define DIGITS "0123456789"
+
+/* Copies a run of _chars from _format to the spec, returns the new position */
+static const char* CopySpan(const char* _format, const char* _chars, char* _spec, size_t* _specLength)
+{
+	size_t span = strspn(_format, _chars);
+
+	if (NULL != _spec && *_specLength + span < LOG_MAX_SPEC)
+	{
+		memcpy(_spec + *_specLength, _format, span);
+	}
+	*_specLength += span;
+	return _format + span;
+}
+
+/* Width or precision - digits or '*', which takes an int argument */
+static const char* ScanNumber(const char* _format, char* _spec, size_t* _specLength, unsigned char* _types, int* _nTypes)
+{
+	if ('*' == *_format)
+	{
+		_types[(*_nTypes)++] = LOG_ARG_INT;
+		return CopySpan(_format, "*", _spec, _specLength);
+	}
+	return CopySpan(_format, DIGITS, _spec, _specLength);
+}
+
+static int ConversionType(char _conversion, const char* _length)
+{
+	switch (_conversion)
+	{
+		case 'd': case 'i': case 'u': case 'x': case 'X': case 'o':
+			if (0 == strcmp(_length, "l") || 0 == strcmp(_length, "z") || 0 == strcmp(_length, "t"))
+			{
+				return LOG_ARG_LONG;
+			}
+			if (0 == strcmp(_length, "ll") || 0 == strcmp(_length, "j") || 0 == strcmp(_length, "q"))
+			{
+				return LOG_ARG_LLONG;
+			}
+			return LOG_ARG_INT;
+		case 'c':
+			return LOG_ARG_INT;
+		case 'e': case 'E': case 'f': case 'F': case 'g': case 'G': case 'a': case 'A':
+			return (0 == strcmp(_length, "L")) ? LOG_ARG_LDOUBLE : LOG_ARG_DOUBLE;
+		case 's':
+			return LOG_ARG_STRING;
+		case 'p':
+			return LOG_ARG_POINTER;
+		default:
+			return -1;
+	}
+}
+
+const char* LogFormatNextSpec(const char* _format, char* _spec, unsigned char* _types, int* _nTypes)
+{
+	const char* start;
+	char length[3] = "";
+	size_t specLength = 1;
+	size_t lengthSize;
+	int type;
+
+	start = strchr(_format, '%');
+	if (NULL == start)
+	{
+		return NULL;
+	}
+	*_nTypes = 0;
+	if (NULL != _spec)
+	{
+		_spec[0] = '%';
+	}
+	if ('%' == start[1])
+	{
+		if (NULL != _spec)
+		{
+			strcpy(_spec, "%%");
+		}
+		return start + 2;
+	}
+
+	_format = CopySpan(start + 1, FLAG_CHARS, _spec, &specLength);
+	_format = ScanNumber(_format, _spec, &specLength, _types, _nTypes);
+	if ('.' == *_format)
+	{
+		_format = CopySpan(_format, ".", _spec, &specLength);
+		_format = ScanNumber(_format, _spec, &specLength, _types, _nTypes);
+	}
+	lengthSize = strspn(_format, "hlLqjzt");
+	if (lengthSize > 2)
+	{
+		*_nTypes = -1;
+		return start + 1;
+	}
+	memcpy(length, _format, lengthSize);
+	_format = CopySpan(_format, "hlLqjzt", _spec, &specLength);
+
+	type = ConversionType(*_format, length);
+	if (type < 0 || specLength + 1 >= LOG_MAX_SPEC)
+	{
+		*_nTypes = -1;
+		return start + 1;
+	}
+	if (NULL != _spec)
+	{
+		_spec[specLength] = *_format;
+		_spec[specLength + 1] = '\0';
+	}
+	_types[(*_nTypes)++] = (unsigned char)type;
+	return _format + 1;
+}
+
+int LogFormatArgTypes(const char* _format, unsigned char* _types, int _maxArgs)
+{
+	unsigned char specTypes[3];
+	const char* next;
+	int nSpecTypes;
+	int nTypes = 0;
+	int i;
+
+	if (NULL == _format)
+	{
+		return -1;
+	}
+	while (NULL != (next = LogFormatNextSpec(_format, NULL, specTypes, &nSpecTypes)))
+	{
+		if (nSpecTypes < 0 || nTypes + nSpecTypes > _maxArgs)
+		{
+			return -1;
+		}
+		for (i = 0; i < nSpecTypes; ++i)
+		{
+			_types[nTypes++] = specTypes[i];
+		}
+		_format = next;
+	}
+	return nTypes;
+}
@@ -0,0 +1,67 @@
+/**************************************************************************************************
+	Creation date: 			19.10.26
+	Last modified date: 	19.10.26
+
+	Description: Header file for printf format scanning, shared by the binary
+				 logger (to pack arguments) and logdecode (to render them).
+**************************************************************************************************/
+
+#ifndef __LOGFORMAT_H__
+#define __LOGFORMAT_H__
+
+#define LOG_MAX_ARGS 12
+#define LOG_MAX_SPEC 32
+
+/*
+ * Binary log layout, native byte order (checked with LOG_BINARY_ENDIAN):
+ *	file header:	magic[8] u32 endian, u8 sizeof(long), u8 sizeof(void*), u16 0
+ *	frame:			u16 length of the rest, u8 e_LogFrameKind, then
+ *		LOG_FRAME_SITE:		u32 id, u8 mode, i32 line, type\0 file\0 function\0 format\0
+ *		LOG_FRAME_MESSAGE:	u32 site id, i64 sec, i32 nsec, u64 monotonic usec, packed arguments
+ *		LOG_FRAME_TEXT:		i64 sec, i32 nsec, u64 monotonic usec, text
+ *	Packed arguments follow e_LogArgType: int 4 bytes, long/pointer their native size,
+ *	long long and double 8 bytes, string u16 length + bytes.
+ *	A site frame comes before the first message of its site in every session,
+ *	a session starts with a file header.
+ */
+#define LOG_BINARY_MAGIC "CDRLOGB1"
+#define LOG_BINARY_MAGIC_SIZE 8
+#define LOG_BINARY_ENDIAN 0x01020304
+#define LOG_BINARY_HEADER_SIZE 16
+
+typedef enum e_LogFrameKind
+{
+	LOG_FRAME_SITE = 1,
+	LOG_FRAME_MESSAGE,
+	LOG_FRAME_TEXT
+} e_LogFrameKind;
+
+typedef enum e_LogArgType
+{
+	LOG_ARG_INT,		/* int and everything promoted to it, '*' width/precision */
+	LOG_ARG_LONG,		/* long, size_t, ptrdiff_t */
+	LOG_ARG_LLONG,		/* long long, intmax_t */
+	LOG_ARG_DOUBLE,
+	LOG_ARG_LDOUBLE,	/* packed as double */
+	LOG_ARG_STRING,		/* packed as length + bytes */
+	LOG_ARG_POINTER
+} e_LogArgType;
+
+/*
+ * Scans the next conversion of _format.
+ *
+ *	Output:	_spec:		the conversion itself, e.g. "%-8.3lf" (may be NULL)
+ *			_types:		argument types it consumes, '*' ones first
+ *			_nTypes:	how many (0 for "%%", -1 when it can't be packed - %n, too long)
+ *
+ *	Returns a pointer past the conversion, NULL when _format has no more conversions.
+ */
+const char* LogFormatNextSpec(const char* _format, char* _spec, unsigned char* _types, int* _nTypes);
+
+/*
+ * Argument types of a whole format, in order.
+ * Returns their number, or -1 if the format can't be packed.
+ */
+int LogFormatArgTypes(const char* _format, unsigned char* _types, int _maxArgs);
+
+#endif /* __LOGFORMAT_H__ */
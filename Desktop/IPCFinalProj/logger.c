@@ -1,27 +1,65 @@
 /**************************************************************************************************
 	Author: 				Tom Vizel
 	Creation date: 			30.9.15
-	Last modified date: 	30.9.15
-	
+	Last modified date: 	19.10.26
+
 	Description: Implementation of logger functions.
+				 Each thread owns a single producer / single consumer ring of
+				 fixed size records. The flusher thread is the only consumer of
+				 all rings and the only writer of the log file.
 **************************************************************************************************/
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <stdbool.h>
+#include <stdarg.h>
 #include <string.h>
 #include <time.h>
 #include <fcntl.h>
 #include <unistd.h>
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 
 #include "ADTErr.h"
 #include "logger.h"
 #include "logger_pub.h"
+#include "logformat.h"
 
 #define BUFFER_SIZE 1024
+/* Record is one cache line multiple, text is cut to fit */
+#define RECORD_SIZE 256
+#define RECORD_TEXT_SIZE (RECORD_SIZE - sizeof(void*) - sizeof(struct timespec) - sizeof(unsigned long) - sizeof(unsigned int))
+/* Power of 2 */
+#define RING_RECORDS 1024
+#define BATCH_SIZE (64 * 1024)
+#define FLUSH_INTERVAL_NSEC 2000000
+#define TIME_TEXT_SIZE 64
+#define NSEC_IN_MSEC 1000000
+#define NSEC_IN_USEC 1000
+#define USEC_IN_SEC 1000000UL
+/* room for the largest frame - a site frame with its strings cut to these */
+#define SITE_STRING_MAX 255
+#define SITE_FORMAT_MAX 1023
+#define FRAME_ROOM (4 * BUFFER_SIZE)
+#define FRAME_HEADER_SIZE 3
+#define STRING_LENGTH_SIZE 2
+
+#define NSEC_IN_SEC 1000000000ULL
+/* how often the flusher reports suppressed messages */
+#define SUPPRESS_REPORT_NSEC NSEC_IN_SEC
+
+/* LogSite.m_state */
+#define LOG_SITE_NEW 0
+#define LOG_SITE_PREPARING 1
+#define LOG_SITE_READY 2
 
 typedef struct Logger Logger;
+typedef struct LogRecord LogRecord;
+typedef struct LogRing LogRing;
+typedef struct TimeCache TimeCache;
 
 struct Logger
 {
@@ -29,40 +67,650 @@ struct Logger
 	unsigned char 	m_modes;
 };
 
+struct LogRecord
+{
+	const LogSite*	m_site;			/* NULL - m_text is text, else packed arguments */
+	struct timespec	m_time;			/* wall clock */
+	unsigned long	m_monoUsec;		/* since LogCreate, with LOG_TIME_MONOTONIC_USEC */
+	unsigned int	m_length;
+	char			m_text[RECORD_TEXT_SIZE];
+};
+
+struct LogRing
+{
+	LogRing*		m_next;			/* list of all rings, guarded by s_ringsMutex */
+	int				m_isOrphan;		/* owner thread exited - freed by the flusher once empty */
+	unsigned long	m_dropped;		/* written by the owner only */
+	unsigned long	m_reported;		/* drops already logged - flusher */
+	unsigned long	m_head;			/* next record to write - owner */
+	char			m_pad[64];
+	unsigned long	m_tail;			/* next record to read - flusher */
+	LogRecord		m_records[RING_RECORDS];
+};
+
+/* Last formatted timestamp - used by the flusher only, shared by all rings */
+struct TimeCache
+{
+	time_t			m_second;
+	long			m_msec;
+	size_t			m_length;
+	char			m_text[TIME_TEXT_SIZE];
+};
+
 /* Log declaration (global) */
 Logger g_log = {-1, LOG_NONE};
+unsigned char g_logActiveModes = LOG_NONE;
+
+static LogRing* s_rings = NULL;
+static pthread_mutex_t s_ringsMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_key_t s_ringKey;
+static pthread_once_t s_keyOnce = PTHREAD_ONCE_INIT;
+static __thread LogRing* s_myRing = NULL;
+static pthread_t s_flusher;
+static int s_isFlusherRunning = false;
+static volatile int s_stop = false;
+static volatile unsigned char s_timeFlags = LOG_TIME_SECONDS;
+static struct timespec s_monoStart;
+static TimeCache s_timeCache = {-1, -1, 0, ""};
+static volatile unsigned char s_format = LOG_FORMAT_TEXT;
+/* format of the open file */
+static unsigned char s_fileFormat = LOG_FORMAT_TEXT;
+static unsigned int s_nextSiteId = 1;
+/* sites already described in the current binary session - flusher only */
+static unsigned char* s_definedSites = NULL;
+static size_t s_definedCapacity = 0;
+/* per site rate limit, 0 - unlimited */
+static volatile unsigned long long s_rateInterval = 0;
+static volatile unsigned long long s_rateBurstWindow = 0;
+/* sites that ever suppressed a message - pushed by producers, walked by the flusher */
+static LogSite* s_limitedSites = NULL;
+
+/* localtime_r and strftime run once per second (once per msec with LOG_TIME_MSEC), not per line */
+static const char* TimeStamp(const LogRecord* _record, size_t* _length)
+{
+    struct tm timeInfo;
+    unsigned char flags = s_timeFlags;
+    long msec = (flags & LOG_TIME_MSEC) ? _record->m_time.tv_nsec / NSEC_IN_MSEC : 0;
+
+    if (_record->m_time.tv_sec != s_timeCache.m_second)
+    {
+        localtime_r(&_record->m_time.tv_sec, &timeInfo);
+        s_timeCache.m_length = strftime(s_timeCache.m_text, TIME_TEXT_SIZE, "[%Y-%m-%d %H:%M:%S", &timeInfo);
+        s_timeCache.m_second = _record->m_time.tv_sec;
+        s_timeCache.m_msec = -1;
+    }
+    if (msec != s_timeCache.m_msec)
+    {
+        /* only the suffix after the cached seconds changes */
+        s_timeCache.m_length = strlen("[YYYY-mm-dd HH:MM:SS");
+        s_timeCache.m_length += (flags & LOG_TIME_MSEC) ?
+            snprintf(s_timeCache.m_text + s_timeCache.m_length, TIME_TEXT_SIZE - s_timeCache.m_length, ".%03ld]", msec) :
+            snprintf(s_timeCache.m_text + s_timeCache.m_length, TIME_TEXT_SIZE - s_timeCache.m_length, "]");
+        s_timeCache.m_msec = msec;
+    }
+    *_length = s_timeCache.m_length;
+    return s_timeCache.m_text;
+}
+
+/* Thread exit - the flusher still owes the records already queued */
+static void OrphanRing(void* _ring)
+{
+	__atomic_store_n(&((LogRing*)_ring)->m_isOrphan, true, __ATOMIC_RELEASE);
+}
+
+static void CreateRingKey(void)
+{
+	pthread_key_create(&s_ringKey, OrphanRing);
+}
+
+static LogRing* MyRing(void)
+{
+	LogRing* ring;
+
+	if (NULL != s_myRing)
+	{
+		return s_myRing;
+	}
+
+	ring = calloc(1, sizeof(LogRing));
+	if (NULL == ring)
+	{
+		return NULL;
+	}
+	pthread_once(&s_keyOnce, CreateRingKey);
+	pthread_setspecific(s_ringKey, ring);
+
+	pthread_mutex_lock(&s_ringsMutex);
+	ring->m_next = s_rings;
+	s_rings = ring;
+	pthread_mutex_unlock(&s_ringsMutex);
+
+	s_myRing = ring;
+	return ring;
+}
+
+/* Returns a free record of the calling thread's ring, NULL if the message is dropped */
+static LogRecord* ReserveRecord(unsigned char _mode)
+{
+	LogRing* ring = MyRing();
+	unsigned long head;
+
+	if (NULL == ring)
+	{
+		return NULL;
+	}
+
+	head = ring->m_head;
+	while (head - __atomic_load_n(&ring->m_tail, __ATOMIC_ACQUIRE) >= RING_RECORDS)
+	{
+		if (!(_mode & (LOG_ERROR | LOG_WARN)) || !s_isFlusherRunning)
+		{
+			__atomic_store_n(&ring->m_dropped, ring->m_dropped + 1, __ATOMIC_RELAXED);
+			return NULL;
+		}
+		sched_yield();
+	}
+	return &ring->m_records[head & (RING_RECORDS - 1)];
+}
+
+static void StampRecord(LogRecord* _record)
+{
+	struct timespec now;
+	unsigned char flags = s_timeFlags;
+
+	/* coarse clock is a plain memory read, good enough for whole seconds */
+	clock_gettime((flags & LOG_TIME_MSEC) ? CLOCK_REALTIME : CLOCK_REALTIME_COARSE, &_record->m_time);
+	_record->m_monoUsec = 0;
+	if (flags & LOG_TIME_MONOTONIC_USEC)
+	{
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		_record->m_monoUsec = (now.tv_sec - s_monoStart.tv_sec) * USEC_IN_SEC + (now.tv_nsec - s_monoStart.tv_nsec) / NSEC_IN_USEC;
+	}
+}
+
+static void CommitRecord(LogRecord* _record, int _length)
+{
+	LogRing* ring = s_myRing;
+
+	if (_length < 0)
+	{
+		return;
+	}
+	_record->m_length = ((size_t)_length < RECORD_TEXT_SIZE) ? (unsigned int)_length : RECORD_TEXT_SIZE - 1;
+	StampRecord(_record);
+	__atomic_store_n(&ring->m_head, ring->m_head + 1, __ATOMIC_RELEASE);
+}
+
+static int FormatText(LogRecord* _record, const char* _type, const char* _file, const char* _function, int _line, const char* _format, va_list _args)
+{
+	int length;
+
+	_record->m_site = NULL;
+	length = snprintf(_record->m_text, RECORD_TEXT_SIZE, "%s::%s[%d]:%s ", _file, _function, _line, _type);
+	if (length >= 0 && (size_t)length < RECORD_TEXT_SIZE)
+	{
+		length += vsnprintf(_record->m_text + length, RECORD_TEXT_SIZE - length, _format, _args);
+	}
+	return length;
+}
+
+/* Argument types are scanned once per site, by whichever thread gets there first */
+static void PrepSite(LogSite* _site)
+{
+	int state = LOG_SITE_NEW;
+
+	if (LOG_SITE_READY == __atomic_load_n(&_site->m_state, __ATOMIC_ACQUIRE))
+	{
+		return;
+	}
+	if (__atomic_compare_exchange_n(&_site->m_state, &state, LOG_SITE_PREPARING, false, __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE))
+	{
+		_site->m_nArgs = LogFormatArgTypes(_site->m_format, _site->m_argTypes, LOG_SITE_MAX_ARGS);
+		_site->m_id = __sync_fetch_and_add(&s_nextSiteId, 1);
+		__atomic_store_n(&_site->m_state, LOG_SITE_READY, __ATOMIC_RELEASE);
+		return;
+	}
+	while (LOG_SITE_READY != __atomic_load_n(&_site->m_state, __ATOMIC_ACQUIRE))
+	{
+		sched_yield();
+	}
+}
+
+static unsigned long long MonotonicNsec(clockid_t _clock)
+{
+	struct timespec now;
+
+	clock_gettime(_clock, &now);
+	return (unsigned long long)now.tv_sec * NSEC_IN_SEC + now.tv_nsec;
+}
+
+/*
+ * Token bucket kept as a single "theoretical arrival time" (GCRA), so threads
+ * sharing a site update it with one compare and swap: every message moves it
+ * one interval forward, and it may run ahead of now by at most the burst.
+ */
+static int SiteAllows(LogSite* _site)
+{
+	unsigned long long interval = s_rateInterval;
+	unsigned long long now;
+	unsigned long long arrival;
+	unsigned long long next;
+	LogSite* head;
+
+	if (0 == interval)
+	{
+		return true;
+	}
+	now = MonotonicNsec(CLOCK_MONOTONIC_COARSE);
+	arrival = __atomic_load_n(&_site->m_arrival, __ATOMIC_RELAXED);
+	do
+	{
+		if (arrival > now + s_rateBurstWindow)
+		{
+			__atomic_fetch_add(&_site->m_suppressed, 1, __ATOMIC_RELAXED);
+			if (!__atomic_exchange_n(&_site->m_isListed, true, __ATOMIC_ACQ_REL))
+			{
+				head = __atomic_load_n(&s_limitedSites, __ATOMIC_ACQUIRE);
+				do
+				{
+					_site->m_nextLimited = head;
+				}
+				while (!__atomic_compare_exchange_n(&s_limitedSites, &head, _site, true, __ATOMIC_RELEASE, __ATOMIC_ACQUIRE));
+			}
+			return false;
+		}
+		next = ((arrival > now) ? arrival : now) + interval;
+	}
+	while (!__atomic_compare_exchange_n(&_site->m_arrival, &arrival, next, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+	return true;
+}
+
+#define PACK(_buffer, _used, _value)\
+	memcpy((_buffer) + (_used), &(_value), sizeof(_value));\
+	(_used) += sizeof(_value)
+
+/* Copies the arguments as they are, strings cut so every argument fits the record */
+static int PackArgs(const LogSite* _site, char* _buffer, va_list _args)
+{
+	size_t used = 0;
+	size_t room;
+	int i;
+	int intArg;
+	long longArg;
+	long long llongArg;
+	double doubleArg;
+	void* pointerArg;
+	const char* stringArg;
+	unsigned short length;
+
+	for (i = 0; i < _site->m_nArgs; ++i)
+	{
+		switch (_site->m_argTypes[i])
+		{
+			case LOG_ARG_INT:
+				intArg = va_arg(_args, int);
+				PACK(_buffer, used, intArg);
+				break;
+			case LOG_ARG_LONG:
+				longArg = va_arg(_args, long);
+				PACK(_buffer, used, longArg);
+				break;
+			case LOG_ARG_LLONG:
+				llongArg = va_arg(_args, long long);
+				PACK(_buffer, used, llongArg);
+				break;
+			case LOG_ARG_DOUBLE:
+				doubleArg = va_arg(_args, double);
+				PACK(_buffer, used, doubleArg);
+				break;
+			case LOG_ARG_LDOUBLE:
+				doubleArg = (double)va_arg(_args, long double);
+				PACK(_buffer, used, doubleArg);
+				break;
+			case LOG_ARG_POINTER:
+				pointerArg = va_arg(_args, void*);
+				PACK(_buffer, used, pointerArg);
+				break;
+			default:
+				stringArg = va_arg(_args, const char*);
+				if (NULL == stringArg)
+				{
+					stringArg = "(null)";
+				}
+				/* leave room for the arguments still to come */
+				room = RECORD_TEXT_SIZE - 1 - used - STRING_LENGTH_SIZE - (_site->m_nArgs - i - 1) * (sizeof(long long) + STRING_LENGTH_SIZE);
+				length = (unsigned short)strnlen(stringArg, room);
+				PACK(_buffer, used, length);
+				memcpy(_buffer + used, stringArg, length);
+				used += length;
+				break;
+		}
+	}
+	return (int)used;
+}
+
+static void PutBytes(char* _batch, size_t* _used, const void* _bytes, size_t _size)
+{
+	memcpy(_batch + *_used, _bytes, _size);
+	*_used += _size;
+}
+
+static void PutFrameHeader(char* _batch, size_t* _used, size_t _length, unsigned char _kind)
+{
+	unsigned short length = (unsigned short)(_length + 1);
+
+	PutBytes(_batch, _used, &length, sizeof(length));
+	PutBytes(_batch, _used, &_kind, sizeof(_kind));
+}
+
+static void PutString(char* _batch, size_t* _used, const char* _string, size_t _max)
+{
+	size_t length = strnlen(_string, _max);
+
+	PutBytes(_batch, _used, _string, length);
+	_batch[(*_used)++] = '\0';
+}
+
+/* Describes a site the first time it appears in the session */
+static void PutSiteFrame(const LogSite* _site, char* _batch, size_t* _used)
+{
+	size_t start;
+	unsigned short length;
+	unsigned int id = _site->m_id;
+	int line = _site->m_line;
+	unsigned char* defined;
+	size_t capacity;
+
+	if (id < s_definedCapacity && s_definedSites[id])
+	{
+		return;
+	}
+	if (id >= s_definedCapacity)
+	{
+		capacity = (2 * s_definedCapacity > id) ? 2 * s_definedCapacity : id + 1;
+		defined = realloc(s_definedSites, capacity);
+		if (NULL != defined)
+		{
+			memset(defined + s_definedCapacity, 0, capacity - s_definedCapacity);
+			s_definedSites = defined;
+			s_definedCapacity = capacity;
+		}
+	}
+	if (id < s_definedCapacity)
+	{
+		s_definedSites[id] = true;
+	}
+
+	start = *_used;
+	PutFrameHeader(_batch, _used, 0, LOG_FRAME_SITE);
+	PutBytes(_batch, _used, &id, sizeof(id));
+	PutBytes(_batch, _used, &_site->m_mode, sizeof(_site->m_mode));
+	PutBytes(_batch, _used, &line, sizeof(line));
+	PutString(_batch, _used, _site->m_type, SITE_STRING_MAX);
+	PutString(_batch, _used, _site->m_file, SITE_STRING_MAX);
+	PutString(_batch, _used, _site->m_function, SITE_STRING_MAX);
+	PutString(_batch, _used, _site->m_format, SITE_FORMAT_MAX);
+	/* length is known only now */
+	length = (unsigned short)(*_used - start - sizeof(length));
+	memcpy(_batch + start, &length, sizeof(length));
+}
+
+static void AppendFrame(const LogRecord* _record, char* _batch, size_t* _used)
+{
+	long long sec = _record->m_time.tv_sec;
+	int nsec = (int)_record->m_time.tv_nsec;
+	unsigned long long monoUsec = _record->m_monoUsec;
+	unsigned int id;
+	size_t timeSize = sizeof(sec) + sizeof(nsec) + sizeof(monoUsec);
 
-static char* TimeStamp(char* _buffer)
+	if (NULL == _record->m_site)
+	{
+		PutFrameHeader(_batch, _used, timeSize + _record->m_length, LOG_FRAME_TEXT);
+	}
+	else
+	{
+		PutSiteFrame(_record->m_site, _batch, _used);
+		id = _record->m_site->m_id;
+		PutFrameHeader(_batch, _used, sizeof(id) + timeSize + _record->m_length, LOG_FRAME_MESSAGE);
+		PutBytes(_batch, _used, &id, sizeof(id));
+	}
+	PutBytes(_batch, _used, &sec, sizeof(sec));
+	PutBytes(_batch, _used, &nsec, sizeof(nsec));
+	PutBytes(_batch, _used, &monoUsec, sizeof(monoUsec));
+	PutBytes(_batch, _used, _record->m_text, _record->m_length);
+}
+
+/* Session header, written before the flusher starts */
+static void WriteBinaryHeader(void)
+{
+	char header[LOG_BINARY_HEADER_SIZE];
+	unsigned int endian = LOG_BINARY_ENDIAN;
+
+	memset(header, 0, sizeof(header));
+	memcpy(header, LOG_BINARY_MAGIC, LOG_BINARY_MAGIC_SIZE);
+	memcpy(header + LOG_BINARY_MAGIC_SIZE, &endian, sizeof(endian));
+	header[LOG_BINARY_MAGIC_SIZE + sizeof(endian)] = (char)sizeof(long);
+	header[LOG_BINARY_MAGIC_SIZE + sizeof(endian) + 1] = (char)sizeof(void*);
+	if (LOG_BINARY_HEADER_SIZE != write(g_log.m_fileDesc, header, sizeof(header)))
+	{
+		/* nothing to log it to */
+		s_fileFormat = LOG_FORMAT_TEXT;
+	}
+}
+
+static void WriteBatch(char* _batch, size_t* _used)
+{
+	size_t offset = 0;
+	ssize_t nBytes;
+
+	while (offset < *_used)
+	{
+		nBytes = write(g_log.m_fileDesc, _batch + offset, *_used - offset);
+		if (nBytes <= 0)
+		{
+			break;
+		}
+		offset += nBytes;
+	}
+	*_used = 0;
+}
+
+static void AppendRecord(const LogRecord* _record, char* _batch, size_t* _used)
 {
-    time_t currentTime;
-    struct tm* timeInfo;
-    
-    currentTime = time(NULL);
-    timeInfo = localtime(&currentTime);
-    strftime(_buffer, BUFFER_SIZE, "[%Y-%m-%d %H:%M:%S]", timeInfo);
-    return _buffer;
+	size_t timeLength;
+	const char* timeText;
+
+	if (LOG_FORMAT_BINARY == s_fileFormat)
+	{
+		AppendFrame(_record, _batch, _used);
+		return;
+	}
+	timeText = TimeStamp(_record, &timeLength);
+
+	memcpy(_batch + *_used, timeText, timeLength);
+	*_used += timeLength;
+	if (s_timeFlags & LOG_TIME_MONOTONIC_USEC)
+	{
+		*_used += snprintf(_batch + *_used, BATCH_SIZE - *_used, " +%luus", _record->m_monoUsec);
+	}
+	_batch[(*_used)++] = ' ';
+	memcpy(_batch + *_used, _record->m_text, _record->m_length);
+	*_used += _record->m_length;
+	_batch[(*_used)++] = '\n';
+}
+
+/* Formats and writes everything queued in one ring, returns the number of records */
+static size_t DrainRing(LogRing* _ring, char* _batch, size_t* _used)
+{
+	LogRecord report;
+	unsigned long tail = _ring->m_tail;
+	unsigned long head = __atomic_load_n(&_ring->m_head, __ATOMIC_ACQUIRE);
+	unsigned long dropped = __atomic_load_n(&_ring->m_dropped, __ATOMIC_RELAXED);
+	size_t nRecords = head - tail;
+
+	for (; tail != head; ++tail)
+	{
+		if (BATCH_SIZE - *_used < FRAME_ROOM)
+		{
+			WriteBatch(_batch, _used);
+		}
+		AppendRecord(&_ring->m_records[tail & (RING_RECORDS - 1)], _batch, _used);
+	}
+	__atomic_store_n(&_ring->m_tail, tail, __ATOMIC_RELEASE);
+	if (dropped != _ring->m_reported)
+	{
+		if (BATCH_SIZE - *_used < FRAME_ROOM)
+		{
+			WriteBatch(_batch, _used);
+		}
+		StampRecord(&report);
+		report.m_site = NULL;
+		report.m_length = snprintf(report.m_text, RECORD_TEXT_SIZE, "logger: ring full, %lu messages dropped", dropped - _ring->m_reported);
+		AppendRecord(&report, _batch, _used);
+		_ring->m_reported = dropped;
+	}
+	return nRecords;
+}
+
+/* One summary line per site that suppressed messages since the last report */
+static void ReportSuppressed(char* _batch, size_t* _used)
+{
+	LogSite* site = __atomic_load_n(&s_limitedSites, __ATOMIC_ACQUIRE);
+	LogRecord report;
+	unsigned long suppressed;
+
+	for (; NULL != site; site = site->m_nextLimited)
+	{
+		suppressed = __atomic_exchange_n(&site->m_suppressed, 0, __ATOMIC_RELAXED);
+		if (0 == suppressed)
+		{
+			continue;
+		}
+		if (BATCH_SIZE - *_used < FRAME_ROOM)
+		{
+			WriteBatch(_batch, _used);
+		}
+		StampRecord(&report);
+		report.m_site = NULL;
+		report.m_length = snprintf(report.m_text, RECORD_TEXT_SIZE, "%s::%s[%d]:%s %lu similar messages suppressed",
+									site->m_file, site->m_function, site->m_line, site->m_type, suppressed);
+		if (report.m_length >= RECORD_TEXT_SIZE)
+		{
+			report.m_length = RECORD_TEXT_SIZE - 1;
+		}
+		AppendRecord(&report, _batch, _used);
+	}
+}
+
+/* One pass over all rings, frees rings of exited threads once they are empty */
+static size_t DrainAll(char* _batch, size_t* _used)
+{
+	LogRing** link;
+	LogRing* ring;
+	size_t nRecords = 0;
+	int isOrphan;
+
+	pthread_mutex_lock(&s_ringsMutex);
+	link = &s_rings;
+	while (NULL != (ring = *link))
+	{
+		/* read before draining, so records written before the thread exited are drained */
+		isOrphan = __atomic_load_n(&ring->m_isOrphan, __ATOMIC_ACQUIRE);
+		nRecords += DrainRing(ring, _batch, _used);
+		if (isOrphan)
+		{
+			*link = ring->m_next;
+			free(ring);
+			continue;
+		}
+		link = &ring->m_next;
+	}
+	pthread_mutex_unlock(&s_ringsMutex);
+
+	if (*_used)
+	{
+		WriteBatch(_batch, _used);
+	}
+	return nRecords;
+}
+
+static void* Flusher(void* _unused)
+{
+	static char batch[BATCH_SIZE];
+	size_t used = 0;
+	struct timespec interval = {0, FLUSH_INTERVAL_NSEC};
+	unsigned long long lastReport = MonotonicNsec(CLOCK_MONOTONIC_COARSE);
+	unsigned long long now;
+
+	while (!s_stop)
+	{
+		/* sleep only when idle - a busy logger is drained back to back */
+		if (0 == DrainAll(batch, &used))
+		{
+			nanosleep(&interval, NULL);
+		}
+		now = MonotonicNsec(CLOCK_MONOTONIC_COARSE);
+		if (now - lastReport >= SUPPRESS_REPORT_NSEC)
+		{
+			ReportSuppressed(batch, &used);
+			WriteBatch(batch, &used);
+			lastReport = now;
+		}
+	}
+	DrainAll(batch, &used);
+	ReportSuppressed(batch, &used);
+	WriteBatch(batch, &used);
+	return NULL;
 }
 
 ADTErr LogCreate( unsigned char _modes, const char* _logName )
 {
+	sigset_t allSignals;
+	sigset_t oldMask;
+
 	if (NULL == _logName)
 	{
 		return ERR_ILLEGAL_INPUT;
 	}
-	
+
 	if (g_log.m_fileDesc >= 0)
 	{
-		close(g_log.m_fileDesc);
-		g_log.m_fileDesc = -1;
+		LogDestroy();
 	}
-	
+
 	g_log.m_fileDesc = open(_logName, O_APPEND | O_RDWR | O_CREAT, S_IRUSR | S_IWUSR | S_IXUSR);
 	if (g_log.m_fileDesc < 0)
 	{
 		return ERR_ALLOCATION_FAILED;
 	}
+
+	s_fileFormat = s_format;
+	if (LOG_FORMAT_BINARY == s_fileFormat)
+	{
+		WriteBinaryHeader();
+		/* site ids are described again in every session */
+		free(s_definedSites);
+		s_definedSites = NULL;
+		s_definedCapacity = 0;
+	}
+	/* localtime_r doesn't read TZ on its own */
+	tzset();
+	clock_gettime(CLOCK_MONOTONIC, &s_monoStart);
+	s_stop = false;
+	/* the flusher inherits a full mask - process signals go to the threads waiting for them */
+	sigfillset(&allSignals);
+	pthread_sigmask(SIG_BLOCK, &allSignals, &oldMask);
+	s_isFlusherRunning = (0 == pthread_create(&s_flusher, NULL, Flusher, NULL));
+	pthread_sigmask(SIG_SETMASK, &oldMask, NULL);
+	if (!s_isFlusherRunning)
+	{
+		close(g_log.m_fileDesc);
+		g_log.m_fileDesc = -1;
+		return ERR_THREAD_CANT_CREATE;
+	}
 	g_log.m_modes = _modes;
-	
+	g_logActiveModes = _modes;
+
 	return ERR_OK;
 }
 
@@ -72,28 +720,115 @@ void LogDestroy( void )
 	{
 		return;
 	}
-	
+
+	g_log.m_modes = LOG_NONE;
+	g_logActiveModes = LOG_NONE;
+	if (s_isFlusherRunning)
+	{
+		s_stop = true;
+		pthread_join(s_flusher, NULL);
+		s_isFlusherRunning = false;
+	}
 	close(g_log.m_fileDesc);
 	g_log.m_fileDesc = -1;
-	g_log.m_modes = LOG_NONE;
 }
 
 void LogRegister (unsigned char _mode, const char* _preMessage, const char* _message)
 {
-	char timeBuff[BUFFER_SIZE] = "";
-	char buffer[BUFFER_SIZE] = "";
-	int buffSize = 0;
-	
+	LogRecord* record;
+
+	if (g_log.m_fileDesc < 0 || ((_mode & g_log.m_modes) != _mode))
+	{
+		return;
+	}
+
+	record = ReserveRecord(_mode);
+	if (NULL != record)
+	{
+		record->m_site = NULL;
+		CommitRecord(record, snprintf(record->m_text, RECORD_TEXT_SIZE, "%s %s", _preMessage, _message));
+	}
+}
+
+void LogPrintf (unsigned char _mode, const char* _type, const char* _file, const char* _function, int _line, const char* _format, ...)
+{
+	LogRecord* record;
+	va_list args;
+	int length;
+
 	if (g_log.m_fileDesc < 0 || ((_mode & g_log.m_modes) != _mode))
 	{
 		return;
 	}
-	
-	buffSize = snprintf(buffer, BUFFER_SIZE, "%s %s %s\n", TimeStamp(timeBuff), _preMessage, _message);
-	write(g_log.m_fileDesc, buffer, buffSize);
+
+	record = ReserveRecord(_mode);
+	if (NULL == record)
+	{
+		return;
+	}
+	va_start(args, _format);
+	length = FormatText(record, _type, _file, _function, _line, _format, args);
+	va_end(args);
+	CommitRecord(record, length);
+}
+
+void LogSitePrintf(LogSite* _site, ...)
+{
+	LogRecord* record;
+	va_list args;
+	int length;
+
+	if (g_log.m_fileDesc < 0 || ((_site->m_mode & g_log.m_modes) != _site->m_mode))
+	{
+		return;
+	}
+
+	if (!SiteAllows(_site))
+	{
+		return;
+	}
+	PrepSite(_site);
+	record = ReserveRecord(_site->m_mode);
+	if (NULL == record)
+	{
+		return;
+	}
+	va_start(args, _site);
+	if (LOG_FORMAT_BINARY == s_fileFormat && _site->m_nArgs >= 0)
+	{
+		record->m_site = _site;
+		length = PackArgs(_site, record->m_text, args);
+	}
+	else
+	{
+		length = FormatText(record, _site->m_type, _site->m_file, _site->m_function, _site->m_line, _site->m_format, args);
+	}
+	va_end(args);
+	CommitRecord(record, length);
+}
+
+void LogSetRateLimit(unsigned int _perSecond, unsigned int _burst)
+{
+	if (0 == _perSecond)
+	{
+		s_rateInterval = 0;
+		return;
+	}
+	s_rateBurstWindow = (_burst > 1) ? (unsigned long long)(_burst - 1) * (NSEC_IN_SEC / _perSecond) : 0;
+	s_rateInterval = NSEC_IN_SEC / _perSecond;
+}
+
+void LogSetFormat(unsigned char _format)
+{
+	s_format = _format;
+}
+
+void LogSetTimeFormat(unsigned char _flags)
+{
+	s_timeFlags = _flags;
 }
 
 int LogTestMode(unsigned char _mode)
 {
-	return ( (g_log.m_fileDesc >= 0) && ((_mode & g_log.m_modes) == _mode) );
+	return ((_mode & g_logActiveModes) == _mode);
 }
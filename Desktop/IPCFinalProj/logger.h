@@ -18,6 +18,57 @@ typedef enum e_LogLevel
     LOG_RMG   = 0x08     /* Resource manager messages	*/
 } e_LogLevel;
 
+typedef enum e_LogTimeFlags
+{								/* Timestamp of each message	*/
+    LOG_TIME_SECONDS		= 0x00,	/* [date time] (default)		*/
+    LOG_TIME_MSEC			= 0x01,	/* [date time.msec]				*/
+    LOG_TIME_MONOTONIC_USEC	= 0x02	/* +usec since LogCreate, from the monotonic clock */
+} e_LogTimeFlags;
+
+/*
+ * Messages are written asynchronously:
+ * every thread appends fixed size records to its own ring, and a flusher
+ * thread started by LogCreate drains all rings and writes them in batches.
+ * Order is kept per thread. When a ring is full, debug and rmg messages
+ * are dropped (and counted), errors and warnings wait for room.
+ */
+
+typedef enum e_LogFormat
+{
+    LOG_FORMAT_TEXT		= 0,	/* formatted lines (default)				*/
+    LOG_FORMAT_BINARY	= 1		/* site id + raw arguments, read with logdecode */
+} e_LogFormat;
+
+#define LOG_SITE_MAX_ARGS 12
+
+/*
+ * One LOG_*_PRINT statement - a static instance per call site.
+ * The first fields are set by the macro, the rest on first use.
+ */
+typedef struct LogSite
+{
+	unsigned char	m_mode;
+	const char*		m_type;
+	const char*		m_file;
+	const char*		m_function;
+	int				m_line;
+	const char*		m_format;
+	int				m_state;		/* LOG_SITE_* in logger.c */
+	unsigned int	m_id;
+	int				m_nArgs;		/* -1: format can't be packed, logged as text */
+	unsigned char	m_argTypes[LOG_SITE_MAX_ARGS];
+	unsigned long long m_arrival;	/* rate limit state, see LogSetRateLimit */
+	unsigned long	m_suppressed;	/* since the last summary */
+	int				m_isListed;
+	struct LogSite*	m_nextLimited;
+} LogSite;
+
+/*
+ * Modes currently logged - LOG_NONE while there is no log file.
+ * Read by the LOG_*_PRINT macros, changed only by LogCreate/LogDestroy.
+ */
+extern unsigned char g_logActiveModes;
+
 /*
  * Create logfile
  *
@@ -29,7 +80,7 @@ typedef enum e_LogLevel
 ADTErr  LogCreate   ( unsigned char _modes, const char* _logName );
 
 /*
- * Stop logging operation
+ * Stop logging operation - writes everything still queued first
  */
 void	LogDestroy	( void );
 
@@ -43,6 +94,39 @@ void	LogDestroy	( void );
  */
 void	LogRegister (unsigned char _mode, const char* _preMessage, const char* _message);
 
+/*
+ * Store log message, formatted printf style after a "file::function[line]:type" prefix.
+ * Used by the LOG_*_PRINT macros.
+ */
+void	LogPrintf	(unsigned char _mode, const char* _type, const char* _file, const char* _function, int _line, const char* _format, ...)
+					__attribute__((format(printf, 6, 7)));
+
+/*
+ * Store log message of a LOG_*_PRINT site, arguments as in its format.
+ * Text format: formatted in the calling thread.
+ * Binary format: only the arguments are copied, strings included.
+ */
+void	LogSitePrintf(LogSite* _site, ...);
+
+/*
+ * Every LOG_*_PRINT statement may log _perSecond messages, in bursts of up to _burst.
+ * The rest are dropped and counted; once a second the logger writes
+ * "<site> N similar messages suppressed" for each site that dropped any.
+ * 0 per second - unlimited (default).
+ */
+void	LogSetRateLimit(unsigned int _perSecond, unsigned int _burst);
+
+/*
+ * e_LogFormat of the files created by the next LogCreate.
+ * A binary file starts with a header, so sessions can be appended to it.
+ */
+void	LogSetFormat(unsigned char _format);
+
+/*
+ * Set e_LogTimeFlags (or-ed) for the messages logged from now on.
+ */
+void	LogSetTimeFormat(unsigned char _flags);
+
 /*
  * Tests if _mode is currently active in logger.
  *
@@ -11,31 +11,75 @@
 #ifndef __logger_pub_h__
 #define __logger_pub_h__
 
-#define LOCAL_BUFFER 1024
-char msg[LOCAL_BUFFER];
-char preMsg[LOCAL_BUFFER];
-	
 #pragma GCC diagnostic push
 #pragma GCC diagnostic ignored "-Wvariadic-macros"
 
+/*
+ * Compile time threshold: statements less severe than LOG_MIN_LEVEL compile to nothing.
+ * e.g. -D LOG_MIN_LEVEL=LOG_SEVERITY_WARN keeps only errors and warnings.
+ */
+#define LOG_SEVERITY_RMG	0
+#define LOG_SEVERITY_DEBUG	1
+#define LOG_SEVERITY_WARN	2
+#define LOG_SEVERITY_ERROR	3
+
+#ifndef LOG_MIN_LEVEL
+#define LOG_MIN_LEVEL LOG_SEVERITY_RMG
+#endif
+
+/* Compiled out statements still type check their arguments, so nothing becomes unused */
+#define LOG_NO_PRINT(mode, type, fmt, ...)\
+	if (0)\
+	{\
+		LogPrintf((mode), (type), __FILE__, __func__, __LINE__, (fmt), __VA_ARGS__);\
+	}
+
+#if LOG_MIN_LEVEL <= LOG_SEVERITY_ERROR
 #define LOG_ERROR_PRINT(fmt,...)\
 	LOG_PRINT(LOG_ERROR, "ERROR", fmt, __VA_ARGS__)
+#else
+#define LOG_ERROR_PRINT(fmt,...)\
+	LOG_NO_PRINT(LOG_ERROR, "ERROR", fmt, __VA_ARGS__)
+#endif
 	
+#if LOG_MIN_LEVEL <= LOG_SEVERITY_WARN
 #define LOG_WARN_PRINT(fmt,...)\
 	LOG_PRINT(LOG_WARN, "WARNING", fmt, __VA_ARGS__)
+#else
+#define LOG_WARN_PRINT(fmt,...)\
+	LOG_NO_PRINT(LOG_WARN, "WARNING", fmt, __VA_ARGS__)
+#endif
 	
+#if LOG_MIN_LEVEL <= LOG_SEVERITY_DEBUG
 #define LOG_DEBUG_PRINT(fmt,...)\
 	LOG_PRINT(LOG_DEBUG, "DEBUG", fmt, __VA_ARGS__)
+#else
+#define LOG_DEBUG_PRINT(fmt,...)\
+	LOG_NO_PRINT(LOG_DEBUG, "DEBUG", fmt, __VA_ARGS__)
+#endif
 	
+#if LOG_MIN_LEVEL <= LOG_SEVERITY_RMG
 #define LOG_RMG_PRINT(fmt,...)\
 	LOG_PRINT(LOG_RMG, "RMG", fmt, __VA_ARGS__)
+#else
+#define LOG_RMG_PRINT(fmt,...)\
+	LOG_NO_PRINT(LOG_RMG, "RMG", fmt, __VA_ARGS__)
+#endif
 
+/*
+ * Runtime check is an inlined test of g_logActiveModes, expected to fail -
+ * a disabled statement costs one load and a not taken branch.
+ * Every statement owns a static LogSite, so the binary log carries only its id.
+ */
 #define LOG_PRINT(mode, type, fmt, ...)\
-	if ( LogTestMode((mode)) && (NULL != (fmt)) )\
+	if ( __builtin_expect(((mode) & g_logActiveModes) == (mode), 0) && (NULL != (fmt)) )\
 	{\
-		snprintf(preMsg, LOCAL_BUFFER, "%s::%s[%d]:%s", __FILE__, __FUNCTION__, __LINE__, (type));\
-		snprintf(msg, LOCAL_BUFFER, (fmt), __VA_ARGS__);\
-		LogRegister((mode), preMsg, msg);\
+		static LogSite logSite = {(mode), (type), __FILE__, __func__, __LINE__, (fmt), 0, 0, 0, {0}};\
+		if (0) /* printf format check only */\
+		{\
+			LogPrintf((mode), (type), __FILE__, __func__, __LINE__, (fmt), __VA_ARGS__);\
+		}\
+		LogSitePrintf(&logSite, __VA_ARGS__);\
 	}
 	
 #pragma GCC diagnostic pop
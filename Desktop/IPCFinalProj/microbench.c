@@ -0,0 +1,467 @@
+/**************************************************************************************************
+	Creation date: 			19.10.26
+	Last modified date: 	19.10.26
+
+	Description: Micro benchmarks of the data structures under the pipeline -
+				 GHashMap, SafeQueue, GLList and Parse - without any file I/O.
+				 Every operation is timed on its own; the clock overhead is measured
+				 at start and subtracted. Prints one line per case:
+				 ns/op (mean) and the p50/p90/p99/p99.9/max percentiles.
+
+	Usage: microbench [-H max entries] [-P max producers] [-n ops] [-s suite]
+				 -H	hash sizes run 1K, 10K ... up to this (1000000, up to 100000000)
+				 -P	SafeQueue producers run 1, 2, 4 ... up to this (64)
+				 -n	operations per SafeQueue / GLList / Parse case (1000000)
+				 -s	only one suite: hash, queue, list or parse
+**************************************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include <getopt.h>
+
+#include "ADTErr.h"
+#include "GData.h"
+#include "GHashMap.h"
+#include "GLList.h"
+#include "safeQueue.h"
+#include "cdr.h"
+#include "parser.h"
+
+#define MIN_HASH_ENTRIES 1000UL
+#define DEFAULT_HASH_ENTRIES 1000000UL
+#define MAX_HASH_ENTRIES 100000000UL
+#define DEFAULT_PRODUCERS 64
+#define MAX_PRODUCERS 64
+#define DEFAULT_OPS 1000000UL
+#define QUEUE_SIZE 1024
+#define CALIBRATION_ROUNDS 100000
+#define NSEC_IN_SEC 1000000000UL
+#define LINE_SIZE 128
+#define NUM_OF_LINES 1024
+/* chains stay short at every size - measures the map, not the bucket count */
+#define BUCKETS_PER_ENTRY 2
+
+/* log-linear histogram: exact below 2^SUB_BITS, then SUB_BUCKETS per power of two */
+#define SUB_BITS 6
+#define SUB_BUCKETS (1 << SUB_BITS)
+#define NUM_OF_BUCKETS ((64 - SUB_BITS + 1) * SUB_BUCKETS)
+
+typedef struct
+{
+	unsigned long	m_counts[NUM_OF_BUCKETS];
+	unsigned long	m_total;
+	unsigned long	m_sum;
+	unsigned long	m_max;
+} Histogram;
+
+typedef struct
+{
+	SafeQueue*		m_queue;
+	unsigned long	m_nOps;
+	Histogram		m_latency;
+} QueueWorker;
+
+static unsigned long s_clockOverhead;
+static Histogram s_histogram;
+
+static inline unsigned long NowNsec(void)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (unsigned long)now.tv_sec * NSEC_IN_SEC + now.tv_nsec;
+}
+
+static size_t BucketOf(unsigned long _value)
+{
+	int msb;
+
+	if (_value < SUB_BUCKETS)
+	{
+		return _value;
+	}
+	msb = 63 - __builtin_clzl(_value);
+	return (size_t)(msb - SUB_BITS + 1) * SUB_BUCKETS + ((_value >> (msb - SUB_BITS)) & (SUB_BUCKETS - 1));
+}
+
+/* the lowest value of the bucket */
+static unsigned long BucketValue(size_t _bucket)
+{
+	size_t shift;
+
+	if (_bucket < SUB_BUCKETS)
+	{
+		return _bucket;
+	}
+	shift = _bucket / SUB_BUCKETS - 1;
+	return (SUB_BUCKETS + _bucket % SUB_BUCKETS) << shift;
+}
+
+static inline void HistogramRecord(Histogram* _histogram, unsigned long _start)
+{
+	unsigned long elapsed = NowNsec() - _start;
+
+	elapsed = (elapsed > s_clockOverhead) ? elapsed - s_clockOverhead : 0;
+	++_histogram->m_counts[BucketOf(elapsed)];
+	++_histogram->m_total;
+	_histogram->m_sum += elapsed;
+	if (elapsed > _histogram->m_max)
+	{
+		_histogram->m_max = elapsed;
+	}
+}
+
+static void HistogramMerge(Histogram* _to, const Histogram* _from)
+{
+	size_t i;
+
+	for (i = 0; i < NUM_OF_BUCKETS; ++i)
+	{
+		_to->m_counts[i] += _from->m_counts[i];
+	}
+	_to->m_total += _from->m_total;
+	_to->m_sum += _from->m_sum;
+	if (_from->m_max > _to->m_max)
+	{
+		_to->m_max = _from->m_max;
+	}
+}
+
+static unsigned long Percentile(const Histogram* _histogram, double _percent)
+{
+	unsigned long rank = (unsigned long)(_histogram->m_total * _percent / 100.0);
+	unsigned long seen = 0;
+	size_t i;
+
+	for (i = 0; i < NUM_OF_BUCKETS; ++i)
+	{
+		seen += _histogram->m_counts[i];
+		if (seen > rank)
+		{
+			return BucketValue(i);
+		}
+	}
+	return _histogram->m_max;
+}
+
+static void Report(const char* _case, unsigned long _size, const Histogram* _histogram)
+{
+	if (0 == _histogram->m_total)
+	{
+		return;
+	}
+	printf("%-22s %10lu %10lu %9.1f %7lu %7lu %7lu %7lu %9lu\n", _case, _size, _histogram->m_total,
+		   (double)_histogram->m_sum / _histogram->m_total, Percentile(_histogram, 50.0), Percentile(_histogram, 90.0),
+		   Percentile(_histogram, 99.0), Percentile(_histogram, 99.9), _histogram->m_max);
+	fflush(stdout);
+}
+
+static void ClockCalibrate(void)
+{
+	unsigned long start = NowNsec();
+	int i;
+
+	for (i = 0; i < CALIBRATION_ROUNDS; ++i)
+	{
+		NowNsec();
+	}
+	s_clockOverhead = (NowNsec() - start) / CALIBRATION_ROUNDS;
+	printf("# clock overhead %lu ns, subtracted from every sample\n", s_clockOverhead);
+	printf("%-22s %10s %10s %9s %7s %7s %7s %7s %9s\n", "# case", "size", "ops", "ns/op", "p50", "p90", "p99", "p99.9", "max");
+}
+
+/* ---------------------------------- GHashMap ---------------------------------- */
+
+static unsigned int KeyHash(HashKey _key, size_t _size)
+{
+	unsigned long key = *(unsigned long*)_key * 0x9E3779B97F4A7C15UL;
+
+	return (unsigned int)((key >> 32) % _size);
+}
+
+static int KeyIsEqual(HashKey _key1, HashKey _key2)
+{
+	return *(unsigned long*)_key1 == *(unsigned long*)_key2;
+}
+
+static int CountEntry(HashKey _key, Data _data, void* _count)
+{
+	++*(unsigned long*)_count;
+	return 1;
+}
+
+/* pseudo random walk over all indexes - the multiplier is a prime above any _n,
+   so every entry is hit once, in no cache friendly order */
+static unsigned long Scatter(unsigned long _i, unsigned long _n)
+{
+	return (_i * 2654435761UL) % _n;
+}
+
+static void BenchHash(unsigned long _nEntries)
+{
+	HashMap* map = HashCreate(_nEntries * BUCKETS_PER_ENTRY, KeyHash, KeyIsEqual);
+	unsigned long* key;
+	unsigned long probe;
+	unsigned long count = 0;
+	unsigned long start;
+	unsigned long i;
+
+	if (NULL == map)
+	{
+		fprintf(stderr, "hash %lu entries: allocation failed\n", _nEntries);
+		return;
+	}
+	/* odd keys are inserted, even ones miss. The map frees its keys, the allocation isn't timed */
+	memset(&s_histogram, 0, sizeof(s_histogram));
+	for (i = 0; i < _nEntries; ++i)
+	{
+		key = malloc(sizeof(unsigned long));
+		if (NULL == key)
+		{
+			break;
+		}
+		*key = 2 * i + 1;
+		start = NowNsec();
+		HashInsert(map, key, key);
+		HistogramRecord(&s_histogram, start);
+	}
+	Report("hash_insert", _nEntries, &s_histogram);
+
+	memset(&s_histogram, 0, sizeof(s_histogram));
+	for (i = 0; i < _nEntries; ++i)
+	{
+		probe = 2 * Scatter(i, _nEntries) + 1;
+		start = NowNsec();
+		HashFind(map, &probe);
+		HistogramRecord(&s_histogram, start);
+	}
+	Report("hash_find_hit", _nEntries, &s_histogram);
+
+	memset(&s_histogram, 0, sizeof(s_histogram));
+	for (i = 0; i < _nEntries; ++i)
+	{
+		probe = 2 * Scatter(i, _nEntries);
+		start = NowNsec();
+		HashFind(map, &probe);
+		HistogramRecord(&s_histogram, start);
+	}
+	Report("hash_find_miss", _nEntries, &s_histogram);
+
+	/* one walk can't be split into samples - every entry gets the mean */
+	memset(&s_histogram, 0, sizeof(s_histogram));
+	start = NowNsec();
+	HashForEach(map, CountEntry, &count);
+	i = NowNsec() - start;
+	if (count)
+	{
+		s_histogram.m_total = count;
+		s_histogram.m_sum = i;
+		s_histogram.m_max = i / count;
+		s_histogram.m_counts[BucketOf(i / count)] = count;
+	}
+	Report("hash_foreach", _nEntries, &s_histogram);
+
+	HashDestroy(map);
+}
+
+/* ---------------------------------- SafeQueue ---------------------------------- */
+
+static void* QueueProducer(void* _worker)
+{
+	QueueWorker* worker = _worker;
+	unsigned long start;
+	unsigned long i;
+
+	for (i = 0; i < worker->m_nOps; ++i)
+	{
+		start = NowNsec();
+		SafeQueuePush(worker->m_queue, worker);
+		HistogramRecord(&worker->m_latency, start);
+	}
+	return NULL;
+}
+
+/* P producers, one consumer - the readers and the DB feeder */
+static void BenchQueue(size_t _nProducers, unsigned long _nOps)
+{
+	static QueueWorker workers[MAX_PRODUCERS];
+	pthread_t threads[MAX_PRODUCERS];
+	SafeQueue* queue = SafeQueueInit(QUEUE_SIZE);
+	Histogram* pushes;
+	unsigned long perProducer = _nOps / _nProducers;
+	unsigned long start;
+	unsigned long i;
+	void* data;
+	size_t created;
+
+	pushes = calloc(1, sizeof(Histogram));
+	if (NULL == queue || NULL == pushes)
+	{
+		fprintf(stderr, "%s\n", "queue: allocation failed");
+		free(pushes);
+		return;
+	}
+	memset(&s_histogram, 0, sizeof(s_histogram));
+	for (created = 0; created < _nProducers; ++created)
+	{
+		memset(&workers[created], 0, sizeof(QueueWorker));
+		workers[created].m_queue = queue;
+		workers[created].m_nOps = perProducer;
+		if (0 != pthread_create(&threads[created], NULL, QueueProducer, &workers[created]))
+		{
+			fprintf(stderr, "queue: only %lu producers started\n", (unsigned long)created);
+			break;
+		}
+	}
+	for (i = 0; i < perProducer * created; ++i)
+	{
+		start = NowNsec();
+		SafeQueuePop(queue, &data);
+		HistogramRecord(&s_histogram, start);
+	}
+	for (i = 0; i < created; ++i)
+	{
+		pthread_join(threads[i], NULL);
+		HistogramMerge(pushes, &workers[i].m_latency);
+	}
+	Report("queue_push", created, pushes);
+	Report("queue_pop", created, &s_histogram);
+	SafeQueueDestroy(queue);
+	free(pushes);
+}
+
+/* ---------------------------------- GLList ---------------------------------- */
+
+static void BenchList(unsigned long _nOps)
+{
+	List* list = ListCreate();
+	ListItr it;
+	ListItr end;
+	unsigned long start;
+	unsigned long i;
+
+	if (NULL == list)
+	{
+		fprintf(stderr, "%s\n", "list: allocation failed");
+		return;
+	}
+	memset(&s_histogram, 0, sizeof(s_histogram));
+	for (i = 0; i < _nOps; ++i)
+	{
+		start = NowNsec();
+		ListPushTail(list, list);
+		HistogramRecord(&s_histogram, start);
+	}
+	Report("list_push_tail", _nOps, &s_histogram);
+
+	memset(&s_histogram, 0, sizeof(s_histogram));
+	end = ListEnd(list);
+	for (it = ListBegin(list); !ListIsSame(it, end); )
+	{
+		start = NowNsec();
+		ListGetData(it);
+		it = ListNext(it);
+		HistogramRecord(&s_histogram, start);
+	}
+	Report("list_iterate", _nOps, &s_histogram);
+
+	memset(&s_histogram, 0, sizeof(s_histogram));
+	for (i = 0; i < _nOps; ++i)
+	{
+		start = NowNsec();
+		ListPopHead(list);
+		HistogramRecord(&s_histogram, start);
+	}
+	Report("list_pop_head", _nOps, &s_histogram);
+	ListDestroy(list);
+}
+
+/* ---------------------------------- Parse ---------------------------------- */
+
+static void BenchParse(unsigned long _nOps, int _isMalformed)
+{
+	static char lines[NUM_OF_LINES][LINE_SIZE];
+	char line[LINE_SIZE];
+	unsigned long start;
+	unsigned long i;
+	CDR* cdr;
+
+	for (i = 0; i < NUM_OF_LINES; ++i)
+	{
+		snprintf(lines[i], LINE_SIZE, "%015lu|9725%08lu|35%013lu|Cellcom|%s|22/02/2015|03:05:55|%s|%lu.25|%lu.50|9725%08lu|Orange\n",
+				 425000000000000UL + i, i, i, (0 == i % 3) ? "MOC" : (1 == i % 3) ? "SMS_MO" : "GPRS",
+				 _isMalformed ? "n/a" : "120", i % 500, i % 50, (i * 7) % NUM_OF_LINES);
+	}
+	memset(&s_histogram, 0, sizeof(s_histogram));
+	for (i = 0; i < _nOps; ++i)
+	{
+		/* Parse cuts the line it gets - copy included, as in FilesReader's fgets */
+		start = NowNsec();
+		memcpy(line, lines[i % NUM_OF_LINES], LINE_SIZE);
+		if (ERR_OK == Parse(line, &cdr))
+		{
+			CDRDestroy(cdr);
+		}
+		HistogramRecord(&s_histogram, start);
+	}
+	Report(_isMalformed ? "parse_malformed" : "parse", _nOps, &s_histogram);
+}
+
+int main(int argc, char* argv[])
+{
+	unsigned long maxEntries = DEFAULT_HASH_ENTRIES;
+	unsigned long nOps = DEFAULT_OPS;
+	unsigned long nEntries;
+	size_t maxProducers = DEFAULT_PRODUCERS;
+	size_t nProducers;
+	const char* suite = NULL;
+	int opt;
+
+	while (-1 != (opt = getopt(argc, argv, "H:P:n:s:")))
+	{
+		switch (opt)
+		{
+			case 'H': maxEntries = strtoul(optarg, NULL, 10); break;
+			case 'P': maxProducers = strtoul(optarg, NULL, 10); break;
+			case 'n': nOps = strtoul(optarg, NULL, 10); break;
+			case 's': suite = optarg; break;
+			default:
+				fprintf(stderr, "Usage: %s [-H max hash entries] [-P max producers] [-n ops] [-s hash|queue|list|parse]\n", argv[0]);
+				return 1;
+		}
+	}
+	if (maxEntries > MAX_HASH_ENTRIES || 0 == maxProducers || maxProducers > MAX_PRODUCERS || 0 == nOps)
+	{
+		fprintf(stderr, "%s\n", "up to 100000000 hash entries and 64 producers, at least one op");
+		return 1;
+	}
+	ClockCalibrate();
+	if (NULL == suite || 0 == strcmp(suite, "hash"))
+	{
+		for (nEntries = MIN_HASH_ENTRIES; nEntries <= maxEntries; nEntries *= 10)
+		{
+			BenchHash(nEntries);
+		}
+	}
+	if (NULL == suite || 0 == strcmp(suite, "queue"))
+	{
+		for (nProducers = 1; nProducers <= maxProducers; nProducers *= 2)
+		{
+			BenchQueue(nProducers, nOps);
+		}
+	}
+	if (NULL == suite || 0 == strcmp(suite, "list"))
+	{
+		BenchList(nOps);
+	}
+	if (NULL == suite || 0 == strcmp(suite, "parse"))
+	{
+		BenchParse(nOps, 0);
+		BenchParse(nOps, 1);
+	}
+	return 0;
+}
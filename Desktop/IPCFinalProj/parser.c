@@ -18,14 +18,12 @@ Description:		* Get CDR string and convert to CDR struct
 
 /* TODO: make static function instead of MACRO */
 #define STR_ERROR_SIZE 100
-#define RETURN_PARSING_ERROR_AND_DESTROY_CDR_IF_FAILED if (errorStatus != ERR_OK)      			  \
-													   {							   			  \
-															CDRDestroy(*_cdr);         			  \
-															*_cdr = NULL;              			  \
-									 						GetError(strErr, ERR_PARSING_FAILED); \
-															LOG_ERROR_PRINT("%s", strErr);		  \
-															return ERR_PARSING_FAILED; 		      \
-													   }
+#define RETURN_PARSING_ERROR_IF_FAILED if (errorStatus != ERR_OK)      			  \
+									   {							   			  \
+											GetError(strErr, ERR_PARSING_FAILED); \
+											LOG_ERROR_PRINT("%s", strErr);		  \
+											return ERR_PARSING_FAILED; 		      \
+									   }
 													   
 static int Convert2ChosenCallType(const char* _callTypeStr)
 {
@@ -63,13 +61,7 @@ static int Convert2ChosenCallType(const char* _callTypeStr)
 /* Get CDR string, convert to CDR struct */
 ADTErr Parse(char* _cdrString, CDR** _cdr)
 {
-	char* savePtr = NULL; /* for strtok_r function, which is thread safe */
 	ADTErr errorStatus;
-	char* cdrDataStr = NULL;
-	e_callType callType;
-	unsigned int callDuration;
-	double downloaded;
-	double uploaded;
 	char strErr[STR_ERROR_SIZE] = "";
 
 	if (NULL == _cdrString || NULL == _cdr)
@@ -87,33 +79,61 @@ ADTErr Parse(char* _cdrString, CDR** _cdr)
 		LOG_ERROR_PRINT("%s", strErr);
 		return ERR_ALLOCATION_FAILED;
 	}
-
 	LOG_DEBUG_PRINT("%s", "CDR Successfuly created");
+
+	errorStatus = ParseInto(_cdrString, *_cdr);
+	if (errorStatus != ERR_OK)
+	{
+		CDRDestroy(*_cdr);
+		*_cdr = NULL;
+	}
+	return errorStatus;
+}
+
+/* Get CDR string, fill a CDR the caller owns */
+ADTErr ParseInto(char* _cdrString, CDR* _cdr)
+{
+	char* savePtr = NULL; /* for strtok_r function, which is thread safe */
+	ADTErr errorStatus;
+	char* cdrDataStr = NULL;
+	e_callType callType;
+	unsigned int callDuration;
+	double downloaded;
+	double uploaded;
+	char strErr[STR_ERROR_SIZE] = "";
+
+	if (NULL == _cdrString || NULL == _cdr)
+	{	
+		GetError(strErr, ERR_NOT_INITIALIZED);
+		LOG_ERROR_PRINT("%s", strErr);
+		return ERR_NOT_INITIALIZED;
+	}
+
 	/* Field: IMSI */ 
 	cdrDataStr = strtok_r(_cdrString, "|", &savePtr);
-	errorStatus = CDRInsertIMSI(*_cdr, cdrDataStr);
-	RETURN_PARSING_ERROR_AND_DESTROY_CDR_IF_FAILED;
+	errorStatus = CDRInsertIMSI(_cdr, cdrDataStr);
+	RETURN_PARSING_ERROR_IF_FAILED;
 	LOG_DEBUG_PRINT("Field %s inserted to IMSI successfully", cdrDataStr);
 	/* Field: MSISDN */
 	cdrDataStr = strtok_r(NULL, "|", &savePtr);
-	errorStatus = CDRInsertMSISDN(*_cdr, cdrDataStr);
-	RETURN_PARSING_ERROR_AND_DESTROY_CDR_IF_FAILED;
+	errorStatus = CDRInsertMSISDN(_cdr, cdrDataStr);
+	RETURN_PARSING_ERROR_IF_FAILED;
 	LOG_DEBUG_PRINT("Field %s inserted to MSISDN successfully", cdrDataStr);
 	/* Field: IMEI */
 	cdrDataStr = strtok_r(NULL, "|", &savePtr);
-	errorStatus = CDRInsertIMEI(*_cdr, cdrDataStr);
-	RETURN_PARSING_ERROR_AND_DESTROY_CDR_IF_FAILED;
+	errorStatus = CDRInsertIMEI(_cdr, cdrDataStr);
+	RETURN_PARSING_ERROR_IF_FAILED;
 	LOG_DEBUG_PRINT("Field %s inserted to IMEI successfully", cdrDataStr);
 	/* Field: operator code */
 	cdrDataStr = strtok_r(NULL, "|", &savePtr);
-	errorStatus = CDRInsertOpCode(*_cdr, cdrDataStr);
-	RETURN_PARSING_ERROR_AND_DESTROY_CDR_IF_FAILED;
+	errorStatus = CDRInsertOpCode(_cdr, cdrDataStr);
+	RETURN_PARSING_ERROR_IF_FAILED;
 	LOG_DEBUG_PRINT("Field %s inserted to operatorCode successfully", cdrDataStr);
 	/* Field: call type */
 	cdrDataStr = strtok_r(NULL, "|", &savePtr);
 	callType = Convert2ChosenCallType(cdrDataStr);
-	errorStatus = CDRInsertCallType(*_cdr, callType);
-	RETURN_PARSING_ERROR_AND_DESTROY_CDR_IF_FAILED;
+	errorStatus = CDRInsertCallType(_cdr, callType);
+	RETURN_PARSING_ERROR_IF_FAILED;
 	LOG_DEBUG_PRINT("Field %s inserted to callType successfully", cdrDataStr);
 
 	/* Field: call date: do nothing */
@@ -127,47 +147,44 @@ ADTErr Parse(char* _cdrString, CDR** _cdr)
 	cdrDataStr = strtok_r(NULL, "|", &savePtr);
 	if(sscanf(cdrDataStr, "%u", &callDuration) != 1) 
 	{ 
-		CDRDestroy(*_cdr);
 		GetError(strErr, ERR_PARSING_FAILED);
 		LOG_ERROR_PRINT("%s", strErr);
 		return ERR_PARSING_FAILED;
     }
 	LOG_DEBUG_PRINT("Field %s inserted to callDuration successfully", cdrDataStr);
-	errorStatus = CDRInsertCallDuration(*_cdr, callDuration);
-	RETURN_PARSING_ERROR_AND_DESTROY_CDR_IF_FAILED;
+	errorStatus = CDRInsertCallDuration(_cdr, callDuration);
+	RETURN_PARSING_ERROR_IF_FAILED;
 	/* Field: downloaded MB */
 	cdrDataStr = strtok_r(NULL, "|", &savePtr);
 	if(sscanf(cdrDataStr, "%lf", &downloaded) != 1) 
 	{ 
-		CDRDestroy(*_cdr);
 		GetError(strErr, ERR_PARSING_FAILED);
 		LOG_ERROR_PRINT("%s", strErr);
 		return ERR_PARSING_FAILED;
     }
-	errorStatus = CDRInsertDownloadedMB(*_cdr, downloaded);
-	RETURN_PARSING_ERROR_AND_DESTROY_CDR_IF_FAILED;
+	errorStatus = CDRInsertDownloadedMB(_cdr, downloaded);
+	RETURN_PARSING_ERROR_IF_FAILED;
 	LOG_DEBUG_PRINT("Field %s inserted to downloaded", cdrDataStr);
 	/* Field: uploaded MB */
 	cdrDataStr = strtok_r(NULL, "|", &savePtr);
 	if(sscanf(cdrDataStr, "%lf", &uploaded) != 1) 
 	{ 
-		CDRDestroy(*_cdr);
 		GetError(strErr, ERR_PARSING_FAILED);
 		LOG_ERROR_PRINT("%s", strErr);
 		return ERR_PARSING_FAILED;
     }
-	errorStatus = CDRInsertUploadedMB(*_cdr, uploaded);
-	RETURN_PARSING_ERROR_AND_DESTROY_CDR_IF_FAILED;
+	errorStatus = CDRInsertUploadedMB(_cdr, uploaded);
+	RETURN_PARSING_ERROR_IF_FAILED;
 	LOG_DEBUG_PRINT("Field %s inserted to uploaded", cdrDataStr);
 	/* Field: party MSISDN */
 	cdrDataStr = strtok_r(NULL, "|", &savePtr);
-	errorStatus = CDRInsertPartyMSISDN(*_cdr, cdrDataStr);
-	RETURN_PARSING_ERROR_AND_DESTROY_CDR_IF_FAILED;
+	errorStatus = CDRInsertPartyMSISDN(_cdr, cdrDataStr);
+	RETURN_PARSING_ERROR_IF_FAILED;
 	LOG_DEBUG_PRINT("Field %s inserted to partyMSISDN", cdrDataStr);
 	/* Field: party operator */
 	cdrDataStr = strtok_r(NULL, "|", &savePtr);
-	errorStatus = CDRInsertPartyOperator(*_cdr, cdrDataStr);
-	RETURN_PARSING_ERROR_AND_DESTROY_CDR_IF_FAILED;	
+	errorStatus = CDRInsertPartyOperator(_cdr, cdrDataStr);
+	RETURN_PARSING_ERROR_IF_FAILED;	
 	LOG_DEBUG_PRINT("Field %s inserted to partyOperator", cdrDataStr);
 	LOG_DEBUG_PRINT("%s", "Parsing Completed successfully");
 	
@@ -9,6 +9,8 @@ Description:		* Get CDR string and convert to CDR struct
 #define __PARSER_H__
 
 ADTErr Parse(char* _cdrString, CDR** _cdr);
+/* same as Parse into a CDR the caller allocated, the CDR is left half filled on error */
+ADTErr ParseInto(char* _cdrString, CDR* _cdr);
 ADTErr SendCDR2Queue(CDR* _cdr, SafeQueue* _queue);
 ADTErr SendEndMsg2Queue(SafeQueue* _queue);
 
@@ -110,6 +110,36 @@ ADTErr QueueInsert(Queue* _queue, Item _item)
 	return ERR_OK;
 }
 
+ADTErr QueueResize(Queue** _queue, size_t _size)
+{
+	Queue* resized = NULL;
+	Queue* old = NULL;
+	Item item;
+
+	if (NULL == _queue || NULL == *_queue || (*_queue)->m_magicNumber != QUEUE_MAGIC_NUMBER)
+	{
+		return ERR_NOT_INITIALIZED;
+	}
+	old = *_queue;
+	if (_size < old->m_nItems)
+	{
+		return ERR_ILLEGAL_INPUT;
+	}
+	resized = QueueCreate(_size);
+	if (NULL == resized)
+	{
+		return ERR_ALLOCATION_FAILED;
+	}
+	while (ERR_OK == QueueRemove(old, &item))
+	{
+		QueueInsert(resized, item);
+	}
+	QueueDestroy(old);
+	*_queue = resized;
+
+	return ERR_OK;
+}
+
 ADTErr QueueRemove(Queue* _queue, Item* _item)
 {
 	if (QUEUE_IS_NULL || NULL == _item)
@@ -15,6 +15,9 @@ void   QueueDestroy (Queue* _queue);
 int	   QueueIsEmpty (Queue* _queue);
 ADTErr QueueInsert 	(Queue* _queue, const Item _item);
 ADTErr QueueRemove 	(Queue* _queue, Item* _item);
+/* Moves the items, in order, to a queue of _size (at least the number of items).
+   *_queue is replaced - the old pointer is freed. */
+ADTErr QueueResize 	(Queue** _queue, size_t _size);
 void   QueuePrint 	(Queue* _queue, PrintFunc _doPrint);
 
 #endif /* __QUEUE_H__ */
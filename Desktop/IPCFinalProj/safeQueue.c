@@ -8,6 +8,8 @@
 #include <unistd.h>
 #include <pthread.h>
 #include <semaphore.h>
+#include <string.h>
+#include <time.h>
 #include <sys/shm.h>
 
 #include "ADTErr.h"
@@ -15,8 +17,10 @@
 #include "queue.h"
 #include "semaphore.h"
 #include "safeQueue.h"
+#include "Metrics.h"
 
 #define SUCCESS 0
+#define NSEC_IN_SEC 1000000000UL
 
 struct SafeQueue
 {
@@ -24,8 +28,54 @@ struct SafeQueue
 	sem_t m_prodSem;
 	sem_t m_consSem;
 	Queue* m_queue;
+	size_t m_nItems;	/* under m_mutex, as the stats below */
+	size_t m_vecSize;	/* room in m_queue, never less than the capacity */
+	size_t m_debt;		/* producer permits still to take back after a shrink */
+	SafeQueueStats m_stats;
 };
 
+static unsigned long NowNsec(void)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (unsigned long)now.tv_sec * NSEC_IN_SEC + now.tv_nsec;
+}
+
+/* a free semaphore is taken without reading the clock - only waits are timed */
+static ADTErr TimedSemDown(sem_t* _sem, unsigned long* _nWaits, unsigned long* _waitNsec)
+{
+	ADTErr error = SemTryDown(_sem);
+	unsigned long start;
+
+	if (ERR_UNDERFLOW != error)
+	{
+		return error;
+	}
+	start = NowNsec();
+	error = SemDown(_sem);
+	__sync_fetch_and_add(_nWaits, 1);
+	__sync_fetch_and_add(_waitNsec, NowNsec() - start);
+	return error;
+}
+
+/* call with m_mutex locked */
+static void SampleOccupancy(SafeQueue* _queue)
+{
+	SafeQueueStats* stats = &_queue->m_stats;
+	size_t bucket = SAFE_QUEUE_OCCUPANCY_BUCKETS - 1;
+
+	if (_queue->m_nItems > stats->m_highWater)
+	{
+		stats->m_highWater = _queue->m_nItems;
+	}
+	if (_queue->m_nItems < stats->m_capacity)
+	{
+		bucket = _queue->m_nItems * (SAFE_QUEUE_OCCUPANCY_BUCKETS - 1) / stats->m_capacity;
+	}
+	++stats->m_occupancy[bucket];
+}
+
 SafeQueue* SafeQueueInit(size_t _size)
 {
 	SafeQueue* safeQ = NULL;
@@ -41,6 +91,11 @@ SafeQueue* SafeQueueInit(size_t _size)
 	{
 		return NULL;
 	}
+	safeQ->m_nItems = 0;
+	safeQ->m_vecSize = _size;
+	safeQ->m_debt = 0;
+	memset(&safeQ->m_stats, 0, sizeof(safeQ->m_stats));
+	safeQ->m_stats.m_capacity = _size;
 	
 	/* initializing its semahores and mutex */
 	pthread_mutex_init(&safeQ->m_mutex, NULL);
@@ -63,13 +118,14 @@ in comparison to before */
 ADTErr SafeQueuePush(SafeQueue* _queue, void* _data)
 {
 	ADTErr error;
+	unsigned long start = MetricsStart();
 	
 	if (NULL == _queue)
 	{
 		return  ERR_NOT_INITIALIZED;
 	}	
 	
-	error = SemDown(&_queue->m_prodSem);
+	error = TimedSemDown(&_queue->m_prodSem, &_queue->m_stats.m_fullWaits, &_queue->m_stats.m_fullNsec);
 	if (error != ERR_OK)
 	{
 		return error;
@@ -81,6 +137,9 @@ ADTErr SafeQueuePush(SafeQueue* _queue, void* _data)
 	{
 		return error;
 	}
+	++_queue->m_nItems;
+	++_queue->m_stats.m_pushes;
+	SampleOccupancy(_queue);
 	pthread_mutex_unlock(&_queue->m_mutex);
 
 	error = SemUp(&_queue->m_consSem);
@@ -88,6 +147,7 @@ ADTErr SafeQueuePush(SafeQueue* _queue, void* _data)
 	{
 		return error;
 	}
+	MetricsRecord(METRIC_QUEUE_PUSH, start);
 
 	return ERR_OK;
 }
@@ -97,13 +157,15 @@ in comparison to before */
 ADTErr SafeQueuePop(SafeQueue* _queue, void** _dataPtr)
 {
 	ADTErr error;
+	int isRoomTaken = 0;
+	unsigned long start = MetricsStart();
 		
 	if (NULL == _queue)
 	{
 		return  ERR_NOT_INITIALIZED;
 	}	
 	
-	error = SemDown(&_queue->m_consSem);
+	error = TimedSemDown(&_queue->m_consSem, &_queue->m_stats.m_emptyWaits, &_queue->m_stats.m_emptyNsec);
 	if (error != ERR_OK)
 	{
 		return error;
@@ -115,13 +177,26 @@ ADTErr SafeQueuePop(SafeQueue* _queue, void** _dataPtr)
 	{
 		return error;
 	}
+	--_queue->m_nItems;
+	++_queue->m_stats.m_pops;
+	SampleOccupancy(_queue);
+	/* the queue was shrunk - this room is gone */
+	if (_queue->m_debt > 0)
+	{
+		--_queue->m_debt;
+		isRoomTaken = 1;
+	}
 	pthread_mutex_unlock(&_queue->m_mutex);
 
-	error = SemUp(&_queue->m_prodSem);
-	if (error != ERR_OK)
+	if (!isRoomTaken)
 	{
-		return error;
+		error = SemUp(&_queue->m_prodSem);
+		if (error != ERR_OK)
+		{
+			return error;
+		}
 	}
+	MetricsRecord(METRIC_QUEUE_POP, start);
 
 	return ERR_OK;
 }
@@ -168,3 +243,86 @@ ADTErr SafeQueueDestroy(SafeQueue* _queue)
 	
 	return ERR_OK;
 }
+
+ADTErr SafeQueueResize(SafeQueue* _queue, size_t _size)
+{
+	ADTErr error = ERR_OK;
+	size_t capacity;
+	size_t change;
+
+	if (NULL == _queue)
+	{
+		return ERR_NOT_INITIALIZED;
+	}
+	if (0 == _size)
+	{
+		return ERR_ILLEGAL_INPUT;
+	}
+	pthread_mutex_lock(&_queue->m_mutex);
+	capacity = _queue->m_stats.m_capacity;
+	if (_size > capacity)
+	{
+		if (_size > _queue->m_vecSize)
+		{
+			error = QueueResize(&_queue->m_queue, _size);
+			if (ERR_OK != error)
+			{
+				pthread_mutex_unlock(&_queue->m_mutex);
+				return error;
+			}
+			_queue->m_vecSize = _size;
+		}
+		/* room not yet taken back is simply kept */
+		change = _size - capacity;
+		for (; change > 0 && _queue->m_debt > 0; --change)
+		{
+			--_queue->m_debt;
+		}
+		for (; change > 0 && ERR_OK == error; --change)
+		{
+			error = SemUp(&_queue->m_prodSem);
+		}
+	}
+	else
+	{
+		/* free room is taken now, room that is full when its item is popped */
+		for (change = capacity - _size; change > 0 && ERR_OK == SemTryDown(&_queue->m_prodSem); --change);
+		_queue->m_debt += change;
+	}
+	_queue->m_stats.m_capacity = _size;
+	pthread_mutex_unlock(&_queue->m_mutex);
+	return error;
+}
+
+ADTErr SafeQueueGetStats(SafeQueue* _queue, SafeQueueStats* _stats)
+{
+	if (NULL == _queue || NULL == _stats)
+	{
+		return ERR_NOT_INITIALIZED;
+	}
+	pthread_mutex_lock(&_queue->m_mutex);
+	*_stats = _queue->m_stats;
+	pthread_mutex_unlock(&_queue->m_mutex);
+	return ERR_OK;
+}
+
+void SafeQueuePrintStats(FILE* _file, void* _queue)
+{
+	SafeQueueStats stats;
+	size_t i;
+
+	if (NULL == _file || ERR_OK != SafeQueueGetStats(_queue, &stats))
+	{
+		return;
+	}
+	fprintf(_file, "queue_capacity %lu\nqueue_high_water %lu\nqueue_pushes %lu\nqueue_pops %lu\n",
+			(unsigned long)stats.m_capacity, (unsigned long)stats.m_highWater, stats.m_pushes, stats.m_pops);
+	fprintf(_file, "queue_full_waits %lu\nqueue_full_sec %.6f\nqueue_empty_waits %lu\nqueue_empty_sec %.6f\n",
+			stats.m_fullWaits, (double)stats.m_fullNsec / NSEC_IN_SEC, stats.m_emptyWaits, (double)stats.m_emptyNsec / NSEC_IN_SEC);
+	fprintf(_file, "queue_occupancy");
+	for (i = 0; i < SAFE_QUEUE_OCCUPANCY_BUCKETS - 1; ++i)
+	{
+		fprintf(_file, " %lu-%lu%%=%lu", (unsigned long)i * 10, (unsigned long)(i + 1) * 10, stats.m_occupancy[i]);
+	}
+	fprintf(_file, " full=%lu\n", stats.m_occupancy[SAFE_QUEUE_OCCUPANCY_BUCKETS - 1]);
+}
@@ -6,12 +6,39 @@
 #ifndef __SAFE_QUEUE_H__
 #define __SAFE_QUEUE_H__
 
+#include <stdio.h> /*for FILE in SafeQueuePrintStats*/
+
 typedef struct SafeQueue SafeQueue;
 
+/* occupancy buckets: [0-10%), [10-20%) ... [90-100%), full */
+#define SAFE_QUEUE_OCCUPANCY_BUCKETS 11
+
+typedef struct
+{
+	size_t			m_capacity;
+	size_t			m_highWater;		/* most items ever in the queue */
+	unsigned long	m_pushes;
+	unsigned long	m_pops;
+	unsigned long	m_fullWaits;		/* pushes that had to wait for room */
+	unsigned long	m_fullNsec;			/* total time producers waited */
+	unsigned long	m_emptyWaits;		/* pops that had to wait for an item */
+	unsigned long	m_emptyNsec;
+	unsigned long	m_occupancy[SAFE_QUEUE_OCCUPANCY_BUCKETS];	/* items in the queue, sampled on every push and pop */
+} SafeQueueStats;
+
 SafeQueue* SafeQueueInit (size_t _size);
 ADTErr SafeQueuePush	 (SafeQueue* _queue, void* _data);
 ADTErr SafeQueuePop		 (SafeQueue* _queue, void** _dataPtr);
 int SafeQueueIsEmpty	 (SafeQueue* _queue);
 ADTErr SafeQueueDestroy  (SafeQueue* _queue);
 
+/* Changes the capacity while producers and consumers run.
+   Shrinking below the current number of items takes effect as they are popped. */
+ADTErr SafeQueueResize (SafeQueue* _queue, size_t _size);
+
+/* totals since SafeQueueInit */
+ADTErr SafeQueueGetStats (SafeQueue* _queue, SafeQueueStats* _stats);
+/* writes the stats as "queue_..." lines - fits MetricsAddSource */
+void SafeQueuePrintStats (FILE* _file, void* _queue);
+
 #endif /* __SAFE_QUEUE_H__ */
@@ -6,13 +6,13 @@
 #include <stdio.h>
 #include <pthread.h>  
 #include <semaphore.h> /* posix semaphores */
+#include <errno.h>
 #include "ADTErr.h"
 #include "semaphore.h" /* my own header of semaphores */
 
 #define SHRD_BTWN_THRDS 0
 #define SHRD_BTWN_PRCSS 1
 
-/* TODO: maybe separate SemCreate to 2 functions: 1 for processes, 1 for threads */
 ADTErr SemCreate(sem_t* _semAddr, unsigned int _initVal)
 {
 	if (-1 == sem_init(_semAddr, SHRD_BTWN_THRDS, _initVal))
@@ -24,6 +24,17 @@ ADTErr SemCreate(sem_t* _semAddr, unsigned int _initVal)
 	return ERR_OK;
 }
 
+ADTErr SemCreateShared(sem_t* _semAddr, unsigned int _initVal)
+{
+	if (-1 == sem_init(_semAddr, SHRD_BTWN_PRCSS, _initVal))
+	{
+		perror("Error in sem_init");
+		return ERR_SEM_INIT_FAILED;
+	}
+
+	return ERR_OK;
+}
+
 ADTErr SemUp(sem_t* _semAddr)
 {
 	if (-1 == sem_post(_semAddr))
@@ -44,6 +55,20 @@ ADTErr SemDown(sem_t* _semAddr)
 	return ERR_OK;
 }
 
+ADTErr SemTryDown(sem_t* _semAddr)
+{
+	if (-1 == sem_trywait(_semAddr))
+	{
+		if (EAGAIN == errno)
+		{
+			return ERR_UNDERFLOW;
+		}
+		perror("Error in sem_trywait");
+		return ERR_SEM_DOWN_FAILED;
+	}
+	return ERR_OK;
+}
+
 ADTErr SemDestroy(sem_t* _semAddr)
 {
 	if (-1 == sem_destroy(_semAddr))
@@ -8,8 +8,12 @@
 #include <semaphore.h>
 
 ADTErr SemCreate  (sem_t* _semAddr, unsigned int _initVal);
+/* _semAddr must be in memory shared between the processes (shm_open + mmap) */
+ADTErr SemCreateShared (sem_t* _semAddr, unsigned int _initVal);
 ADTErr SemUp	  (sem_t* _semAddr);
 ADTErr SemDown	  (sem_t* _semAddr);
+/* ERR_UNDERFLOW instead of waiting when the semaphore is 0 */
+ADTErr SemTryDown (sem_t* _semAddr);
 ADTErr SemDestroy (sem_t* _semAddr);
 
 #endif /* __SEMAPHORE_H_ */
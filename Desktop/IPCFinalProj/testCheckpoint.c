@@ -0,0 +1,291 @@
+/**************************************************************************************************
+	Creation date: 			19.10.26
+	Last modified date: 	19.10.26
+
+	Description: Unit test module for checkpoints - one run feeds CDRs of a file and writes
+				 its checkpoint, the next loads it back: the same records, and the file
+				 offset the readers would go on from. A cut checkpoint is refused.
+**************************************************************************************************/
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+#include "ADTErr.h"
+#include "GData.h"
+#include "safeQueue.h"
+#include "cdr.h"
+#include "parser.h"
+#include "Subscriber.h"
+#include "Operator.h"
+#include "SubscriberDB.h"
+#include "OperatorDB.h"
+#include "DataManager.h"
+#include "Checkpoint.h"
+
+#define PRINT_STATEMENT(_statement) PrintStatement(_statement, __func__)
+
+#define CHECKPOINT_FILE "CheckpointTest.ckp"
+#define CDR_FILE "CheckpointTest.cdr"
+#define QUEUE_SIZE 16
+#define LINE_SIZE 256
+#define KEY_SIZE 64
+#define MAX_SAVED 16
+#define N_LINES 4
+
+static const char* s_lines[N_LINES] =
+{
+	"425000000001219|972500001219|350000000001219|Rami|MTC|24/09/2015|05:36:34|236|0.00|0.00|972500001761|Orange",
+	"425000000000126|972500000126|350000000000126|Cellcom|MOC|28/10/2015|03:02:58|10|0.00|0.00|972500001832|HotMob",
+	"425000000001219|972500001219|350000000001219|Rami|GPRS|24/09/2015|06:00:00|600|12.50|3.25|972500001761|Orange",
+	"425000000000777|972500000777|350000000000777|Orange|SMS_MT|01/10/2015|10:10:10|0|0.00|0.00|972500000126|Cellcom"
+};
+
+/*what a run left in the databases*/
+typedef struct
+{
+	char			m_imsi[MAX_SAVED][KEY_SIZE];
+	SubscriberUsage	m_subscribers[MAX_SAVED];
+	size_t			m_nSubscribers;
+	char			m_name[MAX_SAVED][KEY_SIZE];
+	OperatorUsage	m_operators[MAX_SAVED];
+	size_t			m_nOperators;
+} Saved;
+
+static void PrintStatement(int _statement, const char* _funcName)
+{
+	printf("%s ", _funcName);
+	printf(_statement ? "PASS!\n" : "FAIL!\n");
+}
+
+static void RemoveFiles(void)
+{
+	unlink(CHECKPOINT_FILE);
+	unlink(CHECKPOINT_FILE ".tmp");
+	unlink(CHECKPOINT_FILE ".wal");
+}
+
+static int SaveSubscriber(const Subscriber* _sub, void* _saved)
+{
+	Saved* saved = _saved;
+
+	if (MAX_SAVED == saved->m_nSubscribers)
+	{
+		return 0;
+	}
+	SubscriberGetIMSI(_sub, saved->m_imsi[saved->m_nSubscribers]);
+	SubscriberGetUsage(_sub, &saved->m_subscribers[saved->m_nSubscribers]);
+	++saved->m_nSubscribers;
+	return 1;
+}
+
+static int SaveOperator(const Operator* _opr, void* _saved)
+{
+	Saved* saved = _saved;
+
+	if (MAX_SAVED == saved->m_nOperators)
+	{
+		return 0;
+	}
+	OperatorGetName(_opr, saved->m_name[saved->m_nOperators]);
+	OperatorGetUsage(_opr, &saved->m_operators[saved->m_nOperators]);
+	++saved->m_nOperators;
+	return 1;
+}
+
+static void Save(const DBManagerParams* _params, Saved* _saved)
+{
+	SubscriberDB* subDB;
+	OperatorDB* oprDB;
+
+	memset(_saved, 0, sizeof(Saved));
+	GetSubscriberDB(_params, &subDB);
+	GetOperatorDB(_params, &oprDB);
+	SubscriberDBForEach(subDB, SaveSubscriber, _saved);
+	OperatorDBForEach(oprDB, SaveOperator, _saved);
+}
+
+/*every record of _saved is in the databases with the same totals*/
+static int IsLoaded(const DBManagerParams* _params, const Saved* _saved)
+{
+	SubscriberDB* subDB;
+	OperatorDB* oprDB;
+	Subscriber* sub;
+	Operator* opr;
+	SubscriberUsage subUsage;
+	OperatorUsage oprUsage;
+	size_t i;
+
+	GetSubscriberDB(_params, &subDB);
+	GetOperatorDB(_params, &oprDB);
+	for (i = 0; i < _saved->m_nSubscribers; ++i)
+	{
+		if (ERR_OK != SubscriberDBGet(subDB, _saved->m_imsi[i], &sub) || ERR_OK != SubscriberGetUsage(sub, &subUsage)
+			|| 0 != memcmp(&subUsage, &_saved->m_subscribers[i], sizeof(subUsage)))
+		{
+			return false;
+		}
+	}
+	for (i = 0; i < _saved->m_nOperators; ++i)
+	{
+		if (ERR_OK != OperatorDBGet(oprDB, _saved->m_name[i], &opr) || ERR_OK != OperatorGetUsage(opr, &oprUsage)
+			|| 0 != memcmp(&oprUsage, &_saved->m_operators[i], sizeof(oprUsage)))
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+/*after CheckpointInit, as RunBilling does it - the feeder waits on _queue*/
+static DBManagerParams* Begin(SafeQueue** _queue)
+{
+	DBManagerParams* params;
+	ADTErr err;
+
+	if (ERR_OK != DBManagerSetAppliedHook(CheckpointApplied, NULL) || NULL == (*_queue = SafeQueueInit(QUEUE_SIZE)))
+	{
+		return NULL;
+	}
+	if (NULL == (params = InitDBManager(*_queue, &err)))
+	{
+		SafeQueueDestroy(*_queue);
+		return NULL;
+	}
+	if (ERR_OK != CheckpointStart(params, 0))
+	{
+		SendEndMsg2Queue(*_queue);
+		EndDBManager(params);
+		DestroyDBManager(params);
+		SafeQueueDestroy(*_queue);
+		return NULL;
+	}
+	return params;
+}
+
+static void StopFeeder(DBManagerParams* _params, SafeQueue* _queue)
+{
+	SendEndMsg2Queue(_queue);
+	EndDBManager(_params);
+}
+
+/*the checkpoint is taken here*/
+static ADTErr End(DBManagerParams* _params, SafeQueue* _queue)
+{
+	ADTErr err = EndCheckpoint();
+
+	DestroyDBManager(_params);
+	SafeQueueDestroy(_queue);
+	return err;
+}
+
+/*the lines of CDR_FILE, each stamped with the offset after it - the last offset*/
+static unsigned long Feed(SafeQueue* _queue)
+{
+	char line[LINE_SIZE];
+	unsigned long offset;
+	unsigned int fileId;
+	CDR* cdr;
+	size_t i;
+
+	offset = CheckpointFileStart(CDR_FILE, &fileId, NULL);
+	for (i = 0; i < N_LINES; ++i)
+	{
+		strcpy(line, s_lines[i]);
+		offset += strlen(s_lines[i]) + 1;
+		if (ERR_OK == Parse(line, &cdr))
+		{
+			CDRSetSource(cdr, fileId, offset);
+			SendCDR2Queue(cdr, _queue);
+		}
+	}
+	return offset;
+}
+
+/*a checkpoint of the N_LINES CDRs, _saved - the databases it holds. 0 - failed*/
+static unsigned long WriteCheckpoint(Saved* _saved)
+{
+	DBManagerParams* params;
+	SafeQueue* queue;
+	unsigned long offset;
+
+	RemoveFiles();
+	if (ERR_OK != CheckpointInit(CHECKPOINT_FILE, 0) || NULL == (params = Begin(&queue)))
+	{
+		return 0;
+	}
+	offset = Feed(queue);
+	StopFeeder(params, queue);
+	Save(params, _saved);
+	return ERR_OK == End(params, queue) ? offset : 0;
+}
+
+static void InitNULL(void)
+{
+	PRINT_STATEMENT( ERR_ILLEGAL_INPUT == CheckpointInit(NULL, 0) );
+}
+
+static void StartNotInitialized(void)
+{
+	PRINT_STATEMENT( ERR_NOT_INITIALIZED == CheckpointStart(NULL, 0) );
+}
+
+static void WriteThenRead(void)
+{
+	DBManagerParams* params;
+	SafeQueue* queue;
+	Saved written;
+	Saved loaded;
+	unsigned long offset = WriteCheckpoint(&written);
+	unsigned long start = 0;
+	unsigned int fileId = 0;
+	int isLoaded = false;
+
+	if (0 != offset && ERR_OK == CheckpointInit(CHECKPOINT_FILE, 0))
+	{
+		/*the readers ask before the databases are loaded*/
+		start = CheckpointFileStart(CDR_FILE, &fileId, NULL);
+		if (NULL != (params = Begin(&queue)))
+		{
+			StopFeeder(params, queue);
+			Save(params, &loaded);
+			isLoaded = written.m_nSubscribers == loaded.m_nSubscribers && written.m_nOperators == loaded.m_nOperators
+				&& IsLoaded(params, &written);
+			isLoaded = (ERR_OK == End(params, queue)) && isLoaded;
+		}
+	}
+	PRINT_STATEMENT( 0 != offset && offset == start && 0 != fileId && isLoaded && 0 != written.m_nSubscribers );
+	RemoveFiles();
+}
+
+/*a short file - cut in its trailer, or in its records*/
+static void TruncatedRejected(void)
+{
+	Saved written;
+	struct stat fileStat;
+	int isRejected = false;
+
+	if (0 != WriteCheckpoint(&written) && 0 == stat(CHECKPOINT_FILE, &fileStat)
+		&& 0 == truncate(CHECKPOINT_FILE, fileStat.st_size - 1))
+	{
+		isRejected = ERR_ILLEGAL_INPUT == CheckpointInit(CHECKPOINT_FILE, 0);
+		isRejected = isRejected && 0 == truncate(CHECKPOINT_FILE, fileStat.st_size / 2)
+			&& ERR_ILLEGAL_INPUT == CheckpointInit(CHECKPOINT_FILE, 0);
+	}
+	PRINT_STATEMENT( isRejected );
+	RemoveFiles();
+}
+
+int main()
+{
+	InitNULL();
+	StartNotInitialized();
+	WriteThenRead();
+	TruncatedRejected();
+
+	return 0;
+}
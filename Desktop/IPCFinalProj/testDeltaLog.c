@@ -0,0 +1,289 @@
+/**************************************************************************************************
+	Creation date: 			19.10.26
+	Last modified date: 	19.10.26
+
+	Description: Unit test module for the delta log - batches written by one run and replayed
+				 by the next, a batch with a bad checksum or cut short at the end of the log,
+				 and batches of an older checkpoint.
+				 Every batch adds its own call duration, so the replayed sum tells which
+				 batches came back.
+**************************************************************************************************/
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+#include "ADTErr.h"
+#include "GData.h"
+#include "safeQueue.h"
+#include "cdr.h"
+#include "Subscriber.h"
+#include "Operator.h"
+#include "SubscriberDB.h"
+#include "OperatorDB.h"
+#include "DataManager.h"
+#include "DeltaLog.h"
+
+#define PRINT_STATEMENT(_statement) PrintStatement(_statement, __func__)
+
+#define LOG_FILE "DeltaLogTest.wal"
+/*longer than a test - the batch is written by EndDeltaLog*/
+#define WRITE_PERIOD_MS 60000
+#define PATH_SIZE 64
+#define MAX_FILES 4
+#define IMSI_1 "425000000000001"
+#define IMSI_2 "425000000000002"
+
+/*what a replay gave, the usages summed*/
+typedef struct
+{
+	char			m_paths[MAX_FILES][PATH_SIZE];
+	unsigned long	m_offsets[MAX_FILES];
+	size_t			m_nFiles;
+	SubscriberUsage	m_subscribers;
+	size_t			m_nSubscribers;
+	OperatorUsage	m_operators;
+	size_t			m_nOperators;
+} Replayed;
+
+static void PrintStatement(int _statement, const char* _funcName)
+{
+	printf("%s ", _funcName);
+	printf(_statement ? "PASS!\n" : "FAIL!\n");
+}
+
+static void Applied(DBApplied* _applied, const char* _imsi, const char* _operator, unsigned int _duration, double _data,
+					unsigned int _fileId, unsigned long _offset)
+{
+	memset(_applied, 0, sizeof(DBApplied));
+	_applied->m_imsi = _imsi;
+	_applied->m_operator = _operator;
+	_applied->m_subscriberUsage.m_incomingDuration = _duration;
+	_applied->m_subscriberUsage.m_outgoingDuration = _duration + 1;
+	_applied->m_subscriberUsage.m_messagesReceived = 2;
+	_applied->m_subscriberUsage.m_messagesSent = 3;
+	_applied->m_subscriberUsage.m_downloaded = _data;
+	_applied->m_subscriberUsage.m_uploaded = _data / 2;
+	_applied->m_operatorUsage.m_incomingDuration = _duration;
+	_applied->m_operatorUsage.m_outgoingDuration = _duration + 1;
+	_applied->m_operatorUsage.m_messagesReceived = 2;
+	_applied->m_operatorUsage.m_messagesSent = 3;
+	_applied->m_operatorUsage.m_downloaded = _data;
+	_applied->m_operatorUsage.m_uploaded = _data / 2;
+	_applied->m_fileId = _fileId;
+	_applied->m_offset = _offset;
+}
+
+/*one run adding _applied to a batch that goes on from checkpoint _sequence*/
+static int WriteBatch(unsigned long _sequence, const DBApplied* _applied, const char** _paths, size_t _nApplied)
+{
+	pthread_rwlock_t DBLock = PTHREAD_RWLOCK_INITIALIZER;
+	size_t i;
+
+	if (ERR_OK != DeltaLogInit(LOG_FILE, _sequence, WRITE_PERIOD_MS, NULL, NULL))
+	{
+		return false;
+	}
+	if (ERR_OK != DeltaLogStart(&DBLock))
+	{
+		EndDeltaLog();
+		return false;
+	}
+	pthread_rwlock_wrlock(&DBLock);
+	for (i = 0; i < _nApplied; ++i)
+	{
+		DeltaLogAdd(&_applied[i], _paths[i]);
+	}
+	pthread_rwlock_unlock(&DBLock);
+	return ERR_OK == EndDeltaLog();
+}
+
+/*a batch of one CDR of IMSI_1 that lasted _duration*/
+static int WriteDuration(unsigned long _sequence, unsigned int _duration)
+{
+	DBApplied applied;
+	const char* path = "a.cdr";
+
+	Applied(&applied, IMSI_1, "Cellcom", _duration, 0.0, 1, _duration);
+	return WriteBatch(_sequence, &applied, &path, 1);
+}
+
+static void OnFile(const char* _path, unsigned long _offset, void* _replayed)
+{
+	Replayed* replayed = _replayed;
+	size_t i;
+
+	for (i = 0; i < replayed->m_nFiles && 0 != strcmp(replayed->m_paths[i], _path); ++i);
+	if (i == MAX_FILES)
+	{
+		return;
+	}
+	if (i == replayed->m_nFiles)
+	{
+		strncpy(replayed->m_paths[i], _path, PATH_SIZE - 1);
+		++replayed->m_nFiles;
+	}
+	replayed->m_offsets[i] = _offset;
+}
+
+static ADTErr OnSubscriber(const char* _imsi, const SubscriberUsage* _usage, void* _replayed)
+{
+	Replayed* replayed = _replayed;
+
+	replayed->m_subscribers.m_incomingDuration += _usage->m_incomingDuration;
+	replayed->m_subscribers.m_outgoingDuration += _usage->m_outgoingDuration;
+	replayed->m_subscribers.m_messagesReceived += _usage->m_messagesReceived;
+	replayed->m_subscribers.m_messagesSent += _usage->m_messagesSent;
+	replayed->m_subscribers.m_downloaded += _usage->m_downloaded;
+	replayed->m_subscribers.m_uploaded += _usage->m_uploaded;
+	++replayed->m_nSubscribers;
+	return ERR_OK;
+}
+
+static ADTErr OnOperator(const char* _operator, const OperatorUsage* _usage, void* _replayed)
+{
+	Replayed* replayed = _replayed;
+
+	replayed->m_operators.m_incomingDuration += _usage->m_incomingDuration;
+	replayed->m_operators.m_outgoingDuration += _usage->m_outgoingDuration;
+	replayed->m_operators.m_messagesReceived += _usage->m_messagesReceived;
+	replayed->m_operators.m_messagesSent += _usage->m_messagesSent;
+	replayed->m_operators.m_downloaded += _usage->m_downloaded;
+	replayed->m_operators.m_uploaded += _usage->m_uploaded;
+	++replayed->m_nOperators;
+	return ERR_OK;
+}
+
+/*the batches of checkpoint _sequence, as a restart reads them*/
+static int Replay(unsigned long _sequence, Replayed* _replayed)
+{
+	memset(_replayed, 0, sizeof(Replayed));
+	if (ERR_OK != DeltaLogInit(LOG_FILE, _sequence, 0, OnFile, _replayed))
+	{
+		return false;
+	}
+	if (ERR_OK != DeltaLogReplay(OnSubscriber, OnOperator, _replayed))
+	{
+		EndDeltaLog();
+		return false;
+	}
+	return ERR_OK == EndDeltaLog();
+}
+
+static long LogSize(void)
+{
+	struct stat fileStat;
+
+	return 0 == stat(LOG_FILE, &fileStat) ? (long)fileStat.st_size : -1;
+}
+
+static void InitNULL(void)
+{
+	PRINT_STATEMENT( ERR_NOT_INITIALIZED == DeltaLogInit(NULL, 0, 0, NULL, NULL) );
+}
+
+static void ReplayNotInitialized(void)
+{
+	PRINT_STATEMENT( ERR_NOT_INITIALIZED == DeltaLogReplay(OnSubscriber, OnOperator, NULL) );
+}
+
+/*the CDRs of a batch are summed per IMSI and per operator, a file keeps its last offset*/
+static void EncodeDecode(void)
+{
+	DBApplied applied[3];
+	const char* paths[3] = {"a.cdr", "a.cdr", "b.cdr"};
+	Replayed replayed;
+	int isReplayed;
+
+	unlink(LOG_FILE);
+	Applied(&applied[0], IMSI_1, "Cellcom", 10, 1.5, 1, 100);
+	Applied(&applied[1], IMSI_1, "Cellcom", 20, 2.25, 1, 200);
+	Applied(&applied[2], IMSI_2, "Orange", 30, 4.0, 2, 50);
+	isReplayed = WriteBatch(1, applied, paths, 3) && Replay(1, &replayed);
+	PRINT_STATEMENT( isReplayed && 2 == replayed.m_nFiles
+		&& 0 == strcmp("a.cdr", replayed.m_paths[0]) && 200 == replayed.m_offsets[0]
+		&& 0 == strcmp("b.cdr", replayed.m_paths[1]) && 50 == replayed.m_offsets[1]
+		&& 2 == replayed.m_nSubscribers && 60 == replayed.m_subscribers.m_incomingDuration
+		&& 63 == replayed.m_subscribers.m_outgoingDuration && 6 == replayed.m_subscribers.m_messagesReceived
+		&& 9 == replayed.m_subscribers.m_messagesSent && 7.75 == replayed.m_subscribers.m_downloaded
+		&& 3.875 == replayed.m_subscribers.m_uploaded
+		&& 2 == replayed.m_nOperators && 60 == replayed.m_operators.m_incomingDuration
+		&& 7.75 == replayed.m_operators.m_downloaded );
+	unlink(LOG_FILE);
+}
+
+/*the second batch has a byte changed - it is not replayed, and cut*/
+static void ChecksumMismatch(void)
+{
+	Replayed replayed;
+	unsigned char byte;
+	long firstSize = -1;
+	long size;
+	int isReplayed = false;
+	int fileDesc;
+
+	unlink(LOG_FILE);
+	if (WriteDuration(1, 10) && 0 < (firstSize = LogSize()) && WriteDuration(1, 200) && 0 < (size = LogSize())
+		&& 0 <= (fileDesc = open(LOG_FILE, O_RDWR)))
+	{
+		pread(fileDesc, &byte, 1, size - 1);
+		byte ^= 0xff;
+		pwrite(fileDesc, &byte, 1, size - 1);
+		close(fileDesc);
+		isReplayed = Replay(1, &replayed);
+	}
+	PRINT_STATEMENT( isReplayed && 10 == replayed.m_subscribers.m_incomingDuration && firstSize == LogSize() );
+	unlink(LOG_FILE);
+}
+
+/*a crash in the middle of the second batch - it is cut, and the next one goes in its place*/
+static void TornBatchCut(void)
+{
+	Replayed torn;
+	Replayed replayed;
+	long firstSize = -1;
+	long cutSize = 0;
+	int isReplayed = false;
+
+	unlink(LOG_FILE);
+	if (WriteDuration(1, 10) && 0 < (firstSize = LogSize()) && WriteDuration(1, 200)
+		&& 0 == truncate(LOG_FILE, LogSize() - 3) && Replay(1, &torn))
+	{
+		cutSize = LogSize();
+		isReplayed = WriteDuration(1, 3000) && Replay(1, &replayed);
+	}
+	PRINT_STATEMENT( isReplayed && 10 == torn.m_subscribers.m_incomingDuration && firstSize == cutSize
+		&& 3010 == replayed.m_subscribers.m_incomingDuration && 2 == replayed.m_nSubscribers );
+	unlink(LOG_FILE);
+}
+
+/*batches left from before checkpoint 2 are in it - only the later ones replay*/
+static void OlderSequenceSkipped(void)
+{
+	Replayed older;
+	Replayed newer;
+	int isReplayed;
+
+	unlink(LOG_FILE);
+	isReplayed = WriteDuration(1, 10) && WriteDuration(2, 200) && Replay(2, &newer) && Replay(1, &older);
+	PRINT_STATEMENT( isReplayed && 200 == newer.m_subscribers.m_incomingDuration && 1 == newer.m_nSubscribers
+		&& 1 == newer.m_nFiles && 200 == newer.m_offsets[0] && 10 == older.m_subscribers.m_incomingDuration );
+	unlink(LOG_FILE);
+}
+
+int main()
+{
+	InitNULL();
+	ReplayNotInitialized();
+	EncodeDecode();
+	ChecksumMismatch();
+	TornBatchCut();
+	OlderSequenceSkipped();
+
+	return 0;
+}
@@ -0,0 +1,202 @@
+/**************************************************************************************************
+	Creation date: 			19.10.26
+	Last modified date: 	19.10.26
+
+	Description: Unit test module for the binary log format - the format spec scanner,
+				 and logs of the same statements written binary, rendered by logdecode,
+				 against the text logger.
+**************************************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "ADTErr.h"
+#include "logger.h"
+#include "logger_pub.h"
+#include "logformat.h"
+
+#define PRINT_STATEMENT(_statement) PrintStatement(_statement, __func__)
+
+#define TEXT_LOG "LogFormatTest.txt"
+#define BINARY_LOG "LogFormatTest.bin"
+#define PATH_SIZE 512
+#define TEXT_SIZE 65536
+
+static char s_decoder[PATH_SIZE];
+
+static void PrintStatement(int _statement, const char* _funcName)
+{
+	printf("%s ", _funcName);
+	printf(_statement ? "PASS!\n" : "FAIL!\n");
+}
+
+/* 1 - _format is one conversion, written back as _expected, of the _nExpected types */
+static int SpecIs(const char* _format, const char* _expected, const unsigned char* _types, int _nExpected)
+{
+	char spec[LOG_MAX_SPEC];
+	unsigned char types[3];
+	int nTypes = -2;
+	const char* next = LogFormatNextSpec(_format, spec, types, &nTypes);
+
+	return NULL != next && '\0' == *next && nTypes == _nExpected && 0 == strcmp(spec, _expected)
+		&& 0 == memcmp(types, _types, _nExpected);
+}
+
+static void SpecStars(void)
+{
+	unsigned char types[] = {LOG_ARG_INT, LOG_ARG_INT, LOG_ARG_STRING};
+
+	PRINT_STATEMENT( SpecIs("%*.*s", "%*.*s", types, 3) );
+}
+
+static void SpecLongLong(void)
+{
+	unsigned char types[] = {LOG_ARG_LLONG};
+
+	PRINT_STATEMENT( SpecIs("%lld", "%lld", types, 1) );
+}
+
+static void SpecUnsignedLong(void)
+{
+	unsigned char types[] = {LOG_ARG_LONG};
+
+	PRINT_STATEMENT( SpecIs("%lu", "%lu", types, 1) );
+}
+
+static void SpecPercent(void)
+{
+	unsigned char types[1] = {0};
+
+	PRINT_STATEMENT( SpecIs("%%", "%%", types, 0) );
+}
+
+static void SpecN(void)
+{
+	unsigned char types[LOG_MAX_ARGS];
+	int nTypes = 0;
+
+	LogFormatNextSpec("%n", NULL, types, &nTypes);
+	PRINT_STATEMENT( -1 == nTypes && -1 == LogFormatArgTypes("count %d%n", types, LOG_MAX_ARGS) );
+}
+
+static void SpecNone(void)
+{
+	unsigned char types[1];
+	int nTypes = 0;
+
+	PRINT_STATEMENT( NULL == LogFormatNextSpec("no conversions", NULL, types, &nTypes) );
+}
+
+static void ArgTypesInOrder(void)
+{
+	unsigned char types[LOG_MAX_ARGS];
+	unsigned char expected[] = {LOG_ARG_STRING, LOG_ARG_INT, LOG_ARG_INT, LOG_ARG_DOUBLE, LOG_ARG_LONG, LOG_ARG_POINTER};
+
+	PRINT_STATEMENT( 6 == LogFormatArgTypes("%s %% %*d %.2f %zu %p", types, LOG_MAX_ARGS) && 0 == memcmp(types, expected, 6) );
+}
+
+static void ArgTypesTooMany(void)
+{
+	unsigned char types[2];
+
+	PRINT_STATEMENT( -1 == LogFormatArgTypes("%d %d %d", types, 2) );
+}
+
+/* the same statements for both logs, so their sites match */
+static void LogSamples(void)
+{
+	LOG_ERROR_PRINT("int %d long %ld unsigned long %lu", -5, -123456789L, 42UL);
+	LOG_WARN_PRINT("stars [%*.*s]", 10, 3, "abcdef");
+	LOG_DEBUG_PRINT("long long %lld double %.3f %g 100%%", -9000000000LL, 3.14159, 2.5e10);
+	LOG_DEBUG_PRINT("string %s char %c hex %x", "hello world", 'z', 255U);
+	LOG_DEBUG_PRINT("%s", "");
+}
+
+static int WriteLog(unsigned char _format, const char* _fileName)
+{
+	unlink(_fileName);
+	LogSetFormat(_format);
+	if (ERR_OK != LogCreate(LOG_ERROR | LOG_WARN | LOG_DEBUG, _fileName))
+	{
+		return false;
+	}
+	LogSamples();
+	LogDestroy();
+	LogSetFormat(LOG_FORMAT_TEXT);
+	return true;
+}
+
+/* the lines without their timestamps - the two logs were written at different times */
+static size_t ReadMessages(FILE* _file, char* _text)
+{
+	char line[TEXT_SIZE];
+	const char* message;
+	size_t used = 0;
+
+	while (NULL != fgets(line, sizeof(line), _file))
+	{
+		message = strstr(line, "] ");
+		message = (NULL != message) ? message + 2 : line;
+		used += snprintf(_text + used, TEXT_SIZE - used, "%s", message);
+	}
+	return used;
+}
+
+static void DecodeMatchesText(void)
+{
+	static char text[TEXT_SIZE];
+	static char decoded[TEXT_SIZE];
+	char command[PATH_SIZE + sizeof(BINARY_LOG) + 2];
+	size_t textSize = 0;
+	size_t decodedSize = 1;
+	FILE* file;
+
+	if (WriteLog(LOG_FORMAT_TEXT, TEXT_LOG) && WriteLog(LOG_FORMAT_BINARY, BINARY_LOG)
+		&& NULL != (file = fopen(TEXT_LOG, "r")))
+	{
+		textSize = ReadMessages(file, text);
+		fclose(file);
+		snprintf(command, sizeof(command), "%s %s", s_decoder, BINARY_LOG);
+		if (NULL != (file = popen(command, "r")))
+		{
+			decodedSize = ReadMessages(file, decoded);
+			pclose(file);
+		}
+	}
+	PRINT_STATEMENT( textSize > 0 && textSize == decodedSize && 0 == memcmp(text, decoded, textSize)
+		&& NULL != strstr(text, "stars [       abc]") );
+	unlink(TEXT_LOG);
+	unlink(BINARY_LOG);
+}
+
+/* logdecode is built next to this test */
+int main(int argc, char* argv[])
+{
+	const char* slash = strrchr(argv[0], '/');
+
+	if (NULL == slash)
+	{
+		snprintf(s_decoder, PATH_SIZE, "./logdecode");
+	}
+	else
+	{
+		snprintf(s_decoder, PATH_SIZE, "%.*s/logdecode", (int)(slash - argv[0]), argv[0]);
+	}
+
+	SpecStars();
+	SpecLongLong();
+	SpecUnsignedLong();
+	SpecPercent();
+	SpecN();
+	SpecNone();
+	ArgTypesInOrder();
+	ArgTypesTooMany();
+
+	DecodeMatchesText();
+
+	return 0;
+}
@@ -0,0 +1,319 @@
+/**************************************************************************************************
+	Creation date: 			19.10.26
+	Last modified date: 	19.10.26
+
+	Description: Unit test module for the logger.
+				 A full ring is made by logging to a fifo nobody reads yet - the flusher
+				 blocks in write and the ring fills behind it.
+**************************************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+#include "ADTErr.h"
+#include "logger.h"
+#include "logger_pub.h"
+
+#define PRINT_STATEMENT(_statement) PrintStatement(_statement, __func__)
+
+#define LOG_FILE "LoggerTest.log"
+#define FIFO_FILE "LoggerTest.fifo"
+#define N_THREADS 4
+#define PER_THREAD 5000
+/* far more than a ring, the fifo and a flusher batch hold */
+#define BURST 10000
+#define READ_CHUNK 65536
+#define WAIT_USEC 200000
+/* one a second, in bursts of RATE_BURST - a loop of LIMITED_BURST takes far less than a second */
+#define RATE_BURST 5
+#define LIMITED_BURST 100
+
+static void PrintStatement(int _statement, const char* _funcName)
+{
+	printf("%s ", _funcName);
+	printf(_statement ? "PASS!\n" : "FAIL!\n");
+}
+
+/* all of _fd up to its end, '\0' terminated */
+static char* ReadAll(int _fd)
+{
+	size_t size = 0;
+	size_t capacity = READ_CHUNK;
+	ssize_t nRead;
+	char* text = malloc(capacity + 1);
+	char* bigger;
+
+	while (NULL != text && 0 < (nRead = read(_fd, text + size, capacity - size)))
+	{
+		size += nRead;
+		if (size == capacity)
+		{
+			capacity *= 2;
+			if (NULL == (bigger = realloc(text, capacity + 1)))
+			{
+				free(text);
+				return NULL;
+			}
+			text = bigger;
+		}
+	}
+	if (NULL != text)
+	{
+		text[size] = '\0';
+	}
+	return text;
+}
+
+static char* ReadFile(const char* _fileName)
+{
+	char* text;
+	int fileDesc = open(_fileName, O_RDONLY);
+
+	if (fileDesc < 0)
+	{
+		return NULL;
+	}
+	text = ReadAll(fileDesc);
+	close(fileDesc);
+	return text;
+}
+
+/* lines holding _tag, and the sum of the "ring full, N messages dropped" reports */
+static size_t CountLines(const char* _text, const char* _tag, unsigned long* _dropped)
+{
+	const char* line;
+	const char* report;
+	unsigned long dropped;
+	size_t nLines = 0;
+
+	*_dropped = 0;
+	for (line = _text; '\0' != *line; line = strchr(line, '\n') + 1)
+	{
+		if (NULL == strchr(line, '\n'))
+		{
+			break;
+		}
+		report = strstr(line, "logger: ring full, ");
+		if (NULL != report && report < strchr(line, '\n') && 1 == sscanf(report, "logger: ring full, %lu", &dropped))
+		{
+			*_dropped += dropped;
+		}
+		else if (NULL != strstr(line, _tag) && strstr(line, _tag) < strchr(line, '\n'))
+		{
+			++nLines;
+		}
+	}
+	return nLines;
+}
+
+/* the flusher can not write to it until ReadAll - made before LogCreate, so its open does not block */
+static int OpenFifo(void)
+{
+	int fileDesc;
+
+	unlink(FIFO_FILE);
+	if (0 != mkfifo(FIFO_FILE, S_IRUSR | S_IWUSR))
+	{
+		return -1;
+	}
+	fileDesc = open(FIFO_FILE, O_RDONLY | O_NONBLOCK);
+	if (fileDesc >= 0)
+	{
+		fcntl(fileDesc, F_SETFL, 0);
+	}
+	return fileDesc;
+}
+
+static void* FifoReader(void* _fifo)
+{
+	return ReadAll(*(int*)_fifo);
+}
+
+/* LogDestroy waits for the flusher, which waits for the reader */
+static char* DestroyAndRead(int _fifo, pthread_t* _writer)
+{
+	pthread_t reader;
+	void* text = NULL;
+
+	if (0 == pthread_create(&reader, NULL, FifoReader, &_fifo))
+	{
+		if (NULL != _writer)
+		{
+			pthread_join(*_writer, NULL);
+		}
+		LogDestroy();
+		pthread_join(reader, &text);
+	}
+	close(_fifo);
+	unlink(FIFO_FILE);
+	return text;
+}
+
+static void* OrderedWriter(void* _thread)
+{
+	int thread = (int)(long)_thread;
+	int i;
+
+	for (i = 0; i < PER_THREAD; ++i)
+	{
+		LOG_ERROR_PRINT("ordered %d %d", thread, i);
+	}
+	return NULL;
+}
+
+static void* ErrorWriter(void* _isDone)
+{
+	int i;
+
+	for (i = 0; i < BURST; ++i)
+	{
+		LOG_ERROR_PRINT("waited %d", i);
+	}
+	__atomic_store_n((int*)_isDone, true, __ATOMIC_RELEASE);
+	return NULL;
+}
+
+static void CreateNULL(void)
+{
+	PRINT_STATEMENT( ERR_ILLEGAL_INPUT == LogCreate(LOG_ERROR, NULL) );
+}
+
+/* the writers exit before LogDestroy - their rings are drained and freed by the flusher */
+static void PerThreadOrder(void)
+{
+	pthread_t writers[N_THREADS];
+	int next[N_THREADS] = {0};
+	int isOrdered = true;
+	int thread;
+	int index;
+	const char* line;
+	char* text;
+	long i;
+
+	unlink(LOG_FILE);
+	LogCreate(LOG_ERROR, LOG_FILE);
+	for (i = 0; i < N_THREADS; ++i)
+	{
+		pthread_create(&writers[i], NULL, OrderedWriter, (void*)i);
+	}
+	for (i = 0; i < N_THREADS; ++i)
+	{
+		pthread_join(writers[i], NULL);
+	}
+	LogDestroy();
+
+	text = ReadFile(LOG_FILE);
+	for (line = text; NULL != line && NULL != (line = strstr(line, "ordered ")); ++line)
+	{
+		if (2 != sscanf(line, "ordered %d %d", &thread, &index) || thread < 0 || thread >= N_THREADS || index != next[thread]++)
+		{
+			isOrdered = false;
+		}
+	}
+	for (i = 0; i < N_THREADS; ++i)
+	{
+		isOrdered = isOrdered && (PER_THREAD == next[i]);
+	}
+	PRINT_STATEMENT( NULL != text && isOrdered );
+	free(text);
+	unlink(LOG_FILE);
+}
+
+static void DebugDroppedWhenFull(void)
+{
+	unsigned long dropped = 0;
+	size_t nLines = 0;
+	char* text;
+	int fifo = OpenFifo();
+	int i;
+
+	if (fifo >= 0 && ERR_OK == LogCreate(LOG_DEBUG, FIFO_FILE))
+	{
+		for (i = 0; i < BURST; ++i)
+		{
+			LOG_DEBUG_PRINT("dropped %d", i);
+		}
+		text = DestroyAndRead(fifo, NULL);
+		nLines = (NULL != text) ? CountLines(text, "dropped ", &dropped) : 0;
+		free(text);
+	}
+	PRINT_STATEMENT( dropped > 0 && BURST == nLines + dropped );
+}
+
+static void ErrorWaitsForRoom(void)
+{
+	pthread_t writer;
+	unsigned long dropped = 1;
+	size_t nLines = 0;
+	int isDoneEarly = true;
+	int isDone = false;
+	char* text;
+	int fifo = OpenFifo();
+
+	if (fifo >= 0 && ERR_OK == LogCreate(LOG_ERROR, FIFO_FILE))
+	{
+		pthread_create(&writer, NULL, ErrorWriter, &isDone);
+		usleep(WAIT_USEC);
+		/* nothing was read yet - it must still be waiting for room */
+		isDoneEarly = __atomic_load_n(&isDone, __ATOMIC_ACQUIRE);
+		text = DestroyAndRead(fifo, &writer);
+		nLines = (NULL != text) ? CountLines(text, "waited ", &dropped) : 0;
+		free(text);
+	}
+	PRINT_STATEMENT( !isDoneEarly && BURST == nLines && 0 == dropped );
+}
+
+/* a burst from one statement: RATE_BURST lines get through, the rest are summed up in one line */
+static void RateLimitedBurst(void)
+{
+	const char* line;
+	unsigned long suppressed = 0;
+	unsigned long count;
+	size_t nLines = 0;
+	char* text;
+	int i;
+
+	unlink(LOG_FILE);
+	LogSetRateLimit(1, RATE_BURST);
+	LogCreate(LOG_WARN, LOG_FILE);
+	for (i = 0; i < LIMITED_BURST; ++i)
+	{
+		LOG_WARN_PRINT("limited %d", i);
+	}
+	LogDestroy();
+	LogSetRateLimit(0, 0);
+
+	text = ReadFile(LOG_FILE);
+	for (line = text; NULL != line && NULL != (line = strstr(line, ":WARNING ")); ++line)
+	{
+		if (0 == strncmp(line, ":WARNING limited ", strlen(":WARNING limited ")))
+		{
+			++nLines;
+		}
+		else if (1 == sscanf(line, ":WARNING %lu similar messages suppressed", &count))
+		{
+			suppressed += count;
+		}
+	}
+	PRINT_STATEMENT( NULL != text && RATE_BURST == nLines && LIMITED_BURST - RATE_BURST == suppressed );
+	free(text);
+	unlink(LOG_FILE);
+}
+
+int main()
+{
+	CreateNULL();
+	PerThreadOrder();
+	DebugDroppedWhenFull();
+	ErrorWaitsForRoom();
+	RateLimitedBurst();
+
+	return 0;
+}
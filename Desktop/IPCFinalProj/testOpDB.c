@@ -15,7 +15,7 @@
 #include "Operator.h"
 #include "OperatorDB.h"
 
-#define PRINT_STATEMENT(_statement) PrintStatement(_statement, __FUNCTION__)
+#define PRINT_STATEMENT(_statement) PrintStatement(_statement, __func__)
 
 static void PrintStatement(int _statement, const char* _funcName)
 {
@@ -15,7 +15,7 @@
 #include "cdr.h"
 #include "Operator.h"
 
-#define PRINT_STATEMENT(_statement) PrintStatement(_statement, __FUNCTION__)
+#define PRINT_STATEMENT(_statement) PrintStatement(_statement, __func__)
 
 static void PrintStatement(int _statement, const char* _funcName)
 {
@@ -81,6 +81,34 @@ static void CreateOK(void)
 	OperatorDestroy(operator);
 }
 
+static void CreateFromUsageNULL(void)
+{
+	ADTErr err;
+	Operator* op = OperatorCreateFromUsage(NULL, NULL, &err);
+	PRINT_STATEMENT( (ERR_NOT_INITIALIZED == err) && (NULL == op) );
+}
+
+static void CreateFromUsageOK(void)
+{
+	ADTErr err;
+	CDR* cdr1 = CDR1Init();
+	Operator* created = NULL;
+	Operator* restored = NULL;
+	OperatorUsage usage;
+	OperatorUsage restoredUsage;
+	char buf[20];
+	
+	created = OperatorCreate(cdr1, NULL);
+	OperatorGetUsage(created, &usage);
+	restored = OperatorCreateFromUsage("Cellcom", &usage, &err);
+	OperatorGetUsage(restored, &restoredUsage);
+	OperatorGetName(restored, buf);
+	PRINT_STATEMENT( (ERR_OK == err) && ( ! strcmp(buf, "Cellcom") ) && ( OperatorIsSame(created, restored) )
+		&& (300 == restoredUsage.m_outgoingDuration) && (0 == restoredUsage.m_messagesSent) );
+	OperatorDestroy(created);
+	OperatorDestroy(restored);
+}
+
 static void UpdateNULL(void)
 {
 	PRINT_STATEMENT( ERR_NOT_INITIALIZED == OperatorUpdate(NULL, NULL) );	
@@ -169,6 +197,8 @@ int main()
 {
 	CreateNULL();
 	CreateOK();
+	CreateFromUsageNULL();
+	CreateFromUsageOK();
 	
 	UpdateNULL();
 	UpdateOK();
@@ -22,7 +22,7 @@
 #include "DataManager.h"
 #include "Billing.h"
 
-#define PRINT_STATEMENT(_statement) PrintStatement(_statement, __FUNCTION__)
+#define PRINT_STATEMENT(_statement) PrintStatement(_statement, __func__)
 
 static void PrintStatement(int _statement, const char* _funcName)
 {
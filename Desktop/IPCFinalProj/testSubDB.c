@@ -9,13 +9,15 @@
 #include <stdio.h>
 #include <stddef.h>
 #include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
 
 #include "ADTErr.h"
 #include "cdr.h"
 #include "Subscriber.h"
 #include "SubscriberDB.h"
 
-#define PRINT_STATEMENT(_statement) PrintStatement(_statement, __FUNCTION__)
+#define PRINT_STATEMENT(_statement) PrintStatement(_statement, __func__)
 
 static void PrintStatement(int _statement, const char* _funcName)
 {
@@ -180,6 +182,95 @@ static void PrintToFileOK(void)
 	CDRDestroy(cdr3);
 }
 
+static void PrintShardsOK(void)
+{
+	CDR* cdr1 = CDR1Init();
+	CDR* cdr3 = CDR3Init();
+	Subscriber* sub1 = SubscriberCreate(cdr1, NULL);
+	Subscriber* sub3 = SubscriberCreate(cdr3, NULL);
+	SubscriberDB* sdb = SubscriberDBCreate(NULL);
+	size_t nPrinted1 = 0;
+	size_t nPrinted2 = 0;
+	ADTErr err1;
+	ADTErr err2;
+	
+	SubscriberDBInsert(sdb, sub1);
+	SubscriberDBInsert(sdb, sub3);
+	err1 = SubscriberDBPrintShardToFile(sdb, "TestShard0.txt", 0, 2, 0, &nPrinted1);
+	err2 = SubscriberDBPrintShardToFile(sdb, "TestShard1.txt", 1, 2, 0, &nPrinted2);
+	PRINT_STATEMENT( (ERR_OK == err1) && (ERR_OK == err2) && (2 == nPrinted1 + nPrinted2) );
+	SubscriberDBDestroy(sdb);
+	CDRDestroy(cdr1);
+	CDRDestroy(cdr3);
+}
+
+static void PrintShardIllegalInput(void)
+{
+	SubscriberDB* sdb = SubscriberDBCreate(NULL);
+	
+	PRINT_STATEMENT( ERR_ILLEGAL_INPUT == SubscriberDBPrintShardToFile(sdb, "TestShard.txt", 2, 2, 0, NULL) );
+	SubscriberDBDestroy(sdb);
+}
+
+static void PrintDeltaOK(void)
+{
+	CDR* cdr1 = CDR1Init();
+	CDR* cdr3 = CDR3Init();
+	Subscriber* sub1 = SubscriberCreate(cdr1, NULL);
+	Subscriber* sub3 = SubscriberCreate(cdr3, NULL);
+	SubscriberDB* sdb = SubscriberDBCreate(NULL);
+	unsigned long exported;
+	size_t nPrinted = 0;
+	ADTErr err;
+	
+	SubscriberDBInsert(sdb, sub1);
+	exported = SubscriberDBCloseGeneration(sdb);
+	SubscriberDBInsert(sdb, sub3);
+	err = SubscriberDBPrintShardToFile(sdb, "TestDelta.txt", 0, 1, exported, &nPrinted);
+	PRINT_STATEMENT( (ERR_OK == err) && (1 == nPrinted) );
+	SubscriberDBDestroy(sdb);
+	CDRDestroy(cdr1);
+	CDRDestroy(cdr3);
+}
+
+static void TopNOK(void)
+{
+	CDR* cdr1 = CDR1Init();
+	CDR* cdr3 = CDR3Init();
+	Subscriber* sub1 = SubscriberCreate(cdr1, NULL);
+	Subscriber* sub3 = SubscriberCreate(cdr3, NULL);
+	SubscriberDB* sdb = SubscriberDBCreate(NULL);
+	SubscriberRank outgoing[1];
+	SubscriberRank data[1];
+	SubscriberRank sms[1];
+	SubscriberRank* tops[NUM_OF_TOP_KINDS];
+	size_t nRanked = 0;
+	ADTErr err;
+	
+	tops[TOP_OUTGOING_DURATION] = outgoing;
+	tops[TOP_DATA_VOLUME] = data;
+	tops[TOP_MESSAGES_SENT] = sms;
+	SubscriberDBInsert(sdb, sub1);
+	SubscriberDBInsert(sdb, sub3);
+	err = SubscriberDBTopN(sdb, 0, 1, 1, tops, &nRanked);
+	PRINT_STATEMENT( (ERR_OK == err) && (1 == nRanked)
+					&& !strcmp("111111111", outgoing[0].m_imsi) && (300 == outgoing[0].m_value)
+					&& !strcmp("111111112", data[0].m_imsi) );
+	SubscriberDBDestroy(sdb);
+	CDRDestroy(cdr1);
+	CDRDestroy(cdr3);
+}
+
+static void TopNIllegalInput(void)
+{
+	SubscriberRank ranks[1];
+	SubscriberRank* tops[NUM_OF_TOP_KINDS] = {ranks, ranks, NULL};
+	SubscriberDB* sdb = SubscriberDBCreate(NULL);
+	
+	PRINT_STATEMENT( ERR_ILLEGAL_INPUT == SubscriberDBTopN(sdb, 0, 1, 1, tops, NULL) );
+	SubscriberDBDestroy(sdb);
+}
+
 static void GetNotInitialized(void)
 {
 	PRINT_STATEMENT( ERR_NOT_INITIALIZED == SubscriberDBGet(NULL, NULL, NULL) );
@@ -244,6 +335,54 @@ static void RemoveNotFound(void)
 	CDRDestroy(cdr1);
 }
 
+static void OpenReopenOK(void)
+{
+	ADTErr err;
+	CDR* cdr1 = CDR1Init();
+	CDR* cdr3 = CDR3Init();
+	SubscriberDB* sdb = NULL;
+	Subscriber* get = NULL;
+	SubscriberUsage usage;
+	
+	unlink("TestSubDB.subscribers");
+	sdb = SubscriberDBOpen("TestSubDB.subscribers", NULL);
+	SubscriberDBInsert(sdb, SubscriberCreate(cdr1, NULL));
+	SubscriberDBInsert(sdb, SubscriberCreate(cdr3, NULL));
+	SubscriberDBDestroy(sdb);
+	
+	sdb = SubscriberDBOpen("TestSubDB.subscribers", &err);
+	SubscriberDBGet(sdb, "111111111", &get);
+	SubscriberGetUsage(get, &usage);
+	PRINT_STATEMENT( (ERR_OK == err) && (300 == usage.m_outgoingDuration)
+					&& (ERR_OK == SubscriberDBGet(sdb, "111111112", &get)) );
+	SubscriberDBDestroy(sdb);
+	CDRDestroy(cdr1);
+	CDRDestroy(cdr3);
+}
+
+static void OpenRemoveOK(void)
+{
+	ADTErr err;
+	CDR* cdr1 = CDR1Init();
+	CDR* cdr3 = CDR3Init();
+	SubscriberDB* sdb = NULL;
+	Subscriber* get = NULL;
+	Subscriber* removed = NULL;
+	
+	unlink("TestSubDB.subscribers");
+	sdb = SubscriberDBOpen("TestSubDB.subscribers", NULL);
+	SubscriberDBInsert(sdb, SubscriberCreate(cdr1, NULL));
+	SubscriberDBInsert(sdb, SubscriberCreate(cdr3, NULL));
+	err = SubscriberDBRemove(sdb, "111111111", &removed);
+	PRINT_STATEMENT( (ERR_OK == err) && (ERR_NOT_FOUND == SubscriberDBGet(sdb, "111111111", &get))
+					&& (ERR_OK == SubscriberDBGet(sdb, "111111112", &get)) );
+	SubscriberDestroy(removed);
+	SubscriberDBDestroy(sdb);
+	unlink("TestSubDB.subscribers");
+	CDRDestroy(cdr1);
+	CDRDestroy(cdr3);
+}
+
 int main()
 {
 	CreateOK();
@@ -264,6 +403,15 @@ int main()
 	RemoveNotFound();
 	
 	PrintToFileOK();
+	PrintShardsOK();
+	PrintShardIllegalInput();
+	PrintDeltaOK();
+	
+	TopNOK();
+	TopNIllegalInput();
+	
+	OpenReopenOK();
+	OpenRemoveOK();
 	
 	return 0;
 }
@@ -15,7 +15,7 @@
 #include "cdr.h"
 #include "Subscriber.h"
 
-#define PRINT_STATEMENT(_statement) PrintStatement(_statement, __FUNCTION__)
+#define PRINT_STATEMENT(_statement) PrintStatement(_statement, __func__)
 
 static void PrintStatement(int _statement, const char* _funcName)
 {
@@ -81,6 +81,34 @@ static void CreateOK(void)
 	SubscriberDestroy(subscriber);
 }
 
+static void CreateFromUsageNULL(void)
+{
+	ADTErr err;
+	Subscriber* sub = SubscriberCreateFromUsage(NULL, NULL, &err);
+	PRINT_STATEMENT( (ERR_NOT_INITIALIZED == err) && (NULL == sub) );
+}
+
+static void CreateFromUsageOK(void)
+{
+	ADTErr err;
+	CDR* cdr1 = CDR1Init();
+	Subscriber* created = NULL;
+	Subscriber* restored = NULL;
+	SubscriberUsage usage;
+	SubscriberUsage restoredUsage;
+	char buf[20];
+	
+	created = SubscriberCreate(cdr1, NULL);
+	SubscriberGetUsage(created, &usage);
+	restored = SubscriberCreateFromUsage("111111111", &usage, &err);
+	SubscriberGetUsage(restored, &restoredUsage);
+	SubscriberGetIMSI(restored, buf);
+	PRINT_STATEMENT( (ERR_OK == err) && ( ! strcmp(buf, "111111111") ) && ( SubscriberIsSame(created, restored) )
+		&& (300 == restoredUsage.m_outgoingDuration) && (0 == restoredUsage.m_messagesSent) );
+	SubscriberDestroy(created);
+	SubscriberDestroy(restored);
+}
+
 static void UpdateNULL(void)
 {
 	PRINT_STATEMENT( ERR_NOT_INITIALIZED == SubscriberUpdate(NULL, NULL) );	
@@ -169,6 +197,8 @@ int main()
 {
 	CreateNULL();
 	CreateOK();
+	CreateFromUsageNULL();
+	CreateFromUsageOK();
 	
 	UpdateNULL();
 	UpdateOK();